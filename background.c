@@ -1,40 +1,181 @@
+#include <stdlib.h>
+
 #include "tinywl.h"
 
 #include "v128-logo.h"
 #include "background.h"
+#include "blit.h"
 #include "log.h"
+#include "startup.h"
+
+/*
+ * The background, a grey fill with the logo on top, only changes when an
+ * output's mode, transform or place in the layout does. It is composed once
+ * per output into an output-sized buffer and uploaded as a single opaque
+ * texture. Each frame then only draws that texture into the damaged parts
+ * of the background that no opaque view covers.
+ */
+struct background {
+  struct wlr_texture *texture;
+  uint32_t *pixels;
+  int width, height;
+  bool keep_pixels;
+  bool dirty;
+};
+
+static struct tinywl_server *background_server = NULL;
+
+static void background_compose(struct tinywl_output *output, uint32_t *pixels,
+                               int width, int height, int stride) {
+  const uint32_t grey = 0xff4c4c4c;
+  uint32_t row[v128_logo.width];
+
+  for (int y = 0; y < height; y++) {
+    for (int x = 0; x < width; x++) {
+      pixels[(size_t)y * stride + x] = grey;
+    }
+  }
+
+  /* The logo is centered on the output, offset by the output's place in the
+   * layout like background_render has always done. The layout is in logical
+   * coordinates and the buffer in pixels. */
+  double layout_x = 0, layout_y = 0;
+  wlr_output_layout_output_coords(background_server->output_layout, output->wlr_output,
+                                  &layout_x, &layout_y);
+  float scale = output->wlr_output->scale;
+  int left = (width / 2) - (v128_logo.width / 2) + (int)(layout_x * scale);
+  int top = (height / 2) - (v128_logo.height / 2) + (int)(layout_y * scale);
+
+  for (int y = 0; y < (int)v128_logo.height; y++) {
+    int dy = top + y;
+    if (dy < 0 || dy >= height) {
+      continue;
+    }
+
+    int x0 = left < 0 ? -left : 0;
+    int x1 = left + (int)v128_logo.width > width ? width - left : (int)v128_logo.width;
+    if (x1 <= x0) {
+      continue;
+    }
+
+    /* The logo is stored as RGBA bytes. */
+    const unsigned char *src = v128_logo.pixel_data + ((size_t)y * v128_logo.width + x0) * 4;
+    for (int x = 0; x < x1 - x0; x++, src += 4) {
+      row[x] = ((uint32_t)src[3] << 24) | ((uint32_t)src[0] << 16) |
+        ((uint32_t)src[1] << 8) | src[2];
+    }
+
+    blit_row_over(pixels + (size_t)dy * stride + left + x0, row, x1 - x0);
+  }
+}
+
+static void background_build(struct tinywl_output *output) {
+  struct background *bg = output->background;
+  int width, height;
+
+  STARTUP_PHASE_BEGIN(build_ctx, "background build");
+
+  /* transform_matrix, which background_render draws with, is in buffer
+   * pixels rather than the scaled logical size. */
+  wlr_output_transformed_resolution(output->wlr_output, &width, &height);
+
+  if (bg->pixels == NULL || bg->width != width || bg->height != height) {
+    free(bg->pixels);
+    bg->pixels = malloc((size_t)width * height * 4);
+    bg->width = width;
+    bg->height = height;
+  }
+
+  background_compose(output, bg->pixels, width, height, width);
+
+  if (bg->texture != NULL) {
+    wlr_texture_destroy(bg->texture);
+  }
+  bg->texture = wlr_texture_from_pixels(background_server->renderer,
+                                        WL_SHM_FORMAT_XRGB8888,
+                                        width * 4, width, height, bg->pixels);
 
-static struct wlr_texture *background = NULL;
+  /* Only the CPU renderer needs the pixels once they're on the GPU. */
+  if (!bg->keep_pixels) {
+    free(bg->pixels);
+    bg->pixels = NULL;
+  }
 
-void background_render(struct tinywl_server *server, struct wlr_output *output, struct wlr_renderer *renderer) {
-  int mode_width = output->width;
-  int mode_height = output->height;
+  bg->dirty = false;
 
-  float color[4] = {0.3, 0.3, 0.3, 1.0};
-  wlr_renderer_clear(renderer, color);
+  STARTUP_PHASE_END(build_ctx);
+}
 
-  /* Render the background logo first */
-  struct wlr_box box = {
-    .x = (mode_width / 2) - (v128_logo.width / 2),
-    .y = (mode_height / 2) - (v128_logo.height / 2),
-    .width = v128_logo.width, .height = v128_logo.height
-  };
+static struct background *background_get(struct tinywl_output *output) {
+  if (output->background == NULL) {
+    output->background = calloc(1, sizeof(struct background));
+    output->background->dirty = true;
+  }
 
-  double local_x = box.x;
-  double local_y = box.y;
-  wlr_output_layout_output_coords(server->output_layout, output, &local_x, &local_y);
-  wlr_render_texture(renderer, background, output->transform_matrix, local_x, local_y, 1.0f);
+  return output->background;
 }
 
-void background_init(struct wlr_renderer *renderer) {
-  background = wlr_texture_from_pixels(renderer,
-                                       WL_SHM_FORMAT_ABGR8888,
-                                       v128_logo.width * 4,
-                                       v128_logo.width,
-                                       v128_logo.height,
-                                       v128_logo.pixel_data);
+static void background_layout_change(struct wl_listener *listener, void *data) {
+  /* Raised when an output is added, moved, or changes mode, transform or
+   * scale. Positions are baked into the background, so rebuild them all. */
+  struct tinywl_output *output;
+  wl_list_for_each(output, &background_server->outputs, link) {
+    if (output->background != NULL) {
+      output->background->dirty = true;
+    }
+
+    wlr_output_damage_add_whole(output->damage);
+  }
+}
+
+void background_render(struct tinywl_output *output, struct wlr_renderer *renderer) {
+  struct background *bg = background_get(output);
+
+  if (bg->dirty || bg->texture == NULL) {
+    background_build(output);
+  }
+
+  if (bg->texture == NULL) {
+    return;
+  }
+
+  wlr_render_texture(renderer, bg->texture, output->wlr_output->transform_matrix, 0, 0, 1.0f);
+}
+
+const uint32_t *background_pixels(struct tinywl_output *output) {
+  struct background *bg = background_get(output);
+
+  bg->keep_pixels = true;
+  if (bg->dirty || bg->pixels == NULL) {
+    background_build(output);
+  }
+
+  return bg->pixels;
+}
+
+void background_init(struct tinywl_server *server) {
+  background_server = server;
+
+  server->output_layout_change.notify = background_layout_change;
+  wl_signal_add(&server->output_layout->events.change, &server->output_layout_change);
 }
 
 void background_deinit() {
-  wlr_texture_destroy(background);
+  struct tinywl_output *output;
+
+  wl_list_remove(&background_server->output_layout_change.link);
+
+  wl_list_for_each(output, &background_server->outputs, link) {
+    struct background *bg = output->background;
+    if (bg == NULL) {
+      continue;
+    }
+
+    if (bg->texture != NULL) {
+      wlr_texture_destroy(bg->texture);
+    }
+    free(bg->pixels);
+    free(bg);
+    output->background = NULL;
+  }
 }
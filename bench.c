@@ -0,0 +1,105 @@
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "tracy/TracyC.h"
+
+#include "bench.h"
+#include "log.h"
+
+/*
+ * Frame composition timing. Every frame's composition time is plotted to
+ * Tracy per renderer. With V128_BENCH_FRAMES=<n> (usually together with
+ * WLR_BACKENDS=headless) the shell also collects them, logs a summary for
+ * each renderer that composed frames after <n> frames, and exits.
+ */
+static const char *renderer_names[BENCH_RENDERER_COUNT] = {
+  [BENCH_RENDERER_GL] = "gl",
+  [BENCH_RENDERER_CPU] = "cpu",
+};
+
+static struct wl_display *bench_display = NULL;
+static int bench_frames = 0;
+static int frame_count = 0;
+static uint64_t *samples[BENCH_RENDERER_COUNT];
+static int sample_count[BENCH_RENDERER_COUNT];
+
+void bench_init(struct wl_display *display) {
+  const char *frames = getenv("V128_BENCH_FRAMES");
+  if (frames == NULL) {
+    return;
+  }
+
+  bench_frames = atoi(frames);
+  if (bench_frames <= 0) {
+    LOGF("bench_init: Ignoring invalid V128_BENCH_FRAMES [%s]", frames);
+    bench_frames = 0;
+    return;
+  }
+
+  bench_display = display;
+  for (int i = 0; i < BENCH_RENDERER_COUNT; i++) {
+    samples[i] = calloc(bench_frames, sizeof(uint64_t));
+  }
+
+  LOGF("bench_init: Benchmarking %d frames", bench_frames);
+}
+
+void bench_frame(enum bench_renderer renderer, uint64_t compose_ns) {
+  if (renderer == BENCH_RENDERER_GL) {
+    TracyCPlot("compose gl (ms)", compose_ns / 1e6);
+  } else {
+    TracyCPlot("compose cpu (ms)", compose_ns / 1e6);
+  }
+
+  if (bench_frames == 0 || frame_count >= bench_frames) {
+    return;
+  }
+
+  samples[renderer][sample_count[renderer]++] = compose_ns;
+
+  if (++frame_count == bench_frames) {
+    bench_report();
+    wl_display_terminate(bench_display);
+  }
+}
+
+bool bench_running(void) {
+  return bench_frames != 0 && frame_count < bench_frames;
+}
+
+static int compare_u64(const void *a, const void *b) {
+  uint64_t x = *(const uint64_t *)a;
+  uint64_t y = *(const uint64_t *)b;
+  return (x > y) - (x < y);
+}
+
+void bench_report(void) {
+  if (bench_frames == 0) {
+    return;
+  }
+
+  LOGF("Benchmark report (%d frames):", frame_count);
+
+  for (int i = 0; i < BENCH_RENDERER_COUNT; i++) {
+    int count = sample_count[i];
+    if (count == 0) {
+      LOGF("  %-4s no frames", renderer_names[i]);
+      continue;
+    }
+
+    uint64_t total = 0;
+    qsort(samples[i], count, sizeof(uint64_t), compare_u64);
+    for (int j = 0; j < count; j++) {
+      total += samples[i][j];
+    }
+
+    LOGF("  %-4s %6d frames  mean %8.3f ms  p50 %8.3f ms  p99 %8.3f ms  max %8.3f ms",
+         renderer_names[i], count,
+         total / 1e6 / count,
+         samples[i][count / 2] / 1e6,
+         samples[i][(count * 99) / 100] / 1e6,
+         samples[i][count - 1] / 1e6);
+  }
+}
@@ -0,0 +1,20 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <wayland-server-core.h>
+
+enum bench_renderer {
+  BENCH_RENDERER_GL,
+  BENCH_RENDERER_CPU,
+  BENCH_RENDERER_COUNT,
+};
+
+extern void bench_init(struct wl_display *display);
+extern void bench_frame(enum bench_renderer renderer, uint64_t compose_ns);
+extern void bench_report(void);
+extern bool bench_running(void);
+
+#endif // BENCH_H
@@ -0,0 +1,203 @@
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define BLIT_X86 1
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define BLIT_NEON 1
+#endif
+
+#include "blit.h"
+
+blit_row_func_t blit_row_over = blit_row_over_scalar;
+static const char *kernel_name = "scalar";
+
+/* x / 255, rounded, for x in [0, 255 * 255]. */
+static inline uint32_t div255(uint32_t x) {
+  x += 128;
+  return (x + (x >> 8)) >> 8;
+}
+
+/* Clients don't always premultiply their colors, so channels are clamped
+ * like the SIMD kernels' saturating adds rather than carried into the next
+ * one. */
+static inline uint32_t add_sat255(uint32_t x, uint32_t y) {
+  uint32_t sum = x + y;
+  return sum > 255 ? 255 : sum;
+}
+
+void blit_row_opaque(uint32_t *dst, const uint32_t *src, int count) {
+  /* XRGB buffers can carry garbage in the X byte, so this can't always be a
+   * plain memcpy. The loop is simple enough for the compiler to vectorize. */
+  for (int i = 0; i < count; i++) {
+    dst[i] = src[i] | 0xff000000u;
+  }
+}
+
+static inline uint32_t over_pixel(uint32_t d, uint32_t s) {
+  uint32_t sa = s >> 24;
+
+  if (sa == 0xff) {
+    return s;
+  } else if (sa == 0) {
+    return d;
+  }
+
+  uint32_t inv = 255 - sa;
+  uint32_t a = add_sat255((s >> 24),         div255((d >> 24) * inv));
+  uint32_t r = add_sat255((s >> 16) & 0xff, div255(((d >> 16) & 0xff) * inv));
+  uint32_t g = add_sat255((s >> 8) & 0xff,  div255(((d >> 8) & 0xff) * inv));
+  uint32_t b = add_sat255(s & 0xff,         div255((d & 0xff) * inv));
+
+  return (a << 24) | (r << 16) | (g << 8) | b;
+}
+
+void blit_row_over_scalar(uint32_t *dst, const uint32_t *src, int count) {
+  for (int i = 0; i < count; i++) {
+    dst[i] = over_pixel(dst[i], src[i]);
+  }
+}
+
+#ifdef BLIT_X86
+
+/* Expects 16-bit lanes of dst * (255 - alpha) and returns them / 255. */
+static inline __m128i div255_epu16_sse2(__m128i x) {
+  x = _mm_add_epi16(x, _mm_set1_epi16(128));
+  return _mm_srli_epi16(_mm_add_epi16(x, _mm_srli_epi16(x, 8)), 8);
+}
+
+static inline __m128i over_unpacked_sse2(__m128i d, __m128i s) {
+  /* Broadcast each pixel's alpha across its four 16-bit lanes. */
+  __m128i a = _mm_shufflehi_epi16(_mm_shufflelo_epi16(s, 0xff), 0xff);
+  __m128i inv = _mm_xor_si128(a, _mm_set1_epi16(0xff));
+  return div255_epu16_sse2(_mm_mullo_epi16(d, inv));
+}
+
+static void blit_row_over_sse2(uint32_t *dst, const uint32_t *src, int count) {
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i alpha_mask = _mm_set1_epi32(0xff000000);
+  int i = 0;
+
+  for (; i + 4 <= count; i += 4) {
+    __m128i s = _mm_loadu_si128((const __m128i *)(src + i));
+    __m128i sa = _mm_and_si128(s, alpha_mask);
+
+    /* Skip the arithmetic for runs that are fully opaque or transparent,
+     * which is most of any window. */
+    if (_mm_movemask_epi8(_mm_cmpeq_epi32(sa, alpha_mask)) == 0xffff) {
+      _mm_storeu_si128((__m128i *)(dst + i), s);
+      continue;
+    }
+    if (_mm_movemask_epi8(_mm_cmpeq_epi32(sa, zero)) == 0xffff) {
+      continue;
+    }
+
+    __m128i d = _mm_loadu_si128((const __m128i *)(dst + i));
+    __m128i lo = over_unpacked_sse2(_mm_unpacklo_epi8(d, zero), _mm_unpacklo_epi8(s, zero));
+    __m128i hi = over_unpacked_sse2(_mm_unpackhi_epi8(d, zero), _mm_unpackhi_epi8(s, zero));
+    __m128i r = _mm_adds_epu8(s, _mm_packus_epi16(lo, hi));
+    _mm_storeu_si128((__m128i *)(dst + i), r);
+  }
+
+  blit_row_over_scalar(dst + i, src + i, count - i);
+}
+
+__attribute__((target("avx2")))
+static inline __m256i over_unpacked_avx2(__m256i d, __m256i s) {
+  __m256i a = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(s, 0xff), 0xff);
+  __m256i inv = _mm256_xor_si256(a, _mm256_set1_epi16(0xff));
+  __m256i x = _mm256_add_epi16(_mm256_mullo_epi16(d, inv), _mm256_set1_epi16(128));
+  return _mm256_srli_epi16(_mm256_add_epi16(x, _mm256_srli_epi16(x, 8)), 8);
+}
+
+__attribute__((target("avx2")))
+static void blit_row_over_avx2(uint32_t *dst, const uint32_t *src, int count) {
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i alpha_mask = _mm256_set1_epi32(0xff000000);
+  int i = 0;
+
+  for (; i + 8 <= count; i += 8) {
+    __m256i s = _mm256_loadu_si256((const __m256i *)(src + i));
+    __m256i sa = _mm256_and_si256(s, alpha_mask);
+
+    if (_mm256_movemask_epi8(_mm256_cmpeq_epi32(sa, alpha_mask)) == -1) {
+      _mm256_storeu_si256((__m256i *)(dst + i), s);
+      continue;
+    }
+    if (_mm256_movemask_epi8(_mm256_cmpeq_epi32(sa, zero)) == -1) {
+      continue;
+    }
+
+    /* unpack/pack work within 128-bit lanes, so the pixel order survives
+     * the round trip. */
+    __m256i d = _mm256_loadu_si256((const __m256i *)(dst + i));
+    __m256i lo = over_unpacked_avx2(_mm256_unpacklo_epi8(d, zero), _mm256_unpacklo_epi8(s, zero));
+    __m256i hi = over_unpacked_avx2(_mm256_unpackhi_epi8(d, zero), _mm256_unpackhi_epi8(s, zero));
+    __m256i r = _mm256_adds_epu8(s, _mm256_packus_epi16(lo, hi));
+    _mm256_storeu_si256((__m256i *)(dst + i), r);
+  }
+
+  blit_row_over_sse2(dst + i, src + i, count - i);
+}
+
+#endif // BLIT_X86
+
+#ifdef BLIT_NEON
+
+static inline uint8x8_t div255_neon(uint16x8_t x) {
+  return vraddhn_u16(x, vrshrq_n_u16(x, 8));
+}
+
+static void blit_row_over_neon(uint32_t *dst, const uint32_t *src, int count) {
+  int i = 0;
+
+  for (; i + 8 <= count; i += 8) {
+    /* De-interleaves into b, g, r, a planes on little endian. */
+    uint8x8x4_t s = vld4_u8((const uint8_t *)(src + i));
+    uint64_t alpha = vget_lane_u64(vreinterpret_u64_u8(s.val[3]), 0);
+
+    if (alpha == UINT64_MAX) {
+      vst4_u8((uint8_t *)(dst + i), s);
+      continue;
+    }
+    if (alpha == 0) {
+      continue;
+    }
+
+    uint8x8x4_t d = vld4_u8((const uint8_t *)(dst + i));
+    uint8x8_t inv = vmvn_u8(s.val[3]);
+
+    for (int c = 0; c < 4; c++) {
+      d.val[c] = vqadd_u8(s.val[c], div255_neon(vmull_u8(d.val[c], inv)));
+    }
+
+    vst4_u8((uint8_t *)(dst + i), d);
+  }
+
+  blit_row_over_scalar(dst + i, src + i, count - i);
+}
+
+#endif // BLIT_NEON
+
+void blit_init(void) {
+#ifdef BLIT_X86
+  __builtin_cpu_init();
+
+  if (__builtin_cpu_supports("avx2")) {
+    blit_row_over = blit_row_over_avx2;
+    kernel_name = "avx2";
+  } else if (__builtin_cpu_supports("sse2")) {
+    blit_row_over = blit_row_over_sse2;
+    kernel_name = "sse2";
+  }
+#elif defined(BLIT_NEON)
+  blit_row_over = blit_row_over_neon;
+  kernel_name = "neon";
+#endif
+}
+
+const char *blit_kernel_name(void) {
+  return kernel_name;
+}
@@ -0,0 +1,22 @@
+#ifndef BLIT_H
+#define BLIT_H
+
+#include <stdint.h>
+
+/* Row kernels for the CPU renderer. All pixels are premultiplied 32-bit
+ * ARGB in native byte order, i.e. wl_shm's ARGB8888/XRGB8888. */
+typedef void (*blit_row_func_t)(uint32_t *dst, const uint32_t *src, int count);
+
+extern void blit_init(void);
+extern const char *blit_kernel_name(void);
+
+/* Copies opaque pixels, forcing alpha to 0xff. */
+extern void blit_row_opaque(uint32_t *dst, const uint32_t *src, int count);
+
+/* Composites src over dst (Porter-Duff OVER). Set by blit_init to the
+ * fastest kernel the CPU supports. */
+extern blit_row_func_t blit_row_over;
+
+extern void blit_row_over_scalar(uint32_t *dst, const uint32_t *src, int count);
+
+#endif // BLIT_H
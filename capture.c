@@ -0,0 +1,27 @@
+#include "tinywl.h"
+
+#include "capture.h"
+#include "log.h"
+
+/*
+ * Frame capture for recorders is handled by the wlroots protocol
+ * implementations:
+ *
+ * - export-dmabuf hands the buffer we just committed to the client as a
+ *   dmabuf, so there's no copy at all.
+ * - screencopy copies into a client-provided shm (or dmabuf) buffer during
+ *   the output's precommit, optionally only once the output reports damage.
+ *   output_frame sets the frame damage on every commit, so damage-aware
+ *   clients only copy what actually changed.
+ *
+ * Both only hook into the commit path while a client has a frame pending,
+ * so nothing is spent on capture when nobody is recording.
+ */
+void capture_init(struct tinywl_server *server) {
+  server->screencopy = wlr_screencopy_manager_v1_create(server->wl_display);
+  server->export_dmabuf = wlr_export_dmabuf_manager_v1_create(server->wl_display);
+
+  if (server->screencopy == NULL || server->export_dmabuf == NULL) {
+    LOG("capture_init: Failed to create capture managers");
+  }
+}
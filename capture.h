@@ -0,0 +1,11 @@
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <wayland-server-core.h>
+#include <wlr/types/wlr_output.h>
+
+struct tinywl_server;
+
+void capture_init(struct tinywl_server *server);
+
+#endif // CAPTURE_H
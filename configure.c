@@ -0,0 +1,59 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "tracy/TracyC.h"
+
+#include "tinywl.h"
+
+#include "configure.h"
+#include "log.h"
+#include "startup.h"
+
+/*
+ * wlroots already coalesces set_size, set_fullscreen and set_activated into
+ * a single configure per surface, sent from an idle callback, and cancels it
+ * if the state goes back to what the client has. These wrappers only add
+ * measurement: the time from a configure being scheduled to the client
+ * acking it is plotted.
+ */
+static void configure_sent(struct tinywl_view *view, uint32_t serial) {
+  /* Calls coalesced into an already scheduled configure return its serial,
+   * so only a new one restarts the clock. */
+  if (serial != 0 && serial != view->configure.serial) {
+    view->configure.serial = serial;
+    view->configure.sent_ns = startup_now_ns();
+  }
+}
+
+void configure_set_size(struct tinywl_view *view, uint32_t width, uint32_t height) {
+  configure_sent(view, wlr_xdg_toplevel_set_size(view->xdg_surface, width, height));
+}
+
+void configure_set_fullscreen(struct tinywl_view *view, bool fullscreen) {
+  configure_sent(view, wlr_xdg_toplevel_set_fullscreen(view->xdg_surface, fullscreen));
+}
+
+void configure_set_activated(struct tinywl_view *view, bool activated) {
+  configure_sent(view, wlr_xdg_toplevel_set_activated(view->xdg_surface, activated));
+}
+
+static void view_ack_configure(struct wl_listener *listener, void *data) {
+  struct tinywl_view *view = wl_container_of(listener, view, ack_configure);
+  struct wlr_xdg_surface_configure *configure = data;
+
+  if (configure->serial != view->configure.serial || view->configure.sent_ns == 0) {
+    return;
+  }
+
+  TracyCPlot("configure ack (ms)", (startup_now_ns() - view->configure.sent_ns) / 1e6);
+  view->configure.sent_ns = 0;
+}
+
+void configure_view_init(struct tinywl_view *view) {
+  view->ack_configure.notify = view_ack_configure;
+  wl_signal_add(&view->xdg_surface->events.ack_configure, &view->ack_configure);
+}
+
+void configure_view_destroy(struct tinywl_view *view) {
+  wl_list_remove(&view->ack_configure.link);
+}
@@ -0,0 +1,15 @@
+#ifndef CONFIGURE_H
+#define CONFIGURE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+struct tinywl_view;
+
+extern void configure_view_init(struct tinywl_view *view);
+extern void configure_view_destroy(struct tinywl_view *view);
+extern void configure_set_size(struct tinywl_view *view, uint32_t width, uint32_t height);
+extern void configure_set_fullscreen(struct tinywl_view *view, bool fullscreen);
+extern void configure_set_activated(struct tinywl_view *view, bool activated);
+
+#endif // CONFIGURE_H
@@ -0,0 +1,480 @@
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "tracy/TracyC.h"
+
+#include "tinywl.h"
+
+#include "background.h"
+#include "blit.h"
+#include "cpu_render.h"
+#include "log.h"
+#include "realtime.h"
+
+/*
+ * CPU compositing for machines without a usable GPU, enabled with
+ * V128_RENDERER=cpu.
+ *
+ * Going through llvmpipe costs a textured, blended draw per surface. Instead
+ * we keep a CPU copy of every wl_shm surface (taken at commit time, damage
+ * only), compose the damaged parts of the output into a plain framebuffer
+ * with the SIMD kernels in blit.c, split across worker threads by rows, and
+ * hand the renderer a single opaque texture to put on screen.
+ *
+ * Anything we can't compose ourselves (GPU buffers, scaled or transformed
+ * surfaces and outputs) makes cpu_render_output return NULL, and the frame
+ * goes through the GL path instead.
+ */
+
+struct cpu_surface {
+  uint32_t *pixels;
+  int width, height;
+  bool opaque;
+};
+
+struct cpu_output {
+  uint32_t *pixels;
+  int width, height;
+  struct wlr_texture *texture;
+};
+
+struct cpu_layer {
+  const uint32_t *pixels;
+  int stride;
+  struct wlr_box box;
+  bool opaque;
+};
+
+struct cpu_frame {
+  struct cpu_output *fb;
+  struct cpu_layer *layers;
+  int nlayers;
+  pixman_box32_t *rects;
+  int nrects;
+};
+
+typedef void (*cpu_band_func_t)(void *data, int y0, int y1);
+
+static bool enabled = false;
+
+static pthread_t workers[CPU_RENDER_MAX_THREADS];
+static int nworkers = 0;
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t pool_start = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t pool_done = PTHREAD_COND_INITIALIZER;
+static unsigned pool_generation = 0;
+static int pool_pending = 0;
+static bool pool_exit = false;
+
+static cpu_band_func_t job_func = NULL;
+static void *job_data = NULL;
+static int job_height = 0;
+
+static struct cpu_layer *layers = NULL;
+static int layers_size = 0;
+
+static void run_band(int band, int nbands) {
+  int y0 = job_height * band / nbands;
+  int y1 = job_height * (band + 1) / nbands;
+
+  if (y1 > y0) {
+    job_func(job_data, y0, y1);
+  }
+}
+
+static void *worker_main(void *arg) {
+  int index = (int)(intptr_t)arg;
+  unsigned seen = 0;
+  char name[32];
+
+  snprintf(name, sizeof(name), "cpu render %d", index);
+  TracyCSetThreadName(name);
+
+  pthread_mutex_lock(&pool_lock);
+  for (;;) {
+    while (pool_generation == seen && !pool_exit) {
+      pthread_cond_wait(&pool_start, &pool_lock);
+    }
+
+    if (pool_exit) {
+      break;
+    }
+
+    seen = pool_generation;
+    pthread_mutex_unlock(&pool_lock);
+
+    /* The main thread takes band 0. */
+    run_band(index + 1, nworkers + 1);
+
+    pthread_mutex_lock(&pool_lock);
+    if (--pool_pending == 0) {
+      pthread_cond_signal(&pool_done);
+    }
+  }
+  pthread_mutex_unlock(&pool_lock);
+
+  return NULL;
+}
+
+static void cpu_render_parallel(cpu_band_func_t func, void *data, int height) {
+  job_func = func;
+  job_data = data;
+  job_height = height;
+
+  pthread_mutex_lock(&pool_lock);
+  pool_pending = nworkers;
+  pool_generation++;
+  pthread_cond_broadcast(&pool_start);
+  pthread_mutex_unlock(&pool_lock);
+
+  run_band(0, nworkers + 1);
+
+  pthread_mutex_lock(&pool_lock);
+  while (pool_pending > 0) {
+    pthread_cond_wait(&pool_done, &pool_lock);
+  }
+  pthread_mutex_unlock(&pool_lock);
+}
+
+bool cpu_render_enabled(void) {
+  return enabled;
+}
+
+void cpu_render_init(void) {
+  const char *renderer = getenv("V128_RENDERER");
+  if (renderer == NULL || strcmp(renderer, "cpu") != 0) {
+    return;
+  }
+
+  enabled = true;
+  blit_init();
+
+  long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  int threads = cpus > 0 ? (int)cpus : 1;
+  if (threads > CPU_RENDER_MAX_THREADS) {
+    threads = CPU_RENDER_MAX_THREADS;
+  }
+
+  for (int i = 0; i < threads - 1; i++) {
+    if (pthread_create(&workers[i], NULL, worker_main, (void *)(intptr_t)i) != 0) {
+      break;
+    }
+    nworkers++;
+  }
+
+  LOGF("cpu_render_init: CPU compositing with %s kernels on %d threads",
+       blit_kernel_name(), nworkers + 1);
+}
+
+void cpu_render_deinit(void) {
+  if (!enabled) {
+    return;
+  }
+
+  pthread_mutex_lock(&pool_lock);
+  pool_exit = true;
+  pthread_cond_broadcast(&pool_start);
+  pthread_mutex_unlock(&pool_lock);
+
+  for (int i = 0; i < nworkers; i++) {
+    pthread_join(workers[i], NULL);
+  }
+  nworkers = 0;
+
+  free(layers);
+  layers = NULL;
+  layers_size = 0;
+}
+
+void cpu_render_surface_destroy(struct tinywl_surface *surface) {
+  if (surface->cpu == NULL) {
+    return;
+  }
+
+  free(surface->cpu->pixels);
+  free(surface->cpu);
+  surface->cpu = NULL;
+}
+
+void cpu_render_surface_commit(struct tinywl_surface *surface) {
+  if (!enabled) {
+    return;
+  }
+
+  struct wlr_surface *wlr_surface = surface->wlr_surface;
+  if (wlr_surface->buffer == NULL) {
+    /* Unmapped */
+    cpu_render_surface_destroy(surface);
+    return;
+  }
+
+  if (wlr_surface->buffer->resource == NULL) {
+    /* The client already destroyed the wl_buffer, but nothing changed. */
+    return;
+  }
+
+  struct wl_shm_buffer *shm = wl_shm_buffer_get(wlr_surface->buffer->resource);
+  if (shm == NULL) {
+    /* A GPU buffer, which only the GL path can draw. */
+    cpu_render_surface_destroy(surface);
+    return;
+  }
+
+  uint32_t format = wl_shm_buffer_get_format(shm);
+  if (format != WL_SHM_FORMAT_ARGB8888 && format != WL_SHM_FORMAT_XRGB8888) {
+    cpu_render_surface_destroy(surface);
+    return;
+  }
+
+  TracyCZoneN(copy_ctx, "cpu_render_surface_commit", true);
+
+  int width = wl_shm_buffer_get_width(shm);
+  int height = wl_shm_buffer_get_height(shm);
+  int stride = wl_shm_buffer_get_stride(shm) / 4;
+
+  pixman_region32_t damage;
+  pixman_region32_init(&damage);
+
+  struct cpu_surface *cpu = surface->cpu;
+  if (cpu == NULL || cpu->width != width || cpu->height != height) {
+    cpu_render_surface_destroy(surface);
+
+    cpu = calloc(1, sizeof(struct cpu_surface));
+    cpu->pixels = malloc((size_t)width * height * 4);
+    cpu->width = width;
+    cpu->height = height;
+    surface->cpu = cpu;
+
+    pixman_region32_union_rect(&damage, &damage, 0, 0, width, height);
+  } else {
+    pixman_region32_intersect_rect(&damage, &wlr_surface->buffer_damage,
+                                   0, 0, width, height);
+  }
+
+  cpu->opaque = format == WL_SHM_FORMAT_XRGB8888;
+
+  /* The buffer is released back to the client once this commit has been
+   * handled, so this is the last chance to read it. */
+  wl_shm_buffer_begin_access(shm);
+  const uint32_t *data = wl_shm_buffer_get_data(shm);
+
+  int nrects;
+  pixman_box32_t *rects = pixman_region32_rectangles(&damage, &nrects);
+  for (int i = 0; i < nrects; i++) {
+    int w = rects[i].x2 - rects[i].x1;
+
+    for (int y = rects[i].y1; y < rects[i].y2; y++) {
+      uint32_t *dst = cpu->pixels + (size_t)y * width + rects[i].x1;
+      const uint32_t *src = data + (size_t)y * stride + rects[i].x1;
+
+      if (cpu->opaque) {
+        blit_row_opaque(dst, src, w);
+      } else {
+        memcpy(dst, src, w * 4);
+      }
+    }
+  }
+
+  wl_shm_buffer_end_access(shm);
+  pixman_region32_fini(&damage);
+
+  TracyCZoneEnd(copy_ctx);
+}
+
+static bool cpu_output_resize(struct cpu_output *fb, struct wlr_renderer *renderer,
+                              int width, int height) {
+  if (fb->width == width && fb->height == height && fb->texture != NULL) {
+    return false;
+  }
+
+  free(fb->pixels);
+  if (fb->texture != NULL) {
+    wlr_texture_destroy(fb->texture);
+  }
+
+  fb->width = width;
+  fb->height = height;
+  fb->pixels = calloc((size_t)width * height, 4);
+  realtime_lock_region(fb->pixels, (size_t)width * height * 4);
+  fb->texture = wlr_texture_from_pixels(renderer, WL_SHM_FORMAT_XRGB8888,
+                                        width * 4, width, height, fb->pixels);
+
+  return true;
+}
+
+static void add_layer(struct cpu_frame *frame, const uint32_t *pixels, int stride,
+                      int x, int y, int width, int height, bool opaque) {
+  if (frame->nlayers == layers_size) {
+    layers_size = layers_size ? layers_size * 2 : 16;
+    layers = realloc(layers, layers_size * sizeof(struct cpu_layer));
+  }
+
+  frame->layers = layers;
+  frame->layers[frame->nlayers++] = (struct cpu_layer){
+    .pixels = pixels,
+    .stride = stride,
+    .box = { .x = x, .y = y, .width = width, .height = height },
+    .opaque = opaque,
+  };
+}
+
+struct gather_data {
+  struct cpu_frame *frame;
+  struct wlr_output *output;
+  struct tinywl_view *view;
+  bool fallback;
+};
+
+static void gather_surface(struct wlr_surface *surface, int sx, int sy, void *data) {
+  struct gather_data *gather = data;
+
+  if (gather->fallback || !wlr_surface_has_buffer(surface)) {
+    return;
+  }
+
+  struct tinywl_surface *tsurface = surface->data;
+  if (tsurface == NULL || tsurface->cpu == NULL ||
+      surface->current.scale != 1 ||
+      surface->current.transform != WL_OUTPUT_TRANSFORM_NORMAL) {
+    gather->fallback = true;
+    return;
+  }
+
+  double ox = 0, oy = 0;
+  wlr_output_layout_output_coords(
+    gather->view->server->output_layout, gather->output, &ox, &oy);
+  ox += gather->view->x + sx, oy += gather->view->y + sy;
+
+  struct cpu_surface *cpu = tsurface->cpu;
+  add_layer(gather->frame, cpu->pixels, cpu->width, ox, oy,
+            cpu->width, cpu->height, cpu->opaque);
+}
+
+static void compose_band(void *data, int y0, int y1) {
+  struct cpu_frame *frame = data;
+  struct cpu_output *fb = frame->fb;
+
+  TracyCZoneN(band_ctx, "compose_band", true);
+
+  for (int r = 0; r < frame->nrects; r++) {
+    pixman_box32_t *rect = &frame->rects[r];
+    int ry0 = rect->y1 > y0 ? rect->y1 : y0;
+    int ry1 = rect->y2 < y1 ? rect->y2 : y1;
+
+    for (int l = 0; l < frame->nlayers; l++) {
+      struct cpu_layer *layer = &frame->layers[l];
+      int lx0 = layer->box.x > rect->x1 ? layer->box.x : rect->x1;
+      int lx1 = layer->box.x + layer->box.width < rect->x2 ?
+        layer->box.x + layer->box.width : rect->x2;
+      int ly0 = layer->box.y > ry0 ? layer->box.y : ry0;
+      int ly1 = layer->box.y + layer->box.height < ry1 ?
+        layer->box.y + layer->box.height : ry1;
+
+      if (lx1 <= lx0 || ly1 <= ly0) {
+        continue;
+      }
+
+      for (int y = ly0; y < ly1; y++) {
+        uint32_t *dst = fb->pixels + (size_t)y * fb->width + lx0;
+        const uint32_t *src = layer->pixels +
+          (size_t)(y - layer->box.y) * layer->stride + (lx0 - layer->box.x);
+
+        if (layer->opaque) {
+          memcpy(dst, src, (lx1 - lx0) * 4);
+        } else {
+          blit_row_over(dst, src, lx1 - lx0);
+        }
+      }
+    }
+  }
+
+  TracyCZoneEnd(band_ctx);
+}
+
+struct wlr_texture *cpu_render_output(struct tinywl_output *output,
+                                      pixman_region32_t *damage) {
+  struct wlr_output *wlr_output = output->wlr_output;
+
+  if (!enabled || wlr_output->scale != 1.0f ||
+      wlr_output->transform != WL_OUTPUT_TRANSFORM_NORMAL) {
+    return NULL;
+  }
+
+  TracyCZoneN(cpu_render_ctx, "cpu_render_output", true);
+
+  if (output->cpu == NULL) {
+    output->cpu = calloc(1, sizeof(struct cpu_output));
+  }
+
+  struct cpu_output *fb = output->cpu;
+  bool resized = cpu_output_resize(fb, output->server->renderer,
+                                   wlr_output->width, wlr_output->height);
+  if (fb->texture == NULL) {
+    TracyCZoneEnd(cpu_render_ctx);
+    return NULL;
+  }
+
+  const uint32_t *background = background_pixels(output);
+  if (background == NULL) {
+    TracyCZoneEnd(cpu_render_ctx);
+    return NULL;
+  }
+
+  struct cpu_frame frame = { .fb = fb };
+
+  /* The background is cached at output size, so it's just another opaque
+   * layer underneath the views. */
+  add_layer(&frame, background, fb->width, 0, 0, fb->width, fb->height, true);
+
+  struct tinywl_view *view;
+  wl_list_for_each_reverse(view, &output->server->views, link) {
+    if (!view->mapped) {
+      continue;
+    }
+
+    struct gather_data gather = {
+      .frame = &frame,
+      .output = wlr_output,
+      .view = view,
+    };
+    wlr_xdg_surface_for_each_surface(view->xdg_surface, gather_surface, &gather);
+
+    if (gather.fallback) {
+      TracyCMessageL("cpu_render_output: falling back to GL");
+      TracyCZoneEnd(cpu_render_ctx);
+      return NULL;
+    }
+  }
+
+  /* A fresh framebuffer has nothing in it yet. */
+  pixman_region32_t region;
+  pixman_region32_init(&region);
+  if (resized) {
+    pixman_region32_union_rect(&region, &region, 0, 0, fb->width, fb->height);
+  } else {
+    pixman_region32_intersect_rect(&region, damage, 0, 0, fb->width, fb->height);
+  }
+
+  frame.rects = pixman_region32_rectangles(&region, &frame.nrects);
+  cpu_render_parallel(compose_band, &frame, fb->height);
+
+  TracyCZoneN(upload_ctx, "cpu_render_output upload", true);
+  for (int i = 0; i < frame.nrects; i++) {
+    pixman_box32_t *rect = &frame.rects[i];
+    wlr_texture_write_pixels(fb->texture, fb->width * 4,
+                             rect->x2 - rect->x1, rect->y2 - rect->y1,
+                             rect->x1, rect->y1, rect->x1, rect->y1,
+                             fb->pixels);
+  }
+  TracyCZoneEnd(upload_ctx);
+
+  pixman_region32_fini(&region);
+  TracyCZoneEnd(cpu_render_ctx);
+
+  return fb->texture;
+}
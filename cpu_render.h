@@ -0,0 +1,21 @@
+#ifndef CPU_RENDER_H
+#define CPU_RENDER_H
+
+#include <stdbool.h>
+
+#include <pixman.h>
+#include <wlr/render/wlr_renderer.h>
+
+#define CPU_RENDER_MAX_THREADS 8
+
+extern bool cpu_render_enabled(void);
+extern void cpu_render_init(void);
+extern void cpu_render_deinit(void);
+
+extern void cpu_render_surface_commit(struct tinywl_surface *surface);
+extern void cpu_render_surface_destroy(struct tinywl_surface *surface);
+
+extern struct wlr_texture *cpu_render_output(struct tinywl_output *output,
+                                             pixman_region32_t *damage);
+
+#endif // CPU_RENDER_H
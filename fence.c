@@ -0,0 +1,133 @@
+#include <poll.h>
+#include <stdbool.h>
+
+#include <wlr/types/wlr_buffer.h>
+
+#include "tracy/TracyC.h"
+
+#include "tinywl.h"
+
+#include "fence.h"
+#include "log.h"
+
+/*
+ * GPU clients hand us dma-bufs the GPU may still be rendering into. If we
+ * sample one of those, the composition waits on the client's implicit fence
+ * and one slow client makes every output miss vblank.
+ *
+ * A dma-buf fd polls readable once all pending writes to it are done, so on
+ * commit we check each plane without blocking. Each surface keeps a lock on
+ * the last dma-buf that was ready, which output_frame draws in place of one
+ * that isn't. Holding the lock also keeps the client from reusing it in the
+ * meantime. The fds go on the event loop, and once they signal the surface
+ * is damaged and drawn on the next frame.
+ */
+static int fence_busy_fd(struct wlr_surface *wlr_surface) {
+  if (wlr_surface->buffer == NULL || wlr_surface->buffer->resource == NULL) {
+    return -1;
+  }
+
+  struct wl_resource *resource = wlr_surface->buffer->resource;
+  if (!wlr_dmabuf_v1_resource_is_buffer(resource)) {
+    return -1;
+  }
+
+  struct wlr_dmabuf_v1_buffer *dmabuf =
+    wlr_dmabuf_v1_buffer_from_buffer_resource(resource);
+
+  for (int i = 0; i < dmabuf->attributes.n_planes; i++) {
+    struct pollfd pfd = {
+      .fd = dmabuf->attributes.fd[i],
+      .events = POLLIN,
+    };
+
+    if (poll(&pfd, 1, 0) == 0) {
+      return pfd.fd;
+    }
+  }
+
+  return -1;
+}
+
+static void fence_set_ready(struct tinywl_surface *surface,
+                            struct wlr_client_buffer *buffer) {
+  /* wlroots only updates shm textures in place while nothing else holds the
+   * buffer, so those aren't kept. They never have fences anyway. */
+  if (buffer != NULL && (buffer->resource == NULL ||
+                         !wlr_dmabuf_v1_resource_is_buffer(buffer->resource))) {
+    buffer = NULL;
+  }
+
+  if (buffer != NULL) {
+    wlr_buffer_lock(&buffer->base);
+    surface->ready_width = surface->wlr_surface->current.width;
+    surface->ready_height = surface->wlr_surface->current.height;
+  }
+  if (surface->ready != NULL) {
+    wlr_buffer_unlock(&surface->ready->base);
+  }
+  surface->ready = buffer;
+}
+
+static int fence_signalled(int fd, uint32_t mask, void *data) {
+  struct tinywl_surface *surface = data;
+
+  wl_event_source_remove(surface->fence);
+  surface->fence = NULL;
+
+  TracyCMessageL("fence: client buffer ready");
+
+  /* Another plane may still be busy, in which case we keep waiting. */
+  fence_surface_commit(surface);
+  if (surface->fence == NULL) {
+    struct tinywl_output *output;
+    wl_list_for_each(output, &surface->server->outputs, link) {
+      wlr_output_damage_add_whole(output->damage);
+    }
+  }
+
+  return 0;
+}
+
+void fence_surface_commit(struct tinywl_surface *surface) {
+  if (surface->fence != NULL) {
+    wl_event_source_remove(surface->fence);
+    surface->fence = NULL;
+  }
+
+  int fd = fence_busy_fd(surface->wlr_surface);
+  if (fd < 0) {
+    fence_set_ready(surface, surface->wlr_surface->buffer);
+    return;
+  }
+
+  TracyCMessageL("fence: client buffer still busy");
+
+  struct wl_event_loop *loop = wl_display_get_event_loop(surface->server->wl_display);
+  surface->fence = wl_event_loop_add_fd(loop, fd, WL_EVENT_READABLE,
+                                        fence_signalled, surface);
+}
+
+void fence_surface_destroy(struct tinywl_surface *surface) {
+  if (surface->fence != NULL) {
+    wl_event_source_remove(surface->fence);
+    surface->fence = NULL;
+  }
+
+  fence_set_ready(surface, NULL);
+}
+
+bool fence_surface_pending(struct tinywl_surface *surface) {
+  return surface != NULL && surface->fence != NULL;
+}
+
+struct wlr_texture *fence_surface_ready_texture(struct tinywl_surface *surface,
+                                                int *width, int *height) {
+  if (surface == NULL || surface->ready == NULL) {
+    return NULL;
+  }
+
+  *width = surface->ready_width;
+  *height = surface->ready_height;
+  return surface->ready->texture;
+}
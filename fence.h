@@ -0,0 +1,15 @@
+#ifndef FENCE_H
+#define FENCE_H
+
+#include <stdbool.h>
+
+struct tinywl_surface;
+struct wlr_texture;
+
+extern void fence_surface_commit(struct tinywl_surface *surface);
+extern void fence_surface_destroy(struct tinywl_surface *surface);
+extern bool fence_surface_pending(struct tinywl_surface *surface);
+extern struct wlr_texture *fence_surface_ready_texture(struct tinywl_surface *surface,
+                                                       int *width, int *height);
+
+#endif // FENCE_H
@@ -0,0 +1,362 @@
+#include <errno.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tracy/TracyC.h"
+#include "tracy/server/tracy_xxh3.h"
+#include "tracy/zstd/zstd.h"
+
+#include "tinywl.h"
+
+#include "framedump.h"
+#include "log.h"
+
+/*
+ * Deterministic frame capture for regression testing, usually run on the
+ * headless backend:
+ *
+ *   V128_FRAME_HASHES=<path>  writes "<output> <frame> <xxh3>" per frame
+ *   V128_FRAME_DUMP=<path>    writes the frames themselves, see framedump.h
+ *
+ * output_frame reads the frame back and hashes it, so the hash file lists
+ * every frame whatever the timing. Delta encoding, compression and the dump
+ * file I/O happen on a writer thread. If the writer falls behind, frames
+ * are dropped from the dump (and counted) rather than holding up the
+ * compositor; frame numbers in the dump show the gaps.
+ */
+#define FRAMEDUMP_QUEUE_SIZE    4
+#define FRAMEDUMP_MAX_OUTPUTS   8
+#define FRAMEDUMP_KEYFRAME_RATE 60
+#define FRAMEDUMP_ZSTD_LEVEL    3
+
+struct framedump_slot {
+  uint8_t *pixels;
+  size_t capacity;
+  size_t size;
+  uint64_t frame;
+  uint64_t hash;
+  uint32_t width, height, stride;
+  char output[24];
+};
+
+struct framedump_stream {
+  char output[24];
+  uint8_t *previous;
+  size_t capacity;
+  uint32_t width, height;
+  uint64_t written;
+};
+
+static bool enabled = false;
+static FILE *hash_file = NULL;
+static FILE *dump_file = NULL;
+
+static pthread_t writer_thread;
+static bool writer_running = false;
+static pthread_mutex_t queue_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t queue_cond = PTHREAD_COND_INITIALIZER;
+static struct framedump_slot slots[FRAMEDUMP_QUEUE_SIZE];
+static int queue_head = 0;
+static int queue_count = 0;
+static bool writer_exit = false;
+
+static uint64_t frame_counter = 0;
+static uint64_t dropped = 0;
+
+/* Frames that are hashed but not queued for the writer are read back here. */
+static struct framedump_slot scratch;
+
+/* Only touched by the writer thread. */
+static struct framedump_stream streams[FRAMEDUMP_MAX_OUTPUTS];
+static uint8_t *delta = NULL;
+static size_t delta_size = 0;
+static void *compressed = NULL;
+static size_t compressed_size = 0;
+static ZSTD_CCtx *zstd = NULL;
+
+static struct framedump_stream *find_stream(const char *output) {
+  for (int i = 0; i < FRAMEDUMP_MAX_OUTPUTS; i++) {
+    if (streams[i].output[0] == '\0') {
+      strncpy(streams[i].output, output, sizeof(streams[i].output) - 1);
+      return &streams[i];
+    }
+
+    if (strcmp(streams[i].output, output) == 0) {
+      return &streams[i];
+    }
+  }
+
+  return NULL;
+}
+
+static void write_dump(struct framedump_slot *slot) {
+  struct framedump_stream *stream = find_stream(slot->output);
+  if (stream == NULL) {
+    return;
+  }
+
+  bool keyframe = stream->previous == NULL ||
+    stream->width != slot->width || stream->height != slot->height ||
+    stream->written % FRAMEDUMP_KEYFRAME_RATE == 0;
+
+  const uint8_t *payload = slot->pixels;
+  if (!keyframe) {
+    if (delta_size < slot->size) {
+      free(delta);
+      delta = malloc(slot->size);
+      delta_size = slot->size;
+    }
+
+    /* Most of a frame is identical to the last one, so the XOR is mostly
+     * zeroes and compresses to almost nothing. */
+    const uint64_t *a = (const uint64_t *)slot->pixels;
+    const uint64_t *b = (const uint64_t *)stream->previous;
+    uint64_t *d = (uint64_t *)delta;
+    size_t words = slot->size / 8;
+    for (size_t i = 0; i < words; i++) {
+      d[i] = a[i] ^ b[i];
+    }
+    for (size_t i = words * 8; i < slot->size; i++) {
+      delta[i] = slot->pixels[i] ^ stream->previous[i];
+    }
+    payload = delta;
+  }
+
+  size_t bound = ZSTD_compressBound(slot->size);
+  if (compressed_size < bound) {
+    free(compressed);
+    compressed = malloc(bound);
+    compressed_size = bound;
+  }
+
+  size_t size = ZSTD_compressCCtx(zstd, compressed, compressed_size,
+                                  payload, slot->size, FRAMEDUMP_ZSTD_LEVEL);
+  if (ZSTD_isError(size)) {
+    LOGF("framedump: Failed to compress frame %" PRIu64 ": %s",
+         slot->frame, ZSTD_getErrorName(size));
+    return;
+  }
+
+  /* The record goes to disk as is, so its padding mustn't leak whatever was
+   * on the stack; an initializer doesn't have to clear it. */
+  struct framedump_record record;
+  memset(&record, 0, sizeof(record));
+  record.frame = slot->frame;
+  record.hash = slot->hash;
+  record.flags = keyframe ? FRAMEDUMP_KEYFRAME : 0;
+  record.width = slot->width;
+  record.height = slot->height;
+  record.stride = slot->stride;
+  record.compressed_size = size;
+  memcpy(record.output, slot->output, sizeof(record.output));
+
+  fwrite(&record, sizeof(record), 1, dump_file);
+  fwrite(compressed, size, 1, dump_file);
+
+  /* Keep this frame as the reference for the next delta by swapping
+   * buffers with the slot, which gets reallocated if it doesn't fit. */
+  uint8_t *previous = stream->previous;
+  size_t previous_capacity = stream->capacity;
+  stream->previous = slot->pixels;
+  stream->capacity = slot->capacity;
+  slot->pixels = previous;
+  slot->capacity = previous_capacity;
+  stream->width = slot->width;
+  stream->height = slot->height;
+  stream->written++;
+}
+
+static void *writer_main(void *arg) {
+  TracyCSetThreadName("framedump");
+
+  zstd = ZSTD_createCCtx();
+
+  pthread_mutex_lock(&queue_lock);
+  for (;;) {
+    while (queue_count == 0 && !writer_exit) {
+      pthread_cond_wait(&queue_cond, &queue_lock);
+    }
+
+    if (queue_count == 0 && writer_exit) {
+      break;
+    }
+
+    struct framedump_slot *slot = &slots[queue_head];
+    pthread_mutex_unlock(&queue_lock);
+
+    TracyCZoneN(write_ctx, "framedump write", true);
+    write_dump(slot);
+    TracyCZoneEnd(write_ctx);
+
+    pthread_mutex_lock(&queue_lock);
+    queue_head = (queue_head + 1) % FRAMEDUMP_QUEUE_SIZE;
+    queue_count--;
+  }
+  pthread_mutex_unlock(&queue_lock);
+
+  ZSTD_freeCCtx(zstd);
+  return NULL;
+}
+
+static FILE *open_output(const char *env) {
+  const char *filename = getenv(env);
+  if (filename == NULL) {
+    return NULL;
+  }
+
+  FILE *file = fopen(filename, "wb");
+  if (file == NULL) {
+    LOGF("framedump_init: Couldn't open [%s] for writing: %s", filename, strerror(errno));
+  }
+
+  return file;
+}
+
+void framedump_init(void) {
+  hash_file = open_output("V128_FRAME_HASHES");
+  dump_file = open_output("V128_FRAME_DUMP");
+
+  if (hash_file == NULL && dump_file == NULL) {
+    return;
+  }
+
+  if (dump_file != NULL) {
+    uint32_t version = FRAMEDUMP_VERSION;
+    fwrite(FRAMEDUMP_MAGIC, sizeof(FRAMEDUMP_MAGIC), 1, dump_file);
+    fwrite(&version, sizeof(version), 1, dump_file);
+  }
+
+  if (dump_file != NULL) {
+    if (pthread_create(&writer_thread, NULL, writer_main, NULL) != 0) {
+      LOG("framedump_init: Couldn't start writer thread, frame dump disabled");
+      fclose(dump_file);
+      dump_file = NULL;
+      if (hash_file == NULL) {
+        return;
+      }
+    } else {
+      writer_running = true;
+    }
+  }
+
+  enabled = true;
+  LOG("framedump_init: Capturing frames");
+}
+
+bool framedump_enabled(void) {
+  return enabled;
+}
+
+void framedump_frame(struct wlr_output *output, struct wlr_renderer *renderer) {
+  if (!enabled) {
+    return;
+  }
+
+  uint64_t frame = frame_counter++;
+
+  /* The writer thread moves queue_head and queue_count under the lock, so
+   * the free slot has to be picked there too. Once picked, it stays ours
+   * until we publish it: the writer only ever consumes published slots. */
+  bool full = true;
+  int tail = 0;
+  if (writer_running) {
+    pthread_mutex_lock(&queue_lock);
+    full = queue_count == FRAMEDUMP_QUEUE_SIZE;
+    tail = (queue_head + queue_count) % FRAMEDUMP_QUEUE_SIZE;
+    pthread_mutex_unlock(&queue_lock);
+  }
+
+  if (full && writer_running) {
+    dropped++;
+    TracyCPlot("framedump dropped", (double)dropped);
+  }
+  if (full && hash_file == NULL) {
+    return;
+  }
+
+  TracyCZoneN(readback_ctx, "framedump_frame", true);
+
+  struct framedump_slot *slot = full ? &scratch : &slots[tail];
+  slot->frame = frame;
+  slot->width = output->width;
+  slot->height = output->height;
+  slot->stride = output->width * 4;
+  memset(slot->output, 0, sizeof(slot->output));
+  snprintf(slot->output, sizeof(slot->output), "%s", output->name);
+
+  size_t size = (size_t)slot->height * slot->stride;
+  if (slot->capacity < size) {
+    free(slot->pixels);
+    slot->pixels = malloc(size);
+    slot->capacity = size;
+  }
+  slot->size = size;
+
+  bool ok = wlr_renderer_read_pixels(renderer, WL_SHM_FORMAT_ARGB8888, NULL,
+                                     slot->stride, slot->width, slot->height,
+                                     0, 0, 0, 0, slot->pixels);
+  if (!ok) {
+    TracyCZoneEnd(readback_ctx);
+    LOGF("framedump_frame: Failed to read back frame %" PRIu64, frame);
+    return;
+  }
+
+  /* Hashing here rather than on the writer keeps the hash file complete
+   * and independent of how fast the writer is. */
+  slot->hash = XXH3_64bits(slot->pixels, size);
+  if (hash_file != NULL) {
+    fprintf(hash_file, "%s %" PRIu64 " %016" PRIx64 "\n", slot->output, frame, slot->hash);
+  }
+  TracyCZoneEnd(readback_ctx);
+
+  if (full) {
+    return;
+  }
+
+  pthread_mutex_lock(&queue_lock);
+  queue_count++;
+  pthread_cond_signal(&queue_cond);
+  pthread_mutex_unlock(&queue_lock);
+}
+
+void framedump_deinit(void) {
+  if (!enabled) {
+    return;
+  }
+
+  if (writer_running) {
+    pthread_mutex_lock(&queue_lock);
+    writer_exit = true;
+    pthread_cond_signal(&queue_cond);
+    pthread_mutex_unlock(&queue_lock);
+    pthread_join(writer_thread, NULL);
+    writer_running = false;
+  }
+
+  if (dropped > 0) {
+    LOGF("framedump_deinit: Dropped %" PRIu64 " of %" PRIu64 " frames from the dump", dropped, frame_counter);
+  }
+
+  if (hash_file != NULL) {
+    fclose(hash_file);
+  }
+  if (dump_file != NULL) {
+    fclose(dump_file);
+  }
+
+  for (int i = 0; i < FRAMEDUMP_QUEUE_SIZE; i++) {
+    free(slots[i].pixels);
+  }
+  free(scratch.pixels);
+  for (int i = 0; i < FRAMEDUMP_MAX_OUTPUTS; i++) {
+    free(streams[i].previous);
+  }
+  free(delta);
+  free(compressed);
+  enabled = false;
+}
@@ -0,0 +1,42 @@
+#ifndef FRAMEDUMP_H
+#define FRAMEDUMP_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <wlr/render/wlr_renderer.h>
+#include <wlr/types/wlr_output.h>
+
+/*
+ * Frame dump stream written with V128_FRAME_DUMP=<path>. All fields are
+ * native endian. The file starts with FRAMEDUMP_MAGIC and a uint32_t
+ * version, followed by one record per captured frame:
+ *
+ *   struct framedump_record header;
+ *   uint8_t payload[header.compressed_size];
+ *
+ * The payload is a zstd frame holding height * stride bytes of ARGB8888.
+ * Keyframes hold the pixels themselves, every other frame holds them XORed
+ * with the previous frame of the same output.
+ */
+#define FRAMEDUMP_MAGIC       "V128FRM"
+#define FRAMEDUMP_VERSION     1
+#define FRAMEDUMP_KEYFRAME    (1 << 0)
+
+struct framedump_record {
+  uint64_t frame;
+  uint64_t hash;              /* XXH3-64 of the raw pixels */
+  uint32_t flags;
+  uint32_t width;
+  uint32_t height;
+  uint32_t stride;
+  uint32_t compressed_size;
+  char output[24];
+};
+
+extern void framedump_init(void);
+extern bool framedump_enabled(void);
+extern void framedump_frame(struct wlr_output *output, struct wlr_renderer *renderer);
+extern void framedump_deinit(void);
+
+#endif // FRAMEDUMP_H
@@ -0,0 +1,225 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tracy/TracyC.h"
+
+#include "tinywl.h"
+
+#include "freeze.h"
+#include "log.h"
+#include "startup.h"
+#include "subprogram.h"
+
+/*
+ * Some apps keep burning CPU while they're hidden. For the ones named in
+ * V128_FREEZE_APPS (comma separated process names), once every mapped view
+ * of the process has been covered for V128_FREEZE_AFTER seconds, the
+ * process is frozen. A process with no mapped view at all (e.g. hidden to
+ * the tray) is left alone, as there would be nothing to thaw it for.
+ *
+ * It's thawed again as soon as one of its views can be seen or is about to
+ * be focused. A stopped client can't ask for anything itself, so it's also
+ * thawed after V128_FREEZE_MAX seconds, or once it has no mapped views
+ * left. That also lets it drain its Wayland socket before it fills up.
+ */
+#define FREEZE_DEFAULT_AFTER_S 5
+#define FREEZE_DEFAULT_MAX_S   60
+#define FREEZE_CHECK_MS        1000
+
+static const char *freeze_apps = NULL;
+static uint64_t freeze_after_ns = 0;
+static uint64_t freeze_max_ns = 0;
+static struct wl_event_source *freeze_timer = NULL;
+
+static void view_box(struct tinywl_view *view, struct wlr_box *box) {
+  wlr_xdg_surface_get_geometry(view->xdg_surface, box);
+  box->x = view->x;
+  box->y = view->y;
+}
+
+static bool box_contains(const struct wlr_box *outer, const struct wlr_box *inner) {
+  return inner->x >= outer->x && inner->y >= outer->y &&
+    inner->x + inner->width <= outer->x + outer->width &&
+    inner->y + inner->height <= outer->y + outer->height;
+}
+
+static bool view_hidden(struct tinywl_view *view) {
+  if (!view->mapped) {
+    return true;
+  }
+
+  struct wlr_box box;
+  view_box(view, &box);
+
+  /* Views are kept front to back, so only the ones before us can cover us. */
+  struct tinywl_view *above;
+  wl_list_for_each(above, &view->server->views, link) {
+    if (above == view) {
+      break;
+    }
+    if (!above->mapped) {
+      continue;
+    }
+
+    struct wlr_box above_box;
+    view_box(above, &above_box);
+    if (box_contains(&above_box, &box)) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+static bool process_hidden(struct tinywl_server *server, pid_t pid, uint64_t now) {
+  bool mapped = false;
+
+  struct tinywl_view *view;
+  wl_list_for_each(view, &server->views, link) {
+    if (view->pid != pid || !view->mapped) {
+      continue;
+    }
+    if (view->hidden_since_ns == 0 || now - view->hidden_since_ns < freeze_after_ns) {
+      return false;
+    }
+    mapped = true;
+  }
+  return mapped;
+}
+
+static bool process_mapped(struct tinywl_server *server, pid_t pid) {
+  struct tinywl_view *view;
+  wl_list_for_each(view, &server->views, link) {
+    if (view->pid == pid && view->mapped) {
+      return true;
+    }
+  }
+  return false;
+}
+
+static void process_set_frozen(struct tinywl_server *server, pid_t pid, bool frozen) {
+  uint64_t now = startup_now_ns();
+
+  struct tinywl_view *view;
+  wl_list_for_each(view, &server->views, link) {
+    if (view->pid == pid) {
+      view->frozen = frozen;
+      view->frozen_since_ns = frozen ? now : 0;
+    }
+  }
+}
+
+void freeze_view_thaw(struct tinywl_view *view) {
+  if (!view->frozen) {
+    return;
+  }
+
+  if (!subprogram_freeze(view->pid, false)) {
+    return;
+  }
+
+  LOGF("freeze_view_thaw: Thawed PID [%d]", view->pid);
+  TracyCMessageL("freeze: thawed");
+  process_set_frozen(view->server, view->pid, false);
+  view->hidden_since_ns = 0;
+  view->thaw_ns = startup_now_ns();
+}
+
+void freeze_update(struct tinywl_server *server) {
+  if (freeze_apps == NULL) {
+    return;
+  }
+
+  TracyCZoneN(ctx, "freeze_update", true);
+
+  uint64_t now = startup_now_ns();
+  struct tinywl_view *view;
+  wl_list_for_each(view, &server->views, link) {
+    if (!view_hidden(view)) {
+      view->hidden_since_ns = 0;
+      freeze_view_thaw(view);
+    } else if (view->frozen && (now - view->frozen_since_ns >= freeze_max_ns ||
+                                !process_mapped(server, view->pid))) {
+      /* Hidden views start counting again from here. */
+      freeze_view_thaw(view);
+      view->hidden_since_ns = now;
+    } else if (view->hidden_since_ns == 0) {
+      view->hidden_since_ns = now;
+    }
+  }
+
+  wl_list_for_each(view, &server->views, link) {
+    if (!view->freezable || view->frozen || view->hidden_since_ns == 0) {
+      continue;
+    }
+    if (!process_hidden(server, view->pid, now)) {
+      continue;
+    }
+
+    if (subprogram_freeze(view->pid, true)) {
+      LOGF("freeze_update: Froze PID [%d]", view->pid);
+      TracyCMessageL("freeze: froze");
+      process_set_frozen(server, view->pid, true);
+    }
+  }
+
+  TracyCZoneEnd(ctx);
+}
+
+void freeze_view_map(struct tinywl_view *view) {
+  view->freezable = subprogram_listed(view->pid, freeze_apps);
+  if (view->freezable) {
+    LOGF("freeze_view_map: PID [%d] may be frozen while hidden", view->pid);
+  }
+}
+
+void freeze_surface_commit(struct tinywl_server *server, struct wlr_surface *surface) {
+  struct tinywl_view *view;
+  wl_list_for_each(view, &server->views, link) {
+    if (view->thaw_ns == 0 || view->xdg_surface->surface != surface) {
+      continue;
+    }
+
+    double ms = (startup_now_ns() - view->thaw_ns) / 1e6;
+    LOGF("freeze_surface_commit: PID [%d] first frame %.2fms after thaw",
+         view->pid, ms);
+    TracyCPlot("thaw to first frame (ms)", ms);
+    view->thaw_ns = 0;
+  }
+}
+
+static int freeze_check(void *data) {
+  freeze_update(data);
+  wl_event_source_timer_update(freeze_timer, FREEZE_CHECK_MS);
+  return 0;
+}
+
+void freeze_init(struct tinywl_server *server) {
+  freeze_apps = getenv("V128_FREEZE_APPS");
+  if (freeze_apps == NULL || *freeze_apps == '\0') {
+    freeze_apps = NULL;
+    return;
+  }
+
+  const char *after = getenv("V128_FREEZE_AFTER");
+  int seconds = after != NULL ? atoi(after) : FREEZE_DEFAULT_AFTER_S;
+  if (seconds <= 0) {
+    seconds = FREEZE_DEFAULT_AFTER_S;
+  }
+  freeze_after_ns = seconds * 1000000000ull;
+
+  const char *max = getenv("V128_FREEZE_MAX");
+  int max_seconds = max != NULL ? atoi(max) : FREEZE_DEFAULT_MAX_S;
+  if (max_seconds <= 0) {
+    max_seconds = FREEZE_DEFAULT_MAX_S;
+  }
+  freeze_max_ns = max_seconds * 1000000000ull;
+
+  LOGF("freeze_init: Freezing [%s] after %ds hidden, for at most %ds",
+       freeze_apps, seconds, max_seconds);
+
+  struct wl_event_loop *loop = wl_display_get_event_loop(server->wl_display);
+  freeze_timer = wl_event_loop_add_timer(loop, freeze_check, server);
+  wl_event_source_timer_update(freeze_timer, FREEZE_CHECK_MS);
+}
@@ -0,0 +1,15 @@
+#ifndef FREEZE_H
+#define FREEZE_H
+
+struct wlr_surface;
+struct tinywl_server;
+struct tinywl_view;
+
+extern void freeze_init(struct tinywl_server *server);
+extern void freeze_update(struct tinywl_server *server);
+extern void freeze_view_map(struct tinywl_view *view);
+extern void freeze_view_thaw(struct tinywl_view *view);
+extern void freeze_surface_commit(struct tinywl_server *server,
+                                  struct wlr_surface *surface);
+
+#endif // FREEZE_H
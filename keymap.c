@@ -0,0 +1,348 @@
+#define _GNU_SOURCE
+
+#include <dlfcn.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "tracy/TracyC.h"
+
+#include "keymap.h"
+#include "log.h"
+#include "startup.h"
+
+/*
+ * Compiling an XKB keymap takes tens of milliseconds on slow boards, and the
+ * first keyboard shows up while wlr_backend_start is still enumerating
+ * devices. We kick the compile off on a helper thread as early as possible
+ * and only wait for it when a keyboard actually needs the result.
+ *
+ * Compiled keymaps are cached by their rule names and shared between every
+ * keyboard using them. The serialized form is also written to
+ * KEYMAP_CACHE_DIRNAME so the next start only has to parse it, which skips
+ * resolving all of the include files. The file name covers the mtimes of the
+ * xkeyboard-config files the rules resolve through and of libxkbcommon
+ * itself, so upgrading either recompiles.
+ *
+ * xkbcommon objects aren't thread safe, but the helper thread owns the
+ * context and cache exclusively until it has been joined. The context and
+ * the XKB_DEFAULT_* rule names are set up on the main thread beforehand, as
+ * the environment may change underneath the helper thread.
+ */
+#define XKB_CONFIG_ROOT "/usr/share/X11/xkb"
+
+struct keymap_entry {
+  struct keymap_entry *next;
+  char *key;
+  struct xkb_keymap *keymap;
+};
+
+static pthread_t compile_thread;
+static bool compile_thread_running = false;
+
+static struct xkb_context *context = NULL;
+static struct keymap_entry *cache = NULL;
+
+/* XKB_DEFAULT_* as of keymap_init, with xkbcommon's own defaults for the
+ * ones that aren't set. */
+static struct xkb_rule_names default_rules = { 0 };
+
+static const char *default_rule_name(const char *env, const char *fallback) {
+  const char *value = getenv(env);
+  return strdup(value != NULL && value[0] != '\0' ? value : fallback);
+}
+
+static void keymap_defaults(void) {
+  if (default_rules.rules != NULL) {
+    return;
+  }
+
+  default_rules.rules = default_rule_name("XKB_DEFAULT_RULES", "evdev");
+  default_rules.model = default_rule_name("XKB_DEFAULT_MODEL", "pc105");
+  default_rules.layout = default_rule_name("XKB_DEFAULT_LAYOUT", "us");
+  default_rules.variant = default_rule_name("XKB_DEFAULT_VARIANT", "");
+  default_rules.options = default_rule_name("XKB_DEFAULT_OPTIONS", "");
+}
+
+static bool keymap_context(void) {
+  if (context != NULL) {
+    return true;
+  }
+
+  /* Rule names always come from default_rules rather than the environment. */
+  context = xkb_context_new(XKB_CONTEXT_NO_ENVIRONMENT_NAMES);
+  return context != NULL;
+}
+
+static const char *rule_name(const char *name, const char *fallback) {
+  return name != NULL && name[0] != '\0' ? name : fallback;
+}
+
+static void keymap_resolve(const struct xkb_rule_names *rules,
+                           struct xkb_rule_names *resolved) {
+  resolved->rules = rule_name(rules->rules, default_rules.rules);
+  resolved->model = rule_name(rules->model, default_rules.model);
+  resolved->layout = rule_name(rules->layout, default_rules.layout);
+  resolved->variant = rule_name(rules->variant, default_rules.variant);
+  resolved->options = rule_name(rules->options, default_rules.options);
+}
+
+static char *keymap_key(const struct xkb_rule_names *rules) {
+  char key[512];
+
+  snprintf(key, sizeof(key), "%s:%s:%s:%s:%s",
+           rules->rules, rules->model, rules->layout, rules->variant, rules->options);
+
+  return strdup(key);
+}
+
+static uint64_t fnv1a(uint64_t hash, const char *str) {
+  for (const char *c = str; *c; c++) {
+    hash ^= (unsigned char)*c;
+    hash *= 0x100000001b3ull;
+  }
+
+  return hash;
+}
+
+static uint64_t hash_mtime(uint64_t hash, const char *path) {
+  struct stat path_stat;
+  char mtime[64] = "-";
+
+  if (stat(path, &path_stat) == 0) {
+    snprintf(mtime, sizeof(mtime), ":%lld.%09ld",
+             (long long)path_stat.st_mtim.tv_sec, path_stat.st_mtim.tv_nsec);
+  }
+
+  return fnv1a(fnv1a(hash, path), mtime);
+}
+
+/* Package upgrades replace files rather than rewriting them, so the mtimes
+ * of the directories the rules resolve through, the rules file and the
+ * symbols of each layout catch an xkeyboard-config upgrade without walking
+ * the whole tree. */
+static uint64_t hash_config(uint64_t hash, const struct xkb_rule_names *rules) {
+  static const char *dirs[] = { "", "/rules", "/keycodes", "/types", "/compat", "/symbols" };
+  char path[PATH_MAX];
+
+  for (size_t i = 0; i < sizeof(dirs) / sizeof(dirs[0]); i++) {
+    snprintf(path, sizeof(path), "%s%s", XKB_CONFIG_ROOT, dirs[i]);
+    hash = hash_mtime(hash, path);
+  }
+
+  snprintf(path, sizeof(path), "%s/rules/%s", XKB_CONFIG_ROOT, rules->rules);
+  hash = hash_mtime(hash, path);
+
+  for (const char *layout = rules->layout; *layout; ) {
+    size_t len = strcspn(layout, ",");
+    snprintf(path, sizeof(path), "%s/symbols/%.*s", XKB_CONFIG_ROOT, (int)len, layout);
+    hash = hash_mtime(hash, path);
+    layout += len + (layout[len] == ',');
+  }
+
+  /* Also covers libxkbcommon, whose compiler output may change between
+   * versions. */
+  Dl_info info;
+  if (dladdr((void *)xkb_keymap_new_from_names, &info) != 0 && info.dli_fname != NULL) {
+    hash = hash_mtime(hash, info.dli_fname);
+  }
+
+  return hash;
+}
+
+static void keymap_cache_filename(const char *key, const struct xkb_rule_names *rules,
+                                  char *filename, size_t len) {
+  /* FNV-1a is plenty to tell a handful of layouts apart. */
+  uint64_t hash = fnv1a(0xcbf29ce484222325ull, key);
+  hash = hash_config(hash, rules);
+
+  snprintf(filename, len, "%s/keymap.%016" PRIx64 ".xkb", KEYMAP_CACHE_DIRNAME, hash);
+}
+
+static struct xkb_keymap *keymap_load(const char *filename) {
+  FILE *file = fopen(filename, "r");
+  if (file == NULL) {
+    return NULL;
+  }
+
+  struct xkb_keymap *keymap = xkb_keymap_new_from_file(context, file,
+                                                       XKB_KEYMAP_FORMAT_TEXT_V1,
+                                                       XKB_KEYMAP_COMPILE_NO_FLAGS);
+  fclose(file);
+
+  if (keymap == NULL) {
+    LOGF("keymap_load: Couldn't parse [%s], recompiling", filename);
+  }
+
+  return keymap;
+}
+
+static void keymap_save(struct xkb_keymap *keymap, const char *filename) {
+  char tmp_filename[PATH_MAX + 16];
+
+  char *serialized = xkb_keymap_get_as_string(keymap, XKB_KEYMAP_FORMAT_TEXT_V1);
+  if (serialized == NULL) {
+    return;
+  }
+
+  if (mkdir(KEYMAP_CACHE_DIRNAME, 0755) != 0 && errno != EEXIST) {
+    LOGF("keymap_save: Couldn't create [%s]: %s", KEYMAP_CACHE_DIRNAME, strerror(errno));
+    free(serialized);
+    return;
+  }
+
+  /* Write to a temporary file first so a crash never leaves a truncated
+   * keymap behind for the next start to choke on. */
+  snprintf(tmp_filename, sizeof(tmp_filename), "%s.%d", filename, getpid());
+  int fd = open(tmp_filename, O_CLOEXEC | O_CREAT | O_TRUNC | O_WRONLY, 0644);
+  if (fd < 0) {
+    LOGF("keymap_save: Couldn't open [%s] for writing: %s", tmp_filename, strerror(errno));
+    free(serialized);
+    return;
+  }
+
+  size_t len = strlen(serialized);
+  bool ok = write(fd, serialized, len) == (ssize_t)len;
+  close(fd);
+  free(serialized);
+
+  if (!ok || rename(tmp_filename, filename) != 0) {
+    LOGF("keymap_save: Couldn't write [%s]: %s", filename, strerror(errno));
+    unlink(tmp_filename);
+  }
+}
+
+static struct xkb_keymap *keymap_lookup(const struct xkb_rule_names *requested) {
+  char filename[PATH_MAX];
+  struct xkb_rule_names rules;
+
+  keymap_defaults();
+  keymap_resolve(requested, &rules);
+
+  char *key = keymap_key(&rules);
+  if (key == NULL) {
+    return NULL;
+  }
+
+  for (struct keymap_entry *entry = cache; entry != NULL; entry = entry->next) {
+    if (strcmp(entry->key, key) == 0) {
+      free(key);
+      return entry->keymap;
+    }
+  }
+
+  if (!keymap_context()) {
+    free(key);
+    return NULL;
+  }
+
+  keymap_cache_filename(key, &rules, filename, sizeof(filename));
+
+  TracyCZoneN(load_ctx, "keymap load", true);
+  struct xkb_keymap *keymap = keymap_load(filename);
+  TracyCZoneEnd(load_ctx);
+
+  if (keymap != NULL) {
+    LOGF("keymap_lookup: Loaded [%s] from [%s]", key, filename);
+  } else {
+    TracyCZoneN(compile_ctx, "keymap compile", true);
+    keymap = xkb_keymap_new_from_names(context, &rules, XKB_KEYMAP_COMPILE_NO_FLAGS);
+    TracyCZoneEnd(compile_ctx);
+
+    if (keymap == NULL) {
+      LOGF("keymap_lookup: Failed to compile keymap [%s]", key);
+      free(key);
+      return NULL;
+    }
+
+    LOGF("keymap_lookup: Compiled [%s]", key);
+    keymap_save(keymap, filename);
+  }
+
+  struct keymap_entry *entry = calloc(1, sizeof(struct keymap_entry));
+  entry->key = key;
+  entry->keymap = keymap;
+  entry->next = cache;
+  cache = entry;
+
+  return keymap;
+}
+
+static void *keymap_compile_thread(void *arg) {
+  /* This assumes the defaults (e.g. layout = "us"). */
+  struct xkb_rule_names rules = { 0 };
+
+  TracyCSetThreadName("keymap");
+  STARTUP_PHASE_BEGIN(compile_ctx, "keymap prepare");
+  keymap_lookup(&rules);
+  STARTUP_PHASE_END(compile_ctx);
+  return NULL;
+}
+
+void keymap_init(void) {
+  keymap_defaults();
+  if (!keymap_context()) {
+    LOG("keymap_init: Couldn't create an XKB context");
+    return;
+  }
+
+  int result = pthread_create(&compile_thread, NULL, keymap_compile_thread, NULL);
+  if (result != 0) {
+    LOGF("keymap_init: Couldn't start compile thread, compiling on demand: %s",
+         strerror(result));
+    return;
+  }
+
+  compile_thread_running = true;
+}
+
+struct xkb_keymap *keymap_get(const struct xkb_rule_names *rules) {
+  if (compile_thread_running) {
+    STARTUP_PHASE_BEGIN(wait_ctx, "keymap wait");
+    pthread_join(compile_thread, NULL);
+    compile_thread_running = false;
+    STARTUP_PHASE_END(wait_ctx);
+  }
+
+  struct xkb_keymap *keymap = keymap_lookup(rules);
+  if (keymap == NULL) {
+    return NULL;
+  }
+
+  return xkb_keymap_ref(keymap);
+}
+
+void keymap_deinit(void) {
+  if (compile_thread_running) {
+    pthread_join(compile_thread, NULL);
+    compile_thread_running = false;
+  }
+
+  while (cache != NULL) {
+    struct keymap_entry *entry = cache;
+    cache = entry->next;
+    xkb_keymap_unref(entry->keymap);
+    free(entry->key);
+    free(entry);
+  }
+
+  xkb_context_unref(context);
+  context = NULL;
+
+  free((char *)default_rules.rules);
+  free((char *)default_rules.model);
+  free((char *)default_rules.layout);
+  free((char *)default_rules.variant);
+  free((char *)default_rules.options);
+  memset(&default_rules, 0, sizeof(default_rules));
+}
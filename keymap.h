@@ -0,0 +1,12 @@
+#ifndef KEYMAP_H
+#define KEYMAP_H
+
+#include <xkbcommon/xkbcommon.h>
+
+#define KEYMAP_CACHE_DIRNAME "/var/cache/v128"
+
+extern void keymap_init(void);
+extern struct xkb_keymap *keymap_get(const struct xkb_rule_names *rules);
+extern void keymap_deinit(void);
+
+#endif // KEYMAP_H
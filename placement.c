@@ -0,0 +1,276 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tinywl.h"
+
+#include "log.h"
+#include "placement.h"
+#include "startup.h"
+#include "subprogram.h"
+
+/*
+ * Chooses the output each new view goes on. V128_PLACEMENT names the
+ * policy (least-loaded by default, or round-robin). V128_PLACEMENT_RULES
+ * overrides it per app with comma separated name=target pairs, matched
+ * against the client's process name, where the target is an output or a
+ * policy, e.g. "x128=HDMI-A-1,cool-retro-term=round-robin".
+ */
+
+/* How much a fully used frame budget counts against an output, next to one
+ * view being on it. */
+#define PLACEMENT_COMPOSE_WEIGHT 2.0
+
+#define PLACEMENT_DEFAULT_REFRESH_MHZ 60000
+
+/* Weight of the previous average in the compose time EMA, per frame. */
+#define PLACEMENT_COMPOSE_DECAY 0.9
+
+struct placement_policy {
+  const char *name;
+  struct tinywl_output *(*choose)(struct tinywl_server *server);
+};
+
+/* An index rather than an output, so it can't be left pointing at one
+ * that's gone when outputs come and go. */
+static unsigned int round_robin_next = 0;
+
+static struct tinywl_output *choose_round_robin(struct tinywl_server *server) {
+  int count = wl_list_length(&server->outputs);
+  if (count == 0) {
+    return NULL;
+  }
+
+  unsigned int index = round_robin_next++ % count;
+  struct tinywl_output *output;
+  wl_list_for_each(output, &server->outputs, link) {
+    if (index-- == 0) {
+      break;
+    }
+  }
+
+  return output;
+}
+
+static int output_refresh_mhz(struct tinywl_output *output) {
+  int refresh = output->wlr_output->refresh;
+  return refresh > 0 ? refresh : PLACEMENT_DEFAULT_REFRESH_MHZ;
+}
+
+/* Outputs only produce frames when something changed, and direct scanout
+ * doesn't compose at all, so the average is decayed by every frame period
+ * since the last composed frame, as if each had cost nothing. */
+static double output_compose_ms(struct tinywl_output *output, uint64_t now) {
+  if (output->compose_updated_ns == 0 || now <= output->compose_updated_ns) {
+    return output->compose_ms;
+  }
+
+  /* The first period is the one the last frame was composed in. */
+  uint64_t period_ns = 1000000000000ull / output_refresh_mhz(output);
+  uint64_t idle_frames = (now - output->compose_updated_ns) / period_ns;
+  if (idle_frames <= 1) {
+    return output->compose_ms;
+  }
+  idle_frames--;
+  if (idle_frames > 200) {
+    return 0;
+  }
+
+  double compose_ms = output->compose_ms;
+  for (uint64_t i = 0; i < idle_frames; i++) {
+    compose_ms *= PLACEMENT_COMPOSE_DECAY;
+  }
+  return compose_ms;
+}
+
+/* How much of the view is on the output, from 0 to 1. */
+static double view_share(struct tinywl_view *view, struct wlr_box *output_box) {
+  struct wlr_box geometry;
+  wlr_xdg_surface_get_geometry(view->xdg_surface, &geometry);
+
+  /* Views that haven't committed a size yet only have a position. */
+  if (geometry.width <= 0 || geometry.height <= 0) {
+    return wlr_box_contains_point(output_box, view->x, view->y) ? 1.0 : 0.0;
+  }
+
+  struct wlr_box view_box = {
+    .x = view->x,
+    .y = view->y,
+    .width = geometry.width,
+    .height = geometry.height,
+  };
+  struct wlr_box overlap;
+  if (!wlr_box_intersection(&overlap, output_box, &view_box)) {
+    return 0.0;
+  }
+
+  return (double)overlap.width * overlap.height / ((double)view_box.width * view_box.height);
+}
+
+static double output_load(struct tinywl_server *server, struct tinywl_output *output) {
+  struct wlr_box *box =
+    wlr_output_layout_get_box(server->output_layout, output->wlr_output);
+
+  /* Views that haven't mapped yet count too, so a burst of new views is
+   * spread out. Views straddling outputs count towards each in proportion. */
+  double views = 0;
+  struct tinywl_view *view;
+  wl_list_for_each(view, &server->views, link) {
+    if (box != NULL) {
+      views += view_share(view, box);
+    }
+  }
+
+  double budget_ms = 1000000.0 / output_refresh_mhz(output);
+  double compose_ms = output_compose_ms(output, startup_now_ns());
+  return views + PLACEMENT_COMPOSE_WEIGHT * compose_ms / budget_ms;
+}
+
+static struct tinywl_output *choose_least_loaded(struct tinywl_server *server) {
+  struct tinywl_output *best = NULL;
+  double best_load = 0;
+
+  struct tinywl_output *output;
+  wl_list_for_each(output, &server->outputs, link) {
+    double load = output_load(server, output);
+
+    LOGF("choose_least_loaded: #<%s> load %.2f (%.2fms compose, %dmHz)",
+         output->wlr_output->name, load,
+         output_compose_ms(output, startup_now_ns()), output_refresh_mhz(output));
+
+    /* On a tie, the faster output wins. */
+    if (best == NULL || load < best_load ||
+        (load == best_load && output_refresh_mhz(output) > output_refresh_mhz(best))) {
+      best = output;
+      best_load = load;
+    }
+  }
+
+  return best;
+}
+
+static const struct placement_policy policies[] = {
+  { "least-loaded", choose_least_loaded },
+  { "round-robin", choose_round_robin },
+};
+
+static const struct placement_policy *default_policy = &policies[0];
+static const char *placement_rules = NULL;
+
+static const struct placement_policy *policy_named(const char *name, size_t len) {
+  for (size_t i = 0; i < sizeof(policies) / sizeof(policies[0]); i++) {
+    if (strlen(policies[i].name) == len && strncmp(policies[i].name, name, len) == 0) {
+      return &policies[i];
+    }
+  }
+  return NULL;
+}
+
+static struct tinywl_output *output_named(struct tinywl_server *server,
+                                          const char *name, size_t len) {
+  struct tinywl_output *output;
+  wl_list_for_each(output, &server->outputs, link) {
+    const char *output_name = output->wlr_output->name;
+    if (strlen(output_name) == len && strncmp(output_name, name, len) == 0) {
+      return output;
+    }
+  }
+  return NULL;
+}
+
+/* Applies the first rule for the app, if any. Returns NULL to fall back to
+ * the default policy. */
+static struct tinywl_output *apply_rules(struct tinywl_server *server, const char *app) {
+  size_t app_len = strlen(app);
+  const char *rule = placement_rules;
+
+  while (rule != NULL && *rule != '\0') {
+    size_t rule_len = strcspn(rule, ",");
+    const char *equals = memchr(rule, '=', rule_len);
+
+    if (equals != NULL && (size_t)(equals - rule) == app_len &&
+        strncmp(rule, app, app_len) == 0) {
+      const char *target = equals + 1;
+      size_t target_len = rule_len - (target - rule);
+
+      const struct placement_policy *policy = policy_named(target, target_len);
+      if (policy != NULL) {
+        LOGF("apply_rules: [%s] uses %s", app, policy->name);
+        return policy->choose(server);
+      }
+
+      struct tinywl_output *output = output_named(server, target, target_len);
+      if (output != NULL) {
+        LOGF("apply_rules: [%s] goes on #<%s>", app, output->wlr_output->name);
+        return output;
+      }
+
+      LOGF("apply_rules: [%s] wants [%.*s], which isn't here", app,
+           (int)target_len, target);
+      return NULL;
+    }
+
+    rule += rule_len;
+    if (*rule == ',') {
+      rule++;
+    }
+  }
+
+  return NULL;
+}
+
+struct tinywl_output *placement_choose(struct tinywl_view *view) {
+  struct tinywl_server *server = view->server;
+  struct tinywl_output *output = NULL;
+
+  if (placement_rules != NULL) {
+    pid_t pid = 0;
+    char app[64];
+    wl_client_get_credentials(wl_resource_get_client(view->xdg_surface->resource),
+                              &pid, NULL, NULL);
+    if (subprogram_name(pid, app, sizeof(app))) {
+      output = apply_rules(server, app);
+    }
+  }
+
+  if (output == NULL) {
+    output = default_policy->choose(server);
+  }
+
+  if (output != NULL) {
+    LOGF("placement_choose: Placing view on #<%s>", output->wlr_output->name);
+  } else {
+    LOG("placement_choose: No output to place view on!");
+  }
+  return output;
+}
+
+void placement_output_frame(struct tinywl_output *output, uint64_t compose_ns) {
+  /* A moving average, so one slow frame doesn't scare new views off. The
+   * frames skipped since the last one are folded in first. */
+  uint64_t now = startup_now_ns();
+  double compose_ms = output_compose_ms(output, now);
+  output->compose_ms = compose_ms * PLACEMENT_COMPOSE_DECAY +
+    (compose_ns / 1e6) * (1.0 - PLACEMENT_COMPOSE_DECAY);
+  output->compose_updated_ns = now;
+}
+
+void placement_output_add(struct tinywl_output *output) {
+  /* Start the rotation over, so a new output isn't skipped for a lap. */
+  round_robin_next = 0;
+}
+
+void placement_init(void) {
+  const char *policy = getenv("V128_PLACEMENT");
+  if (policy != NULL) {
+    default_policy = policy_named(policy, strlen(policy));
+    if (default_policy == NULL) {
+      LOGF("placement_init: Unknown V128_PLACEMENT [%s], using least-loaded", policy);
+      default_policy = &policies[0];
+    }
+  }
+
+  placement_rules = getenv("V128_PLACEMENT_RULES");
+  LOGF("placement_init: Placing views %s, rules [%s]", default_policy->name,
+       placement_rules ? placement_rules : "");
+}
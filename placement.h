@@ -0,0 +1,14 @@
+#ifndef PLACEMENT_H
+#define PLACEMENT_H
+
+#include <stdint.h>
+
+struct tinywl_output;
+struct tinywl_view;
+
+extern void placement_init(void);
+extern void placement_output_add(struct tinywl_output *output);
+extern void placement_output_frame(struct tinywl_output *output, uint64_t compose_ns);
+extern struct tinywl_output *placement_choose(struct tinywl_view *view);
+
+#endif // PLACEMENT_H
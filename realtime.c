@@ -0,0 +1,207 @@
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <malloc.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include "tracy/TracyC.h"
+
+#include "log.h"
+#include "realtime.h"
+
+/*
+ * V128_SCHED=fifo|rr puts the main thread (only) into a real-time class at
+ * V128_SCHED_PRIORITY, and V128_MLOCK=1 locks and prefaults the working set
+ * once startup is done. Both have to happen while we're still root.
+ *
+ * Only what's mapped at that point is locked, plus render buffers allocated
+ * later through realtime_lock_region. MCL_FUTURE would also lock every shm
+ * pool a client makes us map, letting any client pin memory without bound.
+ */
+#define REALTIME_DEFAULT_PRIORITY 10
+
+/* Like rtkit: a real-time thread that spins this long without sleeping
+ * gets SIGXCPU instead of wedging the machine, and drops back to
+ * SCHED_OTHER. The kernel only sends SIGKILL at the hard limit, which is
+ * there in case even that doesn't help. */
+#define REALTIME_RTTIME_US      200000
+#define REALTIME_RTTIME_HARD_US 1000000
+
+#define REALTIME_PREFAULT_STACK (512 * 1024)
+
+/* Room for render buffers locked after startup, on top of the image. */
+#define REALTIME_MEMLOCK_HEADROOM (64ull * 1024 * 1024)
+
+static bool locked = false;
+static pid_t main_tid = 0;
+static volatile sig_atomic_t demoted = 0;
+
+static void rttime_exceeded(int signal) {
+  /* SIGXCPU goes to the whole process, so name the thread explicitly. */
+  struct sched_param param = { .sched_priority = 0 };
+  if (sched_setscheduler(main_tid, SCHED_OTHER, &param) == 0) {
+    demoted = 1;
+  }
+}
+
+void realtime_init(void) {
+  const char *sched = getenv("V128_SCHED");
+  if (sched == NULL) {
+    return;
+  }
+
+  int policy;
+  if (strcmp(sched, "fifo") == 0) {
+    policy = SCHED_FIFO;
+  } else if (strcmp(sched, "rr") == 0) {
+    policy = SCHED_RR;
+  } else {
+    LOGF("realtime_init: Unknown V128_SCHED [%s], want fifo or rr", sched);
+    return;
+  }
+
+  const char *priority_env = getenv("V128_SCHED_PRIORITY");
+  struct sched_param param = {
+    .sched_priority = priority_env ? atoi(priority_env) : REALTIME_DEFAULT_PRIORITY,
+  };
+
+  main_tid = gettid();
+  struct sigaction action = {
+    .sa_handler = rttime_exceeded,
+    .sa_flags = SA_RESTART,
+  };
+  sigemptyset(&action.sa_mask);
+  sigaction(SIGXCPU, &action, NULL);
+
+  struct rlimit rttime = {
+    .rlim_cur = REALTIME_RTTIME_US,
+    .rlim_max = REALTIME_RTTIME_HARD_US,
+  };
+  if (setrlimit(RLIMIT_RTTIME, &rttime) < 0) {
+    LOGF("realtime_init: Couldn't set RLIMIT_RTTIME: %s", strerror(errno));
+  }
+
+  /* Worker threads and children go back to SCHED_OTHER. */
+  if (sched_setscheduler(0, policy | SCHED_RESET_ON_FORK, &param) < 0) {
+    LOGF("realtime_init: Couldn't switch to %s priority %d: %s",
+         sched, param.sched_priority, strerror(errno));
+    return;
+  }
+
+  LOGF("realtime_init: Main thread running %s priority %d",
+       sched, param.sched_priority);
+}
+
+static void __attribute__((noinline)) prefault_stack(void) {
+  volatile char stack[REALTIME_PREFAULT_STACK];
+  for (size_t i = 0; i < sizeof(stack); i += 4096) {
+    stack[i] = 0;
+  }
+
+  /* The stack pages stay mapped once touched, so they stay locked too. */
+  if (mlock((const void *)stack, sizeof(stack)) < 0) {
+    LOGF("realtime_lock: Couldn't lock the stack: %s", strerror(errno));
+  }
+}
+
+static unsigned long long locked_bytes(void) {
+  FILE *status = fopen("/proc/self/status", "r");
+  if (status == NULL) {
+    return 0;
+  }
+
+  char line[128];
+  unsigned long long kb = 0;
+  while (fgets(line, sizeof(line), status) != NULL) {
+    if (sscanf(line, "VmLck: %llu kB", &kb) == 1) {
+      break;
+    }
+  }
+  fclose(status);
+  return kb * 1024;
+}
+
+void realtime_lock(void) {
+  const char *mlock = getenv("V128_MLOCK");
+  if (mlock == NULL || strcmp(mlock, "1") != 0) {
+    return;
+  }
+
+  TracyCZoneN(ctx, "realtime_lock", true);
+
+  /* Keep freed heap around instead of handing it back to be faulted in
+   * again later, and keep big allocations off fresh mmaps. */
+  mallopt(M_TRIM_THRESHOLD, -1);
+  mallopt(M_MMAP_MAX, 0);
+
+  if (mlockall(MCL_CURRENT) < 0) {
+    LOGF("realtime_lock: mlockall failed: %s", strerror(errno));
+    TracyCZoneEnd(ctx);
+    return;
+  }
+
+  locked = true;
+  prefault_stack();
+
+  /* Once privileges are dropped, later realtime_lock_region calls count
+   * against this, so leave some room above what's locked now. */
+  unsigned long long limit = locked_bytes() + REALTIME_MEMLOCK_HEADROOM;
+  struct rlimit memlock = {
+    .rlim_cur = limit,
+    .rlim_max = limit,
+  };
+  if (setrlimit(RLIMIT_MEMLOCK, &memlock) < 0) {
+    LOGF("realtime_lock: Couldn't set RLIMIT_MEMLOCK to %llu MB: %s",
+         limit >> 20, strerror(errno));
+  }
+
+  LOG("realtime_lock: Working set locked");
+
+  TracyCZoneEnd(ctx);
+}
+
+void realtime_lock_region(const void *addr, size_t len) {
+  if (!locked || addr == NULL || len == 0) {
+    return;
+  }
+
+  if (mlock(addr, len) < 0) {
+    LOGF("realtime_lock_region: Couldn't lock %zu bytes: %s", len, strerror(errno));
+  }
+}
+
+void realtime_frame(void) {
+  if (demoted == 1) {
+    demoted = 2;
+    LOG("realtime_frame: Exceeded RLIMIT_RTTIME, main thread is back to SCHED_OTHER");
+  }
+
+#ifdef TRACY_ENABLE
+  static struct rusage last_self;
+  static struct rusage last_thread;
+  static bool have_last = false;
+
+  struct rusage self, thread;
+  getrusage(RUSAGE_SELF, &self);
+  getrusage(RUSAGE_THREAD, &thread);
+
+  if (have_last) {
+    TracyCPlot("major faults/frame", self.ru_majflt - last_self.ru_majflt);
+    TracyCPlot("minor faults/frame", self.ru_minflt - last_self.ru_minflt);
+    TracyCPlot("involuntary switches/frame",
+               thread.ru_nivcsw - last_thread.ru_nivcsw);
+  }
+
+  last_self = self;
+  last_thread = thread;
+  have_last = true;
+#endif
+}
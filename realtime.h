@@ -0,0 +1,11 @@
+#ifndef REALTIME_H
+#define REALTIME_H
+
+#include <stddef.h>
+
+extern void realtime_init(void);
+extern void realtime_lock(void);
+extern void realtime_lock_region(const void *addr, size_t len);
+extern void realtime_frame(void);
+
+#endif // REALTIME_H
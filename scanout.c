@@ -0,0 +1,230 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "tracy/TracyC.h"
+
+#include "tinywl.h"
+
+#include "fence.h"
+#include "framedump.h"
+#include "log.h"
+#include "scanout.h"
+#include "startup.h"
+#include "subprogram.h"
+
+/*
+ * Low-latency presentation for apps named in V128_TEARING_APPS (comma
+ * separated process names), e.g. the emulator in game mode.
+ *
+ * When such a view is on top and its buffer covers the output exactly, the
+ * buffer is handed to the output as is instead of being composed, and a new
+ * buffer is flipped as soon as it's committed if no flip is pending, rather
+ * than waiting for the next frame event. Anything that needs composition
+ * (popups, subsurfaces, a software cursor, captures) falls back to the
+ * normal vsynced path.
+ *
+ * Commit-to-present latency of these apps is plotted per path.
+ */
+static const char *tearing_apps = NULL;
+
+static struct tinywl_view *output_top_view(struct tinywl_output *output) {
+  struct tinywl_server *server = output->server;
+  struct wlr_box *box =
+    wlr_output_layout_get_box(server->output_layout, output->wlr_output);
+  if (box == NULL) {
+    return NULL;
+  }
+
+  struct tinywl_view *view;
+  wl_list_for_each(view, &server->views, link) {
+    if (view->mapped && wlr_box_contains_point(box, view->x, view->y)) {
+      return view;
+    }
+  }
+  return NULL;
+}
+
+static struct wlr_surface *scanout_candidate(struct tinywl_output *output) {
+  struct tinywl_server *server = output->server;
+  struct wlr_output *wlr_output = output->wlr_output;
+
+  struct tinywl_view *view = output_top_view(output);
+  if (view == NULL || !view->tearing) {
+    return NULL;
+  }
+
+  struct wlr_box *box = wlr_output_layout_get_box(server->output_layout, wlr_output);
+  struct wlr_surface *surface = view->xdg_surface->surface;
+  struct wlr_surface_state *state = &surface->current;
+
+  if (view->x != box->x || view->y != box->y ||
+      state->buffer_width != wlr_output->width ||
+      state->buffer_height != wlr_output->height ||
+      state->transform != wlr_output->transform ||
+      state->scale != wlr_output->scale) {
+    return NULL;
+  }
+
+  if (surface->buffer == NULL || fence_surface_pending(surface->data) ||
+      !wl_list_empty(&surface->subsurfaces) ||
+      !wl_list_empty(&view->xdg_surface->popups)) {
+    return NULL;
+  }
+
+  /* Anyone reading back the composed frame needs it composed. */
+  if (framedump_enabled() || !wl_list_empty(&server->screencopy->frames) ||
+      !wl_list_empty(&server->export_dmabuf->frames)) {
+    return NULL;
+  }
+
+  struct wlr_output_cursor *cursor;
+  wl_list_for_each(cursor, &wlr_output->cursors, link) {
+    if (cursor->enabled && cursor->visible && wlr_output->hardware_cursor != cursor) {
+      return NULL;
+    }
+  }
+
+  return surface;
+}
+
+static void scanout_destroy(struct wl_listener *listener, void *data);
+
+/* output->scanout is compared across frames, so it's dropped with the
+ * surface rather than left for a new one to be allocated at its address. */
+static void scanout_set(struct tinywl_output *output, struct wlr_surface *surface) {
+  if (output->scanout == surface) {
+    return;
+  }
+
+  if (output->scanout != NULL) {
+    wl_list_remove(&output->scanout_destroy.link);
+  }
+
+  output->scanout = surface;
+  if (surface != NULL) {
+    output->scanout_destroy.notify = scanout_destroy;
+    wl_signal_add(&surface->events.destroy, &output->scanout_destroy);
+  }
+}
+
+static void scanout_leave(struct tinywl_output *output) {
+  if (output->scanout != NULL) {
+    /* The render buffers' ages say nothing about what's on screen now. */
+    scanout_set(output, NULL);
+    wlr_output_damage_add_whole(output->damage);
+  }
+}
+
+static void scanout_destroy(struct wl_listener *listener, void *data) {
+  struct tinywl_output *output = wl_container_of(listener, output, scanout_destroy);
+  scanout_leave(output);
+}
+
+bool scanout_output_frame(struct tinywl_output *output) {
+  struct wlr_output *wlr_output = output->wlr_output;
+  struct wlr_surface *surface = scanout_candidate(output);
+
+  if (surface == NULL) {
+    scanout_leave(output);
+    return false;
+  }
+
+  struct tinywl_surface *tsurface = surface->data;
+  if (output->scanout == surface && output->scanout_commit_ns == tsurface->commit_ns) {
+    /* Already on screen, nothing to flip. */
+    return true;
+  }
+
+  TracyCZoneN(ctx, "scanout_output_frame", true);
+
+  wlr_output_attach_buffer(wlr_output, &surface->buffer->base);
+  if (!wlr_output_test(wlr_output) || !wlr_output_commit(wlr_output)) {
+    wlr_output_rollback(wlr_output);
+    TracyCMessageL("scanout: output refused client buffer");
+    /* Whatever is composed instead has to be complete on its own. */
+    scanout_set(output, NULL);
+    wlr_output_damage_add_whole(output->damage);
+    TracyCZoneEnd(ctx);
+    return false;
+  }
+
+  scanout_set(output, surface);
+  output->scanout_commit_ns = tsurface->commit_ns;
+  output->present_commit_ns = tsurface->commit_ns;
+  output->present_scanout = true;
+
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  wlr_surface_send_frame_done(surface, &now);
+
+  TracyCZoneEnd(ctx);
+  return true;
+}
+
+void scanout_output_composed(struct tinywl_output *output) {
+  struct tinywl_view *view = output_top_view(output);
+  if (view == NULL || !view->tearing) {
+    return;
+  }
+
+  struct tinywl_surface *tsurface = view->xdg_surface->surface->data;
+  if (tsurface != NULL) {
+    output->present_commit_ns = tsurface->commit_ns;
+    output->present_scanout = false;
+  }
+}
+
+void scanout_surface_commit(struct tinywl_surface *surface) {
+  struct tinywl_output *output;
+  wl_list_for_each(output, &surface->server->outputs, link) {
+    /* Flip right away instead of waiting for the next frame event, unless
+     * the previous flip hasn't landed yet. */
+    if (output->scanout == surface->wlr_surface && !output->wlr_output->frame_pending) {
+      scanout_output_frame(output);
+    }
+  }
+}
+
+static void output_present(struct wl_listener *listener, void *data) {
+  struct tinywl_output *output = wl_container_of(listener, output, present);
+  struct wlr_output_event_present *event = data;
+
+  if (output->present_commit_ns == 0 || event->when == NULL) {
+    return;
+  }
+
+#ifdef TRACY_ENABLE
+  uint64_t presented_ns = event->when->tv_sec * 1000000000ull + event->when->tv_nsec;
+  if (presented_ns > output->present_commit_ns) {
+    double ms = (presented_ns - output->present_commit_ns) / 1e6;
+    if (output->present_scanout) {
+      TracyCPlot("commit to present, scanout (ms)", ms);
+    } else {
+      TracyCPlot("commit to present, composed (ms)", ms);
+    }
+  }
+#endif
+
+  output->present_commit_ns = 0;
+}
+
+void scanout_view_map(struct tinywl_view *view) {
+  view->tearing = subprogram_listed(view->pid, tearing_apps);
+  if (view->tearing) {
+    LOGF("scanout_view_map: PID [%d] gets low-latency presentation", view->pid);
+  }
+}
+
+void scanout_output_init(struct tinywl_output *output) {
+  output->present.notify = output_present;
+  wl_signal_add(&output->wlr_output->events.present, &output->present);
+}
+
+void scanout_init(void) {
+  tearing_apps = getenv("V128_TEARING_APPS");
+  if (tearing_apps != NULL && *tearing_apps == '\0') {
+    tearing_apps = NULL;
+  }
+}
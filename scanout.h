@@ -0,0 +1,17 @@
+#ifndef SCANOUT_H
+#define SCANOUT_H
+
+#include <stdbool.h>
+
+struct tinywl_output;
+struct tinywl_surface;
+struct tinywl_view;
+
+extern void scanout_init(void);
+extern void scanout_output_init(struct tinywl_output *output);
+extern void scanout_view_map(struct tinywl_view *view);
+extern void scanout_surface_commit(struct tinywl_surface *surface);
+extern bool scanout_output_frame(struct tinywl_output *output);
+extern void scanout_output_composed(struct tinywl_output *output);
+
+#endif // SCANOUT_H
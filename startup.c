@@ -0,0 +1,106 @@
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "log.h"
+#include "startup.h"
+
+#define STARTUP_MAX_PHASES 32
+
+struct startup_phase {
+  const char *name;
+  uint64_t begin_ns;
+  uint64_t end_ns;
+};
+
+static pthread_mutex_t phase_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct startup_phase phases[STARTUP_MAX_PHASES];
+static int phase_count = 0;
+
+static uint64_t main_ns = 0;
+static uint64_t boot_offset_ns = 0;
+static bool first_frame_seen = false;
+
+static uint64_t timespec_ns(const struct timespec *ts) {
+  return (uint64_t)ts->tv_sec * 1000000000ull + (uint64_t)ts->tv_nsec;
+}
+
+uint64_t startup_now_ns(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return timespec_ns(&now);
+}
+
+void startup_init(void) {
+  struct timespec boot;
+
+  main_ns = startup_now_ns();
+
+  /* CLOCK_BOOTTIME includes time spent suspended, so it tells us how long
+   * after power-on we actually got to run. */
+  clock_gettime(CLOCK_BOOTTIME, &boot);
+  boot_offset_ns = timespec_ns(&boot);
+}
+
+int startup_phase_begin(const char *name) {
+  int phase = -1;
+
+  pthread_mutex_lock(&phase_lock);
+  if (!first_frame_seen && phase_count < STARTUP_MAX_PHASES) {
+    phase = phase_count++;
+    phases[phase].name = name;
+    phases[phase].begin_ns = startup_now_ns();
+    phases[phase].end_ns = 0;
+  }
+  pthread_mutex_unlock(&phase_lock);
+
+  return phase;
+}
+
+void startup_phase_end(int phase) {
+  if (phase < 0) {
+    return;
+  }
+
+  pthread_mutex_lock(&phase_lock);
+  phases[phase].end_ns = startup_now_ns();
+  pthread_mutex_unlock(&phase_lock);
+}
+
+void startup_first_frame(void) {
+  if (first_frame_seen) {
+    return;
+  }
+
+  uint64_t now = startup_now_ns();
+
+  pthread_mutex_lock(&phase_lock);
+  first_frame_seen = true;
+
+  LOG("Startup report:");
+  LOGF("  main() entered %.1f ms after boot", boot_offset_ns / 1e6);
+
+  for (int i = 0; i < phase_count; i++) {
+    struct startup_phase *p = &phases[i];
+
+    if (p->end_ns == 0) {
+      LOGF("  %-24s +%8.2f ms  (still running)",
+           p->name, (p->begin_ns - main_ns) / 1e6);
+      continue;
+    }
+
+    LOGF("  %-24s +%8.2f ms  %8.2f ms",
+         p->name, (p->begin_ns - main_ns) / 1e6, (p->end_ns - p->begin_ns) / 1e6);
+  }
+
+  double first_frame_ms = (now - main_ns) / 1e6;
+  LOGF("  time to first frame: %.2f ms (%.1f ms after boot)",
+       first_frame_ms, (boot_offset_ns + (now - main_ns)) / 1e6);
+  pthread_mutex_unlock(&phase_lock);
+
+  TracyCPlot("startup: time to first frame (ms)", first_frame_ms);
+  TracyCMessageL("startup: first frame committed");
+}
@@ -0,0 +1,24 @@
+#ifndef STARTUP_H
+#define STARTUP_H
+
+#include <stdint.h>
+
+#include "tracy/TracyC.h"
+
+/* Wraps a startup phase in both a Tracy zone and an entry in the startup
+ * report that is written to the log once the first frame is committed. */
+#define STARTUP_PHASE_BEGIN(ctx, name)                  \
+  TracyCZoneN(ctx, "startup: " name, true);             \
+  int ctx##_phase = startup_phase_begin(name);
+
+#define STARTUP_PHASE_END(ctx)                          \
+  startup_phase_end(ctx##_phase);                       \
+  TracyCZoneEnd(ctx);
+
+extern void startup_init(void);
+extern uint64_t startup_now_ns(void);
+extern int startup_phase_begin(const char *name);
+extern void startup_phase_end(int phase);
+extern void startup_first_frame(void);
+
+#endif // STARTUP_H
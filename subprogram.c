@@ -1,28 +1,187 @@
+#include <dirent.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <signal.h>
+#include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/resource.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <unistd.h>
 
+#include <wayland-server-core.h>
+
+#include "tracy/TracyC.h"
+
 #include "log.h"
 #include "subprogram.h"
 
+/*
+ * Every child gets its own process group, and its own cgroup when
+ * V128_CGROUP names a cgroup v2 directory delegated to the user the shell
+ * drops to. Focus changes then move CPU share towards the focused app:
+ * cpu.weight when we have a cgroup, nice on the process group otherwise.
+ *
+ * Moving a process between cgroups needs write access to cgroup.procs of
+ * their common ancestor, so while still root the shell moves itself into a
+ * leaf of the delegated subtree. Children then start out there and can join
+ * their own cgroup after we've dropped privileges.
+ */
+#define SUBPROGRAM_MAX 16
+
+#define SUBPROGRAM_FOCUS_WEIGHT      1000
+#define SUBPROGRAM_BACKGROUND_WEIGHT 25
+#define SUBPROGRAM_FOCUS_NICE        0
+#define SUBPROGRAM_BACKGROUND_NICE   10
+
+#define SUBPROGRAM_WATCH_MS 1000
+
+struct subprogram {
+  volatile sig_atomic_t running;
+  pid_t pgid;
+  char cgroup[256];
+  bool focused;
+
+  /* Tracy keeps the plot name pointers, so these live as long as we do. */
+  char cpu_plot[32];
+  char rss_plot[32];
+  unsigned long long last_ticks;
+};
+
+static struct subprogram subprograms[SUBPROGRAM_MAX];
 static int exec_count = 0;
 
+static const char *cgroup_root = NULL;
+static bool background_idle = false;
+
 static void child_reaper(int signal) {
   int wstatus = -1;
   pid_t pid = waitpid(-1, &wstatus, WNOHANG);
 
   for (; pid > 0; pid = waitpid(-1, &wstatus, WNOHANG)) {
     LOGF("PID [%d] exited code [%d]", pid, WEXITSTATUS(wstatus));
+
+    for (int i = 0; i < SUBPROGRAM_MAX; i++) {
+      if (subprograms[i].pgid == pid) {
+        subprograms[i].running = 0;
+      }
+    }
+  }
+}
+
+static bool write_file(const char *filename, const char *value) {
+  int fd = open(filename, O_WRONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return false;
+  }
+
+  ssize_t len = strlen(value);
+  bool ok = write(fd, value, len) == len;
+  close(fd);
+  return ok;
+}
+
+static bool cgroup_write(const char *cgroup, const char *file, const char *value) {
+  char filename[512];
+  snprintf(filename, sizeof(filename), "%s/%s", cgroup, file);
+
+  if (!write_file(filename, value)) {
+    LOGF("cgroup_write: Failed to write [%s] to [%s]: %s",
+         value, filename, strerror(errno));
+    return false;
+  }
+  return true;
+}
+
+static struct subprogram *subprogram_slot(void) {
+  for (int i = 0; i < SUBPROGRAM_MAX; i++) {
+    struct subprogram *sp = &subprograms[i];
+    if (sp->pgid == 0) {
+      return sp;
+    }
+  }
+
+  /* Reuse the slot of a child that's gone, keeping its plot names. */
+  for (int i = 0; i < SUBPROGRAM_MAX; i++) {
+    struct subprogram *sp = &subprograms[i];
+    if (!sp->running) {
+      if (sp->cgroup[0] != '\0') {
+        rmdir(sp->cgroup);
+        sp->cgroup[0] = '\0';
+      }
+      return sp;
+    }
+  }
+
+  return NULL;
+}
+
+static void subprogram_apply_priority(struct subprogram *sp, bool focused) {
+  sp->focused = focused;
+
+  if (sp->cgroup[0] != '\0') {
+    char weight[16];
+    snprintf(weight, sizeof(weight), "%d",
+             focused ? SUBPROGRAM_FOCUS_WEIGHT : SUBPROGRAM_BACKGROUND_WEIGHT);
+    cgroup_write(sp->cgroup, "cpu.weight", weight);
+
+    if (background_idle) {
+      cgroup_write(sp->cgroup, "cpu.idle", focused ? "0" : "1");
+    }
+    return;
+  }
+
+  int nice = focused ? SUBPROGRAM_FOCUS_NICE : SUBPROGRAM_BACKGROUND_NICE;
+  if (setpriority(PRIO_PGRP, sp->pgid, nice) < 0) {
+    LOGF("subprogram_set_priority: Failed to renice group [%d] to %d: %s",
+         sp->pgid, nice, strerror(errno));
   }
 }
 
+static void subprogram_set_priority(struct subprogram *sp, bool focused) {
+  if (sp->focused != focused) {
+    subprogram_apply_priority(sp, focused);
+  }
+}
+
+static struct subprogram *subprogram_find(pid_t client_pid) {
+  pid_t pgid = getpgid(client_pid);
+  if (pgid < 0) {
+    return NULL;
+  }
+
+  for (int i = 0; i < SUBPROGRAM_MAX; i++) {
+    if (subprograms[i].running && subprograms[i].pgid == pgid) {
+      return &subprograms[i];
+    }
+  }
+  return NULL;
+}
+
+void subprogram_focus(pid_t client_pid) {
+  struct subprogram *focused = subprogram_find(client_pid);
+
+  /* Something we didn't start, leave everyone where they are. */
+  if (focused == NULL) {
+    return;
+  }
+
+  TracyCZoneN(ctx, "subprogram_focus", true);
+
+  for (int i = 0; i < SUBPROGRAM_MAX; i++) {
+    struct subprogram *sp = &subprograms[i];
+    if (sp->running) {
+      subprogram_set_priority(sp, sp == focused);
+    }
+  }
+
+  TracyCZoneEnd(ctx);
+}
+
 void subprogram_start(const char *command) {
   char log_filename[255] = {0};
   int log_fd = -1;
@@ -38,6 +197,16 @@ void subprogram_start(const char *command) {
     return;
   }
 
+  struct subprogram *sp = subprogram_slot();
+  if (sp != NULL && cgroup_root != NULL) {
+    snprintf(sp->cgroup, sizeof(sp->cgroup), "%s/app.%d", cgroup_root, exec_count);
+    if (mkdir(sp->cgroup, 0755) < 0 && errno != EEXIST) {
+      LOGF("start_program: Failed to create cgroup [%s]: %s",
+           sp->cgroup, strerror(errno));
+      sp->cgroup[0] = '\0';
+    }
+  }
+
   pid = fork();
   if (pid < 0) {
     LOGF("start_program: Failed to fork: %s", strerror(errno));
@@ -45,9 +214,37 @@ void subprogram_start(const char *command) {
   } else if (pid > 0) {
     LOGF("start_program: Forked to PID [%d]", pid);
     close(log_fd);
+
+    /* Also done by the child; whichever runs first wins the race. */
+    setpgid(pid, pid);
+
+    if (sp != NULL) {
+      sp->pgid = pid;
+      sp->last_ticks = 0;
+      sp->running = 1;
+      if (sp->cpu_plot[0] == '\0') {
+        int index = sp - subprograms;
+        snprintf(sp->cpu_plot, sizeof(sp->cpu_plot), "app %d cpu (%%)", index);
+        snprintf(sp->rss_plot, sizeof(sp->rss_plot), "app %d rss (MB)", index);
+      }
+
+      /* Everything starts in the background until its view gets focus. A
+       * reused cgroup directory keeps its old settings, so always write. */
+      subprogram_apply_priority(sp, false);
+    } else {
+      LOGF("start_program: More than %d children, PID [%d] isn't managed",
+           SUBPROGRAM_MAX, pid);
+    }
     return;
   }
 
+  setpgid(0, 0);
+  if (sp != NULL && sp->cgroup[0] != '\0') {
+    char self[16];
+    snprintf(self, sizeof(self), "%d", getpid());
+    cgroup_write(sp->cgroup, "cgroup.procs", self);
+  }
+
   close(fileno(stdin));
   dup2(log_fd, fileno(stderr));
   dup2(log_fd, fileno(stdout));
@@ -63,6 +260,186 @@ void subprogram_start(const char *command) {
   }
 }
 
+bool subprogram_name(pid_t pid, char *name, size_t size) {
+  char filename[64];
+
+  snprintf(filename, sizeof(filename), "/proc/%d/comm", pid);
+  FILE *file = fopen(filename, "r");
+  if (file == NULL) {
+    return false;
+  }
+  if (fgets(name, size, file) == NULL) {
+    name[0] = '\0';
+  }
+  fclose(file);
+
+  name[strcspn(name, "\n")] = '\0';
+  return name[0] != '\0';
+}
+
+bool subprogram_listed(pid_t pid, const char *list) {
+  char comm[64];
+  if (list == NULL || !subprogram_name(pid, comm, sizeof(comm))) {
+    return false;
+  }
+
+  size_t len = strlen(comm);
+  const char *entry = list;
+  while (*entry != '\0') {
+    size_t entry_len = strcspn(entry, ",");
+    if (entry_len == len && strncmp(entry, comm, len) == 0) {
+      return true;
+    }
+    entry += entry_len;
+    if (*entry == ',') {
+      entry++;
+    }
+  }
+  return false;
+}
+
+bool subprogram_freeze(pid_t client_pid, bool frozen) {
+  struct subprogram *sp = subprogram_find(client_pid);
+  if (sp == NULL) {
+    return false;
+  }
+
+  /* The cgroup freezer is invisible to the app; SIGSTOP is the fallback. */
+  if (sp->cgroup[0] != '\0' &&
+      cgroup_write(sp->cgroup, "cgroup.freeze", frozen ? "1" : "0")) {
+    return true;
+  }
+
+  if (kill(-sp->pgid, frozen ? SIGSTOP : SIGCONT) < 0) {
+    LOGF("subprogram_freeze: Failed to signal group [%d]: %s",
+         sp->pgid, strerror(errno));
+    return false;
+  }
+  return true;
+}
+
+#ifdef TRACY_ENABLE
+static struct wl_event_source *watch_timer = NULL;
+
+static int subprogram_sample(void *data) {
+  static long page_size = 0;
+  static long ticks_per_second = 0;
+
+  if (page_size == 0) {
+    page_size = sysconf(_SC_PAGESIZE);
+    ticks_per_second = sysconf(_SC_CLK_TCK);
+  }
+
+  unsigned long long ticks[SUBPROGRAM_MAX] = {0};
+  unsigned long long rss[SUBPROGRAM_MAX] = {0};
+
+  /* A group's children come and go, so add up everything in it. */
+  DIR *proc = opendir("/proc");
+  struct dirent *entry;
+  while (proc != NULL && (entry = readdir(proc)) != NULL) {
+    if (entry->d_name[0] < '0' || entry->d_name[0] > '9') {
+      continue;
+    }
+
+    char filename[64];
+    snprintf(filename, sizeof(filename), "/proc/%d/stat", atoi(entry->d_name));
+    FILE *stat = fopen(filename, "r");
+    if (stat == NULL) {
+      continue;
+    }
+
+    int pgid = 0;
+    unsigned long long utime = 0, stime = 0;
+    long pages = 0;
+    int fields = fscanf(stat,
+                        "%*d (%*[^)]) %*c %*d %d %*d %*d %*d %*u %*u %*u %*u %*u "
+                        "%llu %llu %*d %*d %*d %*d %*d %*d %*u %*u %ld",
+                        &pgid, &utime, &stime, &pages);
+    fclose(stat);
+    if (fields != 4) {
+      continue;
+    }
+
+    for (int i = 0; i < SUBPROGRAM_MAX; i++) {
+      if (subprograms[i].running && subprograms[i].pgid == pgid) {
+        ticks[i] += utime + stime;
+        rss[i] += pages * page_size;
+      }
+    }
+  }
+  if (proc != NULL) {
+    closedir(proc);
+  }
+
+  for (int i = 0; i < SUBPROGRAM_MAX; i++) {
+    struct subprogram *sp = &subprograms[i];
+    if (!sp->running) {
+      continue;
+    }
+
+    if (sp->last_ticks != 0 && ticks[i] >= sp->last_ticks) {
+      double seconds = (double) (ticks[i] - sp->last_ticks) / ticks_per_second;
+      TracyCPlot(sp->cpu_plot, seconds * 1000.0 / SUBPROGRAM_WATCH_MS * 100.0);
+    }
+    sp->last_ticks = ticks[i];
+    TracyCPlot(sp->rss_plot, rss[i] / (1024.0 * 1024.0));
+  }
+
+  wl_event_source_timer_update(watch_timer, SUBPROGRAM_WATCH_MS);
+  return 0;
+}
+#endif
+
+void subprogram_watch(struct wl_event_loop *loop) {
+#ifdef TRACY_ENABLE
+  watch_timer = wl_event_loop_add_timer(loop, subprogram_sample, NULL);
+  wl_event_source_timer_update(watch_timer, SUBPROGRAM_WATCH_MS);
+#endif
+}
+
 void subprogram_init(void) {
   signal(SIGCHLD, child_reaper);
+
+  /*
+   * Dropping a background app to nice 10 is always allowed, but bringing it
+   * back to 0 needs RLIMIT_NICE. Raise it while we're still root.
+   */
+  struct rlimit limit = {
+    .rlim_cur = 20 - SUBPROGRAM_FOCUS_NICE,
+    .rlim_max = 20 - SUBPROGRAM_FOCUS_NICE,
+  };
+  if (setrlimit(RLIMIT_NICE, &limit) < 0) {
+    LOGF("subprogram_init: Couldn't raise RLIMIT_NICE: %s", strerror(errno));
+  }
+
+  cgroup_root = getenv("V128_CGROUP");
+  if (cgroup_root != NULL) {
+    char shell[256];
+    char self[16];
+
+    /* Controllers can only be enabled once no process is left directly in
+     * the root, so this has to come first. */
+    snprintf(shell, sizeof(shell), "%s/shell", cgroup_root);
+    snprintf(self, sizeof(self), "%d", getpid());
+    if ((mkdir(shell, 0755) < 0 && errno != EEXIST) ||
+        !cgroup_write(shell, "cgroup.procs", self)) {
+      LOGF("subprogram_init: Couldn't move into [%s], not using cgroups", shell);
+      cgroup_root = NULL;
+    }
+  }
+  if (cgroup_root != NULL) {
+    char weight[16];
+
+    cgroup_write(cgroup_root, "cgroup.subtree_control", "+cpu");
+    cgroup_write(cgroup_root, "cgroup.subtree_control", "+memory");
+
+    /* Never let a focused app outweigh the compositor drawing it. */
+    snprintf(weight, sizeof(weight), "%d", SUBPROGRAM_FOCUS_WEIGHT);
+    cgroup_write(cgroup_root, "shell/cpu.weight", weight);
+    LOGF("subprogram_init: Placing children under [%s]", cgroup_root);
+  }
+
+  /* cpu.idle=1 gives background groups SCHED_IDLE treatment, for latency. */
+  const char *idle = getenv("V128_BACKGROUND_IDLE");
+  background_idle = idle != NULL && strcmp(idle, "1") == 0;
 }
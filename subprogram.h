@@ -1,7 +1,19 @@
 #ifndef SUBPROGRAM_H
 #define SUBPROGRAM_H
 
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+struct wl_event_loop;
+
 void subprogram_start(const char *command);
 void subprogram_init(void);
+void subprogram_watch(struct wl_event_loop *loop);
+void subprogram_focus(pid_t client_pid);
+bool subprogram_freeze(pid_t client_pid, bool frozen);
+bool subprogram_name(pid_t pid, char *name, size_t size);
+/* Whether the process name of pid is in a comma separated list. */
+bool subprogram_listed(pid_t pid, const char *list);
 
 #endif // SUBPROGRAM_H
@@ -4,18 +4,25 @@
 #include <wayland-server-core.h>
 #include <wlr/backend.h>
 #include <wlr/render/wlr_renderer.h>
+#include <wlr/types/wlr_box.h>
 #include <wlr/types/wlr_compositor.h>
+#include <wlr/types/wlr_cursor.h>
 #include <wlr/types/wlr_data_device.h>
+#include <wlr/types/wlr_export_dmabuf_v1.h>
 #include <wlr/types/wlr_input_device.h>
 #include <wlr/types/wlr_keyboard.h>
+#include <wlr/types/wlr_linux_dmabuf_v1.h>
 #include <wlr/types/wlr_matrix.h>
 #include <wlr/types/wlr_output.h>
+#include <wlr/types/wlr_output_damage.h>
 #include <wlr/types/wlr_output_layout.h>
 #include <wlr/types/wlr_pointer.h>
+#include <wlr/types/wlr_screencopy_v1.h>
 #include <wlr/types/wlr_seat.h>
 #include <wlr/types/wlr_xcursor_manager.h>
 #include <wlr/types/wlr_xdg_shell.h>
 #include <wlr/util/log.h>
+#include <wlr/util/region.h>
 
 #include <xkbcommon/xkbcommon.h>
 
@@ -31,11 +38,16 @@ struct tinywl_server {
   struct wlr_backend *backend;
   struct wlr_renderer *renderer;
 
+  struct wlr_compositor *compositor;
+  struct wl_listener new_surface;
+
   struct wlr_xdg_shell *xdg_shell;
   struct wl_listener new_xdg_surface;
   struct wl_list views;
 
+  struct wlr_cursor *cursor;
   struct wlr_xcursor_manager *cursor_mgr;
+  const char *cursor_image;
   struct wl_listener cursor_motion;
   struct wl_listener cursor_motion_absolute;
   struct wl_listener cursor_button;
@@ -54,15 +66,39 @@ struct tinywl_server {
   uint32_t resize_edges;
 
   struct wlr_output_layout *output_layout;
+  struct wl_listener output_layout_change;
   struct wl_list outputs;
   struct wl_listener new_output;
+  struct wlr_screencopy_manager_v1 *screencopy;
+  struct wlr_export_dmabuf_manager_v1 *export_dmabuf;
 };
 
+struct background;
+struct cpu_output;
+struct cpu_surface;
+
 struct tinywl_output {
   struct wl_list link;
   struct tinywl_server *server;
   struct wlr_output *wlr_output;
+  struct wlr_output_damage *damage;
+  struct background *background;
+  struct cpu_output *cpu;
+  double compose_ms;
+  uint64_t compose_updated_ns;
+  struct wlr_surface *scanout;
+  uint64_t scanout_commit_ns;
+  uint64_t present_commit_ns;
+  bool present_scanout;
   struct wl_listener frame;
+  struct wl_listener present;
+  struct wl_listener scanout_destroy;
+};
+
+/* The last configure scheduled for a toplevel, see configure.c */
+struct tinywl_configure {
+  uint32_t serial;
+  uint64_t sent_ns;
 };
 
 struct tinywl_view {
@@ -74,8 +110,30 @@ struct tinywl_view {
   struct wl_listener destroy;
   struct wl_listener request_move;
   struct wl_listener request_resize;
+  struct wl_listener ack_configure;
+  struct tinywl_configure configure;
   bool mapped;
   int x, y;
+
+  pid_t pid;
+  bool freezable;
+  bool frozen;
+  bool tearing;
+  uint64_t hidden_since_ns;
+  uint64_t frozen_since_ns;
+  uint64_t thaw_ns;
+};
+
+struct tinywl_surface {
+  struct tinywl_server *server;
+  struct wlr_surface *wlr_surface;
+  struct cpu_surface *cpu;
+  struct wl_event_source *fence;
+  struct wlr_client_buffer *ready;
+  int ready_width, ready_height;
+  uint64_t commit_ns;
+  struct wl_listener commit;
+  struct wl_listener destroy;
 };
 
 struct tinywl_keyboard {
@@ -19,6 +19,11 @@
 #define ZoneScopedC(x)
 #define ZoneScopedNC(x,y)
 
+#define ZoneNamedH(x,y)
+#define ZoneNamedNH(x,y,z)
+#define ZoneScopedH
+#define ZoneScopedNH(x)
+
 #define ZoneText(x,y)
 #define ZoneTextV(x,y,z)
 #define ZoneName(x,y)
@@ -52,6 +57,7 @@
 #define TracyMessageC(x,y,z)
 #define TracyMessageLC(x,y)
 #define TracyAppInfo(x,y)
+#define TracyFlightDump()
 
 #define TracyAlloc(x,y)
 #define TracyFree(x)
@@ -126,6 +132,11 @@
 #define ZoneScopedC( color ) ZoneNamedC( ___tracy_scoped_zone, color, true )
 #define ZoneScopedNC( name, color ) ZoneNamedNC( ___tracy_scoped_zone, name, color, true )
 
+#define ZoneNamedH( varname, active ) ZoneNamed( varname, active ) tracy::ScopedHwCounters TracyConcat(__tracy_hw_counters,__LINE__)( varname );
+#define ZoneNamedNH( varname, name, active ) ZoneNamedN( varname, name, active ) tracy::ScopedHwCounters TracyConcat(__tracy_hw_counters,__LINE__)( varname );
+#define ZoneScopedH ZoneNamedH( ___tracy_scoped_zone, true )
+#define ZoneScopedNH( name ) ZoneNamedNH( ___tracy_scoped_zone, name, true )
+
 #define ZoneText( txt, size ) ___tracy_scoped_zone.Text( txt, size );
 #define ZoneTextV( varname, txt, size ) varname.Text( txt, size );
 #define ZoneName( txt, size ) ___tracy_scoped_zone.Name( txt, size );
@@ -155,6 +166,7 @@
 #define TracyPlotConfig( name, type ) tracy::Profiler::ConfigurePlot( name, type );
 
 #define TracyAppInfo( txt, size ) tracy::Profiler::MessageAppInfo( txt, size );
+#define TracyFlightDump() tracy::Profiler::FlightDump();
 
 #if defined TRACY_HAS_CALLSTACK && defined TRACY_CALLSTACK
 #  define TracyMessage( txt, size ) tracy::Profiler::Message( txt, size, TRACY_CALLSTACK );
@@ -52,6 +52,7 @@ typedef const void* TracyCZoneCtx;
 #define TracyCMessageC(x,y,z)
 #define TracyCMessageLC(x,y)
 #define TracyCAppInfo(x,y)
+#define TracyCFlightDump()
 
 #define TracyCZoneS(x,y,z)
 #define TracyCZoneNS(x,y,z,w)
@@ -192,9 +193,11 @@ TRACY_API void ___tracy_emit_frame_image( const void* image, uint16_t w, uint16_
 
 TRACY_API void ___tracy_emit_plot( const char* name, double val );
 TRACY_API void ___tracy_emit_message_appinfo( const char* txt, size_t size );
+TRACY_API void ___tracy_flight_dump( void );
 
 #define TracyCPlot( name, val ) ___tracy_emit_plot( name, val );
 #define TracyCAppInfo( txt, color ) ___tracy_emit_message_appinfo( txt, color );
+#define TracyCFlightDump() ___tracy_flight_dump();
 
 
 #ifdef TRACY_HAS_CALLSTACK
@@ -22,9 +22,13 @@
 #include "common/tracy_lz4.cpp"
 #include "client/TracyProfiler.cpp"
 #include "client/TracyCallstack.cpp"
+#include "client/TracySymbolCache.cpp"
 #include "client/TracySysTime.cpp"
+#include "client/TracyHwCounters.cpp"
+#include "client/TracyMemSampler.cpp"
 #include "client/TracySysTrace.cpp"
 #include "common/TracySocket.cpp"
+#include "common/TracyShm.cpp"
 #include "client/tracy_rpmalloc.cpp"
 #include "client/TracyDxt1.cpp"
 
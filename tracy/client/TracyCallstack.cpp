@@ -25,6 +25,9 @@
 #  include "../libbacktrace/backtrace.hpp"
 #  include <dlfcn.h>
 #  include <cxxabi.h>
+#  ifdef TRACY_HAS_FRAME_POINTER_UNWIND
+#    include <pthread.h>
+#  endif
 #elif TRACY_HAS_CALLSTACK == 5
 #  include <dlfcn.h>
 #  include <cxxabi.h>
@@ -450,6 +453,58 @@ void InitCallstack()
     cb_bts = backtrace_create_state( nullptr, 0, nullptr, nullptr );
 }
 
+#ifdef TRACY_HAS_FRAME_POINTER_UNWIND
+// End of the current thread's stack, 1 if it is not known.
+static thread_local uintptr_t s_stackTop = 0;
+
+static tracy_no_inline uintptr_t GetStackTop()
+{
+    uintptr_t top = 1;
+    pthread_attr_t attr;
+    if( pthread_getattr_np( pthread_self(), &attr ) == 0 )
+    {
+        void* addr;
+        size_t size;
+        if( pthread_attr_getstack( &attr, &addr, &size ) == 0 ) top = (uintptr_t)addr + size;
+        pthread_attr_destroy( &attr );
+    }
+    s_stackTop = top;
+    return top;
+}
+
+// Follows the chain of frame records, which start with the caller's frame
+// pointer and the return address. Only records between this frame and the
+// top of the stack are read, each one above the previous, so a frame built
+// without a frame pointer ends the walk instead of faulting. The first
+// entry is the return address into the caller, as with backtrace().
+TRACY_API tracy_no_inline size_t FramePointerTrace( uintptr_t* trace, int depth )
+{
+    auto top = s_stackTop;
+    if( top == 0 ) top = GetStackTop();
+    if( top == 1 )
+    {
+        void* tmp[64];
+        const auto num = backtrace( tmp, depth < 63 ? depth + 1 : 64 );
+        if( num <= 1 ) return 0;
+        memcpy( trace, tmp+1, ( num - 1 ) * sizeof( uintptr_t ) );
+        return size_t( num - 1 );
+    }
+
+    auto fp = (const uintptr_t*)__builtin_frame_address( 0 );
+    size_t num = 0;
+    while( num < (size_t)depth )
+    {
+        const auto ret = fp[1];
+        if( ret == 0 ) break;
+        trace[num++] = ret;
+        const auto next = (const uintptr_t*)fp[0];
+        if( next <= fp || (uintptr_t)( next + 2 ) > top || ( (uintptr_t)next & ( sizeof( uintptr_t ) - 1 ) ) != 0 ) break;
+        fp = next;
+    }
+    return num;
+}
+#endif
+
 static int FastCallstackDataCb( void* data, uintptr_t pc, uintptr_t lowaddr, const char* fn, int lineno, const char* function )
 {
     if( function )
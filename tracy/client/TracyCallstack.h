@@ -25,4 +25,8 @@
 #  define TRACY_HAS_CALLSTACK 6
 #endif
 
+#if TRACY_HAS_CALLSTACK == 3 && defined TRACY_FRAME_POINTER_UNWIND && ( defined __x86_64__ || defined __aarch64__ )
+#  define TRACY_HAS_FRAME_POINTER_UNWIND
+#endif
+
 #endif
@@ -96,12 +96,20 @@ static tracy_force_inline void* Callstack( int depth )
 
 #elif TRACY_HAS_CALLSTACK == 3 || TRACY_HAS_CALLSTACK == 4 || TRACY_HAS_CALLSTACK == 6
 
+#ifdef TRACY_HAS_FRAME_POINTER_UNWIND
+TRACY_API size_t FramePointerTrace( uintptr_t* trace, int depth );
+#endif
+
 static tracy_force_inline void* Callstack( int depth )
 {
     assert( depth >= 1 );
 
     auto trace = (uintptr_t*)tracy_malloc( ( 1 + (size_t)depth ) * sizeof( uintptr_t ) );
+#ifdef TRACY_HAS_FRAME_POINTER_UNWIND
+    const auto num = FramePointerTrace( trace+1, depth );
+#else
     const auto num = (size_t)backtrace( (void**)(trace+1), depth );
+#endif
     *trace = num;
 
     return trace;
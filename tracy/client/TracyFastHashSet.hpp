@@ -0,0 +1,126 @@
+#ifndef __TRACYFASTHASHSET_HPP__
+#define __TRACYFASTHASHSET_HPP__
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "../common/TracyAlloc.hpp"
+#include "../common/TracyForceInline.hpp"
+
+namespace tracy
+{
+
+// Open addressing set of non-zero 64-bit keys. Memory is only allocated
+// on the first insert.
+class FastHashSet
+{
+public:
+    FastHashSet()
+        : m_keys( nullptr )
+        , m_mask( 0 )
+        , m_size( 0 )
+    {
+    }
+
+    FastHashSet( const FastHashSet& ) = delete;
+    FastHashSet( FastHashSet&& ) = delete;
+
+    ~FastHashSet()
+    {
+        if( m_keys ) tracy_free( m_keys );
+    }
+
+    FastHashSet& operator=( const FastHashSet& ) = delete;
+    FastHashSet& operator=( FastHashSet&& ) = delete;
+
+    size_t size() const { return m_size; }
+
+    // Returns true if the key was not in the set yet.
+    tracy_force_inline bool insert( uint64_t key )
+    {
+        assert( key != 0 );
+        if( ( m_size + 1 ) * 2 > m_mask + 1 ) Grow();
+        auto idx = Hash( key ) & m_mask;
+        while( m_keys[idx] != 0 )
+        {
+            if( m_keys[idx] == key ) return false;
+            idx = ( idx + 1 ) & m_mask;
+        }
+        m_keys[idx] = key;
+        m_size++;
+        return true;
+    }
+
+    // Returns true if the key was in the set.
+    tracy_force_inline bool erase( uint64_t key )
+    {
+        assert( key != 0 );
+        if( m_size == 0 ) return false;
+        auto idx = Hash( key ) & m_mask;
+        while( m_keys[idx] != key )
+        {
+            if( m_keys[idx] == 0 ) return false;
+            idx = ( idx + 1 ) & m_mask;
+        }
+        // Keys following the removed one are shifted back, if their probe
+        // sequence passes through the hole, so that no tombstones are needed.
+        auto next = ( idx + 1 ) & m_mask;
+        while( m_keys[next] != 0 )
+        {
+            const auto home = Hash( m_keys[next] ) & m_mask;
+            if( ( ( next - home ) & m_mask ) >= ( ( next - idx ) & m_mask ) )
+            {
+                m_keys[idx] = m_keys[next];
+                idx = next;
+            }
+            next = ( next + 1 ) & m_mask;
+        }
+        m_keys[idx] = 0;
+        m_size--;
+        return true;
+    }
+
+    void clear()
+    {
+        if( m_keys ) memset( m_keys, 0, sizeof( uint64_t ) * ( m_mask + 1 ) );
+        m_size = 0;
+    }
+
+private:
+    static tracy_force_inline size_t Hash( uint64_t key )
+    {
+        key ^= key >> 33;
+        key *= 0xff51afd7ed558ccdull;
+        key ^= key >> 33;
+        return size_t( key );
+    }
+
+    tracy_no_inline void Grow()
+    {
+        const auto oldKeys = m_keys;
+        const auto oldCap = oldKeys ? m_mask + 1 : 0;
+        const auto cap = oldCap == 0 ? size_t( 1024 ) : oldCap * 2;
+        m_keys = (uint64_t*)tracy_malloc( sizeof( uint64_t ) * cap );
+        memset( m_keys, 0, sizeof( uint64_t ) * cap );
+        m_mask = cap - 1;
+        for( size_t i=0; i<oldCap; i++ )
+        {
+            const auto key = oldKeys[i];
+            if( key == 0 ) continue;
+            auto idx = Hash( key ) & m_mask;
+            while( m_keys[idx] != 0 ) idx = ( idx + 1 ) & m_mask;
+            m_keys[idx] = key;
+        }
+        if( oldKeys ) tracy_free( oldKeys );
+    }
+
+    uint64_t* m_keys;
+    size_t m_mask;
+    size_t m_size;
+};
+
+}
+
+#endif
@@ -73,6 +73,12 @@ public:
         m_write++;
     }
 
+    void pop_back()
+    {
+        assert( !empty() );
+        m_write--;
+    }
+
     void clear()
     {
         m_write = m_ptr;
@@ -0,0 +1,561 @@
+#ifndef __TRACYFLIGHTRECORDER_HPP__
+#define __TRACYFLIGHTRECORDER_HPP__
+
+#include <assert.h>
+#include <new>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "../common/TracyAlign.hpp"
+#include "../common/TracyAlloc.hpp"
+#include "../common/TracyForceInline.hpp"
+#include "../common/TracyQueue.hpp"
+#include "TracyFastVector.hpp"
+
+namespace tracy
+{
+
+// Raw stream blocks, as they would be written to a capture file.
+struct FlightBuffer
+{
+    char* ptr;
+    size_t size;
+    size_t capacity;
+
+    void Append( const void* data, size_t len )
+    {
+        if( size + len > capacity )
+        {
+            capacity = capacity * 2 > size + len ? capacity * 2 : size + len;
+            ptr = (char*)tracy_realloc( ptr, capacity );
+        }
+        memcpy( ptr + size, data, len );
+        size += len;
+    }
+
+    void Release()
+    {
+        if( ptr ) tracy_free( ptr );
+        ptr = nullptr;
+        size = capacity = 0;
+    }
+};
+
+// Event chunks, oldest first. The last chunk is open for writing. Time
+// references restart at each chunk and the prologue reopens the zones, frames
+// and locks left open by the chunks before, so a dump can begin at any chunk.
+class FlightRing
+{
+public:
+    struct Chunk
+    {
+        uint64_t seq;
+        int64_t time;
+        uint64_t frames;
+        int64_t frameTime;
+        FlightBuffer prologue;
+        FlightBuffer data;
+    };
+
+    FlightRing()
+        : m_chunks( nullptr )
+        , m_mask( 0 )
+        , m_head( 0 )
+        , m_count( 0 )
+        , m_seq( 0 )
+    {
+    }
+
+    FlightRing( const FlightRing& ) = delete;
+    FlightRing( FlightRing&& ) = delete;
+
+    ~FlightRing()
+    {
+        while( m_count != 0 ) PopFront();
+        if( m_chunks ) tracy_free( m_chunks );
+    }
+
+    FlightRing& operator=( const FlightRing& ) = delete;
+    FlightRing& operator=( FlightRing&& ) = delete;
+
+    size_t size() const { return m_count; }
+    Chunk& operator[]( size_t idx ) { return m_chunks[( m_head + idx ) & m_mask]; }
+    Chunk& front() { assert( m_count != 0 ); return m_chunks[m_head]; }
+    Chunk& back() { assert( m_count != 0 ); return m_chunks[( m_head + m_count - 1 ) & m_mask]; }
+
+    // May move the chunks in memory.
+    Chunk& Push( int64_t time, uint64_t frames, int64_t frameTime )
+    {
+        if( !m_chunks || m_count == m_mask + 1 ) Grow();
+        auto& chunk = m_chunks[( m_head + m_count ) & m_mask];
+        memset( &chunk, 0, sizeof( chunk ) );
+        chunk.seq = m_seq++;
+        chunk.time = time;
+        chunk.frames = frames;
+        chunk.frameTime = frameTime;
+        m_count++;
+        return chunk;
+    }
+
+    // Drops the oldest chunks until the rest fits in maxSize bytes and no
+    // chunk has ended before minTime. The open chunk is always kept.
+    void Trim( size_t maxSize, int64_t minTime )
+    {
+        size_t total = 0;
+        for( size_t i=0; i<m_count; i++ )
+        {
+            auto& chunk = (*this)[i];
+            total += chunk.prologue.size + chunk.data.size;
+        }
+        while( m_count > 1 && ( total > maxSize || (*this)[1].time <= minTime ) )
+        {
+            auto& chunk = front();
+            total -= chunk.prologue.size + chunk.data.size;
+            PopFront();
+        }
+    }
+
+private:
+    void PopFront()
+    {
+        auto& chunk = front();
+        chunk.prologue.Release();
+        chunk.data.Release();
+        m_head = ( m_head + 1 ) & m_mask;
+        m_count--;
+    }
+
+    tracy_no_inline void Grow()
+    {
+        const size_t cap = m_chunks ? ( m_mask + 1 ) * 2 : 16;
+        auto chunks = (Chunk*)tracy_malloc( sizeof( Chunk ) * cap );
+        for( size_t i=0; i<m_count; i++ ) chunks[i] = (*this)[i];
+        if( m_chunks ) tracy_free( m_chunks );
+        m_chunks = chunks;
+        m_mask = cap - 1;
+        m_head = 0;
+    }
+
+    Chunk* m_chunks;
+    size_t m_mask;
+    size_t m_head;
+    size_t m_count;
+    uint64_t m_seq;
+};
+
+// State of the flight recorder, kept by the profiler thread. Besides the ring
+// it follows what is open at the end of the last chunk, and keeps the items
+// that announce locks, GPU contexts and such for as long as they may be
+// referred to by the kept chunks.
+struct FlightRecorder
+{
+    struct Zone
+    {
+        int64_t time;
+        uint64_t srcloc;    // SourceLocationData*, or own copy of the payload
+        uint32_t id;
+        bool alloc;
+    };
+
+    struct ThreadData
+    {
+        ThreadData( uint64_t thread ) : thread( thread ), validation( 0 ), pending( false ), zones( 16 ) {}
+
+        uint64_t thread;
+        uint32_t validation;
+        // The last item waits for the next one, for example a callstack for its zone.
+        bool pending;
+        FastVector<Zone> zones;
+    };
+
+    struct Frame
+    {
+        uint64_t name;
+        int64_t time;
+    };
+
+    struct Lock
+    {
+        uint64_t thread;
+        int64_t waitTime;
+        int64_t obtainTime;     // 0 while waiting
+        uint32_t id;
+        bool shared;
+    };
+
+    struct State
+    {
+        uint64_t seq;
+        QueueItem item;
+    };
+
+    // Lock events may still be in the thread queues when the terminate is
+    // sent, so a terminated lock is remembered with the last chunk its events
+    // were written to, until the queues have been drained once.
+    struct Terminated
+    {
+        uint32_t id;
+        uint64_t seq;
+        bool settled;
+    };
+
+    FlightRecorder()
+        : out( nullptr )
+        , threads( 16 )
+        , thread( nullptr )
+        , frames( 16 )
+        , locks( 64 )
+        , state( 64 )
+        , terminated( 16 )
+        , frameCount( 0 )
+        , frameTime( 0 )
+        , crashed( false )
+    {
+        memset( &answers, 0, sizeof( answers ) );
+    }
+
+    FlightRecorder( const FlightRecorder& ) = delete;
+    FlightRecorder( FlightRecorder&& ) = delete;
+
+    ~FlightRecorder()
+    {
+        for( auto& t : threads )
+        {
+            for( auto& zone : t->zones ) if( zone.alloc ) tracy_free( (void*)zone.srcloc );
+            t->~ThreadData();
+            tracy_free( t );
+        }
+        for( auto& v : state )
+        {
+            const auto ptr = StateString( v.item );
+            if( ptr ) tracy_free( (void*)MemRead<uint64_t>( ptr ) );
+        }
+        answers.Release();
+    }
+
+    FlightRecorder& operator=( const FlightRecorder& ) = delete;
+    FlightRecorder& operator=( FlightRecorder&& ) = delete;
+
+    void SetThread( uint64_t id )
+    {
+        if( thread && thread->thread == id ) return;
+        for( auto& t : threads )
+        {
+            if( t->thread == id )
+            {
+                thread = t;
+                return;
+            }
+        }
+        thread = (ThreadData*)tracy_malloc( sizeof( ThreadData ) );
+        new(thread) ThreadData( id );
+        *threads.push_next() = thread;
+    }
+
+    // Forgets the threads that have exited and left nothing open.
+    template<typename Active>
+    void PruneThreads( const Active& active )
+    {
+        for( size_t i=threads.size(); i>0; i-- )
+        {
+            auto t = threads[i-1];
+            if( !t->zones.empty() || t->validation != 0 || t->pending || active( t->thread ) ) continue;
+            if( thread == t ) thread = nullptr;
+            t->~ThreadData();
+            tracy_free( t );
+            Erase( threads, i-1 );
+        }
+    }
+
+    // Drops the terminated locks that were last used before the chunk with the
+    // given sequence number, the kept chunks can no longer refer to them.
+    void PruneState( uint64_t seq )
+    {
+        FastVector<uint32_t> dead( 16 );
+        for( size_t i=terminated.size(); i>0; i-- )
+        {
+            if( !terminated[i-1].settled || terminated[i-1].seq >= seq ) continue;
+            *dead.push_next() = terminated[i-1].id;
+            Erase( terminated, i-1 );
+        }
+        if( dead.empty() ) return;
+
+        size_t kept = 0;
+        for( size_t i=0; i<state.size(); i++ )
+        {
+            auto& v = state[i];
+            bool drop = false;
+            switch( (QueueType)MemRead<uint8_t>( &v.item.hdr.idx ) )
+            {
+            case QueueType::LockAnnounce:
+            case QueueType::LockTerminate:
+            case QueueType::LockName:
+            {
+                // The lock id comes first in all three.
+                const auto id = MemRead<uint32_t>( &v.item.lockAnnounce.id );
+                for( auto& d : dead ) if( d == id ) drop = true;
+                break;
+            }
+            default:
+                break;
+            }
+            if( drop )
+            {
+                const auto ptr = StateString( v.item );
+                if( ptr ) tracy_free( (void*)MemRead<uint64_t>( ptr ) );
+            }
+            else
+            {
+                if( kept != i ) memcpy( &state[kept], &v, sizeof( State ) );
+                kept++;
+            }
+        }
+        while( state.size() > kept ) state.pop_back();
+    }
+
+    // All queues were empty, no more events will come for the terminated locks.
+    void Settle()
+    {
+        for( size_t i=terminated.size(); i>0 && !terminated[i-1].settled; i-- ) terminated[i-1].settled = true;
+    }
+
+    bool IsPending() const
+    {
+        for( auto& t : threads ) if( t->pending ) return true;
+        return false;
+    }
+
+    // Items from the queue of the current thread, before the times are made relative.
+    void Track( const QueueItem* item )
+    {
+        const auto type = (QueueType)MemRead<uint8_t>( &item->hdr.idx );
+        switch( type )
+        {
+        case QueueType::ZoneValidation:
+            thread->validation = MemRead<uint32_t>( &item->zoneValidation.id );
+            thread->pending = true;
+            return;
+        case QueueType::Callstack:
+        case QueueType::CallstackAlloc:
+            thread->pending = true;
+            return;
+        case QueueType::ZoneBegin:
+        case QueueType::ZoneBeginCallstack:
+            *thread->zones.push_next() = Zone { MemRead<int64_t>( &item->zoneBegin.time ), MemRead<uint64_t>( &item->zoneBegin.srcloc ), thread->validation, false };
+            thread->validation = 0;
+            break;
+        case QueueType::ZoneBeginAllocSrcLoc:
+        case QueueType::ZoneBeginAllocSrcLocCallstack:
+        {
+            // The payload is freed once sent.
+            auto payload = (const char*)MemRead<uint64_t>( &item->zoneBegin.srcloc );
+            uint16_t len;
+            memcpy( &len, payload, sizeof( len ) );
+            auto copy = (char*)tracy_malloc( len );
+            memcpy( copy, payload, len );
+            *thread->zones.push_next() = Zone { MemRead<int64_t>( &item->zoneBegin.time ), (uint64_t)copy, thread->validation, true };
+            thread->validation = 0;
+            break;
+        }
+        case QueueType::ZoneEnd:
+            if( !thread->zones.empty() )
+            {
+                auto& zone = thread->zones.back();
+                if( zone.alloc ) tracy_free( (void*)zone.srcloc );
+                thread->zones.pop_back();
+            }
+            thread->validation = 0;
+            break;
+        case QueueType::FrameMarkMsg:
+            if( MemRead<uint64_t>( &item->frameMark.name ) == 0 )
+            {
+                frameCount++;
+                frameTime = MemRead<int64_t>( &item->frameMark.time );
+            }
+            break;
+        case QueueType::Crash:
+            crashed = true;
+            break;
+        default:
+            KeepState( item );
+            break;
+        }
+        thread->pending = false;
+    }
+
+    void TrackSerial( const QueueItem* item )
+    {
+        const auto type = (QueueType)MemRead<uint8_t>( &item->hdr.idx );
+        switch( type )
+        {
+        case QueueType::FrameMarkMsgStart:
+            *frames.push_next() = Frame { MemRead<uint64_t>( &item->frameMark.name ), MemRead<int64_t>( &item->frameMark.time ) };
+            break;
+        case QueueType::FrameMarkMsgEnd:
+        {
+            const auto name = MemRead<uint64_t>( &item->frameMark.name );
+            for( size_t i=frames.size(); i>0; i-- )
+            {
+                if( frames[i-1].name == name )
+                {
+                    Erase( frames, i-1 );
+                    break;
+                }
+            }
+            break;
+        }
+        case QueueType::LockTerminate:
+        {
+            const auto id = MemRead<uint32_t>( &item->lockTerminate.id );
+            for( size_t i=locks.size(); i>0; i-- )
+            {
+                if( locks[i-1].id == id ) Erase( locks, i-1 );
+            }
+            *terminated.push_next() = Terminated { id, ring.back().seq, false };
+            KeepState( item );
+            break;
+        }
+        default:
+            KeepState( item );
+            break;
+        }
+    }
+
+    // Lock events in the order they are sent, with absolute times.
+    void TrackLock( const QueueItem* item, int64_t time )
+    {
+        const auto type = (QueueType)MemRead<uint8_t>( &item->hdr.idx );
+        // The mark has the lock id at the same place.
+        const auto id = MemRead<uint32_t>( &item->lockWait.id );
+        for( size_t i=terminated.size(); i>0; i-- )
+        {
+            if( terminated[i-1].id == id )
+            {
+                terminated[i-1].seq = ring.back().seq;
+                break;
+            }
+        }
+        if( type == QueueType::LockMark ) return;
+        const auto tid = MemRead<uint64_t>( &item->lockWait.thread );
+        const bool shared = type == QueueType::LockSharedWait || type == QueueType::LockSharedObtain || type == QueueType::LockSharedRelease;
+        switch( type )
+        {
+        case QueueType::LockWait:
+        case QueueType::LockSharedWait:
+            *locks.push_next() = Lock { tid, time, 0, id, shared };
+            break;
+        case QueueType::LockObtain:
+        case QueueType::LockSharedObtain:
+            for( size_t i=locks.size(); i>0; i-- )
+            {
+                auto& lock = locks[i-1];
+                if( lock.id == id && lock.thread == tid && lock.shared == shared && lock.obtainTime == 0 )
+                {
+                    lock.obtainTime = time;
+                    return;
+                }
+            }
+            *locks.push_next() = Lock { tid, time, time, id, shared };
+            break;
+        case QueueType::LockRelease:
+        case QueueType::LockSharedRelease:
+            for( size_t i=locks.size(); i>0; i-- )
+            {
+                auto& lock = locks[i-1];
+                if( lock.id == id && lock.thread == tid && lock.shared == shared && lock.obtainTime != 0 )
+                {
+                    Erase( locks, i-1 );
+                    break;
+                }
+            }
+            break;
+        default:
+            break;
+        }
+    }
+
+    // Returns the string pointer field of items that own a string.
+    static const char* StateString( const QueueItem& item )
+    {
+        switch( (QueueType)MemRead<uint8_t>( &item.hdr.idx ) )
+        {
+        case QueueType::MessageAppInfo: return (const char*)&item.messageFat.text;
+        case QueueType::LockName: return (const char*)&item.lockNameFat.name;
+        case QueueType::GpuContextName: return (const char*)&item.gpuContextNameFat.ptr;
+        default: return nullptr;
+        }
+    }
+
+    // Items the server needs before any event that refers to them. The same
+    // items are deferred in on-demand mode.
+    void KeepState( const QueueItem* item )
+    {
+        switch( (QueueType)MemRead<uint8_t>( &item->hdr.idx ) )
+        {
+        case QueueType::MessageAppInfo:
+        case QueueType::LockAnnounce:
+        case QueueType::LockTerminate:
+        case QueueType::LockName:
+        case QueueType::GpuNewContext:
+        case QueueType::GpuContextName:
+        case QueueType::PlotConfig:
+        case QueueType::ParamSetup:
+        case QueueType::CpuTopology:
+            break;
+        default:
+            return;
+        }
+        auto dst = state.push_next();
+        dst->seq = ring.back().seq;
+        // Records in the thread queues are only as long as their type needs.
+        memcpy( &dst->item, item, QueuePackedSize( (QueueType)MemRead<uint8_t>( &item->hdr.idx ) ) );
+        // The string is freed after it is sent.
+        auto ptr = (char*)StateString( dst->item );
+        if( ptr )
+        {
+            uint16_t size;
+            switch( (QueueType)MemRead<uint8_t>( &item->hdr.idx ) )
+            {
+            case QueueType::MessageAppInfo: size = MemRead<uint16_t>( &item->messageFat.size ); break;
+            case QueueType::LockName: size = MemRead<uint16_t>( &item->lockNameFat.size ); break;
+            default: size = MemRead<uint16_t>( &item->gpuContextNameFat.size ); break;
+            }
+            auto copy = (char*)tracy_malloc( size );
+            memcpy( copy, (const char*)MemRead<uint64_t>( ptr ), size );
+            MemWrite( ptr, (uint64_t)copy );
+        }
+    }
+
+    FlightRing ring;
+    FlightBuffer answers;
+    FlightBuffer* out;
+
+    FastVector<ThreadData*> threads;
+    ThreadData* thread;
+    FastVector<Frame> frames;
+    FastVector<Lock> locks;
+    FastVector<State> state;
+    FastVector<Terminated> terminated;
+    uint64_t frameCount;
+    int64_t frameTime;
+    bool crashed;
+
+    const char* path;
+    size_t sizeLimit;
+    size_t chunkSize;
+    int64_t timeLimit;
+    int64_t chunkTime;
+
+private:
+    template<typename T>
+    static void Erase( FastVector<T>& vec, size_t idx )
+    {
+        memmove( vec.data() + idx, vec.data() + idx + 1, ( vec.size() - idx - 1 ) * sizeof( T ) );
+        vec.pop_back();
+    }
+};
+
+}
+
+#endif
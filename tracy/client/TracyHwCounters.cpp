@@ -0,0 +1,169 @@
+#include "TracyHwCounters.hpp"
+
+#ifdef TRACY_HAS_HW_COUNTERS
+
+#include <atomic>
+#include <string.h>
+#include <unistd.h>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#include "../common/TracyForceInline.hpp"
+
+#if defined __i386 || defined _M_IX86 || defined __x86_64__ || defined _M_X64
+#  define TRACY_HW_COUNTERS_RDPMC
+#endif
+
+namespace tracy
+{
+
+enum { HwCounterNum = 4 };
+
+static const uint64_t HwCounterConfig[HwCounterNum] = {
+    PERF_COUNT_HW_CPU_CYCLES,
+    PERF_COUNT_HW_INSTRUCTIONS,
+    PERF_COUNT_HW_CACHE_MISSES,
+    PERF_COUNT_HW_BRANCH_MISSES
+};
+
+// The counters of a thread are opened as one group, so that they are
+// always scheduled on the PMU together. Each event page is mapped, which
+// allows reading the counters with rdpmc, without entering the kernel.
+struct HwCountersThread
+{
+    HwCountersThread()
+        : initialized( false )
+        , available( false )
+    {
+        for( int i=0; i<HwCounterNum; i++ )
+        {
+            fd[i] = -1;
+            page[i] = nullptr;
+        }
+    }
+
+    ~HwCountersThread()
+    {
+        for( int i=HwCounterNum-1; i>=0; i-- )
+        {
+            if( page[i] ) munmap( (void*)page[i], getpagesize() );
+            if( fd[i] != -1 ) close( fd[i] );
+        }
+    }
+
+    bool Init();
+    bool Read( HwCounterValues& values );
+
+    int fd[HwCounterNum];
+    volatile perf_event_mmap_page* page[HwCounterNum];
+    bool initialized;
+    bool available;
+};
+
+static thread_local HwCountersThread s_hwCounters;
+
+static int PerfEventOpen( perf_event_attr* attr, pid_t pid, int cpu, int group_fd, unsigned long flags )
+{
+    return syscall( __NR_perf_event_open, attr, pid, cpu, group_fd, flags );
+}
+
+bool HwCountersThread::Init()
+{
+    initialized = true;
+
+    perf_event_attr pe = {};
+    pe.type = PERF_TYPE_HARDWARE;
+    pe.size = sizeof( perf_event_attr );
+    pe.read_format = PERF_FORMAT_GROUP;
+    pe.exclude_kernel = 1;
+    pe.exclude_hv = 1;
+
+    for( int i=0; i<HwCounterNum; i++ )
+    {
+        pe.config = HwCounterConfig[i];
+        pe.disabled = i == 0;
+        fd[i] = PerfEventOpen( &pe, 0, -1, i == 0 ? -1 : fd[0], PERF_FLAG_FD_CLOEXEC );
+        if( fd[i] == -1 ) return false;
+#ifdef TRACY_HW_COUNTERS_RDPMC
+        auto ptr = mmap( nullptr, getpagesize(), PROT_READ, MAP_SHARED, fd[i], 0 );
+        if( ptr != MAP_FAILED ) page[i] = (perf_event_mmap_page*)ptr;
+#endif
+    }
+    if( ioctl( fd[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP ) == -1 ) return false;
+
+    available = true;
+    return true;
+}
+
+#ifdef TRACY_HW_COUNTERS_RDPMC
+static tracy_force_inline bool ReadCounterUser( volatile perf_event_mmap_page* pc, uint64_t& value )
+{
+    // Sequence lock protocol described in linux/perf_event.h. The counter
+    // index is only valid while the event is scheduled on this CPU.
+    uint32_t seq;
+    do
+    {
+        seq = pc->lock;
+        std::atomic_signal_fence( std::memory_order_seq_cst );
+        const uint32_t idx = pc->index;
+        if( !pc->cap_user_rdpmc || idx == 0 ) return false;
+        uint32_t lo, hi;
+        asm volatile( "rdpmc" : "=a" (lo), "=d" (hi) : "c" (idx - 1) );
+        const auto width = pc->pmc_width;
+        auto pmc = int64_t( ( uint64_t( hi ) << 32 ) | lo );
+        pmc = int64_t( uint64_t( pmc ) << ( 64 - width ) ) >> ( 64 - width );
+        value = uint64_t( pc->offset + pmc );
+        std::atomic_signal_fence( std::memory_order_seq_cst );
+    }
+    while( pc->lock != seq );
+    return true;
+}
+#endif
+
+bool HwCountersThread::Read( HwCounterValues& values )
+{
+    uint64_t v[HwCounterNum];
+#ifdef TRACY_HW_COUNTERS_RDPMC
+    bool user = true;
+    for( int i=0; i<HwCounterNum && user; i++ )
+    {
+        user = page[i] && ReadCounterUser( page[i], v[i] );
+    }
+    if( !user )
+#endif
+    {
+        uint64_t buf[1 + HwCounterNum];
+        if( read( fd[0], buf, sizeof( buf ) ) != sizeof( buf ) || buf[0] != HwCounterNum ) return false;
+        memcpy( v, buf+1, sizeof( v ) );
+    }
+    values.cycles = v[0];
+    values.instructions = v[1];
+    values.cacheMisses = v[2];
+    values.branchMisses = v[3];
+    return true;
+}
+
+TRACY_API bool ReadHwCounters( HwCounterValues& values )
+{
+    auto& hw = s_hwCounters;
+    if( !hw.initialized && !hw.Init() ) return false;
+    return hw.available && hw.Read( values );
+}
+
+}
+
+#else
+
+namespace tracy
+{
+
+TRACY_API bool ReadHwCounters( HwCounterValues& )
+{
+    return false;
+}
+
+}
+
+#endif
@@ -0,0 +1,29 @@
+#ifndef __TRACYHWCOUNTERS_HPP__
+#define __TRACYHWCOUNTERS_HPP__
+
+#include <stdint.h>
+
+#include "../common/TracyApi.h"
+
+#if defined __linux__ && !defined __ANDROID__ && !defined TRACY_NO_HW_COUNTERS
+#  define TRACY_HAS_HW_COUNTERS
+#endif
+
+namespace tracy
+{
+
+struct HwCounterValues
+{
+    uint64_t cycles;
+    uint64_t instructions;
+    uint64_t cacheMisses;
+    uint64_t branchMisses;
+};
+
+// Reads the calling thread's hardware counters, which are opened on the
+// first call. Returns false if they are not available on this system.
+TRACY_API bool ReadHwCounters( HwCounterValues& values );
+
+}
+
+#endif
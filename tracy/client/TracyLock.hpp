@@ -65,23 +65,21 @@ public:
         if( !queue ) return false;
 #endif
 
-        auto item = Profiler::QueueSerial();
-        MemWrite( &item->hdr.type, QueueType::LockWait );
+        TracyLfqPrepare( QueueType::LockWait );
         MemWrite( &item->lockWait.thread, GetThreadHandle() );
         MemWrite( &item->lockWait.id, m_id );
         MemWrite( &item->lockWait.time, Profiler::GetTime() );
-        Profiler::QueueSerialFinish();
+        TracyLfqCommit;
         return true;
     }
 
     tracy_force_inline void AfterLock()
     {
-        auto item = Profiler::QueueSerial();
-        MemWrite( &item->hdr.type, QueueType::LockObtain );
+        TracyLfqPrepare( QueueType::LockObtain );
         MemWrite( &item->lockObtain.thread, GetThreadHandle() );
         MemWrite( &item->lockObtain.id, m_id );
         MemWrite( &item->lockObtain.time, Profiler::GetTime() );
-        Profiler::QueueSerialFinish();
+        TracyLfqCommit;
     }
 
     tracy_force_inline void AfterUnlock()
@@ -96,12 +94,11 @@ public:
         }
 #endif
 
-        auto item = Profiler::QueueSerial();
-        MemWrite( &item->hdr.type, QueueType::LockRelease );
+        TracyLfqPrepare( QueueType::LockRelease );
         MemWrite( &item->lockRelease.thread, GetThreadHandle() );
         MemWrite( &item->lockRelease.id, m_id );
         MemWrite( &item->lockRelease.time, Profiler::GetTime() );
-        Profiler::QueueSerialFinish();
+        TracyLfqCommit;
     }
 
     tracy_force_inline void AfterTryLock( bool acquired )
@@ -123,12 +120,11 @@ public:
 
         if( acquired )
         {
-            auto item = Profiler::QueueSerial();
-            MemWrite( &item->hdr.type, QueueType::LockObtain );
+            TracyLfqPrepare( QueueType::LockObtain );
             MemWrite( &item->lockObtain.thread, GetThreadHandle() );
             MemWrite( &item->lockObtain.id, m_id );
             MemWrite( &item->lockObtain.time, Profiler::GetTime() );
-            Profiler::QueueSerialFinish();
+            TracyLfqCommit;
         }
     }
 
@@ -145,12 +141,11 @@ public:
         }
 #endif
 
-        auto item = Profiler::QueueSerial();
-        MemWrite( &item->hdr.type, QueueType::LockMark );
+        TracyLfqPrepare( QueueType::LockMark );
         MemWrite( &item->lockMark.thread, GetThreadHandle() );
         MemWrite( &item->lockMark.id, m_id );
         MemWrite( &item->lockMark.srcloc, (uint64_t)srcloc );
-        Profiler::QueueSerialFinish();
+        TracyLfqCommit;
     }
 
     tracy_force_inline void CustomName( const char* name, size_t size )
@@ -280,23 +275,21 @@ public:
         if( !queue ) return false;
 #endif
 
-        auto item = Profiler::QueueSerial();
-        MemWrite( &item->hdr.type, QueueType::LockWait );
+        TracyLfqPrepare( QueueType::LockWait );
         MemWrite( &item->lockWait.thread, GetThreadHandle() );
         MemWrite( &item->lockWait.id, m_id );
         MemWrite( &item->lockWait.time, Profiler::GetTime() );
-        Profiler::QueueSerialFinish();
+        TracyLfqCommit;
         return true;
     }
 
     tracy_force_inline void AfterLock()
     {
-        auto item = Profiler::QueueSerial();
-        MemWrite( &item->hdr.type, QueueType::LockObtain );
+        TracyLfqPrepare( QueueType::LockObtain );
         MemWrite( &item->lockObtain.thread, GetThreadHandle() );
         MemWrite( &item->lockObtain.id, m_id );
         MemWrite( &item->lockObtain.time, Profiler::GetTime() );
-        Profiler::QueueSerialFinish();
+        TracyLfqCommit;
     }
 
     tracy_force_inline void AfterUnlock()
@@ -311,12 +304,11 @@ public:
         }
 #endif
 
-        auto item = Profiler::QueueSerial();
-        MemWrite( &item->hdr.type, QueueType::LockRelease );
+        TracyLfqPrepare( QueueType::LockRelease );
         MemWrite( &item->lockRelease.thread, GetThreadHandle() );
         MemWrite( &item->lockRelease.id, m_id );
         MemWrite( &item->lockRelease.time, Profiler::GetTime() );
-        Profiler::QueueSerialFinish();
+        TracyLfqCommit;
     }
 
     tracy_force_inline void AfterTryLock( bool acquired )
@@ -338,12 +330,11 @@ public:
 
         if( acquired )
         {
-            auto item = Profiler::QueueSerial();
-            MemWrite( &item->hdr.type, QueueType::LockObtain );
+            TracyLfqPrepare( QueueType::LockObtain );
             MemWrite( &item->lockObtain.thread, GetThreadHandle() );
             MemWrite( &item->lockObtain.id, m_id );
             MemWrite( &item->lockObtain.time, Profiler::GetTime() );
-            Profiler::QueueSerialFinish();
+            TracyLfqCommit;
         }
     }
 
@@ -362,23 +353,21 @@ public:
         if( !queue ) return false;
 #endif
 
-        auto item = Profiler::QueueSerial();
-        MemWrite( &item->hdr.type, QueueType::LockSharedWait );
+        TracyLfqPrepare( QueueType::LockSharedWait );
         MemWrite( &item->lockWait.thread, GetThreadHandle() );
         MemWrite( &item->lockWait.id, m_id );
         MemWrite( &item->lockWait.time, Profiler::GetTime() );
-        Profiler::QueueSerialFinish();
+        TracyLfqCommit;
         return true;
     }
 
     tracy_force_inline void AfterLockShared()
     {
-        auto item = Profiler::QueueSerial();
-        MemWrite( &item->hdr.type, QueueType::LockSharedObtain );
+        TracyLfqPrepare( QueueType::LockSharedObtain );
         MemWrite( &item->lockObtain.thread, GetThreadHandle() );
         MemWrite( &item->lockObtain.id, m_id );
         MemWrite( &item->lockObtain.time, Profiler::GetTime() );
-        Profiler::QueueSerialFinish();
+        TracyLfqCommit;
     }
 
     tracy_force_inline void AfterUnlockShared()
@@ -393,12 +382,11 @@ public:
         }
 #endif
 
-        auto item = Profiler::QueueSerial();
-        MemWrite( &item->hdr.type, QueueType::LockSharedRelease );
+        TracyLfqPrepare( QueueType::LockSharedRelease );
         MemWrite( &item->lockRelease.thread, GetThreadHandle() );
         MemWrite( &item->lockRelease.id, m_id );
         MemWrite( &item->lockRelease.time, Profiler::GetTime() );
-        Profiler::QueueSerialFinish();
+        TracyLfqCommit;
     }
 
     tracy_force_inline void AfterTryLockShared( bool acquired )
@@ -420,12 +408,11 @@ public:
 
         if( acquired )
         {
-            auto item = Profiler::QueueSerial();
-            MemWrite( &item->hdr.type, QueueType::LockSharedObtain );
+            TracyLfqPrepare( QueueType::LockSharedObtain );
             MemWrite( &item->lockObtain.thread, GetThreadHandle() );
             MemWrite( &item->lockObtain.id, m_id );
             MemWrite( &item->lockObtain.time, Profiler::GetTime() );
-            Profiler::QueueSerialFinish();
+            TracyLfqCommit;
         }
     }
 
@@ -442,12 +429,11 @@ public:
         }
 #endif
 
-        auto item = Profiler::QueueSerial();
-        MemWrite( &item->hdr.type, QueueType::LockMark );
+        TracyLfqPrepare( QueueType::LockMark );
         MemWrite( &item->lockMark.thread, GetThreadHandle() );
         MemWrite( &item->lockMark.id, m_id );
         MemWrite( &item->lockMark.srcloc, (uint64_t)srcloc );
-        Profiler::QueueSerialFinish();
+        TracyLfqCommit;
     }
 
     tracy_force_inline void CustomName( const char* name, size_t size )
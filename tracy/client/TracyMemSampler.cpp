@@ -0,0 +1,110 @@
+#ifdef TRACY_MEMORY_SAMPLING
+
+#include <atomic>
+#include <chrono>
+#include <math.h>
+#include <stdint.h>
+
+#include "TracyFastHashSet.hpp"
+#include "TracyMemSampler.hpp"
+#include "TracyProfiler.hpp"
+#include "../common/TracyMutex.hpp"
+
+namespace tracy
+{
+
+// Sample points are placed in the stream of allocated bytes of a thread as
+// a Poisson process, so an allocation is sampled with probability
+// 1 - exp( -size / TRACY_MEMORY_SAMPLING ). The server scales the sizes of
+// sampled allocations back using this probability.
+struct MemSamplerThread
+{
+    int64_t countdown;      // bytes until the next sample point
+    uint64_t rng;           // 0 until the first allocation of the thread
+};
+
+static thread_local MemSamplerThread s_memSampler;
+
+// Sampled pointers that were not freed yet. Frees are much more frequent
+// than sampled allocations, and may happen on any thread, so each pointer
+// also increments a counter in a small lock-free filter. Frees whose
+// counter is zero are rejected without taking the lock.
+enum { MemSampleFilterSize = 64*1024 };
+
+static std::atomic<uint16_t> s_memSampleFilter[MemSampleFilterSize];
+static TracyMutex s_memSampleLock;
+static FastHashSet* s_memSampled = nullptr;
+
+static tracy_force_inline size_t MemSampleFilterIdx( uint64_t ptr )
+{
+    return size_t( ( ( ptr >> 4 ) * 0x9E3779B97F4A7C15ull ) >> 48 );
+}
+
+static int64_t MemSampleInterval( MemSamplerThread& t )
+{
+    // xorshift64*
+    t.rng ^= t.rng >> 12;
+    t.rng ^= t.rng << 25;
+    t.rng ^= t.rng >> 27;
+    const auto r = t.rng * 0x2545F4914F6CDD1Dull;
+    const auto u = double( ( r >> 11 ) + 1 ) * ( 1.0 / 9007199254740992.0 );
+    return int64_t( -log( u ) * double( TRACY_MEMORY_SAMPLING ) ) + 1;
+}
+
+static tracy_no_inline bool MemSampleAllocSlow( const void* ptr, size_t size )
+{
+    auto& t = s_memSampler;
+    if( t.rng == 0 )
+    {
+        const auto seed = uint64_t( std::chrono::high_resolution_clock::now().time_since_epoch().count() ) ^ uint64_t( (uintptr_t)&t );
+        t.rng = seed | 1;
+        t.countdown = MemSampleInterval( t ) - int64_t( size );
+        if( t.countdown > 0 ) return false;
+    }
+    // A large allocation may span several sample points. It is still
+    // recorded only once.
+    do
+    {
+        t.countdown += MemSampleInterval( t );
+    }
+    while( t.countdown <= 0 );
+
+    if( !ptr ) return false;
+
+    InitRPMallocThread();
+    s_memSampleLock.lock();
+    if( !s_memSampled )
+    {
+        s_memSampled = (FastHashSet*)tracy_malloc( sizeof( FastHashSet ) );
+        new(s_memSampled) FastHashSet();
+    }
+    const auto inserted = s_memSampled->insert( (uint64_t)ptr );
+    if( inserted ) s_memSampleFilter[MemSampleFilterIdx( (uint64_t)ptr )].fetch_add( 1, std::memory_order_relaxed );
+    s_memSampleLock.unlock();
+    return inserted;
+}
+
+TRACY_API bool MemSampleAlloc( const void* ptr, size_t size )
+{
+    auto& t = s_memSampler;
+    t.countdown -= int64_t( size );
+    if( t.countdown > 0 ) return false;
+    return MemSampleAllocSlow( ptr, size );
+}
+
+TRACY_API bool MemSampleFree( const void* ptr )
+{
+    if( !ptr ) return false;
+    auto& cnt = s_memSampleFilter[MemSampleFilterIdx( (uint64_t)ptr )];
+    if( cnt.load( std::memory_order_relaxed ) == 0 ) return false;
+
+    s_memSampleLock.lock();
+    const auto erased = s_memSampled && s_memSampled->erase( (uint64_t)ptr );
+    if( erased ) cnt.fetch_sub( 1, std::memory_order_relaxed );
+    s_memSampleLock.unlock();
+    return erased;
+}
+
+}
+
+#endif
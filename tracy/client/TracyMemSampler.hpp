@@ -0,0 +1,19 @@
+#ifndef __TRACYMEMSAMPLER_HPP__
+#define __TRACYMEMSAMPLER_HPP__
+
+#include <stddef.h>
+
+#include "../common/TracyApi.h"
+
+namespace tracy
+{
+
+// Allocation sampling, enabled by defining TRACY_MEMORY_SAMPLING to the mean
+// number of bytes allocated between samples. Returns true if the event
+// should be sent.
+TRACY_API bool MemSampleAlloc( const void* ptr, size_t size );
+TRACY_API bool MemSampleFree( const void* ptr );
+
+}
+
+#endif
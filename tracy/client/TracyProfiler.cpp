@@ -62,12 +62,15 @@
 #include <thread>
 
 #include "../common/TracyAlign.hpp"
+#include "../common/TracyShm.hpp"
 #include "../common/TracySocket.hpp"
 #include "../common/TracySystem.hpp"
 #include "../common/tracy_lz4.hpp"
 #include "tracy_rpmalloc.hpp"
 #include "TracyCallstack.hpp"
 #include "TracyDxt1.hpp"
+#include "TracyFlightRecorder.hpp"
+#include "TracySymbolCache.hpp"
 #include "TracyScoped.hpp"
 #include "TracyProfiler.hpp"
 #include "TracyThread.hpp"
@@ -711,6 +714,7 @@ LONG WINAPI CrashFilter( PEXCEPTION_POINTERS pExp )
 
 #ifdef __linux__
 static long s_profilerTid = 0;
+static long s_symbolTid = 0;
 static char s_crashText[1024];
 static std::atomic<bool> s_alreadyCrashed( false );
 
@@ -719,6 +723,11 @@ static void ThreadFreezer( int /*signal*/ )
     for(;;) sleep( 1000 );
 }
 
+static void FlightDumpSignal( int /*signal*/ )
+{
+    Profiler::FlightDump();
+}
+
 static inline void HexPrint( char*& ptr, uint64_t val )
 {
     if( val == 0 )
@@ -915,7 +924,7 @@ static void CrashHandler( int signal, siginfo_t* info, void* /*ucontext*/ )
     {
         if( ep->d_name[0] == '.' ) continue;
         int tid = atoi( ep->d_name );
-        if( tid != selfTid && tid != s_profilerTid )
+        if( tid != selfTid && tid != s_profilerTid && tid != s_symbolTid )
         {
             syscall( SYS_tkill, tid, SIGPWR );
         }
@@ -936,11 +945,15 @@ static void CrashHandler( int signal, siginfo_t* info, void* /*ucontext*/ )
 #endif
 
 
-enum { QueuePrealloc = 256 * 1024 };
+enum { QueuePrealloc = 256 * 1024 * QueueItemSize };
+enum { LockDequeueBatch = 16 * 1024 };
 
 static Profiler* s_instance = nullptr;
 static Thread* s_thread;
 static Thread* s_compressThread;
+#ifdef TRACY_HAS_CALLSTACK
+static Thread* s_symbolThread;
+#endif
 
 #ifdef TRACY_HAS_SYSTEM_TRACING
 static Thread* s_sysTraceThread = nullptr;
@@ -1139,6 +1152,7 @@ Profiler::Profiler()
     , m_shutdownManual( false )
     , m_shutdownFinished( false )
     , m_sock( nullptr )
+    , m_shm( nullptr )
     , m_broadcast( nullptr )
     , m_noExit( false )
     , m_userPort( 0 )
@@ -1151,14 +1165,28 @@ Profiler::Profiler()
     , m_lz4Buf( (char*)tracy_malloc( LZ4Size + sizeof( lz4sz_t ) ) )
     , m_serialQueue( 1024*1024 )
     , m_serialDequeue( 1024*1024 )
+    , m_lockDequeue( LockDequeueBatch )
+    , m_lockFlush( false )
     , m_fiQueue( 16 )
     , m_fiDequeue( 16 )
+    , m_symbolCache( nullptr )
+    , m_symbolQueue( 64 )
+    , m_symbolDequeue( 64 )
+    , m_symbolAnswers( 64 )
+    , m_symbolAnswersDequeue( 64 )
+    , m_symbolEpoch( 0 )
+    , m_symbolShutdown( false )
     , m_frameCount( 0 )
     , m_isConnected( false )
 #ifdef TRACY_ON_DEMAND
     , m_connectionId( 0 )
     , m_deferredQueue( 64*1024 )
 #endif
+    , m_captureFile( nullptr )
+    , m_captureLocal( false )
+    , m_captureQueries( 64 )
+    , m_flight( nullptr )
+    , m_flightDump( false )
     , m_paramCallback( nullptr )
     , m_queryData( nullptr )
 {
@@ -1205,6 +1233,11 @@ void Profiler::SpawnWorkerThreads()
     s_compressThread = (Thread*)tracy_malloc( sizeof( Thread ) );
     new(s_compressThread) Thread( LaunchCompressWorker, this );
 
+#ifdef TRACY_HAS_CALLSTACK
+    s_symbolThread = (Thread*)tracy_malloc( sizeof( Thread ) );
+    new(s_symbolThread) Thread( LaunchSymbolWorker, this );
+#endif
+
 #ifdef TRACY_HAS_SYSTEM_TRACING
     if( SysTraceStart( m_samplingPeriod ) )
     {
@@ -1237,6 +1270,8 @@ void Profiler::SpawnWorkerThreads()
 
 #ifdef TRACY_HAS_CALLSTACK
     InitCallstack();
+    m_symbolCache = (SymbolCache*)tracy_malloc( sizeof( SymbolCache ) );
+    new(m_symbolCache) SymbolCache();
 #endif
 
     m_timeBegin.store( GetTime(), std::memory_order_relaxed );
@@ -1260,10 +1295,21 @@ Profiler::~Profiler()
     s_thread->~Thread();
     tracy_free( s_thread );
 
+#ifdef TRACY_HAS_CALLSTACK
+    // Runs until the profiler thread is done, as it may wait for answers.
+    m_symbolShutdown.store( true, std::memory_order_relaxed );
+    s_symbolThread->~Thread();
+    tracy_free( s_symbolThread );
+    m_symbolCache->~SymbolCache();
+    tracy_free( m_symbolCache );
+#endif
+
     tracy_free( m_lz4Buf );
     tracy_free( m_buffer );
     LZ4_freeStream( (LZ4_stream_t*)m_stream );
 
+    CloseShmTransport();
+
     if( m_sock )
     {
         m_sock->~Socket();
@@ -1386,6 +1432,11 @@ void Profiler::Worker()
     MemWrite( &welcome.exectime, m_exectime );
     MemWrite( &welcome.pid, pid );
     MemWrite( &welcome.samplingPeriod, m_samplingPeriod );
+#ifdef TRACY_MEMORY_SAMPLING
+    MemWrite( &welcome.memSamplingInterval, uint64_t( TRACY_MEMORY_SAMPLING ) );
+#else
+    MemWrite( &welcome.memSamplingInterval, uint64_t( 0 ) );
+#endif
     MemWrite( &welcome.onDemand, onDemand );
     MemWrite( &welcome.isApple, isApple );
     MemWrite( &welcome.cpuArch, cpuArch );
@@ -1399,6 +1450,25 @@ void Profiler::Worker()
 
     moodycamel::ConsumerToken token( GetQueue() );
 
+    // Without a server the trace is written straight to a file, which can be
+    // converted to a regular trace with the update utility.
+    const char* captureFile = getenv( "TRACY_CAPTURE_FILE" );
+    if( captureFile && CaptureToFile( captureFile, welcome, token ) )
+    {
+        m_shutdownFinished.store( true, std::memory_order_relaxed );
+        return;
+    }
+
+    // The flight recorder keeps the most recent events in memory and writes
+    // them to a file of the same format on request.
+    const char* flightFile = getenv( "TRACY_FLIGHT_RECORDER" );
+    if( flightFile )
+    {
+        FlightRecord( flightFile, welcome, token );
+        m_shutdownFinished.store( true, std::memory_order_relaxed );
+        return;
+    }
+
     ListenSocket listen;
     bool isListening = false;
     if( !dataPortSearch )
@@ -1500,6 +1570,7 @@ void Profiler::Worker()
         }
 
         // Handshake
+        TransportType transport = TransportSocket;
         {
             char shibboleth[HandshakeShibbolethSize];
             auto res = m_sock->ReadRaw( shibboleth, HandshakeShibbolethSize, 2000 );
@@ -1530,6 +1601,15 @@ void Profiler::Worker()
                 m_sock = nullptr;
                 continue;
             }
+
+            res = m_sock->ReadRaw( &transport, sizeof( transport ), 2000 );
+            if( !res )
+            {
+                m_sock->~Socket();
+                tracy_free( m_sock );
+                m_sock = nullptr;
+                continue;
+            }
         }
 
 #ifdef TRACY_ON_DEMAND
@@ -1541,9 +1621,11 @@ void Profiler::Worker()
 
         HandshakeStatus handshake = HandshakeWelcome;
         m_sock->Send( &handshake, sizeof( handshake ) );
+        if( transport == TransportShm ) SetupShmTransport();
 
         LZ4_resetStream( (LZ4_stream_t*)m_stream );
         m_sock->Send( &welcome, sizeof( welcome ) );
+        m_symbolEpoch++;
 
         m_threadCtx = 0;
         m_refTimeSerial = 0;
@@ -1557,30 +1639,7 @@ void Profiler::Worker()
 
         m_sock->Send( &onDemand, sizeof( onDemand ) );
 
-        m_deferredLock.lock();
-        for( auto& item : m_deferredQueue )
-        {
-            uint64_t ptr;
-            uint16_t size;
-            const auto idx = MemRead<uint8_t>( &item.hdr.idx );
-            switch( (QueueType)idx )
-            {
-            case QueueType::MessageAppInfo:
-                ptr = MemRead<uint64_t>( &item.messageFat.text );
-                size = MemRead<uint16_t>( &item.messageFat.size );
-                SendSingleString( (const char*)ptr, size );
-                break;
-            case QueueType::LockName:
-                ptr = MemRead<uint64_t>( &item.lockNameFat.name );
-                size = MemRead<uint16_t>( &item.lockNameFat.size );
-                SendSingleString( (const char*)ptr, size );
-                break;
-            default:
-                break;
-            }
-            AppendData( &item, QueueDataSize[idx] );
-        }
-        m_deferredLock.unlock();
+        SendDeferredQueue();
 #endif
 
         // Main communications loop
@@ -1627,6 +1686,7 @@ void Profiler::Worker()
                 connActive = HandleServerQuery();
             }
             if( !connActive ) break;
+            SendSymbolAnswers();
         }
         if( ShouldExit() ) break;
 
@@ -1636,6 +1696,7 @@ void Profiler::Worker()
         m_bufferStart = 0;
 #endif
 
+        CloseShmTransport();
         m_sock->~Socket();
         tracy_free( m_sock );
         m_sock = nullptr;
@@ -1709,6 +1770,7 @@ void Profiler::Worker()
                 return;
             }
         }
+        SendSymbolAnswers();
     }
 
     // Send client termination notice to the server
@@ -1722,6 +1784,7 @@ void Profiler::Worker()
     // Handle remaining server queries
     for(;;)
     {
+        SendSymbolAnswers();
         if( m_sock->HasData() )
         {
             while( m_sock->HasData() )
@@ -1751,6 +1814,504 @@ void Profiler::Worker()
     }
 }
 
+#ifdef TRACY_ON_DEMAND
+void Profiler::SendDeferredQueue()
+{
+    m_deferredLock.lock();
+    for( auto& item : m_deferredQueue )
+    {
+        uint64_t ptr;
+        uint16_t size;
+        const auto idx = MemRead<uint8_t>( &item.hdr.idx );
+        switch( (QueueType)idx )
+        {
+        case QueueType::MessageAppInfo:
+            ptr = MemRead<uint64_t>( &item.messageFat.text );
+            size = MemRead<uint16_t>( &item.messageFat.size );
+            SendSingleString( (const char*)ptr, size );
+            break;
+        case QueueType::LockName:
+            ptr = MemRead<uint64_t>( &item.lockNameFat.name );
+            size = MemRead<uint16_t>( &item.lockNameFat.size );
+            SendSingleString( (const char*)ptr, size );
+            break;
+        default:
+            break;
+        }
+        AppendData( &item, QueueDataSize[idx] );
+        if( m_captureLocal ) CaptureItemQueries( &item );
+        if( m_flight ) m_flight->KeepState( &item );
+    }
+    m_deferredLock.unlock();
+}
+#endif
+
+bool Profiler::CaptureToFile( const char* path, const WelcomeMessage& welcome, moodycamel::ConsumerToken& token )
+{
+    m_captureFile = fopen( path, "wb" );
+    if( !m_captureFile ) return false;
+
+    const uint32_t protocolVersion = ProtocolVersion;
+    fwrite( RawStreamMagic, 1, RawStreamMagicSize, m_captureFile );
+    fwrite( &protocolVersion, 1, sizeof( protocolVersion ), m_captureFile );
+    fwrite( &welcome, 1, sizeof( welcome ), m_captureFile );
+
+#ifdef TRACY_ON_DEMAND
+    OnDemandPayloadMessage onDemand;
+    onDemand.currentTime = GetTime();
+    ClearQueues( token );
+    m_connectionId.fetch_add( 1, std::memory_order_release );
+    onDemand.frames = m_frameCount.load( std::memory_order_relaxed );
+    fwrite( &onDemand, 1, sizeof( onDemand ), m_captureFile );
+#endif
+    m_isConnected.store( true, std::memory_order_release );
+    m_captureLocal = true;
+
+    memset( &m_captureBlock, 0, sizeof( m_captureBlock ) );
+    LZ4_resetStream( (LZ4_stream_t*)m_stream );
+    m_threadCtx = 0;
+    m_refTimeSerial = 0;
+    m_refTimeCtx = 0;
+    m_refTimeGpu = 0;
+
+#ifdef TRACY_ON_DEMAND
+    SendDeferredQueue();
+#endif
+
+    // Events are written until the application exits. A write error ends the
+    // capture, but the events still have to be taken off the queues.
+    bool ok = true;
+    for(;;)
+    {
+        ProcessSysTime();
+        const auto status = Dequeue( token );
+        const auto serialStatus = DequeueSerial();
+        if( status == DequeueStatus::ConnectionLost || serialStatus == DequeueStatus::ConnectionLost || !AnswerCaptureQueries() )
+        {
+            ok = false;
+            break;
+        }
+        if( status == DequeueStatus::QueueEmpty && serialStatus == DequeueStatus::QueueEmpty )
+        {
+            if( ShouldExit() ) break;
+            if( m_bufferOffset != m_bufferStart && !CommitData() )
+            {
+                ok = false;
+                break;
+            }
+            std::this_thread::sleep_for( std::chrono::milliseconds( 10 ) );
+        }
+    }
+
+    if( ok )
+    {
+        if( m_bufferOffset != m_bufferStart ) CommitData();
+        QueueItem terminate;
+        MemWrite( &terminate.hdr.type, QueueType::Terminate );
+        SendData( (const char*)&terminate, 1 );
+    }
+    fclose( m_captureFile );
+    m_captureFile = nullptr;
+    m_captureLocal = false;
+    m_isConnected.store( false, std::memory_order_release );
+
+    while( !ShouldExit() )
+    {
+        ClearQueues( token );
+        std::this_thread::sleep_for( std::chrono::milliseconds( 10 ) );
+    }
+    return true;
+}
+
+void Profiler::CaptureItemQueries( const QueueItem* item )
+{
+    switch( (QueueType)MemRead<uint8_t>( &item->hdr.idx ) )
+    {
+    case QueueType::ZoneBegin:
+    case QueueType::ZoneBeginCallstack:
+        CaptureQuery( ServerQuerySourceLocation, MemRead<uint64_t>( &item->zoneBegin.srcloc ) );
+        break;
+    case QueueType::LockWait:
+    case QueueType::LockObtain:
+    case QueueType::LockRelease:
+    case QueueType::LockSharedWait:
+    case QueueType::LockSharedObtain:
+    case QueueType::LockSharedRelease:
+        CaptureQuery( ServerQueryThreadString, MemRead<uint64_t>( &item->lockWait.thread ) );
+        break;
+    case QueueType::LockMark:
+        CaptureQuery( ServerQueryThreadString, MemRead<uint64_t>( &item->lockMark.thread ) );
+        CaptureQuery( ServerQuerySourceLocation, MemRead<uint64_t>( &item->lockMark.srcloc ) );
+        break;
+    case QueueType::LockAnnounce:
+        CaptureQuery( ServerQuerySourceLocation, MemRead<uint64_t>( &item->lockAnnounce.lckloc ) );
+        break;
+    case QueueType::GpuZoneBegin:
+    case QueueType::GpuZoneBeginCallstack:
+    case QueueType::GpuZoneBeginSerial:
+    case QueueType::GpuZoneBeginCallstackSerial:
+        CaptureQuery( ServerQuerySourceLocation, MemRead<uint64_t>( &item->gpuZoneBegin.srcloc ) );
+        CaptureQuery( ServerQueryThreadString, MemRead<uint64_t>( &item->gpuZoneBegin.thread ) );
+        break;
+    case QueueType::GpuZoneBeginAllocSrcLoc:
+    case QueueType::GpuZoneBeginAllocSrcLocCallstack:
+    case QueueType::GpuZoneBeginAllocSrcLocSerial:
+    case QueueType::GpuZoneBeginAllocSrcLocCallstackSerial:
+        CaptureQuery( ServerQueryThreadString, MemRead<uint64_t>( &item->gpuZoneBegin.thread ) );
+        break;
+    case QueueType::GpuZoneEnd:
+    case QueueType::GpuZoneEndSerial:
+        CaptureQuery( ServerQueryThreadString, MemRead<uint64_t>( &item->gpuZoneEnd.thread ) );
+        break;
+    case QueueType::GpuNewContext:
+        CaptureQuery( ServerQueryThreadString, MemRead<uint64_t>( &item->gpuNewContext.thread ) );
+        break;
+    case QueueType::MemAlloc:
+    case QueueType::MemAllocNamed:
+    case QueueType::MemAllocCallstack:
+    case QueueType::MemAllocCallstackNamed:
+        CaptureQuery( ServerQueryThreadString, MemRead<uint64_t>( &item->memAlloc.thread ) );
+        break;
+    case QueueType::MemFree:
+    case QueueType::MemFreeNamed:
+    case QueueType::MemFreeCallstack:
+    case QueueType::MemFreeCallstackNamed:
+        CaptureQuery( ServerQueryThreadString, MemRead<uint64_t>( &item->memFree.thread ) );
+        break;
+    case QueueType::MemNamePayload:
+        CaptureQuery( ServerQueryString, MemRead<uint64_t>( &item->memName.name ) );
+        break;
+    case QueueType::CallstackSample:
+        CaptureQuery( ServerQueryThreadString, MemRead<uint64_t>( &item->callstackSample.thread ) );
+        break;
+#ifdef TRACY_HAS_SYSTEM_TRACING
+    case QueueType::ContextSwitch:
+        CaptureQuery( ServerQueryExternalName, MemRead<uint64_t>( &item->contextSwitch.newThread ) );
+        break;
+#endif
+    case QueueType::PlotData:
+        CaptureQuery( ServerQueryPlotName, MemRead<uint64_t>( &item->plotData.name ) );
+        break;
+    case QueueType::PlotConfig:
+        CaptureQuery( ServerQueryPlotName, MemRead<uint64_t>( &item->plotConfig.name ) );
+        break;
+    case QueueType::FrameMarkMsg:
+    case QueueType::FrameMarkMsgStart:
+    case QueueType::FrameMarkMsgEnd:
+        CaptureQuery( ServerQueryFrameName, MemRead<uint64_t>( &item->frameMark.name ) );
+        break;
+    case QueueType::MessageLiteral:
+    case QueueType::MessageLiteralCallstack:
+        CaptureQuery( ServerQueryString, MemRead<uint64_t>( &item->messageLiteral.text ) );
+        break;
+    case QueueType::MessageLiteralColor:
+    case QueueType::MessageLiteralColorCallstack:
+        CaptureQuery( ServerQueryString, MemRead<uint64_t>( &item->messageColorLiteral.text ) );
+        break;
+    case QueueType::CrashReport:
+        CaptureQuery( ServerQueryString, MemRead<uint64_t>( &item->crashReport.text ) );
+        break;
+    case QueueType::ParamSetup:
+        CaptureQuery( ServerQueryString, MemRead<uint64_t>( &item->paramSetup.name ) );
+        break;
+    default:
+        break;
+    }
+}
+
+bool Profiler::AnswerCaptureQueries()
+{
+    if( m_captureQueries.empty() ) return true;
+    // The records that caused the queries go first.
+    if( m_bufferOffset != m_bufferStart && !CommitData() ) return false;
+
+    m_captureBlock.type = RawStreamAnswer;
+    // Answers may add queries of their own, which are handled in the same pass.
+    for( size_t i=0; i<m_captureQueries.size(); i++ )
+    {
+        const auto query = m_captureQueries[i];
+        if( query.type == ServerQuerySourceLocation )
+        {
+            auto srcloc = (const SourceLocationData*)query.ptr;
+            CaptureQuery( ServerQueryString, (uint64_t)srcloc->name );
+            CaptureQuery( ServerQueryString, (uint64_t)srcloc->function );
+            CaptureQuery( ServerQueryString, (uint64_t)srcloc->file );
+        }
+        m_captureBlock.query = query.type;
+        m_captureBlock.ptr = query.ptr;
+        ProcessServerQuery( query.type, query.ptr, 0 );
+        if( m_bufferOffset != m_bufferStart && !CommitData() )
+        {
+            m_captureBlock.type = RawStreamData;
+            m_captureQueries.clear();
+            return false;
+        }
+    }
+    m_captureBlock.type = RawStreamData;
+    m_captureQueries.clear();
+    return true;
+}
+
+void Profiler::FlightRecord( const char* path, const WelcomeMessage& welcome, moodycamel::ConsumerToken& token )
+{
+    m_flight = (FlightRecorder*)tracy_malloc( sizeof( FlightRecorder ) );
+    new(m_flight) FlightRecorder();
+    m_flight->path = path;
+
+    // Chunks are dropped whole, the window is kept within a sixteenth of the limits.
+    const char* sizeEnv = getenv( "TRACY_FLIGHT_RECORDER_SIZE" );
+    const int sizeMb = sizeEnv ? atoi( sizeEnv ) : 0;
+    m_flight->sizeLimit = size_t( sizeMb > 0 ? sizeMb : 64 ) * 1024 * 1024;
+    m_flight->chunkSize = m_flight->sizeLimit / 16;
+    const char* timeEnv = getenv( "TRACY_FLIGHT_RECORDER_SECONDS" );
+    const int seconds = timeEnv ? atoi( timeEnv ) : 0;
+    m_flight->timeLimit = seconds > 0 ? int64_t( seconds * 1000000000. / m_timerMul ) : 0;
+    m_flight->chunkTime = m_flight->timeLimit / 16;
+
+#ifdef TRACY_ON_DEMAND
+    m_flight->frameTime = GetTime();
+    ClearQueues( token );
+    m_connectionId.fetch_add( 1, std::memory_order_release );
+    m_flight->frameCount = m_frameCount.load( std::memory_order_relaxed );
+#else
+    m_flight->frameTime = welcome.initEnd;
+#endif
+    m_isConnected.store( true, std::memory_order_release );
+    m_captureLocal = true;
+
+    memset( &m_captureBlock, 0, sizeof( m_captureBlock ) );
+    m_flight->out = &m_flight->ring.Push( GetTime(), m_flight->frameCount, m_flight->frameTime ).data;
+    m_threadCtx = 0;
+    m_refTimeSerial = 0;
+    m_refTimeCtx = 0;
+    m_refTimeGpu = 0;
+
+#ifdef TRACY_ON_DEMAND
+    SendDeferredQueue();
+#endif
+
+#ifdef __linux__
+    struct sigaction prev;
+    if( sigaction( SIGUSR2, nullptr, &prev ) == 0 && prev.sa_handler == SIG_DFL )
+    {
+        struct sigaction act = {};
+        act.sa_handler = FlightDumpSignal;
+        sigaction( SIGUSR2, &act, nullptr );
+    }
+#endif
+
+    const auto dumpWait = int64_t( 100000000. / m_timerMul );
+    int64_t dumpTime = 0;
+    for(;;)
+    {
+        ProcessSysTime();
+        const auto status = Dequeue( token );
+        const auto serialStatus = DequeueSerial();
+        AnswerCaptureQueries();
+        const bool idle = status == DequeueStatus::QueueEmpty && serialStatus == DequeueStatus::QueueEmpty;
+
+        // Chunks are closed between iterations, so that no record is cut in two.
+        // A record that waits for the next one, such as a callstack for its zone,
+        // holds the chunk open for a while.
+        const auto& chunk = m_flight->ring.back();
+        if( chunk.data.size != 0 &&
+            ( chunk.data.size >= m_flight->chunkSize || ( m_flight->chunkTime > 0 && GetTime() - chunk.time >= m_flight->chunkTime ) ) &&
+            ( !m_flight->IsPending() || chunk.data.size >= m_flight->chunkSize * 4 ) )
+        {
+            FlightSeal();
+        }
+
+        // Events queued before a dump request are drained first, unless the
+        // program keeps the queues busy. After a crash nothing more will come.
+        if( m_flightDump.exchange( false, std::memory_order_relaxed ) && dumpTime == 0 ) dumpTime = GetTime();
+        if( m_flight->crashed ? idle : dumpTime != 0 && ( idle || GetTime() - dumpTime >= dumpWait ) )
+        {
+            m_flight->crashed = false;
+            dumpTime = 0;
+            FlightWriteDump( welcome );
+        }
+
+        if( idle )
+        {
+            m_flight->Settle();
+            if( ShouldExit() ) break;
+            if( m_bufferOffset != m_bufferStart ) CommitData();
+            std::this_thread::sleep_for( std::chrono::milliseconds( 10 ) );
+        }
+    }
+    if( m_flight->crashed || dumpTime != 0 || m_flightDump.load( std::memory_order_relaxed ) ) FlightWriteDump( welcome );
+
+    m_isConnected.store( false, std::memory_order_release );
+    m_captureLocal = false;
+    m_flight->~FlightRecorder();
+    tracy_free( m_flight );
+    m_flight = nullptr;
+}
+
+void Profiler::FlightSeal()
+{
+    if( m_bufferOffset != m_bufferStart ) CommitData();
+
+    auto& chunk = m_flight->ring.Push( GetTime(), m_flight->frameCount, m_flight->frameTime );
+    m_flight->out = &chunk.prologue;
+    FlightWritePrologue();
+    m_flight->out = &chunk.data;
+    m_threadCtx = 0;
+    m_refTimeSerial = 0;
+    m_refTimeCtx = 0;
+    m_refTimeGpu = 0;
+
+    const auto minTime = m_flight->timeLimit > 0 ? chunk.time - m_flight->timeLimit : std::numeric_limits<int64_t>::min();
+    m_flight->ring.Trim( m_flight->sizeLimit, minTime );
+    m_flight->PruneState( m_flight->ring.front().seq );
+    m_flight->PruneThreads( [] ( uint64_t thread ) { return GetQueue().is_thread_active( thread ); } );
+}
+
+// Reopens what is open at the start of the chunk, with the original times.
+void Profiler::FlightWritePrologue()
+{
+    QueueItem item;
+    for( auto& v : m_flight->frames )
+    {
+        MemWrite( &item.hdr.type, QueueType::FrameMarkMsgStart );
+        MemWrite( &item.frameMark.time, v.time );
+        MemWrite( &item.frameMark.name, v.name );
+        AppendData( &item, QueueDataSize[(int)QueueType::FrameMarkMsgStart] );
+    }
+
+    int64_t refSerial = 0;
+    for( auto& v : m_flight->locks )
+    {
+        // Wait and obtain items share the same layout.
+        MemWrite( &item.hdr.type, v.shared ? QueueType::LockSharedWait : QueueType::LockWait );
+        MemWrite( &item.lockWait.thread, v.thread );
+        MemWrite( &item.lockWait.id, v.id );
+        MemWrite( &item.lockWait.time, v.waitTime - refSerial );
+        refSerial = v.waitTime;
+        AppendData( &item, QueueDataSize[(int)QueueType::LockWait] );
+        if( v.obtainTime != 0 )
+        {
+            MemWrite( &item.hdr.type, v.shared ? QueueType::LockSharedObtain : QueueType::LockObtain );
+            MemWrite( &item.lockWait.time, v.obtainTime - refSerial );
+            refSerial = v.obtainTime;
+            AppendData( &item, QueueDataSize[(int)QueueType::LockObtain] );
+        }
+    }
+
+    for( auto& t : m_flight->threads )
+    {
+        if( t->zones.empty() && t->validation == 0 ) continue;
+        MemWrite( &item.hdr.type, QueueType::ThreadContext );
+        MemWrite( &item.threadCtx.thread, t->thread );
+        AppendData( &item, QueueDataSize[(int)QueueType::ThreadContext] );
+
+        int64_t refThread = 0;
+        for( auto& zone : t->zones )
+        {
+            if( zone.id != 0 )
+            {
+                MemWrite( &item.hdr.type, QueueType::ZoneValidation );
+                MemWrite( &item.zoneValidation.id, zone.id );
+                AppendData( &item, QueueDataSize[(int)QueueType::ZoneValidation] );
+            }
+            QueueType type;
+            if( zone.alloc )
+            {
+                SendSourceLocationPayload( zone.srcloc );
+                type = QueueType::ZoneBeginAllocSrcLoc;
+            }
+            else
+            {
+                type = QueueType::ZoneBegin;
+                MemWrite( &item.zoneBegin.srcloc, zone.srcloc );
+            }
+            MemWrite( &item.hdr.type, type );
+            MemWrite( &item.zoneBegin.time, zone.time - refThread );
+            refThread = zone.time;
+            AppendData( &item, QueueDataSize[(int)type] );
+        }
+        if( t->validation != 0 )
+        {
+            MemWrite( &item.hdr.type, QueueType::ZoneValidation );
+            MemWrite( &item.zoneValidation.id, t->validation );
+            AppendData( &item, QueueDataSize[(int)QueueType::ZoneValidation] );
+        }
+    }
+
+    if( m_bufferOffset != m_bufferStart ) CommitData();
+}
+
+bool Profiler::FlightWriteDump( const WelcomeMessage& welcome )
+{
+    FILE* f = fopen( m_flight->path, "wb" );
+    if( !f ) return false;
+
+    // Everything taken off the queues so far goes into the dump.
+    if( !m_lockDequeue.empty() ) SendLockEvents();
+    if( m_bufferOffset != m_bufferStart ) CommitData();
+
+    auto& ring = m_flight->ring;
+    const auto& first = ring.front();
+
+    // A window that starts after the beginning of the run loads like an
+    // on-demand capture.
+    WelcomeMessage header = welcome;
+    const bool cut = header.onDemand != 0 || first.seq != 0;
+    header.onDemand = cut ? 1 : 0;
+    const uint32_t protocolVersion = ProtocolVersion;
+    fwrite( RawStreamMagic, 1, RawStreamMagicSize, f );
+    fwrite( &protocolVersion, 1, sizeof( protocolVersion ), f );
+    fwrite( &header, 1, sizeof( header ), f );
+    if( cut )
+    {
+        OnDemandPayloadMessage onDemand;
+        onDemand.frames = first.frames;
+        onDemand.currentTime = first.frameTime;
+        fwrite( &onDemand, 1, sizeof( onDemand ), f );
+    }
+    if( m_flight->answers.size != 0 ) fwrite( m_flight->answers.ptr, 1, m_flight->answers.size, f );
+
+    // Locks, GPU contexts and such announced in the dropped chunks.
+    m_captureFile = f;
+    for( auto& v : m_flight->state )
+    {
+        if( v.seq >= first.seq ) break;
+        auto& item = v.item;
+        const auto idx = MemRead<uint8_t>( &item.hdr.idx );
+        switch( (QueueType)idx )
+        {
+        case QueueType::MessageAppInfo:
+            SendSingleString( (const char*)MemRead<uint64_t>( &item.messageFat.text ), MemRead<uint16_t>( &item.messageFat.size ) );
+            break;
+        case QueueType::LockName:
+            SendSingleString( (const char*)MemRead<uint64_t>( &item.lockNameFat.name ), MemRead<uint16_t>( &item.lockNameFat.size ) );
+            break;
+        case QueueType::GpuContextName:
+            SendSingleString( (const char*)MemRead<uint64_t>( &item.gpuContextNameFat.ptr ), MemRead<uint16_t>( &item.gpuContextNameFat.size ) );
+            break;
+        default:
+            break;
+        }
+        AppendData( &item, QueueDataSize[idx] );
+    }
+    bool ok = m_bufferOffset == m_bufferStart || CommitData();
+    m_captureFile = nullptr;
+
+    if( first.prologue.size != 0 ) ok = ok && fwrite( first.prologue.ptr, 1, first.prologue.size, f ) == first.prologue.size;
+    for( size_t i=0; i<ring.size(); i++ )
+    {
+        const auto& chunk = ring[i];
+        if( chunk.data.size != 0 ) ok = ok && fwrite( chunk.data.ptr, 1, chunk.data.size, f ) == chunk.data.size;
+    }
+
+    QueueItem terminate;
+    MemWrite( &terminate.hdr.type, QueueType::Terminate );
+    m_captureFile = f;
+    ok = ok && SendData( (const char*)&terminate, 1 );
+    m_captureFile = nullptr;
+    return fclose( f ) == 0 && ok;
+}
+
 void Profiler::CompressWorker()
 {
     ThreadExitHandler threadExitHandler;
@@ -1818,6 +2379,50 @@ void Profiler::CompressWorker()
     }
 }
 
+void Profiler::SymbolWorker()
+{
+#ifdef TRACY_HAS_CALLSTACK
+#ifdef __linux__
+    s_symbolTid = syscall( SYS_gettid );
+#endif
+
+    ThreadExitHandler threadExitHandler;
+
+    SetThreadName( "Tracy Symbol Worker" );
+    while( m_timeBegin.load( std::memory_order_relaxed ) == 0 ) std::this_thread::sleep_for( std::chrono::milliseconds( 10 ) );
+    rpmalloc_thread_initialize();
+    while( !m_symbolShutdown.load( std::memory_order_relaxed ) )
+    {
+        m_symbolLock.lock();
+        if( !m_symbolQueue.empty() ) m_symbolQueue.swap( m_symbolDequeue );
+        m_symbolLock.unlock();
+
+        const auto sz = m_symbolDequeue.size();
+        if( sz == 0 )
+        {
+            std::this_thread::sleep_for( std::chrono::milliseconds( 10 ) );
+            continue;
+        }
+
+        // Walking the batch in address order keeps the decoder within one
+        // module and compilation unit for as long as possible.
+        auto item = m_symbolDequeue.data();
+        auto end = item + sz;
+        std::sort( item, end, [] ( const SymbolQueueItem& lhs, const SymbolQueueItem& rhs ) { return lhs.ptr < rhs.ptr; } );
+        while( item != end )
+        {
+            item->data = DecodeSymbolQuery( item->type, item->ptr );
+            item++;
+        }
+
+        m_symbolLock.lock();
+        for( auto& v : m_symbolDequeue ) *m_symbolAnswers.push_next() = v;
+        m_symbolLock.unlock();
+        m_symbolDequeue.clear();
+    }
+#endif
+}
+
 static void FreeAssociatedMemory( const QueueItem& item )
 {
     if( item.hdr.idx >= (int)QueueType::Terminate ) return;
@@ -1899,7 +2504,18 @@ void Profiler::ClearQueues( moodycamel::ConsumerToken& token )
 {
     for(;;)
     {
-        const auto sz = GetQueue().try_dequeue_bulk_single( token, [](const uint64_t&){}, []( QueueItem* item, size_t sz ) { assert( sz > 0 ); while( sz-- > 0 ) FreeAssociatedMemory( *item++ ); } );
+        const auto sz = GetQueue().try_dequeue_bulk_single( token, [](const uint64_t&){}, []( QueueItem* item, size_t sz )
+        {
+            assert( sz > 0 );
+            auto data = (const char*)item;
+            const auto end = data + sz;
+            while( data != end )
+            {
+                auto& v = *(const QueueItem*)data;
+                FreeAssociatedMemory( v );
+                data += QueuePackedSize( MemRead<QueueType>( &v.hdr.type ) );
+            }
+        } );
         if( sz == 0 ) break;
     }
 
@@ -1926,6 +2542,7 @@ void Profiler::ClearSerial()
 
     for( auto& v : m_serialDequeue ) FreeAssociatedMemory( v );
     m_serialDequeue.clear();
+    m_lockDequeue.clear();
 }
 
 Profiler::DequeueStatus Profiler::Dequeue( moodycamel::ConsumerToken& token )
@@ -1940,6 +2557,7 @@ Profiler::DequeueStatus Profiler::Dequeue( moodycamel::ConsumerToken& token )
                 MemWrite( &item.hdr.type, QueueType::ThreadContext );
                 MemWrite( &item.threadCtx.thread, threadId );
                 if( !AppendData( &item, QueueDataSize[(int)QueueType::ThreadContext] ) ) connectionLost = true;
+                if( m_captureLocal ) CaptureQuery( ServerQueryThreadString, threadId );
                 m_threadCtx = threadId;
                 m_refTimeThread = 0;
             }
@@ -1951,11 +2569,66 @@ Profiler::DequeueStatus Profiler::Dequeue( moodycamel::ConsumerToken& token )
             int64_t refThread = m_refTimeThread;
             int64_t refCtx = m_refTimeCtx;
             int64_t refGpu = m_refTimeGpu;
-            while( sz-- > 0 )
+            // Records that are sent as stored are copied in runs, straight from the queue
+            auto data = (char*)item;
+            const auto end = data + sz;
+            auto run = data;
+            if( m_captureLocal )
+            {
+                if( m_flight ) m_flight->SetThread( m_threadCtx );
+                for( auto ptr = data; ptr != end; ptr += QueuePackedSize( (QueueType)MemRead<uint8_t>( ptr ) ) )
+                {
+                    CaptureItemQueries( (const QueueItem*)ptr );
+                    if( m_flight ) m_flight->Track( (const QueueItem*)ptr );
+                }
+            }
+            while( data != end )
             {
+                item = (QueueItem*)data;
                 uint64_t ptr;
                 uint16_t size;
                 auto idx = MemRead<uint8_t>( &item->hdr.idx );
+                const auto packed = QueuePackedSize( (QueueType)idx );
+                const bool lock = ( idx >= (int)QueueType::LockWait && idx <= (int)QueueType::LockSharedRelease ) || idx == (int)QueueType::LockMark;
+                const bool lean = !lock && packed == QueueDataSize[idx];
+                if( !lean || m_bufferOffset - m_bufferStart + int( data - run + packed ) > TargetFrameSize )
+                {
+                    if( run != data && !AppendData( run, data - run ) )
+                    {
+                        connectionLost = true;
+                        break;
+                    }
+                    run = data;
+                }
+                if( lock )
+                {
+                    // Lock events from all threads are merged in time order by SendLockEvents()
+                    auto lev = m_lockDequeue.push_next();
+                    lev->seq = uint32_t( m_lockDequeue.size() );
+                    memcpy( &lev->item, item, packed );
+                    if( idx != (int)QueueType::LockMark )
+                    {
+                        lev->time = MemRead<int64_t>( &item->lockWait.time );
+                    }
+                    else
+                    {
+                        // Keep the mark right after the last event of its thread
+                        const auto thread = MemRead<uint64_t>( &item->lockMark.thread );
+                        lev->time = std::numeric_limits<int64_t>::min();
+                        for( auto it = lev; it != m_lockDequeue.begin(); )
+                        {
+                            --it;
+                            if( MemRead<uint64_t>( &it->item.lockWait.thread ) == thread )
+                            {
+                                lev->time = it->time;
+                                break;
+                            }
+                        }
+                    }
+                    data += packed;
+                    run = data;
+                    continue;
+                }
                 if( idx < (int)QueueType::Terminate )
                 {
                     switch( (QueueType)idx )
@@ -2130,21 +2803,25 @@ Profiler::DequeueStatus Profiler::Dequeue( moodycamel::ConsumerToken& token )
                         break;
                     }
                 }
-                if( !AppendData( item++, QueueDataSize[idx] ) )
+                data += packed;
+                if( !lean )
                 {
-                    connectionLost = true;
-                    m_refTimeThread = refThread;
-                    m_refTimeCtx = refCtx;
-                    m_refTimeGpu = refGpu;
-                    return;
+                    if( !AppendData( item, QueueDataSize[idx] ) )
+                    {
+                        connectionLost = true;
+                        break;
+                    }
+                    run = data;
                 }
             }
+            if( !connectionLost && run != end && !AppendData( run, end - run ) ) connectionLost = true;
             m_refTimeThread = refThread;
             m_refTimeCtx = refCtx;
             m_refTimeGpu = refGpu;
         }
     );
     if( connectionLost ) return DequeueStatus::ConnectionLost;
+    if( sz == 0 ) m_lockFlush = true;
     return sz > 0 ? DequeueStatus::DataDequeued : DequeueStatus::QueueEmpty;
 }
 
@@ -2155,11 +2832,15 @@ Profiler::DequeueStatus Profiler::DequeueContextSwitches( tracy::moodycamel::Con
         {
             assert( sz > 0 );
             int64_t refCtx = m_refTimeCtx;
-            while( sz-- > 0 )
+            auto data = (char*)item;
+            const auto end = data + sz;
+            while( data != end )
             {
+                item = (QueueItem*)data;
                 FreeAssociatedMemory( *item );
                 if( timeStop < 0 ) return;
                 const auto idx = MemRead<uint8_t>( &item->hdr.idx );
+                data += QueuePackedSize( (QueueType)idx );
                 if( idx == (uint8_t)QueueType::ContextSwitch )
                 {
                     const auto csTime = MemRead<int64_t>( &item->contextSwitch.time );
@@ -2198,7 +2879,6 @@ Profiler::DequeueStatus Profiler::DequeueContextSwitches( tracy::moodycamel::Con
                         return;
                     }
                 }
-                item++;
             }
             m_refTimeCtx = refCtx;
         }
@@ -2234,6 +2914,14 @@ Profiler::DequeueStatus Profiler::DequeueSerial()
         int64_t refGpu = m_refTimeGpu;
         auto item = m_serialDequeue.data();
         auto end = item + sz;
+        if( m_captureLocal )
+        {
+            for( auto it = item; it != end; it++ )
+            {
+                CaptureItemQueries( it );
+                if( m_flight ) m_flight->TrackSerial( it );
+            }
+        }
         while( item != end )
         {
             uint64_t ptr;
@@ -2247,33 +2935,6 @@ Profiler::DequeueStatus Profiler::DequeueSerial()
                     SendCallstackPayload( ptr );
                     tracy_free( (void*)ptr );
                     break;
-                case QueueType::LockWait:
-                case QueueType::LockSharedWait:
-                {
-                    int64_t t = MemRead<int64_t>( &item->lockWait.time );
-                    int64_t dt = t - refSerial;
-                    refSerial = t;
-                    MemWrite( &item->lockWait.time, dt );
-                    break;
-                }
-                case QueueType::LockObtain:
-                case QueueType::LockSharedObtain:
-                {
-                    int64_t t = MemRead<int64_t>( &item->lockObtain.time );
-                    int64_t dt = t - refSerial;
-                    refSerial = t;
-                    MemWrite( &item->lockObtain.time, dt );
-                    break;
-                }
-                case QueueType::LockRelease:
-                case QueueType::LockSharedRelease:
-                {
-                    int64_t t = MemRead<int64_t>( &item->lockRelease.time );
-                    int64_t dt = t - refSerial;
-                    refSerial = t;
-                    MemWrite( &item->lockRelease.time, dt );
-                    break;
-                }
                 case QueueType::LockName:
                 {
                     ptr = MemRead<uint64_t>( &item->lockNameFat.name );
@@ -2365,13 +3026,51 @@ Profiler::DequeueStatus Profiler::DequeueSerial()
         m_refTimeGpu = refGpu;
         m_serialDequeue.clear();
     }
-    else
+    // Lock events are held until all thread queues were drained, or enough of
+    // them are pending, so that events from many threads are merged at once.
+    const bool sendLocks = !m_lockDequeue.empty() && ( m_lockFlush || m_lockDequeue.size() >= LockDequeueBatch );
+    m_lockFlush = false;
+    if( sendLocks )
+    {
+        if( !SendLockEvents() ) return DequeueStatus::ConnectionLost;
+    }
+    else if( sz == 0 )
     {
         return DequeueStatus::QueueEmpty;
     }
     return DequeueStatus::DataDequeued;
 }
 
+bool Profiler::SendLockEvents()
+{
+    // Events of a thread were pushed in order, the sequence number keeps them so.
+    std::sort( m_lockDequeue.begin(), m_lockDequeue.end(), [] ( const LockQueueItem& l, const LockQueueItem& r ) { return l.time < r.time || ( l.time == r.time && l.seq < r.seq ); } );
+
+    bool ret = true;
+    int64_t refSerial = m_refTimeSerial;
+    for( auto& v : m_lockDequeue )
+    {
+        auto& item = v.item;
+        const auto idx = MemRead<uint8_t>( &item.hdr.idx );
+        if( m_flight ) m_flight->TrackLock( &item, v.time );
+        if( idx != (uint8_t)QueueType::LockMark )
+        {
+            // Wait, obtain and release items share the same layout.
+            int64_t dt = v.time - refSerial;
+            refSerial = v.time;
+            MemWrite( &item.lockWait.time, dt );
+        }
+        if( !AppendData( &item, QueueDataSize[idx] ) )
+        {
+            ret = false;
+            break;
+        }
+    }
+    m_refTimeSerial = refSerial;
+    m_lockDequeue.clear();
+    return ret;
+}
+
 bool Profiler::CommitData()
 {
     bool ret = SendData( m_buffer + m_bufferStart, m_bufferOffset - m_bufferStart );
@@ -2382,8 +3081,36 @@ bool Profiler::CommitData()
 
 bool Profiler::SendData( const char* data, size_t len )
 {
+#ifdef TRACY_HAS_SHM_TRANSPORT
+    if( m_shm )
+    {
+        // Server is local, hand the frame over uncompressed.
+        while( !m_shm->Write( data, uint32_t( len ) ) )
+        {
+            if( m_sock->IsPeerClosed() ) return false;
+            std::this_thread::sleep_for( std::chrono::milliseconds( 1 ) );
+        }
+        return true;
+    }
+#endif
+    // Flight recorder frames must not refer to frames that may have been dropped.
+    if( m_flight ) LZ4_resetStream( (LZ4_stream_t*)m_stream );
     const lz4sz_t lz4sz = LZ4_compress_fast_continue( (LZ4_stream_t*)m_stream, data, m_lz4Buf + sizeof( lz4sz_t ), (int)len, LZ4Size, 1 );
     memcpy( m_lz4Buf, &lz4sz, sizeof( lz4sz ) );
+    if( m_captureFile )
+    {
+        if( fwrite( &m_captureBlock, 1, sizeof( m_captureBlock ), m_captureFile ) != sizeof( m_captureBlock ) ) return false;
+        return fwrite( m_lz4Buf, 1, lz4sz + sizeof( lz4sz_t ), m_captureFile ) == lz4sz + sizeof( lz4sz_t );
+    }
+    if( m_flight )
+    {
+        auto block = m_captureBlock;
+        auto& buf = block.type == RawStreamAnswer ? m_flight->answers : *m_flight->out;
+        if( buf.size == 0 && block.type == RawStreamData ) block.type = RawStreamChunk;
+        buf.Append( &block, sizeof( block ) );
+        buf.Append( m_lz4Buf, lz4sz + sizeof( lz4sz_t ) );
+        return true;
+    }
     return m_sock->Send( m_lz4Buf, lz4sz + sizeof( lz4sz_t ) ) != -1;
 }
 
@@ -2440,6 +3167,44 @@ void Profiler::SendSecondString( const char* ptr, size_t len )
     AppendDataUnsafe( ptr, l16 );
 }
 
+void Profiler::SetupShmTransport()
+{
+    ShmOfferMessage offer;
+    memset( &offer, 0, sizeof( offer ) );
+#ifdef TRACY_HAS_SHM_TRANSPORT
+    auto ring = (ShmRing*)tracy_malloc( sizeof( ShmRing ) );
+    new(ring) ShmRing();
+    ShmListen listen;
+    // The token only travels over the TCP connection. The server proves itself
+    // by sending it back over the unix socket before it gets the ring.
+    if( ShmRandom( &offer.token, sizeof( offer.token ) ) && ring->Create( ShmRingSize ) && listen.Listen( offer.socketName ) ) offer.available = 1;
+    m_sock->Send( &offer, sizeof( offer ) );
+
+    // The server answers whether it could reach the unix socket, which fails
+    // when it runs on another machine.
+    uint8_t accepted = 0;
+    if( offer.available && m_sock->ReadRaw( &accepted, sizeof( accepted ), 2000 ) && accepted && listen.SendFd( ring->GetFd(), offer.token, 2000 ) )
+    {
+        m_shm = ring;
+        return;
+    }
+    ring->~ShmRing();
+    tracy_free( ring );
+#else
+    m_sock->Send( &offer, sizeof( offer ) );
+#endif
+}
+
+void Profiler::CloseShmTransport()
+{
+#ifdef TRACY_HAS_SHM_TRANSPORT
+    if( !m_shm ) return;
+    m_shm->~ShmRing();
+    tracy_free( m_shm );
+    m_shm = nullptr;
+#endif
+}
+
 void Profiler::SendLongString( uint64_t str, const char* ptr, size_t len, QueueType type )
 {
     assert( type == QueueType::FrameImageData ||
@@ -2514,6 +3279,11 @@ void Profiler::SendCallstackPayload( uint64_t _ptr )
     AppendDataUnsafe( &item, QueueDataSize[(int)QueueType::CallstackPayload] );
     AppendDataUnsafe( &l16, sizeof( l16 ) );
 
+    if( m_captureLocal )
+    {
+        for( uintptr_t i=0; i<sz; i++ ) CaptureQuery( ServerQueryCallstackFrame, uint64_t( ptr[i] ) );
+    }
+
     if( compile_time_condition<sizeof( uintptr_t ) == sizeof( uint64_t )>::value )
     {
         AppendDataUnsafe( ptr, sizeof( uint64_t ) * sz );
@@ -2545,6 +3315,11 @@ void Profiler::SendCallstackPayload64( uint64_t _ptr )
     AppendDataUnsafe( &item, QueueDataSize[(int)QueueType::CallstackPayload] );
     AppendDataUnsafe( &l16, sizeof( l16 ) );
     AppendDataUnsafe( ptr, sizeof( uint64_t ) * sz );
+
+    if( m_captureLocal )
+    {
+        for( uint64_t i=0; i<sz; i++ ) CaptureQuery( ServerQueryCallstackFrame, ptr[i] );
+    }
 }
 
 void Profiler::SendCallstackAlloc( uint64_t _ptr )
@@ -2566,25 +3341,23 @@ void Profiler::SendCallstackAlloc( uint64_t _ptr )
     AppendDataUnsafe( ptr, len );
 }
 
-void Profiler::SendCallstackFrame( uint64_t ptr )
+void Profiler::SendCallstackFrame( uint64_t ptr, const CachedCallstackFrame* frameData )
 {
 #ifdef TRACY_HAS_CALLSTACK
-    const auto frameData = DecodeCallstackPtr( ptr );
-
     {
-        SendSingleString( frameData.imageName );
+        SendSingleString( frameData->imageName );
 
         QueueItem item;
         MemWrite( &item.hdr.type, QueueType::CallstackFrameSize );
         MemWrite( &item.callstackFrameSize.ptr, ptr );
-        MemWrite( &item.callstackFrameSize.size, frameData.size );
+        MemWrite( &item.callstackFrameSize.size, frameData->size );
 
         AppendData( &item, QueueDataSize[(int)QueueType::CallstackFrameSize] );
     }
 
-    for( uint8_t i=0; i<frameData.size; i++ )
+    for( uint8_t i=0; i<frameData->size; i++ )
     {
-        const auto& frame = frameData.data[i];
+        const auto& frame = frameData->data[i];
 
         SendSingleString( frame.name );
         SendSecondString( frame.file );
@@ -2596,13 +3369,38 @@ void Profiler::SendCallstackFrame( uint64_t ptr )
         MemWrite( &item.callstackFrame.symLen, frame.symLen );
 
         AppendData( &item, QueueDataSize[(int)QueueType::CallstackFrame] );
-
-        tracy_free( (void*)frame.name );
-        tracy_free( (void*)frame.file );
+        if( m_captureLocal ) CaptureQuery( ServerQuerySymbol, frame.symAddr );
     }
 #endif
 }
 
+void Profiler::SendSymbolInformation( uint64_t symbol, const CachedSymbol* sym )
+{
+#ifdef TRACY_HAS_CALLSTACK
+    SendSingleString( sym->file );
+
+    QueueItem item;
+    MemWrite( &item.hdr.type, QueueType::SymbolInformation );
+    MemWrite( &item.symbolInformation.line, sym->line );
+    MemWrite( &item.symbolInformation.symAddr, symbol );
+
+    AppendData( &item, QueueDataSize[(int)QueueType::SymbolInformation] );
+#endif
+}
+
+void Profiler::SendCodeLocation( uint64_t ptr, const CachedSymbol* sym )
+{
+#ifdef TRACY_HAS_CALLSTACK
+    SendSingleString( sym->file );
+
+    QueueItem item;
+    MemWrite( &item.hdr.type, QueueType::CodeInformation );
+    MemWrite( &item.codeInformation.ptr, ptr );
+    MemWrite( &item.codeInformation.line, sym->line );
+
+    AppendData( &item, QueueDataSize[(int)QueueType::CodeInformation] );
+#endif
+}
 
 bool Profiler::HandleServerQuery()
 {
@@ -2616,6 +3414,11 @@ bool Profiler::HandleServerQuery()
     memcpy( &ptr, &payload.ptr, sizeof( payload.ptr ) );
     memcpy( &extra, &payload.extra, sizeof( payload.extra ) );
 
+    return ProcessServerQuery( type, ptr, extra );
+}
+
+bool Profiler::ProcessServerQuery( uint8_t type, uint64_t ptr, uint32_t extra )
+{
     switch( type )
     {
     case ServerQueryString:
@@ -2640,7 +3443,7 @@ bool Profiler::HandleServerQuery()
     case ServerQueryTerminate:
         return false;
     case ServerQueryCallstackFrame:
-        SendCallstackFrame( ptr );
+        HandleSymbolQuery( type, ptr );
         break;
     case ServerQueryFrameName:
         SendString( ptr, (const char*)ptr, QueueType::FrameName );
@@ -2657,7 +3460,7 @@ bool Profiler::HandleServerQuery()
         HandleParameter( ptr );
         break;
     case ServerQuerySymbol:
-        HandleSymbolQuery( ptr );
+        HandleSymbolQuery( type, ptr );
         break;
 #ifndef TRACY_NO_CODE_TRANSFER
     case ServerQuerySymbolCode:
@@ -2665,7 +3468,7 @@ bool Profiler::HandleServerQuery()
         break;
 #endif
     case ServerQueryCodeLocation:
-        SendCodeLocation( ptr );
+        HandleSymbolQuery( type, ptr );
         break;
     case ServerQuerySourceCode:
         HandleSourceCodeQuery();
@@ -2726,6 +3529,7 @@ void Profiler::HandleDisconnect()
                 {
                     if( !HandleServerQuery() ) return;
                 }
+                SendSymbolAnswers();
                 if( m_bufferOffset != m_bufferStart )
                 {
                     if( !CommitData() ) return;
@@ -2755,6 +3559,7 @@ void Profiler::HandleDisconnect()
             {
                 if( !HandleServerQuery() ) return;
             }
+            SendSymbolAnswers();
             if( m_bufferOffset != m_bufferStart )
             {
                 if( !CommitData() ) return;
@@ -2811,7 +3616,7 @@ void Profiler::CalibrateDelay()
     m_delay = m_resolution;
 #else
     constexpr int Events = Iterations * 2;   // start + end
-    static_assert( Events < QueuePrealloc, "Delay calibration loop will allocate memory in queue" );
+    static_assert( Iterations * ( QueuePackedSize( QueueType::ZoneBegin ) + QueuePackedSize( QueueType::ZoneEnd ) ) < QueuePrealloc, "Delay calibration loop will allocate memory in queue" );
 
     static const tracy::SourceLocationData __tracy_source_location { nullptr, __FUNCTION__,  __FILE__, (uint32_t)__LINE__, 0 };
     const auto t0 = GetTime();
@@ -2834,12 +3639,10 @@ void Profiler::CalibrateDelay()
     m_delay = dt / Events;
 
     moodycamel::ConsumerToken token( GetQueue() );
-    int left = Events;
-    while( left != 0 )
+    for(;;)
     {
         const auto sz = GetQueue().try_dequeue_bulk_single( token, [](const uint64_t&){}, [](QueueItem* item, size_t sz){} );
-        assert( sz > 0 );
-        left -= (int)sz;
+        if( sz == 0 ) break;
     }
     assert( GetQueue().size_approx() == 0 );
 #endif
@@ -3190,29 +3993,87 @@ static bool EnsureReadable( uintptr_t address )
 
 #endif  // defined __ANDROID__
 
-void Profiler::HandleSymbolQuery( uint64_t symbol )
+void Profiler::HandleSymbolQuery( uint8_t type, uint64_t ptr )
 {
 #ifdef TRACY_HAS_CALLSTACK
-#ifdef __ANDROID__
-    // On Android it's common for code to be in mappings that are only executable
-    // but not readable.
-    if( !EnsureReadable( symbol ) )
+    if( m_captureLocal )
     {
+        // Local captures answer queries in place, there is no connection to keep alive.
+        SendSymbolAnswer( type, ptr, DecodeSymbolQuery( type, ptr ) );
         return;
     }
-#endif
-    const auto sym = DecodeSymbolAddress( symbol );
 
-    SendSingleString( sym.file );
+    m_symbolLock.lock();
+    auto item = m_symbolQueue.push_next();
+    item->ptr = ptr;
+    item->data = nullptr;
+    item->epoch = m_symbolEpoch;
+    item->type = type;
+    m_symbolLock.unlock();
+#endif
+}
 
-    QueueItem item;
-    MemWrite( &item.hdr.type, QueueType::SymbolInformation );
-    MemWrite( &item.symbolInformation.line, sym.line );
-    MemWrite( &item.symbolInformation.symAddr, symbol );
+const void* Profiler::DecodeSymbolQuery( uint8_t type, uint64_t ptr )
+{
+#ifdef TRACY_HAS_CALLSTACK
+    switch( type )
+    {
+    case ServerQueryCallstackFrame:
+        return m_symbolCache->CallstackFrame( ptr );
+    case ServerQuerySymbol:
+#ifdef __ANDROID__
+        // On Android it's common for code to be in mappings that are only executable
+        // but not readable.
+        if( !EnsureReadable( ptr ) ) return nullptr;
+#endif
+        return m_symbolCache->Symbol( ptr );
+    case ServerQueryCodeLocation:
+        return m_symbolCache->CodeLocation( ptr );
+    default:
+        assert( false );
+        break;
+    }
+#endif
+    return nullptr;
+}
 
-    AppendData( &item, QueueDataSize[(int)QueueType::SymbolInformation] );
+void Profiler::SendSymbolAnswer( uint8_t type, uint64_t ptr, const void* data )
+{
+    if( !data ) return;
+    switch( type )
+    {
+    case ServerQueryCallstackFrame:
+        SendCallstackFrame( ptr, (const CachedCallstackFrame*)data );
+        break;
+    case ServerQuerySymbol:
+        SendSymbolInformation( ptr, (const CachedSymbol*)data );
+        break;
+    case ServerQueryCodeLocation:
+        SendCodeLocation( ptr, (const CachedSymbol*)data );
+        break;
+    default:
+        assert( false );
+        break;
+    }
+}
 
-    if( sym.needFree ) tracy_free( (void*)sym.file );
+void Profiler::SendSymbolAnswers()
+{
+#ifdef TRACY_HAS_CALLSTACK
+    m_symbolLock.lock();
+    if( !m_symbolAnswers.empty() ) m_symbolAnswers.swap( m_symbolAnswersDequeue );
+    m_symbolLock.unlock();
+
+    const auto sz = m_symbolAnswersDequeue.size();
+    if( sz == 0 ) return;
+    auto item = m_symbolAnswersDequeue.data();
+    auto end = item + sz;
+    while( item != end )
+    {
+        if( item->epoch == m_symbolEpoch ) SendSymbolAnswer( item->type, item->ptr, item->data );
+        item++;
+    }
+    m_symbolAnswersDequeue.clear();
 #endif
 }
 
@@ -3267,24 +4128,6 @@ void Profiler::HandleSourceCodeQuery()
     m_queryData = nullptr;
 }
 
-void Profiler::SendCodeLocation( uint64_t ptr )
-{
-#ifdef TRACY_HAS_CALLSTACK
-    const auto sym = DecodeCodeAddress( ptr );
-
-    SendSingleString( sym.file );
-
-    QueueItem item;
-    MemWrite( &item.hdr.type, QueueType::CodeInformation );
-    MemWrite( &item.codeInformation.ptr, ptr );
-    MemWrite( &item.codeInformation.line, sym.line );
-
-    AppendData( &item, QueueDataSize[(int)QueueType::CodeInformation] );
-
-    if( sym.needFree ) tracy_free( (void*)sym.file );
-#endif
-}
-
 #if ( defined _WIN32 || defined __CYGWIN__ ) && defined TRACY_TIMER_QPC
 int64_t Profiler::GetTimeQpc()
 {
@@ -3534,6 +4377,7 @@ TRACY_API void ___tracy_emit_messageL( const char* txt, int callstack ) { tracy:
 TRACY_API void ___tracy_emit_messageC( const char* txt, size_t size, uint32_t color, int callstack ) { tracy::Profiler::MessageColor( txt, size, color, callstack ); }
 TRACY_API void ___tracy_emit_messageLC( const char* txt, uint32_t color, int callstack ) { tracy::Profiler::MessageColor( txt, color, callstack ); }
 TRACY_API void ___tracy_emit_message_appinfo( const char* txt, size_t size ) { tracy::Profiler::MessageAppInfo( txt, size ); }
+TRACY_API void ___tracy_flight_dump() { tracy::Profiler::FlightDump(); }
 
 TRACY_API uint64_t ___tracy_alloc_srcloc( uint32_t line, const char* source, size_t sourceSz, const char* function, size_t functionSz ) {
     return tracy::Profiler::AllocSourceLocation( line, source, sourceSz, function, functionSz );
@@ -4,13 +4,16 @@
 #include <assert.h>
 #include <atomic>
 #include <stdint.h>
+#include <stdio.h>
 #include <string.h>
 #include <time.h>
 
 #include "tracy_concurrentqueue.h"
 #include "TracyCallstack.hpp"
 #include "TracySysTime.hpp"
+#include "TracyFastHashSet.hpp"
 #include "TracyFastVector.hpp"
+#include "TracyMemSampler.hpp"
 #include "../common/TracyQueue.hpp"
 #include "../common/TracyAlign.hpp"
 #include "../common/TracyAlloc.hpp"
@@ -47,8 +50,13 @@ void StartupProfiler();
 void ShutdownProfiler();
 #endif
 
+struct CachedCallstackFrame;
+struct CachedSymbol;
+struct FlightRecorder;
 class GpuCtx;
 class Profiler;
+class ShmRing;
+class SymbolCache;
 class Socket;
 class UdpBroadcast;
 
@@ -87,23 +95,25 @@ struct LuaZoneState
 
 #define TracyLfqPrepare( _type ) \
     moodycamel::ConcurrentQueueDefaultTraits::index_t __magic; \
+    const auto __size = QueuePackedSize( _type ); \
     auto __token = GetToken(); \
     auto& __tail = __token->get_tail_index(); \
-    auto item = __token->enqueue_begin( __magic ); \
+    auto item = __token->enqueue_begin( __magic, __size ); \
     MemWrite( &item->hdr.type, _type );
 
 #define TracyLfqCommit \
-    __tail.store( __magic + 1, std::memory_order_release );
+    __tail.store( __magic + __size, std::memory_order_release );
 
 #define TracyLfqPrepareC( _type ) \
     tracy::moodycamel::ConcurrentQueueDefaultTraits::index_t __magic; \
+    const auto __size = tracy::QueuePackedSize( _type ); \
     auto __token = tracy::GetToken(); \
     auto& __tail = __token->get_tail_index(); \
-    auto item = __token->enqueue_begin( __magic ); \
+    auto item = __token->enqueue_begin( __magic, __size ); \
     tracy::MemWrite( &item->hdr.type, _type );
 
 #define TracyLfqCommitC \
-    __tail.store( __magic + 1, std::memory_order_release );
+    __tail.store( __magic + __size, std::memory_order_release );
 
 
 typedef void(*ParameterCallback)( uint32_t idx, int32_t val );
@@ -120,6 +130,27 @@ class Profiler
         bool flip;
     };
 
+    struct LockQueueItem
+    {
+        int64_t time;
+        uint32_t seq;
+        QueueItem item;
+    };
+
+    struct CaptureQueryItem
+    {
+        ServerQuery type;
+        uint64_t ptr;
+    };
+
+    struct SymbolQueueItem
+    {
+        uint64_t ptr;
+        const void* data;   // decoded symbol, once answered
+        uint32_t epoch;
+        uint8_t type;
+    };
+
 public:
     Profiler();
     ~Profiler();
@@ -390,6 +421,9 @@ public:
         if( secure && !ProfilerAvailable() ) return;
 #ifdef TRACY_ON_DEMAND
         if( !GetProfiler().IsConnected() ) return;
+#endif
+#ifdef TRACY_MEMORY_SAMPLING
+        if( !MemSampleAlloc( ptr, size ) ) return;
 #endif
         const auto thread = GetThreadHandle();
 
@@ -403,6 +437,9 @@ public:
         if( secure && !ProfilerAvailable() ) return;
 #ifdef TRACY_ON_DEMAND
         if( !GetProfiler().IsConnected() ) return;
+#endif
+#ifdef TRACY_MEMORY_SAMPLING
+        if( !MemSampleFree( ptr ) ) return;
 #endif
         const auto thread = GetThreadHandle();
 
@@ -418,6 +455,9 @@ public:
         auto& profiler = GetProfiler();
 #  ifdef TRACY_ON_DEMAND
         if( !profiler.IsConnected() ) return;
+#  endif
+#  ifdef TRACY_MEMORY_SAMPLING
+        if( !MemSampleAlloc( ptr, size ) ) return;
 #  endif
         const auto thread = GetThreadHandle();
 
@@ -440,6 +480,9 @@ public:
         auto& profiler = GetProfiler();
 #  ifdef TRACY_ON_DEMAND
         if( !profiler.IsConnected() ) return;
+#  endif
+#  ifdef TRACY_MEMORY_SAMPLING
+        if( !MemSampleFree( ptr ) ) return;
 #  endif
         const auto thread = GetThreadHandle();
 
@@ -460,6 +503,9 @@ public:
         if( secure && !ProfilerAvailable() ) return;
 #ifdef TRACY_ON_DEMAND
         if( !GetProfiler().IsConnected() ) return;
+#endif
+#ifdef TRACY_MEMORY_SAMPLING
+        if( !MemSampleAlloc( ptr, size ) ) return;
 #endif
         const auto thread = GetThreadHandle();
 
@@ -474,6 +520,9 @@ public:
         if( secure && !ProfilerAvailable() ) return;
 #ifdef TRACY_ON_DEMAND
         if( !GetProfiler().IsConnected() ) return;
+#endif
+#ifdef TRACY_MEMORY_SAMPLING
+        if( !MemSampleFree( ptr ) ) return;
 #endif
         const auto thread = GetThreadHandle();
 
@@ -490,6 +539,9 @@ public:
         auto& profiler = GetProfiler();
 #  ifdef TRACY_ON_DEMAND
         if( !profiler.IsConnected() ) return;
+#  endif
+#  ifdef TRACY_MEMORY_SAMPLING
+        if( !MemSampleAlloc( ptr, size ) ) return;
 #  endif
         const auto thread = GetThreadHandle();
 
@@ -513,6 +565,9 @@ public:
         auto& profiler = GetProfiler();
 #  ifdef TRACY_ON_DEMAND
         if( !profiler.IsConnected() ) return;
+#  endif
+#  ifdef TRACY_MEMORY_SAMPLING
+        if( !MemSampleFree( ptr ) ) return;
 #  endif
         const auto thread = GetThreadHandle();
 
@@ -539,6 +594,10 @@ public:
 #endif
     }
 
+    // Writes the flight recorder window to its file. Does nothing unless the
+    // flight recorder runs.
+    static tracy_force_inline void FlightDump() { GetProfiler().m_flightDump.store( true, std::memory_order_relaxed ); }
+
     static tracy_force_inline void ParameterRegister( ParameterCallback cb ) { GetProfiler().m_paramCallback = cb; }
     static tracy_force_inline void ParameterSetup( uint32_t idx, const char* name, bool isBool, int32_t val )
     {
@@ -645,11 +704,15 @@ private:
     static void LaunchCompressWorker( void* ptr ) { ((Profiler*)ptr)->CompressWorker(); }
     void CompressWorker();
 
+    static void LaunchSymbolWorker( void* ptr ) { ((Profiler*)ptr)->SymbolWorker(); }
+    void SymbolWorker();
+
     void ClearQueues( tracy::moodycamel::ConsumerToken& token );
     void ClearSerial();
     DequeueStatus Dequeue( tracy::moodycamel::ConsumerToken& token );
     DequeueStatus DequeueContextSwitches( tracy::moodycamel::ConsumerToken& token, int64_t& timeStop );
     DequeueStatus DequeueSerial();
+    bool SendLockEvents();
     bool CommitData();
 
     tracy_force_inline bool AppendData( const void* data, size_t len )
@@ -677,19 +740,43 @@ private:
     }
 
     bool SendData( const char* data, size_t len );
+    void SetupShmTransport();
+    void CloseShmTransport();
+    bool CaptureToFile( const char* path, const WelcomeMessage& welcome, tracy::moodycamel::ConsumerToken& token );
+    void CaptureItemQueries( const QueueItem* item );
+    bool AnswerCaptureQueries();
+    void FlightRecord( const char* path, const WelcomeMessage& welcome, tracy::moodycamel::ConsumerToken& token );
+    void FlightSeal();
+    void FlightWritePrologue();
+    bool FlightWriteDump( const WelcomeMessage& welcome );
+
+    tracy_force_inline void CaptureQuery( ServerQuery type, uint64_t ptr )
+    {
+        // Queried pointers and ids never differ only in the top byte.
+        if( ptr != 0 && m_captureQueried.insert( ptr ^ ( uint64_t( type ) << 56 ) ) )
+        {
+            *m_captureQueries.push_next() = CaptureQueryItem { type, ptr };
+        }
+    }
+
     void SendLongString( uint64_t ptr, const char* str, size_t len, QueueType type );
     void SendSourceLocation( uint64_t ptr );
     void SendSourceLocationPayload( uint64_t ptr );
     void SendCallstackPayload( uint64_t ptr );
     void SendCallstackPayload64( uint64_t ptr );
     void SendCallstackAlloc( uint64_t ptr );
-    void SendCallstackFrame( uint64_t ptr );
-    void SendCodeLocation( uint64_t ptr );
+    void SendCallstackFrame( uint64_t ptr, const CachedCallstackFrame* frame );
+    void SendSymbolInformation( uint64_t symbol, const CachedSymbol* sym );
+    void SendCodeLocation( uint64_t ptr, const CachedSymbol* sym );
 
     bool HandleServerQuery();
+    bool ProcessServerQuery( uint8_t type, uint64_t ptr, uint32_t extra );
     void HandleDisconnect();
     void HandleParameter( uint64_t payload );
-    void HandleSymbolQuery( uint64_t symbol );
+    void HandleSymbolQuery( uint8_t type, uint64_t ptr );
+    const void* DecodeSymbolQuery( uint8_t type, uint64_t ptr );
+    void SendSymbolAnswer( uint8_t type, uint64_t ptr, const void* data );
+    void SendSymbolAnswers();
     void HandleSymbolCodeQuery( uint64_t symbol, uint32_t size );
     void HandleSourceCodeQuery();
 
@@ -768,6 +855,7 @@ private:
     std::atomic<bool> m_shutdownManual;
     std::atomic<bool> m_shutdownFinished;
     Socket* m_sock;
+    ShmRing* m_shm;
     UdpBroadcast* m_broadcast;
     bool m_noExit;
     uint32_t m_userPort;
@@ -790,9 +878,21 @@ private:
     FastVector<QueueItem> m_serialQueue, m_serialDequeue;
     TracyMutex m_serialLock;
 
+    FastVector<LockQueueItem> m_lockDequeue;
+    bool m_lockFlush;
+
     FastVector<FrameImageQueueItem> m_fiQueue, m_fiDequeue;
     TracyMutex m_fiLock;
 
+    // Symbol queries are decoded in batches on their own thread. Answers
+    // from an earlier connection are dropped by the epoch.
+    SymbolCache* m_symbolCache;
+    FastVector<SymbolQueueItem> m_symbolQueue, m_symbolDequeue;
+    FastVector<SymbolQueueItem> m_symbolAnswers, m_symbolAnswersDequeue;
+    TracyMutex m_symbolLock;
+    uint32_t m_symbolEpoch;
+    std::atomic<bool> m_symbolShutdown;
+
     std::atomic<uint64_t> m_frameCount;
     std::atomic<bool> m_isConnected;
 #ifdef TRACY_ON_DEMAND
@@ -800,8 +900,23 @@ private:
 
     TracyMutex m_deferredLock;
     FastVector<QueueItem> m_deferredQueue;
+
+    void SendDeferredQueue();
 #endif
 
+    // Serverless capture. The profiler thread answers the queries a server
+    // would make and stores the answers next to the event data.
+    FILE* m_captureFile;
+    bool m_captureLocal;    // to a file or to the flight recorder
+    RawStreamBlockHeader m_captureBlock;
+    FastVector<CaptureQueryItem> m_captureQueries;
+    FastHashSet m_captureQueried;
+
+    // Flight recorder. Events are kept in memory, in the same form as when
+    // capturing to a file, and written out only when asked to.
+    FlightRecorder* m_flight;
+    std::atomic<bool> m_flightDump;
+
 #ifdef TRACY_HAS_SYSTIME
     void ProcessSysTime();
 
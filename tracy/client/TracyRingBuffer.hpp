@@ -13,8 +13,9 @@ public:
         assert( __builtin_popcount( Size ) == 1 );
         m_mapSize = Size + pageSize;
         auto mapAddr = mmap( nullptr, m_mapSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 );
-        if( !mapAddr )
+        if( mapAddr == MAP_FAILED )
         {
+            m_metadata = nullptr;
             m_fd = 0;
             close( fd );
             return;
@@ -61,7 +62,10 @@ public:
         return head > m_metadata->data_tail;
     }
 
-    void Read( void* dst, uint64_t offset, uint64_t cnt )
+    uint64_t GetHead() const { return LoadHead(); }
+    uint64_t GetTail() const { return m_metadata->data_tail; }
+
+    void Read( void* dst, uint64_t offset, uint64_t cnt ) const
     {
         auto src = ( m_metadata->data_tail + offset ) % Size;
         if( src + cnt <= Size )
@@ -8,6 +8,7 @@
 #include "../common/TracySystem.hpp"
 #include "../common/TracyAlign.hpp"
 #include "../common/TracyAlloc.hpp"
+#include "TracyHwCounters.hpp"
 #include "TracyProfiler.hpp"
 
 namespace tracy
@@ -160,6 +161,24 @@ public:
         TracyLfqCommit;
     }
 
+    tracy_force_inline void Counters( const HwCounterValues& delta )
+    {
+        if( !m_active ) return;
+#ifdef TRACY_ON_DEMAND
+        if( GetProfiler().ConnectionId() != m_connectionId ) return;
+#endif
+        TracyLfqPrepare( QueueType::ZoneCounters );
+        MemWrite( &item->zoneCounters.cycles, delta.cycles );
+        MemWrite( &item->zoneCounters.instructions, delta.instructions );
+        // Miss counts are sent as 32-bit values and saturate.
+        const auto u32max = std::numeric_limits<uint32_t>::max();
+        MemWrite( &item->zoneCounters.cacheMisses, uint32_t( delta.cacheMisses < u32max ? delta.cacheMisses : u32max ) );
+        MemWrite( &item->zoneCounters.branchMisses, uint32_t( delta.branchMisses < u32max ? delta.branchMisses : u32max ) );
+        TracyLfqCommit;
+    }
+
+    tracy_force_inline bool IsActive() const { return m_active; }
+
 private:
     const bool m_active;
 
@@ -168,6 +187,40 @@ private:
 #endif
 };
 
+// Attaches hardware counter deltas to an enclosing zone. Must be declared
+// after the zone, so that it is destroyed first.
+class ScopedHwCounters
+{
+public:
+    ScopedHwCounters( const ScopedHwCounters& ) = delete;
+    ScopedHwCounters( ScopedHwCounters&& ) = delete;
+    ScopedHwCounters& operator=( const ScopedHwCounters& ) = delete;
+    ScopedHwCounters& operator=( ScopedHwCounters&& ) = delete;
+
+    tracy_force_inline ScopedHwCounters( ScopedZone& zone )
+        : m_zone( zone )
+        , m_active( zone.IsActive() && ReadHwCounters( m_begin ) )
+    {
+    }
+
+    tracy_force_inline ~ScopedHwCounters()
+    {
+        if( !m_active ) return;
+        HwCounterValues end;
+        if( !ReadHwCounters( end ) ) return;
+        end.cycles -= m_begin.cycles;
+        end.instructions -= m_begin.instructions;
+        end.cacheMisses -= m_begin.cacheMisses;
+        end.branchMisses -= m_begin.branchMisses;
+        m_zone.Counters( end );
+    }
+
+private:
+    ScopedZone& m_zone;
+    HwCounterValues m_begin;
+    const bool m_active;
+};
+
 }
 
 #endif
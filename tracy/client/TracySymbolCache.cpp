@@ -0,0 +1,537 @@
+#include "TracySymbolCache.hpp"
+
+#ifdef TRACY_HAS_CALLSTACK
+
+#include <mutex>
+#include <new>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef TRACY_HAS_SYMBOL_CACHE_FILE
+#  include <errno.h>
+#  include <fcntl.h>
+#  include <link.h>
+#  include <sys/stat.h>
+#  include <unistd.h>
+#endif
+
+#include "../common/TracyAlloc.hpp"
+
+namespace tracy
+{
+
+#ifdef TRACY_HAS_SYMBOL_CACHE_FILE
+enum { SymbolCacheHeaderSize = 12 };
+static const char SymbolCacheHeader[SymbolCacheHeaderSize] = { 'T', 'r', 'a', 'c', 'y', 'S', 'y', 'm', 1, 0, 0, 0 };
+
+static bool MakeDirectories( char* path )
+{
+    for( auto ptr = path + 1; *ptr; ptr++ )
+    {
+        if( *ptr != '/' ) continue;
+        *ptr = '\0';
+        const auto res = mkdir( path, 0755 );
+        *ptr = '/';
+        if( res != 0 && errno != EEXIST ) return false;
+    }
+    return mkdir( path, 0755 ) == 0 || errno == EEXIST;
+}
+
+struct ModuleSearch
+{
+    uint64_t ptr;
+    uint64_t bias;
+    uint64_t begin;
+    uint64_t end;
+    bool found;
+    char buildId[129];
+};
+
+static int FindModuleCallback( struct dl_phdr_info* info, size_t /*size*/, void* data )
+{
+    auto& search = *(ModuleSearch*)data;
+    uint64_t begin = ~uint64_t( 0 );
+    uint64_t end = 0;
+    bool contains = false;
+    for( int i=0; i<info->dlpi_phnum; i++ )
+    {
+        const auto& ph = info->dlpi_phdr[i];
+        if( ph.p_type != PT_LOAD ) continue;
+        const uint64_t b = info->dlpi_addr + ph.p_vaddr;
+        const uint64_t e = b + ph.p_memsz;
+        if( b < begin ) begin = b;
+        if( e > end ) end = e;
+        if( search.ptr >= b && search.ptr < e ) contains = true;
+    }
+    if( !contains ) return 0;
+
+    search.bias = info->dlpi_addr;
+    search.begin = begin;
+    search.end = end;
+    search.found = true;
+    for( int i=0; i<info->dlpi_phnum; i++ )
+    {
+        const auto& ph = info->dlpi_phdr[i];
+        if( ph.p_type != PT_NOTE ) continue;
+        auto ptr = (const char*)( info->dlpi_addr + ph.p_vaddr );
+        const auto noteEnd = ptr + ph.p_memsz;
+        while( ptr + sizeof( ElfW(Nhdr) ) <= noteEnd )
+        {
+            auto note = (const ElfW(Nhdr)*)ptr;
+            const auto name = ptr + sizeof( ElfW(Nhdr) );
+            const auto desc = name + ( ( note->n_namesz + 3 ) & ~3 );
+            const auto next = desc + ( ( note->n_descsz + 3 ) & ~3 );
+            if( next > noteEnd ) break;
+            if( note->n_type == NT_GNU_BUILD_ID && note->n_namesz == 4 && memcmp( name, "GNU", 4 ) == 0 &&
+                note->n_descsz > 0 && note->n_descsz * 2 < sizeof( search.buildId ) )
+            {
+                static const char hex[] = "0123456789abcdef";
+                for( uint32_t j=0; j<note->n_descsz; j++ )
+                {
+                    search.buildId[j*2] = hex[uint8_t( desc[j] ) >> 4];
+                    search.buildId[j*2+1] = hex[uint8_t( desc[j] ) & 0xF];
+                }
+                search.buildId[note->n_descsz*2] = '\0';
+                return 1;
+            }
+            ptr = next;
+        }
+    }
+    return 1;
+}
+#endif
+
+SymbolCache::SymbolCache()
+    : m_entries( nullptr )
+    , m_mask( 0 )
+    , m_size( 0 )
+    , m_modules( 8 )
+    , m_dir( nullptr )
+{
+#ifdef TRACY_HAS_SYMBOL_CACHE_FILE
+    // An empty TRACY_SYMBOL_CACHE disables the cache files.
+    const char* dir = getenv( "TRACY_SYMBOL_CACHE" );
+    if( dir )
+    {
+        if( *dir ) m_dir = CopyString( dir );
+    }
+    else
+    {
+        const char* base = getenv( "XDG_CACHE_HOME" );
+        const char* suffix = "/tracy/symbols";
+        if( !base || !*base )
+        {
+            base = getenv( "HOME" );
+            suffix = "/.cache/tracy/symbols";
+        }
+        if( base && *base )
+        {
+            const auto baseLen = strlen( base );
+            const auto suffixLen = strlen( suffix );
+            m_dir = (char*)tracy_malloc( baseLen + suffixLen + 1 );
+            memcpy( m_dir, base, baseLen );
+            memcpy( m_dir + baseLen, suffix, suffixLen + 1 );
+        }
+    }
+    if( m_dir && !MakeDirectories( m_dir ) )
+    {
+        tracy_free( m_dir );
+        m_dir = nullptr;
+    }
+#endif
+}
+
+SymbolCache::~SymbolCache()
+{
+    for( size_t i=0; i<=m_mask && m_entries; i++ )
+    {
+        auto& entry = m_entries[i];
+        if( entry.kind == KindFrame )
+        {
+            auto frame = (CachedCallstackFrame*)entry.value;
+            for( uint8_t j=0; j<frame->size; j++ )
+            {
+                tracy_free( (void*)frame->data[j].name );
+                tracy_free( (void*)frame->data[j].file );
+            }
+            tracy_free( frame->data );
+            tracy_free( (void*)frame->imageName );
+            tracy_free( frame );
+        }
+        else if( entry.kind != 0 )
+        {
+            auto sym = (CachedSymbol*)entry.value;
+            tracy_free( (void*)sym->file );
+            tracy_free( sym );
+        }
+    }
+    if( m_entries ) tracy_free( m_entries );
+
+    for( auto& module : m_modules )
+    {
+#ifdef TRACY_HAS_SYMBOL_CACHE_FILE
+        if( module->fd != -1 ) close( module->fd );
+#endif
+        tracy_free( module );
+    }
+    if( m_dir ) tracy_free( m_dir );
+}
+
+const CachedCallstackFrame* SymbolCache::CallstackFrame( uint64_t ptr )
+{
+    std::lock_guard<TracyMutex> lock( m_lock );
+    auto frame = (CachedCallstackFrame*)Find( ptr, KindFrame );
+    if( frame ) return frame;
+    auto module = GetModule( ptr );
+    if( module )
+    {
+        frame = (CachedCallstackFrame*)Find( ptr, KindFrame );
+        if( frame ) return frame;
+    }
+
+    // Frame names and files are allocated by the decoder and owned by the cache from now on.
+    const auto data = DecodeCallstackPtr( ptr );
+    frame = (CachedCallstackFrame*)tracy_malloc( sizeof( CachedCallstackFrame ) );
+    frame->imageName = CopyString( data.imageName );
+    frame->size = data.size;
+    frame->data = (CallstackEntry*)tracy_malloc( sizeof( CallstackEntry ) * data.size );
+    memcpy( frame->data, data.data, sizeof( CallstackEntry ) * data.size );
+
+    Insert( ptr, KindFrame, frame );
+    if( module )
+    {
+        // Frames without debug information are named relative to the load
+        // address, which changes between runs. They are cheap to decode again.
+        bool relocatable = true;
+        for( uint8_t i=0; i<frame->size; i++ )
+        {
+            if( strcmp( frame->data[i].file, "[unknown]" ) == 0 )
+            {
+                relocatable = false;
+                break;
+            }
+        }
+        if( relocatable ) Store( *module, ptr, KindFrame, frame );
+    }
+    return frame;
+}
+
+const CachedSymbol* SymbolCache::Symbol( uint64_t ptr )
+{
+    return DecodeSymbol( ptr, KindSymbol );
+}
+
+const CachedSymbol* SymbolCache::CodeLocation( uint64_t ptr )
+{
+    return DecodeSymbol( ptr, KindCode );
+}
+
+const CachedSymbol* SymbolCache::DecodeSymbol( uint64_t ptr, Kind kind )
+{
+    std::lock_guard<TracyMutex> lock( m_lock );
+    auto sym = (CachedSymbol*)Find( ptr, kind );
+    if( sym ) return sym;
+    auto module = GetModule( ptr );
+    if( module )
+    {
+        sym = (CachedSymbol*)Find( ptr, kind );
+        if( sym ) return sym;
+    }
+
+    const auto data = kind == KindSymbol ? DecodeSymbolAddress( ptr ) : DecodeCodeAddress( ptr );
+    sym = (CachedSymbol*)tracy_malloc( sizeof( CachedSymbol ) );
+    sym->file = data.needFree ? data.file : CopyString( data.file );
+    sym->line = data.line;
+
+    Insert( ptr, kind, sym );
+    if( module ) Store( *module, ptr, kind, sym );
+    return sym;
+}
+
+static tracy_force_inline size_t HashSymbolKey( uint64_t ptr, uint8_t kind )
+{
+    ptr ^= uint64_t( kind ) << 59;
+    ptr ^= ptr >> 33;
+    ptr *= 0xff51afd7ed558ccdull;
+    ptr ^= ptr >> 33;
+    return size_t( ptr );
+}
+
+void* SymbolCache::Find( uint64_t ptr, Kind kind ) const
+{
+    if( !m_entries ) return nullptr;
+    auto idx = HashSymbolKey( ptr, kind ) & m_mask;
+    while( m_entries[idx].kind != 0 )
+    {
+        if( m_entries[idx].ptr == ptr && m_entries[idx].kind == kind ) return m_entries[idx].value;
+        idx = ( idx + 1 ) & m_mask;
+    }
+    return nullptr;
+}
+
+void SymbolCache::Insert( uint64_t ptr, Kind kind, void* value )
+{
+    if( ( m_size + 1 ) * 2 > m_mask + 1 ) Grow();
+    auto idx = HashSymbolKey( ptr, kind ) & m_mask;
+    while( m_entries[idx].kind != 0 ) idx = ( idx + 1 ) & m_mask;
+    m_entries[idx] = Entry { ptr, kind, value };
+    m_size++;
+}
+
+void SymbolCache::Grow()
+{
+    const auto oldEntries = m_entries;
+    const auto oldCap = oldEntries ? m_mask + 1 : 0;
+    const auto cap = oldCap == 0 ? size_t( 1024 ) : oldCap * 2;
+    m_entries = (Entry*)tracy_malloc( sizeof( Entry ) * cap );
+    memset( m_entries, 0, sizeof( Entry ) * cap );
+    m_mask = cap - 1;
+    for( size_t i=0; i<oldCap; i++ )
+    {
+        const auto& entry = oldEntries[i];
+        if( entry.kind == 0 ) continue;
+        auto idx = HashSymbolKey( entry.ptr, entry.kind ) & m_mask;
+        while( m_entries[idx].kind != 0 ) idx = ( idx + 1 ) & m_mask;
+        m_entries[idx] = entry;
+    }
+    if( oldEntries ) tracy_free( oldEntries );
+}
+
+// Returns the module containing the address, if it is cached on disk. The
+// cache file is loaded when the module is first seen.
+SymbolCache::Module* SymbolCache::GetModule( uint64_t ptr )
+{
+#ifdef TRACY_HAS_SYMBOL_CACHE_FILE
+    if( !m_dir ) return nullptr;
+    for( auto& module : m_modules )
+    {
+        if( ptr >= module->begin && ptr < module->end ) return module->fd != -1 ? module : nullptr;
+    }
+
+    ModuleSearch search;
+    search.ptr = ptr;
+    search.found = false;
+    search.buildId[0] = '\0';
+    dl_iterate_phdr( FindModuleCallback, &search );
+    if( !search.found ) return nullptr;
+
+    auto module = (Module*)tracy_malloc( sizeof( Module ) );
+    module->bias = search.bias;
+    module->begin = search.begin;
+    module->end = search.end;
+    module->fd = -1;
+    *m_modules.push_next() = module;
+
+    // Without a build-id there is no telling whether the file still matches.
+    if( search.buildId[0] == '\0' ) return nullptr;
+    const auto dirLen = strlen( m_dir );
+    const auto idLen = strlen( search.buildId );
+    auto path = (char*)tracy_malloc( dirLen + idLen + 2 );
+    memcpy( path, m_dir, dirLen );
+    path[dirLen] = '/';
+    memcpy( path + dirLen + 1, search.buildId, idLen + 1 );
+    Load( *module, path );
+    tracy_free( path );
+    return module->fd != -1 ? module : nullptr;
+#else
+    return nullptr;
+#endif
+}
+
+// Records are appended as symbols are decoded. A record cut short, e.g. by
+// a crash, ends the file and is dropped on the next load.
+void SymbolCache::Load( Module& module, const char* path )
+{
+#ifdef TRACY_HAS_SYMBOL_CACHE_FILE
+    const int fd = open( path, O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644 );
+    if( fd == -1 ) return;
+
+    struct stat st;
+    size_t valid = 0;
+    if( fstat( fd, &st ) == 0 && st.st_size >= SymbolCacheHeaderSize )
+    {
+        auto buf = (char*)tracy_malloc( st.st_size );
+        if( pread( fd, buf, st.st_size, 0 ) == st.st_size && memcmp( buf, SymbolCacheHeader, SymbolCacheHeaderSize ) == 0 )
+        {
+            const char* ptr = buf + SymbolCacheHeaderSize;
+            const char* end = buf + st.st_size;
+            valid = SymbolCacheHeaderSize;
+            while( ptr < end && LoadRecord( module, ptr, end ) ) valid = ptr - buf;
+        }
+        tracy_free( buf );
+    }
+
+    if( valid == 0 )
+    {
+        if( ftruncate( fd, 0 ) != 0 || write( fd, SymbolCacheHeader, SymbolCacheHeaderSize ) != SymbolCacheHeaderSize )
+        {
+            close( fd );
+            return;
+        }
+    }
+    else if( valid != (size_t)st.st_size )
+    {
+        if( ftruncate( fd, valid ) != 0 )
+        {
+            close( fd );
+            return;
+        }
+    }
+    module.fd = fd;
+#endif
+}
+
+bool SymbolCache::LoadRecord( const Module& module, const char*& ptr, const char* end )
+{
+    struct String
+    {
+        const char* ptr;
+        uint16_t len;
+    };
+
+    const char* p = ptr;
+    auto read = [&p, end] ( void* dst, size_t len ) {
+        if( size_t( end - p ) < len ) return false;
+        memcpy( dst, p, len );
+        p += len;
+        return true;
+    };
+    auto readString = [&p, end, &read] ( String& str ) {
+        if( !read( &str.len, sizeof( str.len ) ) || size_t( end - p ) < str.len ) return false;
+        str.ptr = p;
+        p += str.len;
+        return true;
+    };
+
+    uint8_t kind;
+    uint64_t offset;
+    if( !read( &kind, sizeof( kind ) ) || !read( &offset, sizeof( offset ) ) ) return false;
+    const auto addr = module.bias + offset;
+
+    if( kind == KindFrame )
+    {
+        struct
+        {
+            String name;
+            String file;
+            uint32_t line;
+            uint32_t symLen;
+            uint64_t symOffset;
+        } frames[256];
+        String imageName;
+        uint8_t size;
+        if( !readString( imageName ) || !read( &size, sizeof( size ) ) ) return false;
+        for( int i=0; i<size; i++ )
+        {
+            auto& f = frames[i];
+            if( !readString( f.name ) || !readString( f.file ) || !read( &f.line, sizeof( f.line ) ) ||
+                !read( &f.symLen, sizeof( f.symLen ) ) || !read( &f.symOffset, sizeof( f.symOffset ) ) ) return false;
+        }
+        ptr = p;
+        if( size == 0 || Find( addr, KindFrame ) ) return true;
+
+        auto frame = (CachedCallstackFrame*)tracy_malloc( sizeof( CachedCallstackFrame ) );
+        frame->imageName = CopyString( imageName.ptr, imageName.len );
+        frame->size = size;
+        frame->data = (CallstackEntry*)tracy_malloc( sizeof( CallstackEntry ) * size );
+        for( int i=0; i<size; i++ )
+        {
+            const auto& f = frames[i];
+            auto& dst = frame->data[i];
+            dst.name = CopyString( f.name.ptr, f.name.len );
+            dst.file = CopyString( f.file.ptr, f.file.len );
+            dst.line = f.line;
+            dst.symLen = f.symLen;
+            dst.symAddr = f.symOffset == 0 ? 0 : module.bias + f.symOffset - 1;
+        }
+        Insert( addr, KindFrame, frame );
+        return true;
+    }
+    else if( kind == KindSymbol || kind == KindCode )
+    {
+        String file;
+        uint32_t line;
+        if( !readString( file ) || !read( &line, sizeof( line ) ) ) return false;
+        ptr = p;
+        if( Find( addr, (Kind)kind ) ) return true;
+
+        auto sym = (CachedSymbol*)tracy_malloc( sizeof( CachedSymbol ) );
+        sym->file = CopyString( file.ptr, file.len );
+        sym->line = line;
+        Insert( addr, (Kind)kind, sym );
+        return true;
+    }
+    return false;
+}
+
+void SymbolCache::Store( const Module& module, uint64_t ptr, Kind kind, const void* value )
+{
+#ifdef TRACY_HAS_SYMBOL_CACHE_FILE
+    char buf[64*1024];
+    char* p = buf;
+    const char* end = buf + sizeof( buf );
+    bool fits = true;
+    auto write = [&p, end, &fits] ( const void* src, size_t len ) {
+        if( size_t( end - p ) < len )
+        {
+            fits = false;
+            return;
+        }
+        memcpy( p, src, len );
+        p += len;
+    };
+    auto writeString = [&write] ( const char* str ) {
+        const auto len = strlen( str );
+        const auto l16 = uint16_t( len < 0xFFFF ? len : 0xFFFF );
+        write( &l16, sizeof( l16 ) );
+        write( str, l16 );
+    };
+
+    const uint8_t k = kind;
+    const uint64_t offset = ptr - module.bias;
+    write( &k, sizeof( k ) );
+    write( &offset, sizeof( offset ) );
+    if( kind == KindFrame )
+    {
+        auto frame = (const CachedCallstackFrame*)value;
+        writeString( frame->imageName );
+        write( &frame->size, sizeof( frame->size ) );
+        for( uint8_t i=0; i<frame->size; i++ )
+        {
+            const auto& f = frame->data[i];
+            const uint64_t symOffset = f.symAddr < module.bias ? 0 : f.symAddr - module.bias + 1;
+            writeString( f.name );
+            writeString( f.file );
+            write( &f.line, sizeof( f.line ) );
+            write( &f.symLen, sizeof( f.symLen ) );
+            write( &symOffset, sizeof( symOffset ) );
+        }
+    }
+    else
+    {
+        auto sym = (const CachedSymbol*)value;
+        writeString( sym->file );
+        write( &sym->line, sizeof( sym->line ) );
+    }
+
+    // A single write keeps the records of concurrent runs apart.
+    if( fits ) ::write( module.fd, buf, p - buf );
+#endif
+}
+
+char* SymbolCache::CopyString( const char* src, size_t len )
+{
+    auto dst = (char*)tracy_malloc( len + 1 );
+    memcpy( dst, src, len );
+    dst[len] = '\0';
+    return dst;
+}
+
+char* SymbolCache::CopyString( const char* src )
+{
+    return CopyString( src, strlen( src ) );
+}
+
+}
+
+#endif
@@ -0,0 +1,103 @@
+#ifndef __TRACYSYMBOLCACHE_HPP__
+#define __TRACYSYMBOLCACHE_HPP__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "TracyCallstack.hpp"
+#include "TracyFastVector.hpp"
+#include "../common/TracyMutex.hpp"
+
+#if defined TRACY_HAS_CALLSTACK && defined __linux__ && !defined TRACY_NO_SYMBOL_CACHE
+#  define TRACY_HAS_SYMBOL_CACHE_FILE
+#endif
+
+#ifdef TRACY_HAS_CALLSTACK
+
+namespace tracy
+{
+
+struct CachedCallstackFrame
+{
+    const char* imageName;
+    CallstackEntry* data;
+    uint8_t size;
+};
+
+struct CachedSymbol
+{
+    const char* file;
+    uint32_t line;
+};
+
+// Decoded symbols, kept for the lifetime of the process. On Linux they are
+// also stored on disk, in one file per module build-id, so that the next
+// run of the same binary starts with them. Calls are serialized, decoding
+// included, as the decoders are not reentrant. Returned data is never
+// modified or freed before the cache is destroyed.
+class SymbolCache
+{
+public:
+    SymbolCache();
+    ~SymbolCache();
+
+    const CachedCallstackFrame* CallstackFrame( uint64_t ptr );
+    const CachedSymbol* Symbol( uint64_t ptr );
+    const CachedSymbol* CodeLocation( uint64_t ptr );
+
+    SymbolCache( const SymbolCache& ) = delete;
+    SymbolCache( SymbolCache&& ) = delete;
+    SymbolCache& operator=( const SymbolCache& ) = delete;
+    SymbolCache& operator=( SymbolCache&& ) = delete;
+
+private:
+    enum Kind : uint8_t
+    {
+        KindFrame = 1,
+        KindSymbol,
+        KindCode
+    };
+
+    struct Entry
+    {
+        uint64_t ptr;
+        Kind kind;          // 0 if the slot is empty
+        void* value;
+    };
+
+    struct Module
+    {
+        uint64_t bias;
+        uint64_t begin;
+        uint64_t end;
+        int fd;             // -1 if the module is not cached on disk
+    };
+
+    const CachedSymbol* DecodeSymbol( uint64_t ptr, Kind kind );
+
+    void* Find( uint64_t ptr, Kind kind ) const;
+    void Insert( uint64_t ptr, Kind kind, void* value );
+    void Grow();
+
+    Module* GetModule( uint64_t ptr );
+    void Load( Module& module, const char* path );
+    bool LoadRecord( const Module& module, const char*& ptr, const char* end );
+    void Store( const Module& module, uint64_t ptr, Kind kind, const void* value );
+
+    static char* CopyString( const char* src, size_t len );
+    static char* CopyString( const char* src );
+
+    TracyMutex m_lock;
+    Entry* m_entries;
+    size_t m_mask;
+    size_t m_size;
+
+    FastVector<Module*> m_modules;
+    char* m_dir;
+};
+
+}
+
+#endif
+
+#endif
@@ -627,6 +627,10 @@ static const char SchedSwitch[] = "events/sched/sched_switch/enable";
 static const char SchedWakeup[] = "events/sched/sched_wakeup/enable";
 static const char BufferSizeKb[] = "buffer_size_kb";
 static const char TracePipe[] = "trace_pipe";
+static const char SchedSwitchId[] = "events/sched/sched_switch/id";
+static const char SchedSwitchFormat[] = "events/sched/sched_switch/format";
+static const char SchedWakeupId[] = "events/sched/sched_wakeup/id";
+static const char SchedWakeupFormat[] = "events/sched/sched_wakeup/format";
 
 static std::atomic<bool> traceActive { false };
 static Thread* s_threadSampling = nullptr;
@@ -635,6 +639,27 @@ static int s_numCpus = 0;
 static constexpr size_t RingBufSize = 64*1024;
 static RingBuffer<RingBufSize>* s_ring = nullptr;
 
+static constexpr size_t SchedRingBufSize = 256*1024;
+static RingBuffer<SchedRingBufSize>* s_schedRing = nullptr;
+static int* s_schedWakeupFd = nullptr;
+static int s_schedNumCpus = 0;
+static bool s_traceFtrace = false;
+
+// Tracepoint ids and field offsets in the raw sample data, as described
+// by the event format files.
+struct SchedFormat
+{
+    uint16_t switchId;
+    uint16_t wakeupId;
+    uint16_t prevPid;
+    uint16_t prevState;
+    uint16_t prevStateSize;
+    uint16_t nextPid;
+    uint16_t wakeupPid;
+};
+
+static SchedFormat s_schedFormat;
+
 static int perf_event_open( struct perf_event_attr* hw_event, pid_t pid, int cpu, int group_fd, unsigned long flags )
 {
     return syscall( __NR_perf_event_open, hw_event, pid, cpu, group_fd, flags );
@@ -844,6 +869,311 @@ static bool TraceWrite( const char* path, size_t psz, const char* val, size_t vs
         val += cnt;
     }
 }
+
+static bool TraceRead( const char* path, size_t psz, char* buf, size_t bsz )
+{
+    char tmp[256];
+    memcpy( tmp, BasePath, sizeof( BasePath ) - 1 );
+    memcpy( tmp + sizeof( BasePath ) - 1, path, psz );
+
+    int fd = open( tmp, O_RDONLY );
+    if( fd < 0 ) return false;
+
+    size_t sz = 0;
+    while( sz < bsz - 1 )
+    {
+        const auto cnt = read( fd, buf + sz, bsz - 1 - sz );
+        if( cnt <= 0 ) break;
+        sz += cnt;
+    }
+    close( fd );
+    buf[sz] = '\0';
+    return sz != 0;
+}
+
+static bool GetTraceField( const char* format, const char* field, uint16_t& offset, uint16_t& size )
+{
+    // Fields are listed as "field:pid_t prev_pid;	offset:24;	size:4;	signed:1;"
+    const auto len = strlen( field );
+    auto ptr = format;
+    for(;;)
+    {
+        ptr = strstr( ptr, field );
+        if( !ptr ) return false;
+        if( ptr > format && ptr[-1] == ' ' && ptr[len] == ';' ) break;
+        ptr += len;
+    }
+    ptr = strstr( ptr, "offset:" );
+    if( !ptr ) return false;
+    offset = (uint16_t)atoi( ptr + 7 );
+    ptr = strstr( ptr, "size:" );
+    if( !ptr ) return false;
+    size = (uint16_t)atoi( ptr + 5 );
+    return true;
+}
+
+static void CleanupSchedCapture( int num )
+{
+    for( int i=0; i<num; i++ )
+    {
+        if( s_schedWakeupFd[i] != -1 ) close( s_schedWakeupFd[i] );
+        s_schedRing[i].~RingBuffer<SchedRingBufSize>();
+    }
+    tracy_free( s_schedWakeupFd );
+    tracy_free( s_schedRing );
+    s_schedRing = nullptr;
+}
+
+// Scheduler events are read in binary form from the sched_switch and
+// sched_wakeup tracepoints, instead of parsing the text trace_pipe. Both
+// events of a CPU share one ring buffer, so that its records stay in time
+// order.
+static bool SetupSchedCapture()
+{
+    char buf[4096];
+    uint16_t size;
+    if( !TraceRead( SchedSwitchId, sizeof( SchedSwitchId ), buf, sizeof( buf ) ) ) return false;
+    s_schedFormat.switchId = (uint16_t)atoi( buf );
+    if( !TraceRead( SchedWakeupId, sizeof( SchedWakeupId ), buf, sizeof( buf ) ) ) return false;
+    s_schedFormat.wakeupId = (uint16_t)atoi( buf );
+    if( !TraceRead( SchedSwitchFormat, sizeof( SchedSwitchFormat ), buf, sizeof( buf ) ) ) return false;
+    if( !GetTraceField( buf, "prev_pid", s_schedFormat.prevPid, size ) || size != 4 ) return false;
+    if( !GetTraceField( buf, "next_pid", s_schedFormat.nextPid, size ) || size != 4 ) return false;
+    if( !GetTraceField( buf, "prev_state", s_schedFormat.prevState, s_schedFormat.prevStateSize ) ) return false;
+    if( s_schedFormat.prevStateSize != 4 && s_schedFormat.prevStateSize != 8 ) return false;
+    if( !TraceRead( SchedWakeupFormat, sizeof( SchedWakeupFormat ), buf, sizeof( buf ) ) ) return false;
+    if( !GetTraceField( buf, "pid", s_schedFormat.wakeupPid, size ) || size != 4 ) return false;
+
+    s_schedNumCpus = (int)std::thread::hardware_concurrency();
+    s_schedRing = (RingBuffer<SchedRingBufSize>*)tracy_malloc( sizeof( RingBuffer<SchedRingBufSize> ) * s_schedNumCpus );
+    s_schedWakeupFd = (int*)tracy_malloc( sizeof( int ) * s_schedNumCpus );
+
+    perf_event_attr pe = {};
+
+    pe.type = PERF_TYPE_TRACEPOINT;
+    pe.size = sizeof( perf_event_attr );
+    pe.sample_period = 1;
+    pe.sample_type = PERF_SAMPLE_TIME | PERF_SAMPLE_RAW;
+#if !defined TRACY_HW_TIMER || !( defined __i386 || defined _M_IX86 || defined __x86_64__ || defined _M_X64 )
+    pe.use_clockid = 1;
+    pe.clockid = CLOCK_MONOTONIC_RAW;
+#endif
+
+    for( int i=0; i<s_schedNumCpus; i++ )
+    {
+        pe.config = s_schedFormat.switchId;
+        pe.disabled = 1;
+        const int fd = perf_event_open( &pe, -1, i, -1, PERF_FLAG_FD_CLOEXEC );
+        if( fd == -1 )
+        {
+            CleanupSchedCapture( i );
+            return false;
+        }
+        new( s_schedRing+i ) RingBuffer<SchedRingBufSize>( fd );
+        s_schedWakeupFd[i] = -1;
+        if( !s_schedRing[i].IsValid() )
+        {
+            CleanupSchedCapture( i+1 );
+            return false;
+        }
+#if defined TRACY_HW_TIMER && ( defined __i386 || defined _M_IX86 || defined __x86_64__ || defined _M_X64 )
+        if( !s_schedRing[i].CheckTscCaps() )
+        {
+            CleanupSchedCapture( i+1 );
+            return false;
+        }
+#endif
+
+        // The wakeup event is a member of the switch event group, so that
+        // enabling the switch event also enables it.
+        pe.config = s_schedFormat.wakeupId;
+        pe.disabled = 0;
+        s_schedWakeupFd[i] = perf_event_open( &pe, -1, i, fd, PERF_FLAG_FD_CLOEXEC );
+        if( s_schedWakeupFd[i] == -1 || ioctl( s_schedWakeupFd[i], PERF_EVENT_IOC_SET_OUTPUT, fd ) != 0 )
+        {
+            CleanupSchedCapture( i+1 );
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static uint8_t ConvertTaskState( uint64_t state )
+{
+    // The lowest set bit decides, as in the text trace output, which prints
+    // the state flags in this order. Codes are the same as in ReadState().
+    state &= 0xFF;
+    switch( state & ( ~state + 1 ) )
+    {
+    case 0x00: return 103;  // R
+    case 0x01: return 104;  // S
+    case 0x02: return 101;  // D
+    case 0x04: return 105;  // T
+    case 0x08: return 106;  // t
+    case 0x10: return 108;  // X
+    case 0x20: return 109;  // Z
+    case 0x80: return 102;  // I
+    default: return 100;
+    }
+}
+
+static int64_t GetSchedRecordTime( const RingBuffer<SchedRingBufSize>& ring )
+{
+    perf_event_header hdr;
+    ring.Read( &hdr, 0, sizeof( perf_event_header ) );
+    if( hdr.type != PERF_RECORD_SAMPLE ) return 0;
+    int64_t time;
+    ring.Read( &time, sizeof( perf_event_header ), sizeof( int64_t ) );
+    return time;
+}
+
+static void HandleSchedRecord( const RingBuffer<SchedRingBufSize>& ring, uint8_t cpu, int64_t time )
+{
+    // Sample layout: header, time, raw data size, raw data.
+    const auto raw = sizeof( perf_event_header ) + sizeof( int64_t ) + sizeof( uint32_t );
+
+    uint16_t type;
+    ring.Read( &type, raw, sizeof( uint16_t ) );
+
+#if defined TRACY_HW_TIMER && ( defined __i386 || defined _M_IX86 || defined __x86_64__ || defined _M_X64 )
+    time = ring.ConvertTimeToTsc( time );
+#endif
+
+    if( type == s_schedFormat.switchId )
+    {
+        int32_t oldPid, newPid;
+        ring.Read( &oldPid, raw + s_schedFormat.prevPid, sizeof( int32_t ) );
+        ring.Read( &newPid, raw + s_schedFormat.nextPid, sizeof( int32_t ) );
+        uint64_t state;
+        if( s_schedFormat.prevStateSize == 8 )
+        {
+            ring.Read( &state, raw + s_schedFormat.prevState, sizeof( uint64_t ) );
+        }
+        else
+        {
+            uint32_t state32;
+            ring.Read( &state32, raw + s_schedFormat.prevState, sizeof( uint32_t ) );
+            state = state32;
+        }
+
+        uint8_t reason = 100;
+
+        TracyLfqPrepare( QueueType::ContextSwitch );
+        MemWrite( &item->contextSwitch.time, time );
+        MemWrite( &item->contextSwitch.oldThread, (uint64_t)oldPid );
+        MemWrite( &item->contextSwitch.newThread, (uint64_t)newPid );
+        MemWrite( &item->contextSwitch.cpu, cpu );
+        MemWrite( &item->contextSwitch.reason, reason );
+        MemWrite( &item->contextSwitch.state, ConvertTaskState( state ) );
+        TracyLfqCommit;
+    }
+    else if( type == s_schedFormat.wakeupId )
+    {
+        int32_t pid;
+        ring.Read( &pid, raw + s_schedFormat.wakeupPid, sizeof( int32_t ) );
+
+        TracyLfqPrepare( QueueType::ThreadWakeup );
+        MemWrite( &item->threadWakeup.time, time );
+        MemWrite( &item->threadWakeup.thread, (uint64_t)pid );
+        TracyLfqCommit;
+    }
+}
+
+static void ProcessSchedRings()
+{
+    const auto num = s_schedNumCpus;
+    auto ring = s_schedRing;
+    auto end = (uint64_t*)tracy_malloc( sizeof( uint64_t ) * num );
+    auto time = (int64_t*)tracy_malloc( sizeof( int64_t ) * num );
+
+    uint64_t lost = 0;
+    auto lostReport = std::chrono::steady_clock::now();
+
+    for( int i=0; i<num; i++ ) ring[i].Enable();
+    while( traceActive.load( std::memory_order_relaxed ) )
+    {
+        // Each pass handles the records present in the buffers when it
+        // starts. Records of a single CPU are already in time order, so the
+        // streams are merged by always taking the oldest pending record.
+        int active = 0;
+        for( int i=0; i<num; i++ )
+        {
+            end[i] = ring[i].GetHead();
+            if( ring[i].GetTail() == end[i] )
+            {
+                time[i] = std::numeric_limits<int64_t>::max();
+            }
+            else
+            {
+                time[i] = GetSchedRecordTime( ring[i] );
+                active++;
+            }
+        }
+        if( active == 0 )
+        {
+            std::this_thread::sleep_for( std::chrono::milliseconds( 10 ) );
+            continue;
+        }
+
+#ifdef TRACY_ON_DEMAND
+        const auto connected = GetProfiler().IsConnected();
+#else
+        const auto connected = true;
+#endif
+        while( active > 0 )
+        {
+            int sel = 0;
+            for( int i=1; i<num; i++ )
+            {
+                if( time[i] < time[sel] ) sel = i;
+            }
+
+            auto& rb = ring[sel];
+            perf_event_header hdr;
+            rb.Read( &hdr, 0, sizeof( perf_event_header ) );
+            if( hdr.type == PERF_RECORD_SAMPLE )
+            {
+                if( connected ) HandleSchedRecord( rb, (uint8_t)sel, time[sel] );
+            }
+            else if( hdr.type == PERF_RECORD_LOST )
+            {
+                // Layout: header, id, number of lost records.
+                uint64_t cnt;
+                rb.Read( &cnt, sizeof( perf_event_header ) + sizeof( uint64_t ), sizeof( uint64_t ) );
+                lost += cnt;
+            }
+            rb.Advance( hdr.size );
+
+            if( rb.GetTail() == end[sel] )
+            {
+                time[sel] = std::numeric_limits<int64_t>::max();
+                active--;
+            }
+            else
+            {
+                time[sel] = GetSchedRecordTime( rb );
+            }
+        }
+
+        if( lost != 0 )
+        {
+            const auto now = std::chrono::steady_clock::now();
+            if( now - lostReport >= std::chrono::seconds( 1 ) )
+            {
+                char msg[128];
+                const auto sz = sprintf( msg, "Tracy Profiler: %" PRIu64 " scheduler events lost due to kernel buffer overflow.", lost );
+                Profiler::Message( msg, sz, 0 );
+                lost = 0;
+                lostReport = now;
+            }
+        }
+    }
+
+    tracy_free( time );
+    tracy_free( end );
+    CleanupSchedCapture( num );
+}
 #endif
 
 #ifdef __ANDROID__
@@ -889,6 +1219,16 @@ bool SysTraceStart( int64_t& samplingPeriod )
     return false;
 #endif
 
+#ifndef __ANDROID__
+    if( SetupSchedCapture() )
+    {
+        traceActive.store( true, std::memory_order_relaxed );
+        SetupSampling( samplingPeriod );
+        return true;
+    }
+#endif
+
+    s_traceFtrace = true;
     if( !TraceWrite( TracingOn, sizeof( TracingOn ), "0", 2 ) ) return false;
     if( !TraceWrite( CurrentTracer, sizeof( CurrentTracer ), "nop", 4 ) ) return false;
     TraceWrite( TraceOptions, sizeof( TraceOptions ), "norecord-cmd", 13 );
@@ -918,7 +1258,7 @@ bool SysTraceStart( int64_t& samplingPeriod )
 
 void SysTraceStop()
 {
-    TraceWrite( TracingOn, sizeof( TracingOn ), "0", 2 );
+    if( s_traceFtrace ) TraceWrite( TracingOn, sizeof( TracingOn ), "0", 2 );
     traceActive.store( false, std::memory_order_relaxed );
     if( s_threadSampling )
     {
@@ -1243,6 +1583,14 @@ void SysTraceWorker( void* ptr )
 {
     ThreadExitHandler threadExitHandler;
     SetThreadName( "Tracy SysTrace" );
+    if( s_schedRing )
+    {
+        sched_param sp = { 5 };
+        pthread_setschedparam( pthread_self(), SCHED_FIFO, &sp );
+        ProcessSchedRings();
+        return;
+    }
+
     char tmp[256];
     memcpy( tmp, BasePath, sizeof( BasePath ) - 1 );
     memcpy( tmp + sizeof( BasePath ) - 1, TracePipe, sizeof( TracePipe ) );
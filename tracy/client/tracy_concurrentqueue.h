@@ -141,7 +141,8 @@ struct ConcurrentQueueDefaultTraits
 	// but many producers, a smaller block size should be favoured. For few producers
 	// and/or many elements, a larger block size is preferred. A sane default
 	// is provided. Must be a power of 2.
-	static const size_t BLOCK_SIZE = 64*1024;
+	// Elements are variable-length records, so the block size is in bytes.
+	static const size_t BLOCK_SIZE = 256*1024;
 
 	// For explicit producers (i.e. when using a producer token), the block is
 	// checked for being empty by iterating through a list of flags, one per element.
@@ -514,9 +515,9 @@ public:
     ConcurrentQueue& operator=(ConcurrentQueue&& other) = delete;
 
 public:
-    tracy_force_inline T* enqueue_begin(producer_token_t const& token, index_t& currentTailIndex)
+    tracy_force_inline T* enqueue_begin(producer_token_t const& token, index_t& currentTailIndex, size_t size)
     {
-        return static_cast<ExplicitProducer*>(token.producer)->ConcurrentQueue::ExplicitProducer::enqueue_begin(currentTailIndex);
+        return static_cast<ExplicitProducer*>(token.producer)->ConcurrentQueue::ExplicitProducer::enqueue_begin(currentTailIndex, size);
     }
 
 	template<class NotifyThread, class ProcessData>
@@ -576,6 +577,16 @@ public:
 		return size;
 	}
 
+    // Returns true if the thread still has a producer in use, or one that
+    // holds items not dequeued yet.
+    bool is_thread_active( uint64_t threadId ) const
+    {
+        for (auto ptr = producerListTail.load(std::memory_order_acquire); ptr != nullptr; ptr = ptr->next_prod()) {
+            if( ptr->threadId == threadId && ( !ptr->inactive.load(std::memory_order_relaxed) || ptr->size_approx() != 0 ) ) return true;
+        }
+        return false;
+    }
+
 
 	// Returns true if the underlying atomic variables used by
 	// the queue are lock-free (they should be on most platforms).
@@ -759,7 +770,7 @@ private:
 	struct Block
 	{
 		Block()
-			: next(nullptr), elementsCompletelyDequeued(0), freeListRefs(0), freeListNext(nullptr), shouldBeOnFreeList(false), dynamicallyAllocated(true)
+			: next(nullptr), elementsCompletelyDequeued(0), dataEnd(BLOCK_SIZE), freeListRefs(0), freeListNext(nullptr), shouldBeOnFreeList(false), dynamicallyAllocated(true)
 		{
 		}
 
@@ -843,6 +854,7 @@ private:
 
 		inline void reset_empty()
 		{
+			dataEnd.store(BLOCK_SIZE, std::memory_order_relaxed);
 			if (compile_time_condition<BLOCK_SIZE <= EXPLICIT_BLOCK_EMPTY_COUNTER_THRESHOLD>::value) {
 				// Reset flags
 				for (size_t i = 0; i != BLOCK_SIZE; ++i) {
@@ -855,8 +867,8 @@ private:
 			}
 		}
 
-		inline T* operator[](index_t idx) noexcept { return static_cast<T*>(static_cast<void*>(elements)) + static_cast<size_t>(idx & static_cast<index_t>(BLOCK_SIZE - 1)); }
-		inline T const* operator[](index_t idx) const noexcept { return static_cast<T const*>(static_cast<void const*>(elements)) + static_cast<size_t>(idx & static_cast<index_t>(BLOCK_SIZE - 1)); }
+		inline T* operator[](index_t idx) noexcept { return static_cast<T*>(static_cast<void*>(elements + static_cast<size_t>(idx & static_cast<index_t>(BLOCK_SIZE - 1)))); }
+		inline T const* operator[](index_t idx) const noexcept { return static_cast<T const*>(static_cast<void const*>(elements + static_cast<size_t>(idx & static_cast<index_t>(BLOCK_SIZE - 1)))); }
 
 	private:
 		// IMPORTANT: This must be the first member in Block, so that if T depends on the alignment of
@@ -870,12 +882,13 @@ private:
 		// arrays of Blocks all be properly aligned (not just the first one). We use a union to force
 		// this.
 		union {
-			char elements[sizeof(T) * BLOCK_SIZE];
+			char elements[BLOCK_SIZE];
 			details::max_align_t dummy;
 		};
 	public:
 		Block* next;
 		std::atomic<size_t> elementsCompletelyDequeued;
+		std::atomic<size_t> dataEnd;		// Bytes past this offset are padding left by a record that did not fit
 		std::atomic<bool> emptyFlags[BLOCK_SIZE <= EXPLICIT_BLOCK_EMPTY_COUNTER_THRESHOLD ? BLOCK_SIZE : 1];
 	public:
 		std::atomic<std::uint32_t> freeListRefs;
@@ -959,44 +972,7 @@ private:
 
 		~ExplicitProducer()
 		{
-			// Destruct any elements not yet dequeued.
-			// Since we're in the destructor, we can assume all elements
-			// are either completely dequeued or completely not (no halfways).
-			if (this->tailBlock != nullptr) {		// Note this means there must be a block index too
-				// First find the block that's partially dequeued, if any
-				Block* halfDequeuedBlock = nullptr;
-				if ((this->headIndex.load(std::memory_order_relaxed) & static_cast<index_t>(BLOCK_SIZE - 1)) != 0) {
-					// The head's not on a block boundary, meaning a block somewhere is partially dequeued
-					// (or the head block is the tail block and was fully dequeued, but the head/tail are still not on a boundary)
-					size_t i = (pr_blockIndexFront - pr_blockIndexSlotsUsed) & (pr_blockIndexSize - 1);
-					while (details::circular_less_than<index_t>(pr_blockIndexEntries[i].base + BLOCK_SIZE, this->headIndex.load(std::memory_order_relaxed))) {
-						i = (i + 1) & (pr_blockIndexSize - 1);
-					}
-					assert(details::circular_less_than<index_t>(pr_blockIndexEntries[i].base, this->headIndex.load(std::memory_order_relaxed)));
-					halfDequeuedBlock = pr_blockIndexEntries[i].block;
-				}
-
-				// Start at the head block (note the first line in the loop gives us the head from the tail on the first iteration)
-				auto block = this->tailBlock;
-				do {
-					block = block->next;
-					if (block->ConcurrentQueue::Block::is_empty()) {
-						continue;
-					}
-
-					size_t i = 0;	// Offset into block
-					if (block == halfDequeuedBlock) {
-						i = static_cast<size_t>(this->headIndex.load(std::memory_order_relaxed) & static_cast<index_t>(BLOCK_SIZE - 1));
-					}
-
-					// Walk through all the items in the block; if this is the tail block, we need to stop when we reach the tail index
-					auto lastValidIndex = (this->tailIndex.load(std::memory_order_relaxed) & static_cast<index_t>(BLOCK_SIZE - 1)) == 0 ? BLOCK_SIZE : static_cast<size_t>(this->tailIndex.load(std::memory_order_relaxed) & static_cast<index_t>(BLOCK_SIZE - 1));
-					while (i != BLOCK_SIZE && (block != this->tailBlock || i != lastValidIndex)) {
-						(*block)[i++]->~T();
-					}
-				} while (block != this->tailBlock);
-			}
-
+			// Elements are trivially destructible byte records, so only the blocks need to be released.
 			// Destroy all blocks that we own
 			if (this->tailBlock != nullptr) {
 				auto block = this->tailBlock;
@@ -1022,8 +998,15 @@ private:
 			}
 		}
 
-        inline void enqueue_begin_alloc(index_t currentTailIndex)
+        inline index_t enqueue_begin_alloc(index_t currentTailIndex)
         {
+            // The record does not fit in what is left of the block; leave the rest as padding
+            const auto offset = static_cast<size_t>(currentTailIndex & static_cast<index_t>(BLOCK_SIZE - 1));
+            if (offset != 0) {
+                this->tailBlock->dataEnd.store(offset, std::memory_order_relaxed);
+                currentTailIndex += static_cast<index_t>(BLOCK_SIZE - offset);
+            }
+
             // We reached the end of a block, start a new one
             if (this->tailBlock != nullptr && this->tailBlock->next->ConcurrentQueue::Block::is_empty()) {
                 // We can re-use the block ahead of us, it's empty!
@@ -1065,13 +1048,16 @@ private:
             entry.block = this->tailBlock;
             blockIndex.load(std::memory_order_relaxed)->front.store(pr_blockIndexFront, std::memory_order_release);
             pr_blockIndexFront = (pr_blockIndexFront + 1) & (pr_blockIndexSize - 1);
+            return currentTailIndex;
         }
 
-        tracy_force_inline T* enqueue_begin(index_t& currentTailIndex)
+        // Reserves size contiguous bytes. The record is published by storing currentTailIndex + size to the tail index.
+        tracy_force_inline T* enqueue_begin(index_t& currentTailIndex, size_t size)
         {
             currentTailIndex = this->tailIndex.load(std::memory_order_relaxed);
-            if (details::cqUnlikely((currentTailIndex & static_cast<index_t>(BLOCK_SIZE - 1)) == 0)) {
-                this->enqueue_begin_alloc(currentTailIndex);
+            const auto offset = static_cast<size_t>(currentTailIndex & static_cast<index_t>(BLOCK_SIZE - 1));
+            if (details::cqUnlikely(offset == 0 || offset + size > BLOCK_SIZE)) {
+                currentTailIndex = this->enqueue_begin_alloc(currentTailIndex);
             }
             return (*this->tailBlock)[currentTailIndex];
         }
@@ -1088,7 +1074,10 @@ private:
 			auto overcommit = this->dequeueOvercommit.load(std::memory_order_relaxed);
 			auto desiredCount = static_cast<size_t>(tail - (this->dequeueOptimisticCount.load(std::memory_order_relaxed) - overcommit));
 			if (details::circular_less_than<size_t>(0, desiredCount)) {
-				desiredCount = desiredCount < 8192 ? desiredCount : 8192;
+				// Records never straddle blocks, so stop at the end of the head block
+				auto head = this->dequeueOptimisticCount.load(std::memory_order_relaxed) - overcommit;
+				auto blockLeft = BLOCK_SIZE - static_cast<size_t>(head & static_cast<index_t>(BLOCK_SIZE - 1));
+				desiredCount = desiredCount < blockLeft ? desiredCount : blockLeft;
 				std::atomic_thread_fence(std::memory_order_acquire);
 
 				auto myDequeueCount = this->dequeueOptimisticCount.fetch_add(desiredCount, std::memory_order_relaxed);
@@ -1125,9 +1114,12 @@ private:
 						endIndex = details::circular_less_than<index_t>(firstIndex + static_cast<index_t>(actualCount), endIndex) ? firstIndex + static_cast<index_t>(actualCount) : endIndex;
 						auto block = localBlockIndex->entries[indexIndex].block;
 
-						const auto sz = endIndex - index;
-						processData( (*block)[index], sz );
-						index += sz;
+						const auto first = static_cast<size_t>(index & static_cast<index_t>(BLOCK_SIZE - 1));
+						auto last = static_cast<size_t>((endIndex - 1) & static_cast<index_t>(BLOCK_SIZE - 1)) + 1;
+						const auto dataEnd = block->dataEnd.load(std::memory_order_relaxed);
+						if (last > dataEnd) last = dataEnd;
+						if (last > first) processData( (*block)[index], last - first );
+						index = endIndex;
 
 						block->ConcurrentQueue::Block::set_many_empty(firstIndexInBlock, static_cast<size_t>(endIndex - firstIndexInBlock));
 						indexIndex = (indexIndex + 1) & (localBlockIndex->size - 1);
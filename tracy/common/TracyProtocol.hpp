@@ -9,7 +9,7 @@ namespace tracy
 
 constexpr unsigned Lz4CompressBound( unsigned isize ) { return isize + ( isize / 255 ) + 16; }
 
-enum : uint32_t { ProtocolVersion = 46 };
+enum : uint32_t { ProtocolVersion = 50 };
 enum : uint16_t { BroadcastVersion = 2 };
 
 using lz4sz_t = uint32_t;
@@ -31,6 +31,16 @@ enum HandshakeStatus : uint8_t
     HandshakeDropped
 };
 
+enum TransportType : uint8_t
+{
+    TransportSocket,
+    TransportShm
+};
+
+enum { ShmRingSize = 16 * 1024 * 1024 };
+enum { ShmSocketNameSize = 64 };
+static_assert( ShmRingSize >= TargetFrameSize * 2, "Shared memory ring cannot hold two frames" );
+
 enum { WelcomeMessageProgramNameSize = 64 };
 enum { WelcomeMessageHostInfoSize = 1024 };
 
@@ -88,6 +98,7 @@ struct WelcomeMessage
     uint64_t exectime;
     uint64_t pid;
     int64_t samplingPeriod;
+    uint64_t memSamplingInterval;
     uint8_t onDemand;
     uint8_t isApple;
     uint8_t cpuArch;
@@ -101,6 +112,40 @@ struct WelcomeMessage
 enum { WelcomeMessageSize = sizeof( WelcomeMessage ) };
 
 
+// Sent by the client after the handshake, if the server asked for TransportShm.
+struct ShmOfferMessage
+{
+    uint8_t available;
+    uint64_t token;
+    char socketName[ShmSocketNameSize];
+};
+
+enum { ShmOfferMessageSize = sizeof( ShmOfferMessage ) };
+
+
+// A client capturing to file writes the raw stream magic, the protocol version,
+// the welcome message and, in on-demand mode, the on-demand payload message.
+// Each following frame is prefixed by a block header and the compressed size.
+enum { RawStreamMagicSize = 8 };
+static const char RawStreamMagic[RawStreamMagicSize] = { 'T', 'r', 'a', 'c', 'y', 'R', 'a', 'w' };
+
+enum RawStreamBlockType : uint8_t
+{
+    RawStreamData,
+    RawStreamAnswer,    // client's own answer to the query below
+    RawStreamChunk      // data, time references restart from zero
+};
+
+struct RawStreamBlockHeader
+{
+    RawStreamBlockType type;
+    ServerQuery query;
+    uint64_t ptr;
+};
+
+enum { RawStreamBlockHeaderSize = sizeof( RawStreamBlockHeader ) };
+
+
 struct OnDemandPayloadMessage
 {
     uint64_t frames;
@@ -64,6 +64,7 @@ enum class QueueType : uint8_t
     ZoneValidation,
     ZoneColor,
     ZoneValue,
+    ZoneCounters,
     FrameMarkMsg,
     FrameMarkMsgStart,
     FrameMarkMsgEnd,
@@ -144,6 +145,14 @@ struct QueueZoneValue
     uint64_t value;
 };
 
+struct QueueZoneCounters
+{
+    uint64_t cycles;
+    uint64_t instructions;
+    uint32_t cacheMisses;
+    uint32_t branchMisses;
+};
+
 struct QueueStringTransfer
 {
     uint64_t ptr;
@@ -521,6 +530,7 @@ struct QueueItem
         QueueZoneValidation zoneValidation;
         QueueZoneColor zoneColor;
         QueueZoneValue zoneValue;
+        QueueZoneCounters zoneCounters;
         QueueStringTransfer stringTransfer;
         QueueFrameMark frameMark;
         QueueFrameImage frameImage;
@@ -634,6 +644,7 @@ static constexpr size_t QueueDataSize[] = {
     sizeof( QueueHeader ) + sizeof( QueueZoneValidation ),
     sizeof( QueueHeader ) + sizeof( QueueZoneColor ),
     sizeof( QueueHeader ) + sizeof( QueueZoneValue ),
+    sizeof( QueueHeader ) + sizeof( QueueZoneCounters ),
     sizeof( QueueHeader ) + sizeof( QueueFrameMark ),       // continuous frames
     sizeof( QueueHeader ) + sizeof( QueueFrameMark ),       // start
     sizeof( QueueHeader ) + sizeof( QueueFrameMark ),       // end
@@ -675,8 +686,66 @@ static constexpr size_t QueueDataSize[] = {
     sizeof( QueueHeader ) + sizeof( QueueStringTransfer ),  // source code
 };
 
+// Size of the records stored in the client queues. Items below Terminate are
+// fixed up by the profiler thread and may carry data that is not sent.
+static constexpr size_t QueueFatDataSize[] = {
+    sizeof( QueueHeader ) + sizeof( QueueZoneTextFat ),     // zone text
+    sizeof( QueueHeader ) + sizeof( QueueZoneTextFat ),     // zone name
+    sizeof( QueueHeader ) + sizeof( QueueMessageFat ),
+    sizeof( QueueHeader ) + sizeof( QueueMessageColorFat ),
+    sizeof( QueueHeader ) + sizeof( QueueMessageFat ),      // callstack
+    sizeof( QueueHeader ) + sizeof( QueueMessageColorFat ), // callstack
+    sizeof( QueueHeader ) + sizeof( QueueMessageFat ),      // app info
+    sizeof( QueueHeader ) + sizeof( QueueZoneBegin ),       // allocated source location
+    sizeof( QueueHeader ) + sizeof( QueueZoneBegin ),       // allocated source location, callstack
+    sizeof( QueueHeader ) + sizeof( QueueCallstackFat ),    // callstack memory
+    sizeof( QueueHeader ) + sizeof( QueueCallstackFat ),    // callstack
+    sizeof( QueueHeader ) + sizeof( QueueCallstackAllocFat ),   // callstack alloc
+    sizeof( QueueHeader ) + sizeof( QueueCallstackSampleFat ),
+    sizeof( QueueHeader ) + sizeof( QueueFrameImageFat ),
+    sizeof( QueueHeader ) + sizeof( QueueZoneBegin ),
+    sizeof( QueueHeader ) + sizeof( QueueZoneBegin ),       // callstack
+    sizeof( QueueHeader ) + sizeof( QueueZoneEnd ),
+    sizeof( QueueHeader ) + sizeof( QueueLockWait ),
+    sizeof( QueueHeader ) + sizeof( QueueLockObtain ),
+    sizeof( QueueHeader ) + sizeof( QueueLockRelease ),
+    sizeof( QueueHeader ) + sizeof( QueueLockWait ),        // shared
+    sizeof( QueueHeader ) + sizeof( QueueLockObtain ),      // shared
+    sizeof( QueueHeader ) + sizeof( QueueLockRelease ),     // shared
+    sizeof( QueueHeader ) + sizeof( QueueLockNameFat ),
+    sizeof( QueueHeader ) + sizeof( QueueMemAlloc ),
+    sizeof( QueueHeader ) + sizeof( QueueMemAlloc ),        // named
+    sizeof( QueueHeader ) + sizeof( QueueMemFree ),
+    sizeof( QueueHeader ) + sizeof( QueueMemFree ),         // named
+    sizeof( QueueHeader ) + sizeof( QueueMemAlloc ),        // callstack
+    sizeof( QueueHeader ) + sizeof( QueueMemAlloc ),        // callstack, named
+    sizeof( QueueHeader ) + sizeof( QueueMemFree ),         // callstack
+    sizeof( QueueHeader ) + sizeof( QueueMemFree ),         // callstack, named
+    sizeof( QueueHeader ) + sizeof( QueueGpuZoneBegin ),
+    sizeof( QueueHeader ) + sizeof( QueueGpuZoneBegin ),    // callstack
+    sizeof( QueueHeader ) + sizeof( QueueGpuZoneBegin ),    // allocated source location
+    sizeof( QueueHeader ) + sizeof( QueueGpuZoneBegin ),    // allocated source location, callstack
+    sizeof( QueueHeader ) + sizeof( QueueGpuZoneEnd ),
+    sizeof( QueueHeader ) + sizeof( QueueGpuZoneBegin ),    // serial
+    sizeof( QueueHeader ) + sizeof( QueueGpuZoneBegin ),    // serial, callstack
+    sizeof( QueueHeader ) + sizeof( QueueGpuZoneBegin ),    // serial, allocated source location
+    sizeof( QueueHeader ) + sizeof( QueueGpuZoneBegin ),    // serial, allocated source location, callstack
+    sizeof( QueueHeader ) + sizeof( QueueGpuZoneEnd ),      // serial
+    sizeof( QueueHeader ) + sizeof( QueuePlotData ),
+    sizeof( QueueHeader ) + sizeof( QueueContextSwitch ),
+    sizeof( QueueHeader ) + sizeof( QueueThreadWakeup ),
+    sizeof( QueueHeader ) + sizeof( QueueGpuTime ),
+    sizeof( QueueHeader ) + sizeof( QueueGpuContextNameFat ),
+};
+
+static constexpr size_t QueuePackedSize( QueueType type )
+{
+    return type < QueueType::Terminate ? QueueFatDataSize[(uint8_t)type] : QueueDataSize[(uint8_t)type];
+}
+
 static_assert( QueueItemSize == 32, "Queue item size not 32 bytes" );
 static_assert( sizeof( QueueDataSize ) / sizeof( size_t ) == (uint8_t)QueueType::NUM_TYPES, "QueueDataSize mismatch" );
+static_assert( sizeof( QueueFatDataSize ) / sizeof( size_t ) == (uint8_t)QueueType::Terminate, "QueueFatDataSize mismatch" );
 static_assert( sizeof( void* ) <= sizeof( uint64_t ), "Pointer size > 8 bytes" );
 static_assert( sizeof( void* ) == sizeof( uintptr_t ), "Pointer size != uintptr_t" );
 
@@ -0,0 +1,350 @@
+#include "TracyShm.hpp"
+
+#ifdef TRACY_HAS_SHM_TRANSPORT
+
+#include <algorithm>
+#include <assert.h>
+#include <atomic>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <new>
+#include <poll.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifndef MFD_CLOEXEC
+#  define MFD_CLOEXEC 0x0001U
+#endif
+
+namespace tracy
+{
+
+struct ShmRing::Header
+{
+    std::atomic<uint64_t> head;
+    char pad0[64 - sizeof( uint64_t )];
+    std::atomic<uint64_t> tail;
+    char pad1[64 - sizeof( uint64_t )];
+    uint32_t size;
+};
+
+enum { ShmHeaderSize = 4096 };
+
+ShmRing::ShmRing()
+    : m_hdr( nullptr )
+    , m_data( nullptr )
+    , m_mapSize( 0 )
+    , m_mask( 0 )
+    , m_fd( -1 )
+{
+}
+
+ShmRing::~ShmRing()
+{
+    if( m_hdr ) munmap( m_hdr, m_mapSize );
+    if( m_fd != -1 ) close( m_fd );
+}
+
+bool ShmRing::Create( uint32_t size )
+{
+    static_assert( sizeof( Header ) <= ShmHeaderSize, "Shared memory ring header too big" );
+    assert( ( size & ( size - 1 ) ) == 0 );
+
+    m_fd = (int)syscall( SYS_memfd_create, "tracy", MFD_CLOEXEC );
+    if( m_fd == -1 ) return false;
+    m_mapSize = ShmHeaderSize + size;
+    if( ftruncate( m_fd, m_mapSize ) == -1 ) return false;
+    auto ptr = mmap( nullptr, m_mapSize, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0 );
+    if( ptr == MAP_FAILED ) return false;
+
+    m_hdr = new(ptr) Header();
+    m_hdr->head.store( 0, std::memory_order_relaxed );
+    m_hdr->tail.store( 0, std::memory_order_relaxed );
+    m_hdr->size = size;
+    m_data = (char*)ptr + ShmHeaderSize;
+    m_mask = size - 1;
+    return true;
+}
+
+bool ShmRing::Map( int fd )
+{
+    m_fd = fd;
+    struct stat st;
+    if( fstat( fd, &st ) == -1 || st.st_size <= ShmHeaderSize ) return false;
+    auto ptr = mmap( nullptr, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 );
+    if( ptr == MAP_FAILED ) return false;
+    m_hdr = (Header*)ptr;
+    m_mapSize = st.st_size;
+
+    const auto size = m_hdr->size;
+    if( size == 0 || ( size & ( size - 1 ) ) != 0 || ShmHeaderSize + size != m_mapSize ) return false;
+    m_data = (char*)ptr + ShmHeaderSize;
+    m_mask = size - 1;
+    return true;
+}
+
+void ShmRing::CopyIn( uint64_t pos, const void* src, uint32_t len )
+{
+    const auto offset = uint32_t( pos & m_mask );
+    const auto first = std::min( len, m_mask + 1 - offset );
+    memcpy( m_data + offset, src, first );
+    if( first != len ) memcpy( m_data, (const char*)src + first, len - first );
+}
+
+void ShmRing::CopyOut( uint64_t pos, void* dst, uint32_t len ) const
+{
+    const auto offset = uint32_t( pos & m_mask );
+    const auto first = std::min( len, m_mask + 1 - offset );
+    memcpy( dst, m_data + offset, first );
+    if( first != len ) memcpy( (char*)dst + first, m_data, len - first );
+}
+
+bool ShmRing::Write( const char* data, uint32_t len )
+{
+    const auto head = m_hdr->head.load( std::memory_order_relaxed );
+    const auto tail = m_hdr->tail.load( std::memory_order_acquire );
+    const auto need = uint64_t( sizeof( len ) ) + len;
+    assert( need <= m_mask + 1 );
+    if( m_mask + 1 - ( head - tail ) < need ) return false;
+    CopyIn( head, &len, sizeof( len ) );
+    CopyIn( head + sizeof( len ), data, len );
+    m_hdr->head.store( head + need, std::memory_order_release );
+    return true;
+}
+
+int ShmRing::Read( char* data, uint32_t maxLen )
+{
+    const auto tail = m_hdr->tail.load( std::memory_order_relaxed );
+    const auto head = m_hdr->head.load( std::memory_order_acquire );
+    if( head == tail ) return -1;
+    uint32_t len;
+    if( head - tail < sizeof( len ) ) return -2;
+    CopyOut( tail, &len, sizeof( len ) );
+    if( len > maxLen || head - tail < sizeof( len ) + len ) return -2;
+    CopyOut( tail + sizeof( len ), data, len );
+    m_hdr->tail.store( tail + sizeof( len ) + len, std::memory_order_release );
+    return (int)len;
+}
+
+
+bool ShmRandom( void* buf, size_t len )
+{
+#ifdef SYS_getrandom
+    auto ptr = (char*)buf;
+    while( len > 0 )
+    {
+        const auto res = syscall( SYS_getrandom, ptr, len, 0 );
+        if( res == -1 )
+        {
+            if( errno == EINTR ) continue;
+            break;
+        }
+        ptr += res;
+        len -= size_t( res );
+    }
+    if( len == 0 ) return true;
+#endif
+    const int fd = open( "/dev/urandom", O_RDONLY | O_CLOEXEC );
+    if( fd == -1 ) return false;
+    const auto res = read( fd, buf, len );
+    close( fd );
+    return res == ssize_t( len );
+}
+
+static bool ShmSameUser( int sock )
+{
+    struct ucred cred;
+    socklen_t len = sizeof( cred );
+    if( getsockopt( sock, SOL_SOCKET, SO_PEERCRED, &cred, &len ) == -1 ) return false;
+    return cred.uid == geteuid();
+}
+
+static int64_t ShmTimeMs()
+{
+    struct timespec ts;
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return int64_t( ts.tv_sec ) * 1000 + ts.tv_nsec / 1000000;
+}
+
+static socklen_t SetShmAddress( struct sockaddr_un& addr, const char* name )
+{
+    memset( &addr, 0, sizeof( addr ) );
+    addr.sun_family = AF_UNIX;
+    const auto len = strlen( name );
+    assert( len < ShmSocketNameSize && len + 1 < sizeof( addr.sun_path ) );
+    memcpy( addr.sun_path + 1, name, len );
+    return socklen_t( offsetof( struct sockaddr_un, sun_path ) + 1 + len );
+}
+
+ShmListen::ShmListen()
+    : m_sock( -1 )
+{
+}
+
+ShmListen::~ShmListen()
+{
+    if( m_sock != -1 ) close( m_sock );
+}
+
+bool ShmListen::Listen( char* name )
+{
+    // The name only has to be unique, it is visible in /proc/net/unix.
+    uint64_t id;
+    if( !ShmRandom( &id, sizeof( id ) ) ) return false;
+    m_sock = socket( AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0 );
+    if( m_sock == -1 ) return false;
+    snprintf( name, ShmSocketNameSize, "tracy-%016" PRIx64, id );
+    struct sockaddr_un addr;
+    const auto len = SetShmAddress( addr, name );
+    if( bind( m_sock, (const struct sockaddr*)&addr, len ) == -1 ) return false;
+    return listen( m_sock, 1 ) == 0;
+}
+
+// Accepts connections until one proves to be the server, which is allowed to
+// take the descriptor. Peers of other users are dropped right away, the rest
+// are polled together, so one that never sends its token can't hold up the
+// handover.
+static int ShmAcceptServer( int sock, uint64_t token, int timeout )
+{
+    enum { MaxPending = 8 };
+    struct pollfd pfd[1 + MaxPending];
+    pfd[0].fd = sock;
+    pfd[0].events = POLLIN;
+    int pending = 0;
+    int conn = -1;
+
+    const auto deadline = ShmTimeMs() + timeout;
+    while( conn == -1 )
+    {
+        const auto remaining = deadline - ShmTimeMs();
+        if( remaining <= 0 || poll( pfd, 1 + pending, int( remaining ) ) <= 0 ) break;
+
+        for( int i=pending; i>0; i-- )
+        {
+            if( pfd[i].revents == 0 ) continue;
+            uint64_t recvToken;
+            const auto ok = conn == -1 &&
+                recv( pfd[i].fd, &recvToken, sizeof( recvToken ), MSG_WAITALL | MSG_DONTWAIT ) == sizeof( recvToken ) &&
+                recvToken == token;
+            if( ok ) conn = pfd[i].fd;
+            else close( pfd[i].fd );
+            pfd[i] = pfd[pending--];
+        }
+        if( conn != -1 || !( pfd[0].revents & POLLIN ) ) continue;
+
+        const int peer = accept4( sock, nullptr, nullptr, SOCK_CLOEXEC );
+        if( peer == -1 ) continue;
+        if( !ShmSameUser( peer ) )
+        {
+            close( peer );
+            continue;
+        }
+        if( pending == MaxPending )
+        {
+            close( pfd[1].fd );
+            pfd[1] = pfd[pending--];
+        }
+        pending++;
+        pfd[pending].fd = peer;
+        pfd[pending].events = POLLIN;
+    }
+
+    for( int i=1; i<=pending; i++ ) close( pfd[i].fd );
+    return conn;
+}
+
+bool ShmListen::SendFd( int fd, uint64_t token, int timeout )
+{
+    const int conn = ShmAcceptServer( m_sock, token, timeout );
+    if( conn == -1 ) return false;
+
+    struct iovec iov;
+    iov.iov_base = &token;
+    iov.iov_len = sizeof( token );
+    char ctrl[CMSG_SPACE( sizeof( int ) )];
+    memset( ctrl, 0, sizeof( ctrl ) );
+    struct msghdr msg;
+    memset( &msg, 0, sizeof( msg ) );
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = ctrl;
+    msg.msg_controllen = sizeof( ctrl );
+    auto cmsg = CMSG_FIRSTHDR( &msg );
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN( sizeof( int ) );
+    memcpy( CMSG_DATA( cmsg ), &fd, sizeof( int ) );
+
+    const auto res = sendmsg( conn, &msg, MSG_NOSIGNAL );
+    close( conn );
+    return res == sizeof( token );
+}
+
+ShmConnect::ShmConnect()
+    : m_sock( -1 )
+{
+}
+
+ShmConnect::~ShmConnect()
+{
+    if( m_sock != -1 ) close( m_sock );
+}
+
+bool ShmConnect::Connect( const char* name )
+{
+    m_sock = socket( AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0 );
+    if( m_sock == -1 ) return false;
+    struct sockaddr_un addr;
+    const auto len = SetShmAddress( addr, name );
+    return connect( m_sock, (const struct sockaddr*)&addr, len ) == 0;
+}
+
+int ShmConnect::ReceiveFd( uint64_t token, int timeout )
+{
+    // The client's uid is checked for the same reason it checks ours: the
+    // socket name is public, so anyone could be listening on it.
+    if( !ShmSameUser( m_sock ) ) return -1;
+    if( send( m_sock, &token, sizeof( token ), MSG_NOSIGNAL ) != sizeof( token ) ) return -1;
+
+    struct pollfd pfd;
+    pfd.fd = m_sock;
+    pfd.events = POLLIN;
+    if( poll( &pfd, 1, timeout ) <= 0 ) return -1;
+
+    uint64_t recvToken;
+    struct iovec iov;
+    iov.iov_base = &recvToken;
+    iov.iov_len = sizeof( recvToken );
+    char ctrl[CMSG_SPACE( sizeof( int ) )];
+    struct msghdr msg;
+    memset( &msg, 0, sizeof( msg ) );
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = ctrl;
+    msg.msg_controllen = sizeof( ctrl );
+
+    if( recvmsg( m_sock, &msg, MSG_CMSG_CLOEXEC ) != sizeof( recvToken ) ) return -1;
+    auto cmsg = CMSG_FIRSTHDR( &msg );
+    if( !cmsg || cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS ) return -1;
+    int fd;
+    memcpy( &fd, CMSG_DATA( cmsg ), sizeof( int ) );
+    if( recvToken != token )
+    {
+        close( fd );
+        return -1;
+    }
+    return fd;
+}
+
+}
+
+#endif
@@ -0,0 +1,100 @@
+#ifndef __TRACYSHM_HPP__
+#define __TRACYSHM_HPP__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "TracyProtocol.hpp"
+
+#if defined __linux__ && !defined TRACY_NO_SHM_TRANSPORT
+#  define TRACY_HAS_SHM_TRANSPORT
+#endif
+
+namespace tracy
+{
+
+#ifdef TRACY_HAS_SHM_TRANSPORT
+
+// Single producer, single consumer ring in a memfd mapping shared by the client
+// and a capture process on the same machine. Frames are stored as a 32-bit
+// length followed by the uncompressed frame data.
+class ShmRing
+{
+public:
+    ShmRing();
+    ~ShmRing();
+
+    bool Create( uint32_t size );
+    bool Map( int fd );
+    int GetFd() const { return m_fd; }
+
+    bool Write( const char* data, uint32_t len );
+    // Returns frame size, -1 if the ring is empty, -2 if the frame is malformed.
+    int Read( char* data, uint32_t maxLen );
+
+    ShmRing( const ShmRing& ) = delete;
+    ShmRing( ShmRing&& ) = delete;
+    ShmRing& operator=( const ShmRing& ) = delete;
+    ShmRing& operator=( ShmRing&& ) = delete;
+
+private:
+    struct Header;
+
+    void CopyIn( uint64_t pos, const void* src, uint32_t len );
+    void CopyOut( uint64_t pos, void* dst, uint32_t len ) const;
+
+    Header* m_hdr;
+    char* m_data;
+    size_t m_mapSize;
+    uint32_t m_mask;
+    int m_fd;
+};
+
+// Fills the buffer from the kernel's random number generator.
+bool ShmRandom( void* buf, size_t len );
+
+// The memfd is passed over an abstract unix socket with a random name, which
+// any local user can see and connect to. The client listens, and only sends
+// the descriptor to a peer of the same user that first sends back the token
+// the server got over the TCP connection.
+class ShmListen
+{
+public:
+    ShmListen();
+    ~ShmListen();
+
+    bool Listen( char* name );
+    bool SendFd( int fd, uint64_t token, int timeout );
+
+    ShmListen( const ShmListen& ) = delete;
+    ShmListen( ShmListen&& ) = delete;
+    ShmListen& operator=( const ShmListen& ) = delete;
+    ShmListen& operator=( ShmListen&& ) = delete;
+
+private:
+    int m_sock;
+};
+
+class ShmConnect
+{
+public:
+    ShmConnect();
+    ~ShmConnect();
+
+    bool Connect( const char* name );
+    int ReceiveFd( uint64_t token, int timeout );
+
+    ShmConnect( const ShmConnect& ) = delete;
+    ShmConnect( ShmConnect&& ) = delete;
+    ShmConnect& operator=( const ShmConnect& ) = delete;
+    ShmConnect& operator=( ShmConnect&& ) = delete;
+
+private:
+    int m_sock;
+};
+
+#endif
+
+}
+
+#endif
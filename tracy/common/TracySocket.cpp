@@ -428,6 +428,20 @@ bool Socket::HasData()
     return poll( &fd, 1, 0 ) > 0;
 }
 
+bool Socket::IsPeerClosed()
+{
+    const auto sock = m_sock.load( std::memory_order_relaxed );
+    if( m_bufLeft > 0 ) return false;
+
+    struct pollfd fd;
+    fd.fd = (socket_t)sock;
+    fd.events = POLLIN;
+    if( poll( &fd, 1, 0 ) <= 0 ) return false;
+
+    char tmp;
+    return recv( sock, &tmp, 1, MSG_PEEK ) <= 0;
+}
+
 bool Socket::IsValid() const
 {
     return m_sock.load( std::memory_order_relaxed ) >= 0;
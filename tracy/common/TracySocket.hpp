@@ -47,6 +47,7 @@ public:
 
     bool ReadRaw( void* buf, int len, int timeout );
     bool HasData();
+    bool IsPeerClosed();
     bool IsValid() const;
 
     Socket( const Socket& ) = delete;
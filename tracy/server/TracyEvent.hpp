@@ -8,6 +8,7 @@
 #include <string.h>
 
 #include "TracyCharUtil.hpp"
+#include "TracyPopcnt.hpp"
 #include "TracyShortPtr.hpp"
 #include "TracySortedVector.hpp"
 #include "TracyVector.hpp"
@@ -214,6 +215,15 @@ struct ZoneExtra
 enum { ZoneExtraSize = sizeof( ZoneExtra ) };
 
 
+struct ZoneCounters
+{
+    uint64_t cycles;
+    uint64_t instructions;
+    uint64_t cacheMisses;
+    uint64_t branchMisses;
+};
+
+
 // This union exploits the fact that the current implementations of x64 and arm64 do not provide
 // full 64 bit address space. The high bits must be bit-extended, so 0x80... is an invalid pointer.
 // This allows using the highest bit as a selector between a native pointer and a table index here.
@@ -273,10 +283,56 @@ struct LockEvent
     Type type;
 };
 
+// Set of lock participants, indexed by LockEvent::thread.
+struct LockThreadMask
+{
+    enum { Words = 2 };
+
+    tracy_force_inline bool Test( uint8_t thread ) const { return ( bits[thread >> 6] & ( uint64_t( 1 ) << ( thread & 63 ) ) ) != 0; }
+    tracy_force_inline void Set( uint8_t thread ) { bits[thread >> 6] |= uint64_t( 1 ) << ( thread & 63 ); }
+    tracy_force_inline void Clear( uint8_t thread ) { bits[thread >> 6] &= ~( uint64_t( 1 ) << ( thread & 63 ) ); }
+
+    tracy_force_inline bool Any() const
+    {
+        for( int i=0; i<Words; i++ ) if( bits[i] != 0 ) return true;
+        return false;
+    }
+
+    tracy_force_inline bool AnyOther( uint8_t thread ) const
+    {
+        for( int i=0; i<Words; i++ )
+        {
+            auto v = bits[i];
+            if( i == ( thread >> 6 ) ) v &= ~( uint64_t( 1 ) << ( thread & 63 ) );
+            if( v != 0 ) return true;
+        }
+        return false;
+    }
+
+    tracy_force_inline uint64_t Count() const
+    {
+        uint64_t cnt = 0;
+        for( int i=0; i<Words; i++ ) cnt += TracyCountBits( bits[i] );
+        return cnt;
+    }
+
+    tracy_force_inline LockThreadMask operator|( const LockThreadMask& other ) const
+    {
+        LockThreadMask ret;
+        for( int i=0; i<Words; i++ ) ret.bits[i] = bits[i] | other.bits[i];
+        return ret;
+    }
+
+    tracy_force_inline bool operator==( const LockThreadMask& other ) const { return memcmp( bits, other.bits, sizeof( bits ) ) == 0; }
+    tracy_force_inline bool operator!=( const LockThreadMask& other ) const { return !( *this == other ); }
+
+    uint64_t bits[Words];
+};
+
 struct LockEventShared : public LockEvent
 {
-    uint64_t waitShared;
-    uint64_t sharedList;
+    LockThreadMask waitShared;
+    LockThreadMask sharedList;
 };
 
 struct LockEventPtr
@@ -284,14 +340,14 @@ struct LockEventPtr
     short_ptr<LockEvent> ptr;
     uint8_t lockingThread;
     uint8_t lockCount;
-    uint64_t waitList;
+    LockThreadMask waitList;
 };
 
 enum { LockEventSize = sizeof( LockEvent ) };
 enum { LockEventSharedSize = sizeof( LockEventShared ) };
 enum { LockEventPtrSize = sizeof( LockEventPtr ) };
 
-enum { MaxLockThreads = sizeof( LockEventPtr::waitList ) * 8 };
+enum { MaxLockThreads = sizeof( LockThreadMask ) * 8 };
 static_assert( std::numeric_limits<decltype(LockEventPtr::lockCount)>::max() >= MaxLockThreads, "Not enough space for lock count." );
 
 
@@ -609,7 +665,7 @@ struct LockMap
     bool valid;
     bool isContended;
 
-    TimeRange range[64];
+    TimeRange range[MaxLockThreads];
 };
 
 struct LockHighlight
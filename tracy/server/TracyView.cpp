@@ -75,19 +75,14 @@ constexpr const char* GpuContextNames[] = {
 };
 
 
-static inline uint64_t GetThreadBit( uint8_t thread )
+static inline bool IsThreadWaiting( const LockThreadMask& bitlist, uint8_t thread )
 {
-    return uint64_t( 1 ) << thread;
+    return bitlist.Test( thread );
 }
 
-static inline bool IsThreadWaiting( uint64_t bitlist, uint64_t threadBit )
+static inline bool AreOtherWaiting( const LockThreadMask& bitlist, uint8_t thread )
 {
-    return ( bitlist & threadBit ) != 0;
-}
-
-static inline bool AreOtherWaiting( uint64_t bitlist, uint64_t threadBit )
-{
-    return ( bitlist & ~threadBit ) != 0;
+    return bitlist.AnyOther( thread );
 }
 
 static tracy_force_inline void PrintStringPercent( char* buf, const char* string, double percent )
@@ -4837,7 +4832,7 @@ enum class LockState
     WaitLock            // red
 };
 
-static Vector<LockEventPtr>::const_iterator GetNextLockEvent( const Vector<LockEventPtr>::const_iterator& it, const Vector<LockEventPtr>::const_iterator& end, LockState& nextState, uint64_t threadBit )
+static Vector<LockEventPtr>::const_iterator GetNextLockEvent( const Vector<LockEventPtr>::const_iterator& it, const Vector<LockEventPtr>::const_iterator& end, LockState& nextState, uint8_t thread )
 {
     auto next = it;
     next++;
@@ -4849,12 +4844,12 @@ static Vector<LockEventPtr>::const_iterator GetNextLockEvent( const Vector<LockE
         {
             if( next->lockCount != 0 )
             {
-                if( GetThreadBit( next->lockingThread ) == threadBit )
+                if( next->lockingThread == thread )
                 {
-                    nextState = AreOtherWaiting( next->waitList, threadBit ) ? LockState::HasBlockingLock : LockState::HasLock;
+                    nextState = AreOtherWaiting( next->waitList, thread ) ? LockState::HasBlockingLock : LockState::HasLock;
                     break;
                 }
-                else if( IsThreadWaiting( next->waitList, threadBit ) )
+                else if( IsThreadWaiting( next->waitList, thread ) )
                 {
                     nextState = LockState::WaitLock;
                     break;
@@ -4871,9 +4866,9 @@ static Vector<LockEventPtr>::const_iterator GetNextLockEvent( const Vector<LockE
                 nextState = LockState::Nothing;
                 break;
             }
-            if( next->waitList != 0 )
+            if( next->waitList.Any() )
             {
-                if( AreOtherWaiting( next->waitList, threadBit ) )
+                if( AreOtherWaiting( next->waitList, thread ) )
                 {
                     nextState = LockState::HasBlockingLock;
                 }
@@ -4904,9 +4899,9 @@ static Vector<LockEventPtr>::const_iterator GetNextLockEvent( const Vector<LockE
     case LockState::WaitLock:
         while( next < end )
         {
-            if( GetThreadBit( next->lockingThread ) == threadBit )
+            if( next->lockingThread == thread )
             {
-                nextState = AreOtherWaiting( next->waitList, threadBit ) ? LockState::HasBlockingLock : LockState::HasLock;
+                nextState = AreOtherWaiting( next->waitList, thread ) ? LockState::HasBlockingLock : LockState::HasLock;
                 break;
             }
             if( next->lockingThread != it->lockingThread )
@@ -4928,7 +4923,7 @@ static Vector<LockEventPtr>::const_iterator GetNextLockEvent( const Vector<LockE
     return next;
 }
 
-static Vector<LockEventPtr>::const_iterator GetNextLockEventShared( const Vector<LockEventPtr>::const_iterator& it, const Vector<LockEventPtr>::const_iterator& end, LockState& nextState, uint64_t threadBit )
+static Vector<LockEventPtr>::const_iterator GetNextLockEventShared( const Vector<LockEventPtr>::const_iterator& it, const Vector<LockEventPtr>::const_iterator& end, LockState& nextState, uint8_t thread )
 {
     const auto itptr = (const LockEventShared*)(const LockEvent*)it->ptr;
     auto next = it;
@@ -4943,23 +4938,23 @@ static Vector<LockEventPtr>::const_iterator GetNextLockEventShared( const Vector
             if( next->lockCount != 0 )
             {
                 const auto wait = next->waitList | ptr->waitShared;
-                if( GetThreadBit( next->lockingThread ) == threadBit )
+                if( next->lockingThread == thread )
                 {
-                    nextState = AreOtherWaiting( wait, threadBit ) ? LockState::HasBlockingLock : LockState::HasLock;
+                    nextState = AreOtherWaiting( wait, thread ) ? LockState::HasBlockingLock : LockState::HasLock;
                     break;
                 }
-                else if( IsThreadWaiting( wait, threadBit ) )
+                else if( IsThreadWaiting( wait, thread ) )
                 {
                     nextState = LockState::WaitLock;
                     break;
                 }
             }
-            else if( IsThreadWaiting( ptr->sharedList, threadBit ) )
+            else if( IsThreadWaiting( ptr->sharedList, thread ) )
             {
-                nextState = ( next->waitList != 0 ) ? LockState::HasBlockingLock : LockState::HasLock;
+                nextState = ( next->waitList.Any() ) ? LockState::HasBlockingLock : LockState::HasLock;
                 break;
             }
-            else if( ptr->sharedList != 0 && IsThreadWaiting( next->waitList, threadBit ) )
+            else if( ptr->sharedList.Any() && IsThreadWaiting( next->waitList, thread ) )
             {
                 nextState = LockState::WaitLock;
                 break;
@@ -4971,20 +4966,20 @@ static Vector<LockEventPtr>::const_iterator GetNextLockEventShared( const Vector
         while( next < end )
         {
             const auto ptr = (const LockEventShared*)(const LockEvent*)next->ptr;
-            if( next->lockCount == 0 && !IsThreadWaiting( ptr->sharedList, threadBit ) )
+            if( next->lockCount == 0 && !IsThreadWaiting( ptr->sharedList, thread ) )
             {
                 nextState = LockState::Nothing;
                 break;
             }
-            if( next->waitList != 0 )
+            if( next->waitList.Any() )
             {
-                if( AreOtherWaiting( next->waitList, threadBit ) )
+                if( AreOtherWaiting( next->waitList, thread ) )
                 {
                     nextState = LockState::HasBlockingLock;
                 }
                 break;
             }
-            else if( !IsThreadWaiting( ptr->sharedList, threadBit ) && ptr->waitShared != 0 )
+            else if( !IsThreadWaiting( ptr->sharedList, thread ) && ptr->waitShared.Any() )
             {
                 nextState = LockState::HasBlockingLock;
                 break;
@@ -5000,7 +4995,7 @@ static Vector<LockEventPtr>::const_iterator GetNextLockEventShared( const Vector
         while( next < end )
         {
             const auto ptr = (const LockEventShared*)(const LockEvent*)next->ptr;
-            if( next->lockCount == 0 && !IsThreadWaiting( ptr->sharedList, threadBit ) )
+            if( next->lockCount == 0 && !IsThreadWaiting( ptr->sharedList, thread ) )
             {
                 nextState = LockState::Nothing;
                 break;
@@ -5016,22 +5011,22 @@ static Vector<LockEventPtr>::const_iterator GetNextLockEventShared( const Vector
         while( next < end )
         {
             const auto ptr = (const LockEventShared*)(const LockEvent*)next->ptr;
-            if( GetThreadBit( next->lockingThread ) == threadBit )
+            if( next->lockingThread == thread )
             {
                 const auto wait = next->waitList | ptr->waitShared;
-                nextState = AreOtherWaiting( wait, threadBit ) ? LockState::HasBlockingLock : LockState::HasLock;
+                nextState = AreOtherWaiting( wait, thread ) ? LockState::HasBlockingLock : LockState::HasLock;
                 break;
             }
-            if( IsThreadWaiting( ptr->sharedList, threadBit ) )
+            if( IsThreadWaiting( ptr->sharedList, thread ) )
             {
-                nextState = ( next->waitList != 0 ) ? LockState::HasBlockingLock : LockState::HasLock;
+                nextState = ( next->waitList.Any() ) ? LockState::HasBlockingLock : LockState::HasLock;
                 break;
             }
             if( next->lockingThread != it->lockingThread )
             {
                 break;
             }
-            if( next->lockCount == 0 && !IsThreadWaiting( ptr->waitShared, threadBit ) )
+            if( next->lockCount == 0 && !IsThreadWaiting( ptr->waitShared, thread ) )
             {
                 break;
             }
@@ -5186,7 +5181,6 @@ int View::DrawLocks( uint64_t tid, bool hover, double pxns, const ImVec2& wpos,
         auto GetNextLockFunc = lockmap.type == LockType::Lockable ? GetNextLockEvent : GetNextLockEventShared;
 
         const auto thread = it->second;
-        const auto threadBit = GetThreadBit( thread );
 
         auto vbegin = std::lower_bound( tl.begin(), tl.end(), std::max( range.start, m_vd.zvStart - delay ), [] ( const auto& l, const auto& r ) { return l.ptr->Time() < r; } );
         const auto vend = std::lower_bound( vbegin, tl.end(), std::min( range.end, m_vd.zvEnd + resolution ), [] ( const auto& l, const auto& r ) { return l.ptr->Time() < r; } );
@@ -5200,9 +5194,9 @@ int View::DrawLocks( uint64_t tid, bool hover, double pxns, const ImVec2& wpos,
             {
                 if( vbegin->lockingThread == thread )
                 {
-                    state = AreOtherWaiting( vbegin->waitList, threadBit ) ? LockState::HasBlockingLock : LockState::HasLock;
+                    state = AreOtherWaiting( vbegin->waitList, thread ) ? LockState::HasBlockingLock : LockState::HasLock;
                 }
-                else if( IsThreadWaiting( vbegin->waitList, threadBit ) )
+                else if( IsThreadWaiting( vbegin->waitList, thread ) )
                 {
                     state = LockState::WaitLock;
                 }
@@ -5215,18 +5209,18 @@ int View::DrawLocks( uint64_t tid, bool hover, double pxns, const ImVec2& wpos,
             {
                 if( vbegin->lockingThread == thread )
                 {
-                    state = ( AreOtherWaiting( vbegin->waitList, threadBit ) || AreOtherWaiting( ptr->waitShared, threadBit ) ) ? LockState::HasBlockingLock : LockState::HasLock;
+                    state = ( AreOtherWaiting( vbegin->waitList, thread ) || AreOtherWaiting( ptr->waitShared, thread ) ) ? LockState::HasBlockingLock : LockState::HasLock;
                 }
-                else if( IsThreadWaiting( vbegin->waitList, threadBit ) || IsThreadWaiting( ptr->waitShared, threadBit ) )
+                else if( IsThreadWaiting( vbegin->waitList, thread ) || IsThreadWaiting( ptr->waitShared, thread ) )
                 {
                     state = LockState::WaitLock;
                 }
             }
-            else if( IsThreadWaiting( ptr->sharedList, threadBit ) )
+            else if( IsThreadWaiting( ptr->sharedList, thread ) )
             {
-                state = vbegin->waitList != 0 ? LockState::HasBlockingLock : LockState::HasLock;
+                state = vbegin->waitList.Any() ? LockState::HasBlockingLock : LockState::HasLock;
             }
-            else if( ptr->sharedList != 0 && IsThreadWaiting( vbegin->waitList, threadBit ) )
+            else if( ptr->sharedList.Any() && IsThreadWaiting( vbegin->waitList, thread ) )
             {
                 state = LockState::WaitLock;
             }
@@ -5245,14 +5239,14 @@ int View::DrawLocks( uint64_t tid, bool hover, double pxns, const ImVec2& wpos,
                 {
                     while( vbegin < vend && ( state == LockState::Nothing || state == LockState::HasLock ) )
                     {
-                        vbegin = GetNextLockFunc( vbegin, vend, state, threadBit );
+                        vbegin = GetNextLockFunc( vbegin, vend, state, thread );
                     }
                 }
                 else
                 {
                     while( vbegin < vend && state == LockState::Nothing )
                     {
-                        vbegin = GetNextLockFunc( vbegin, vend, state, threadBit );
+                        vbegin = GetNextLockFunc( vbegin, vend, state, thread );
                     }
                 }
                 if( vbegin >= vend ) break;
@@ -5261,7 +5255,7 @@ int View::DrawLocks( uint64_t tid, bool hover, double pxns, const ImVec2& wpos,
                 drawn = true;
 
                 LockState drawState = state;
-                auto next = GetNextLockFunc( vbegin, vend, state, threadBit );
+                auto next = GetNextLockFunc( vbegin, vend, state, thread );
 
                 const auto t0 = vbegin->ptr->Time();
                 int64_t t1 = next == tl.end() ? m_worker.GetLastTime() : next->ptr->Time();
@@ -5279,12 +5273,12 @@ int View::DrawLocks( uint64_t tid, bool hover, double pxns, const ImVec2& wpos,
                         auto ns = state;
                         while( n < vend && ( ns == LockState::Nothing || ns == LockState::HasLock ) )
                         {
-                            n = GetNextLockFunc( n, vend, ns, threadBit );
+                            n = GetNextLockFunc( n, vend, ns, thread );
                         }
                         if( n >= vend ) break;
                         if( n == next )
                         {
-                            n = GetNextLockFunc( n, vend, ns, threadBit );
+                            n = GetNextLockFunc( n, vend, ns, thread );
                         }
                         drawState = CombineLockState( drawState, state );
                         condensed++;
@@ -5308,12 +5302,12 @@ int View::DrawLocks( uint64_t tid, bool hover, double pxns, const ImVec2& wpos,
                         auto ns = state;
                         while( n < vend && ns == LockState::Nothing )
                         {
-                            n = GetNextLockFunc( n, vend, ns, threadBit );
+                            n = GetNextLockFunc( n, vend, ns, thread );
                         }
                         if( n >= vend ) break;
                         if( n == next )
                         {
-                            n = GetNextLockFunc( n, vend, ns, threadBit );
+                            n = GetNextLockFunc( n, vend, ns, thread );
                         }
                         drawState = CombineLockState( drawState, state );
                         condensed++;
@@ -5408,7 +5402,7 @@ int View::DrawLocks( uint64_t tid, bool hover, double pxns, const ImVec2& wpos,
                         {
                             if( it->ptr->thread == thread )
                             {
-                                if( ( it->lockingThread == thread || IsThreadWaiting( it->waitList, threadBit ) ) && it->ptr->SrcLoc() != 0 )
+                                if( ( it->lockingThread == thread || IsThreadWaiting( it->waitList, thread ) ) && it->ptr->SrcLoc() != 0 )
                                 {
                                     markloc = it->ptr->SrcLoc();
                                     break;
@@ -5439,9 +5433,9 @@ int View::DrawLocks( uint64_t tid, bool hover, double pxns, const ImVec2& wpos,
                                 {
                                     ImGui::Text( "Thread \"%s\" has %i locks. No other threads are waiting.", m_worker.GetThreadName( tid ), vbegin->lockCount );
                                 }
-                                if( vbegin->waitList != 0 )
+                                if( vbegin->waitList.Any() )
                                 {
-                                    assert( !AreOtherWaiting( next->waitList, threadBit ) );
+                                    assert( !AreOtherWaiting( next->waitList, thread ) );
                                     ImGui::TextUnformatted( "Recursive lock acquire in thread." );
                                 }
                                 break;
@@ -5449,23 +5443,20 @@ int View::DrawLocks( uint64_t tid, bool hover, double pxns, const ImVec2& wpos,
                             {
                                 if( vbegin->lockCount == 1 )
                                 {
-                                    ImGui::Text( "Thread \"%s\" has lock. Blocked threads (%" PRIu64 "):", m_worker.GetThreadName( tid ), TracyCountBits( vbegin->waitList ) );
+                                    ImGui::Text( "Thread \"%s\" has lock. Blocked threads (%" PRIu64 "):", m_worker.GetThreadName( tid ), vbegin->waitList.Count() );
                                 }
                                 else
                                 {
-                                    ImGui::Text( "Thread \"%s\" has %i locks. Blocked threads (%" PRIu64 "):", m_worker.GetThreadName( tid ), vbegin->lockCount, TracyCountBits( vbegin->waitList ) );
+                                    ImGui::Text( "Thread \"%s\" has %i locks. Blocked threads (%" PRIu64 "):", m_worker.GetThreadName( tid ), vbegin->lockCount, vbegin->waitList.Count() );
                                 }
-                                auto waitList = vbegin->waitList;
-                                int t = 0;
+                                const auto& waitList = vbegin->waitList;
                                 ImGui::Indent( ty );
-                                while( waitList != 0 )
+                                for( size_t t=0; t<lockmap.threadList.size(); t++ )
                                 {
-                                    if( waitList & 0x1 )
+                                    if( waitList.Test( t ) )
                                     {
                                         ImGui::Text( "\"%s\"", m_worker.GetThreadName( lockmap.threadList[t] ) );
                                     }
-                                    waitList >>= 1;
-                                    t++;
                                 }
                                 ImGui::Unindent( ty );
                                 break;
@@ -5496,88 +5487,76 @@ int View::DrawLocks( uint64_t tid, bool hover, double pxns, const ImVec2& wpos,
                             switch( drawState )
                             {
                             case LockState::HasLock:
-                                assert( vbegin->waitList == 0 );
-                                if( ptr->sharedList == 0 )
+                                assert( !vbegin->waitList.Any() );
+                                if( !ptr->sharedList.Any() )
                                 {
                                     assert( vbegin->lockCount == 1 );
                                     ImGui::Text( "Thread \"%s\" has lock. No other threads are waiting.", m_worker.GetThreadName( tid ) );
                                 }
-                                else if( TracyCountBits( ptr->sharedList ) == 1 )
+                                else if( ptr->sharedList.Count() == 1 )
                                 {
                                     ImGui::Text( "Thread \"%s\" has a sole shared lock. No other threads are waiting.", m_worker.GetThreadName( tid ) );
                                 }
                                 else
                                 {
                                     ImGui::Text( "Thread \"%s\" has shared lock. No other threads are waiting.", m_worker.GetThreadName( tid ) );
-                                    ImGui::Text( "Threads sharing the lock (%" PRIu64 "):", TracyCountBits( ptr->sharedList ) - 1 );
-                                    auto sharedList = ptr->sharedList;
-                                    int t = 0;
+                                    ImGui::Text( "Threads sharing the lock (%" PRIu64 "):", ptr->sharedList.Count() - 1 );
+                                    const auto& sharedList = ptr->sharedList;
                                     ImGui::Indent( ty );
-                                    while( sharedList != 0 )
+                                    for( size_t t=0; t<lockmap.threadList.size(); t++ )
                                     {
-                                        if( sharedList & 0x1 && t != thread )
+                                        if( sharedList.Test( t ) && t != thread )
                                         {
                                             ImGui::Text( "\"%s\"", m_worker.GetThreadName( lockmap.threadList[t] ) );
                                         }
-                                        sharedList >>= 1;
-                                        t++;
                                     }
                                     ImGui::Unindent( ty );
                                 }
                                 break;
                             case LockState::HasBlockingLock:
                             {
-                                if( ptr->sharedList == 0 )
+                                if( !ptr->sharedList.Any() )
                                 {
                                     assert( vbegin->lockCount == 1 );
-                                    ImGui::Text( "Thread \"%s\" has lock. Blocked threads (%" PRIu64 "):", m_worker.GetThreadName( tid ), TracyCountBits( vbegin->waitList ) + TracyCountBits( ptr->waitShared ) );
+                                    ImGui::Text( "Thread \"%s\" has lock. Blocked threads (%" PRIu64 "):", m_worker.GetThreadName( tid ), vbegin->waitList.Count() + ptr->waitShared.Count() );
                                 }
-                                else if( TracyCountBits( ptr->sharedList ) == 1 )
+                                else if( ptr->sharedList.Count() == 1 )
                                 {
-                                    ImGui::Text( "Thread \"%s\" has a sole shared lock. Blocked threads (%" PRIu64 "):", m_worker.GetThreadName( tid ), TracyCountBits( vbegin->waitList ) + TracyCountBits( ptr->waitShared ) );
+                                    ImGui::Text( "Thread \"%s\" has a sole shared lock. Blocked threads (%" PRIu64 "):", m_worker.GetThreadName( tid ), vbegin->waitList.Count() + ptr->waitShared.Count() );
                                 }
                                 else
                                 {
                                     ImGui::Text( "Thread \"%s\" has shared lock.", m_worker.GetThreadName( tid ) );
-                                    ImGui::Text( "Threads sharing the lock (%" PRIu64 "):", TracyCountBits( ptr->sharedList ) - 1 );
-                                    auto sharedList = ptr->sharedList;
-                                    int t = 0;
+                                    ImGui::Text( "Threads sharing the lock (%" PRIu64 "):", ptr->sharedList.Count() - 1 );
+                                    const auto& sharedList = ptr->sharedList;
                                     ImGui::Indent( ty );
-                                    while( sharedList != 0 )
+                                    for( size_t t=0; t<lockmap.threadList.size(); t++ )
                                     {
-                                        if( sharedList & 0x1 && t != thread )
+                                        if( sharedList.Test( t ) && t != thread )
                                         {
                                             ImGui::Text( "\"%s\"", m_worker.GetThreadName( lockmap.threadList[t] ) );
                                         }
-                                        sharedList >>= 1;
-                                        t++;
                                     }
                                     ImGui::Unindent( ty );
-                                    ImGui::Text( "Blocked threads (%" PRIu64 "):", TracyCountBits( vbegin->waitList ) + TracyCountBits( ptr->waitShared ) );
+                                    ImGui::Text( "Blocked threads (%" PRIu64 "):", vbegin->waitList.Count() + ptr->waitShared.Count() );
                                 }
 
-                                auto waitList = vbegin->waitList;
-                                int t = 0;
+                                const auto& waitList = vbegin->waitList;
                                 ImGui::Indent( ty );
-                                while( waitList != 0 )
+                                for( size_t t=0; t<lockmap.threadList.size(); t++ )
                                 {
-                                    if( waitList & 0x1 )
+                                    if( waitList.Test( t ) )
                                     {
                                         ImGui::Text( "\"%s\"", m_worker.GetThreadName( lockmap.threadList[t] ) );
                                     }
-                                    waitList >>= 1;
-                                    t++;
                                 }
-                                auto waitShared = ptr->waitShared;
-                                t = 0;
-                                while( waitShared != 0 )
+                                const auto& waitShared = ptr->waitShared;
+                                for( size_t t=0; t<lockmap.threadList.size(); t++ )
                                 {
-                                    if( waitShared & 0x1 )
+                                    if( waitShared.Test( t ) )
                                     {
                                         ImGui::Text( "\"%s\"", m_worker.GetThreadName( lockmap.threadList[t] ) );
                                     }
-                                    waitShared >>= 1;
-                                    t++;
                                 }
                                 ImGui::Unindent( ty );
                                 break;
@@ -5585,9 +5564,9 @@ int View::DrawLocks( uint64_t tid, bool hover, double pxns, const ImVec2& wpos,
                             case LockState::WaitLock:
                             {
                                 assert( vbegin->lockCount == 0 || vbegin->lockCount == 1 );
-                                if( vbegin->lockCount != 0 || ptr->sharedList != 0 )
+                                if( vbegin->lockCount != 0 || ptr->sharedList.Any() )
                                 {
-                                    ImGui::Text( "Thread \"%s\" is blocked by other threads (%" PRIu64 "):", m_worker.GetThreadName( tid ), vbegin->lockCount + TracyCountBits( ptr->sharedList ) );
+                                    ImGui::Text( "Thread \"%s\" is blocked by other threads (%" PRIu64 "):", m_worker.GetThreadName( tid ), vbegin->lockCount + ptr->sharedList.Count() );
                                 }
                                 else
                                 {
@@ -5598,16 +5577,13 @@ int View::DrawLocks( uint64_t tid, bool hover, double pxns, const ImVec2& wpos,
                                 {
                                     ImGui::Text( "\"%s\"", m_worker.GetThreadName( lockmap.threadList[vbegin->lockingThread] ) );
                                 }
-                                auto sharedList = ptr->sharedList;
-                                int t = 0;
-                                while( sharedList != 0 )
+                                const auto& sharedList = ptr->sharedList;
+                                for( size_t t=0; t<lockmap.threadList.size(); t++ )
                                 {
-                                    if( sharedList & 0x1 )
+                                    if( sharedList.Test( t ) )
                                     {
                                         ImGui::Text( "\"%s\"", m_worker.GetThreadName( lockmap.threadList[t] ) );
                                     }
-                                    sharedList >>= 1;
-                                    t++;
                                 }
                                 ImGui::Unindent( ty );
                                 break;
@@ -5678,7 +5654,7 @@ int View::DrawLocks( uint64_t tid, bool hover, double pxns, const ImVec2& wpos,
         {
             while( vbegin < vend && ( state == LockState::Nothing || ( m_vd.onlyContendedLocks && state == LockState::HasLock ) ) )
             {
-                vbegin = GetNextLockFunc( vbegin, vend, state, threadBit );
+                vbegin = GetNextLockFunc( vbegin, vend, state, thread );
             }
             if( vbegin < vend ) cnt++;
         }
@@ -7101,6 +7077,47 @@ void View::DrawZoneInfoWindow()
         ImGui::SameLine();
         TextDisabledUnformatted( buf );
     }
+    const auto counters = m_worker.GetZoneCounters( ev );
+    if( counters )
+    {
+        ImGui::Separator();
+        TextFocused( "Cycles:", RealToString( counters->cycles ) );
+        ImGui::SameLine();
+        TextFocused( "Instructions:", RealToString( counters->instructions ) );
+        if( counters->cycles != 0 )
+        {
+            char buf[64];
+            sprintf( buf, "%.2f", double( counters->instructions ) / counters->cycles );
+            ImGui::SameLine();
+            TextFocused( "IPC:", buf );
+        }
+        TextFocused( "Cache misses:", RealToString( counters->cacheMisses ) );
+        if( counters->instructions != 0 )
+        {
+            ImGui::SameLine();
+            ImGui::TextDisabled( "(%.2f per 1k instructions)", 1000. * counters->cacheMisses / counters->instructions );
+        }
+        TextFocused( "Branch misses:", RealToString( counters->branchMisses ) );
+        if( counters->instructions != 0 )
+        {
+            ImGui::SameLine();
+            ImGui::TextDisabled( "(%.2f per 1k instructions)", 1000. * counters->branchMisses / counters->instructions );
+        }
+#ifndef TRACY_NO_STATISTICS
+        if( m_worker.AreSourceLocationZonesReady() )
+        {
+            auto& zoneData = m_worker.GetZonesForSourceLocation( ev.SrcLoc() );
+            if( zoneData.counters.cycles != 0 )
+            {
+                char buf[64];
+                sprintf( buf, "%.2f", double( zoneData.counters.instructions ) / zoneData.counters.cycles );
+                TextFocused( "IPC of all zones at this location:", buf );
+                ImGui::SameLine();
+                ImGui::TextDisabled( "(%s zones)", RealToString( zoneData.countersCnt ) );
+            }
+        }
+#endif
+    }
     const auto ctx = m_worker.GetContextSwitchData( tid );
     if( ctx )
     {
@@ -12362,8 +12379,21 @@ void View::DrawStatistics()
         }
         else
         {
+            // Hardware counter ratios are computed over the whole capture.
+            const auto hwCounters = m_worker.HasZoneCounters();
+            auto counterRatio = [this]( int16_t srcloc, int column ) -> double {
+                const auto& c = m_worker.GetZonesForSourceLocation( srcloc ).counters;
+                switch( column )
+                {
+                case 5: return c.cycles != 0 ? double( c.instructions ) / c.cycles : -1;
+                case 6: return c.instructions != 0 ? 1000. * c.cacheMisses / c.instructions : -1;
+                case 7: return c.instructions != 0 ? 1000. * c.branchMisses / c.instructions : -1;
+                default: assert( false ); return -1;
+                }
+            };
+
             ImGui::BeginChild( "##statistics" );
-            if( ImGui::BeginTable( "##statistics", 5, ImGuiTableFlags_Resizable | ImGuiTableFlags_Reorderable | ImGuiTableFlags_Hideable | ImGuiTableFlags_Sortable | ImGuiTableFlags_BordersInnerV | ImGuiTableFlags_ScrollY ) )
+            if( ImGui::BeginTable( "##statistics", hwCounters ? 8 : 5, ImGuiTableFlags_Resizable | ImGuiTableFlags_Reorderable | ImGuiTableFlags_Hideable | ImGuiTableFlags_Sortable | ImGuiTableFlags_BordersInnerV | ImGuiTableFlags_ScrollY ) )
             {
                 ImGui::TableSetupScrollFreeze( 0, 1 );
                 ImGui::TableSetupColumn( "Name", ImGuiTableColumnFlags_NoHide );
@@ -12371,6 +12401,12 @@ void View::DrawStatistics()
                 ImGui::TableSetupColumn( "Total time", ImGuiTableColumnFlags_DefaultSort | ImGuiTableColumnFlags_PreferSortDescending | ImGuiTableColumnFlags_WidthFixed | ImGuiTableColumnFlags_NoResize );
                 ImGui::TableSetupColumn( "Counts", ImGuiTableColumnFlags_PreferSortDescending | ImGuiTableColumnFlags_WidthFixed | ImGuiTableColumnFlags_NoResize );
                 ImGui::TableSetupColumn( "MTPC", ImGuiTableColumnFlags_PreferSortDescending | ImGuiTableColumnFlags_WidthFixed | ImGuiTableColumnFlags_NoResize );
+                if( hwCounters )
+                {
+                    ImGui::TableSetupColumn( "IPC", ImGuiTableColumnFlags_WidthFixed | ImGuiTableColumnFlags_NoResize );
+                    ImGui::TableSetupColumn( "Cache MPKI", ImGuiTableColumnFlags_PreferSortDescending | ImGuiTableColumnFlags_WidthFixed | ImGuiTableColumnFlags_NoResize );
+                    ImGui::TableSetupColumn( "Branch MPKI", ImGuiTableColumnFlags_PreferSortDescending | ImGuiTableColumnFlags_WidthFixed | ImGuiTableColumnFlags_NoResize );
+                }
                 ImGui::TableHeadersRow();
 
                 const auto& sortspec = *ImGui::TableGetSortSpecs()->Specs;
@@ -12444,6 +12480,21 @@ void View::DrawStatistics()
                         }
                     }
                     break;
+                case 5:
+                case 6:
+                case 7:
+                {
+                    const auto column = sortspec.ColumnIndex;
+                    if( sortspec.SortDirection == ImGuiSortDirection_Ascending )
+                    {
+                        pdqsort_branchless( srcloc.begin(), srcloc.end(), [&counterRatio, column]( const auto& lhs, const auto& rhs ) { return counterRatio( lhs.srcloc, column ) < counterRatio( rhs.srcloc, column ); } );
+                    }
+                    else
+                    {
+                        pdqsort_branchless( srcloc.begin(), srcloc.end(), [&counterRatio, column]( const auto& lhs, const auto& rhs ) { return counterRatio( lhs.srcloc, column ) > counterRatio( rhs.srcloc, column ); } );
+                    }
+                    break;
+                }
                 default:
                     assert( false );
                     break;
@@ -12500,6 +12551,15 @@ void View::DrawStatistics()
                     ImGui::TextUnformatted( RealToString( v.numZones ) );
                     ImGui::TableNextColumn();
                     ImGui::TextUnformatted( TimeToString( ( m_statSelf ? v.selfTotal : v.total ) / v.numZones ) );
+                    if( hwCounters )
+                    {
+                        for( int column=5; column<8; column++ )
+                        {
+                            ImGui::TableNextColumn();
+                            const auto ratio = counterRatio( v.srcloc, column );
+                            if( ratio >= 0 ) ImGui::Text( "%.2f", ratio );
+                        }
+                    }
                     ImGui::PopID();
                 }
                 ImGui::EndTable();
@@ -14568,23 +14628,23 @@ void View::DrawLockInfoWindow()
         }
         if( waitState )
         {
-            if( v.waitList == 0 )
+            if( !v.waitList.Any() )
             {
                 waitTotalTime += v.ptr->Time() - waitStartTime;
                 waitState = false;
             }
             else
             {
-                maxWaitingThreads = std::max<uint32_t>( maxWaitingThreads, TracyCountBits( v.waitList ) );
+                maxWaitingThreads = std::max<uint32_t>( maxWaitingThreads, v.waitList.Count() );
             }
         }
         else
         {
-            if( v.waitList != 0 )
+            if( v.waitList.Any() )
             {
                 waitStartTime = v.ptr->Time();
                 waitState = true;
-                maxWaitingThreads = std::max<uint32_t>( maxWaitingThreads, TracyCountBits( v.waitList ) );
+                maxWaitingThreads = std::max<uint32_t>( maxWaitingThreads, v.waitList.Count() );
             }
         }
     }
@@ -15923,12 +15983,12 @@ unordered_flat_map<uint32_t, View::PathData> View::GetCallstackPaths( const MemD
             auto it = pathSum.find( ev.CsAlloc() );
             if( it == pathSum.end() )
             {
-                pathSum.emplace( ev.CsAlloc(), PathData { 1, ev.Size() } );
+                pathSum.emplace( ev.CsAlloc(), PathData { 1, m_worker.ScaleMemSize( ev.Size() ) } );
             }
             else
             {
                 it->second.cnt++;
-                it->second.mem += ev.Size();
+                it->second.mem += m_worker.ScaleMemSize( ev.Size() );
             }
         }
     }
@@ -15942,12 +16002,12 @@ unordered_flat_map<uint32_t, View::PathData> View::GetCallstackPaths( const MemD
             auto it = pathSum.find( ev.CsAlloc() );
             if( it == pathSum.end() )
             {
-                pathSum.emplace( ev.CsAlloc(), PathData { 1, ev.Size() } );
+                pathSum.emplace( ev.CsAlloc(), PathData { 1, m_worker.ScaleMemSize( ev.Size() ) } );
             }
             else
             {
                 it->second.cnt++;
-                it->second.mem += ev.Size();
+                it->second.mem += m_worker.ScaleMemSize( ev.Size() );
             }
         }
     }
@@ -16270,6 +16330,13 @@ void View::DrawMemory()
     ImGui::Text( "%-15s", MemSizeToString( mem.usage ) );
     ImGui::SameLine();
     TextFocused( "Memory span:", MemSizeToString( mem.high - mem.low ) );
+    if( m_worker.GetMemSamplingInterval() != 0 )
+    {
+        ImGui::SameLine();
+        TextFocused( "Sampling interval:", MemSizeToString( m_worker.GetMemSamplingInterval() ) );
+        ImGui::SameLine();
+        DrawHelpMarker( "Only a sample of allocations was recorded. Memory usage, the memory plot and call stack trees are estimates, scaled from the sampled allocations. Allocation counts and lists show the sampled allocations only." );
+    }
     ImGui::SameLine();
     ImGui::Spacing();
     ImGui::SameLine();
@@ -17036,6 +17103,18 @@ void View::ZoneTooltip( const ZoneEvent& ev )
         ImGui::SameLine();
         TextDisabledUnformatted( buf );
     }
+    const auto counters = m_worker.GetZoneCounters( ev );
+    if( counters && counters->cycles != 0 )
+    {
+        char buf[64];
+        sprintf( buf, "%.2f", double( counters->instructions ) / counters->cycles );
+        TextFocused( "IPC:", buf );
+        if( counters->instructions != 0 )
+        {
+            ImGui::SameLine();
+            ImGui::TextDisabled( "(%.2f cache, %.2f branch misses per 1k instructions)", 1000. * counters->cacheMisses / counters->instructions, 1000. * counters->branchMisses / counters->instructions );
+        }
+    }
     const auto ctx = m_worker.GetContextSwitchData( tid );
     if( ctx )
     {
@@ -68,13 +68,12 @@ static void UpdateLockCountLockable( LockMap& lockmap, size_t pos )
     bool isContended = lockmap.isContended;
     uint8_t lockingThread;
     uint8_t lockCount;
-    uint64_t waitList;
+    LockThreadMask waitList = {};
 
     if( pos == 0 )
     {
         lockingThread = 0;
         lockCount = 0;
-        waitList = 0;
     }
     else
     {
@@ -88,17 +87,17 @@ static void UpdateLockCountLockable( LockMap& lockmap, size_t pos )
     while( pos != end )
     {
         auto& tl = timeline[pos];
-        const auto tbit = uint64_t( 1 ) << tl.ptr->thread;
+        const auto thread = tl.ptr->thread;
         switch( (LockEvent::Type)tl.ptr->type )
         {
         case LockEvent::Type::Wait:
-            waitList |= tbit;
+            waitList.Set( thread );
             break;
         case LockEvent::Type::Obtain:
             assert( lockCount < std::numeric_limits<uint8_t>::max() );
-            assert( ( waitList & tbit ) != 0 );
-            waitList &= ~tbit;
-            lockingThread = tl.ptr->thread;
+            assert( waitList.Test( thread ) );
+            waitList.Clear( thread );
+            lockingThread = thread;
             lockCount++;
             break;
         case LockEvent::Type::Release:
@@ -111,7 +110,7 @@ static void UpdateLockCountLockable( LockMap& lockmap, size_t pos )
         tl.lockingThread = lockingThread;
         tl.waitList = waitList;
         tl.lockCount = lockCount;
-        if( !isContended ) isContended = lockCount != 0 && waitList != 0;
+        if( !isContended ) isContended = lockCount != 0 && waitList.Any();
         pos++;
     }
 
@@ -124,17 +123,14 @@ static void UpdateLockCountSharedLockable( LockMap& lockmap, size_t pos )
     bool isContended = lockmap.isContended;
     uint8_t lockingThread;
     uint8_t lockCount;
-    uint64_t waitShared;
-    uint64_t waitList;
-    uint64_t sharedList;
+    LockThreadMask waitShared = {};
+    LockThreadMask waitList = {};
+    LockThreadMask sharedList = {};
 
     if( pos == 0 )
     {
         lockingThread = 0;
         lockCount = 0;
-        waitShared = 0;
-        waitList = 0;
-        sharedList = 0;
     }
     else
     {
@@ -154,20 +150,20 @@ static void UpdateLockCountSharedLockable( LockMap& lockmap, size_t pos )
     {
         auto& tl = timeline[pos];
         const auto tlp = (LockEventShared*)(LockEvent*)tl.ptr;
-        const auto tbit = uint64_t( 1 ) << tlp->thread;
+        const auto thread = tlp->thread;
         switch( (LockEvent::Type)tlp->type )
         {
         case LockEvent::Type::Wait:
-            waitList |= tbit;
+            waitList.Set( thread );
             break;
         case LockEvent::Type::WaitShared:
-            waitShared |= tbit;
+            waitShared.Set( thread );
             break;
         case LockEvent::Type::Obtain:
             assert( lockCount < std::numeric_limits<uint8_t>::max() );
-            assert( ( waitList & tbit ) != 0 );
-            waitList &= ~tbit;
-            lockingThread = tlp->thread;
+            assert( waitList.Test( thread ) );
+            waitList.Clear( thread );
+            lockingThread = thread;
             lockCount++;
             break;
         case LockEvent::Type::Release:
@@ -175,14 +171,14 @@ static void UpdateLockCountSharedLockable( LockMap& lockmap, size_t pos )
             lockCount--;
             break;
         case LockEvent::Type::ObtainShared:
-            assert( ( waitShared & tbit ) != 0 );
-            assert( ( sharedList & tbit ) == 0 );
-            waitShared &= ~tbit;
-            sharedList |= tbit;
+            assert( waitShared.Test( thread ) );
+            assert( !sharedList.Test( thread ) );
+            waitShared.Clear( thread );
+            sharedList.Set( thread );
             break;
         case LockEvent::Type::ReleaseShared:
-            assert( ( sharedList & tbit ) != 0 );
-            sharedList &= ~tbit;
+            assert( sharedList.Test( thread ) );
+            sharedList.Clear( thread );
             break;
         default:
             break;
@@ -192,7 +188,7 @@ static void UpdateLockCountSharedLockable( LockMap& lockmap, size_t pos )
         tl.waitList = waitList;
         tlp->sharedList = sharedList;
         tl.lockCount = lockCount;
-        if( !isContended ) isContended = ( lockCount != 0 && ( waitList != 0 || waitShared != 0 ) ) || ( sharedList != 0 && waitList != 0 );
+        if( !isContended ) isContended = ( lockCount != 0 && ( waitList.Any() || waitShared.Any() ) ) || ( sharedList.Any() && waitList.Any() );
         pos++;
     }
 
@@ -252,6 +248,38 @@ Worker::Worker( const char* addr, uint16_t port )
     , m_callstackFrameStaging( nullptr )
     , m_traceVersion( CurrentVersion )
     , m_loadTime( 0 )
+{
+    InitLive();
+
+    m_thread = std::thread( [this] { SetThreadName( "Tracy Worker" ); Exec(); } );
+    m_threadNet = std::thread( [this] { SetThreadName( "Tracy Network" ); Network(); } );
+}
+
+Worker::Worker( FILE* rawStream )
+    : m_port( 0 )
+    , m_rawStream( rawStream )
+    , m_hasData( false )
+    , m_stream( LZ4_createStreamDecode() )
+    , m_buffer( new char[TargetFrameSize*3 + 1] )
+    , m_bufferOffset( 0 )
+    , m_pendingStrings( 0 )
+    , m_pendingThreads( 0 )
+    , m_pendingExternalNames( 0 )
+    , m_pendingSourceLocation( 0 )
+    , m_pendingCallstackFrames( 0 )
+    , m_pendingCallstackSubframes( 0 )
+    , m_pendingCodeInformation( 0 )
+    , m_callstackFrameStaging( nullptr )
+    , m_traceVersion( CurrentVersion )
+    , m_loadTime( 0 )
+{
+    InitLive();
+
+    m_threadNet = std::thread( [this] { SetThreadName( "Tracy Network" ); Network(); } );
+    Exec();
+}
+
+void Worker::InitLive()
 {
     m_data.sourceLocationExpand.push_back( 0 );
     m_data.localThreadCompress.InitZero();
@@ -270,9 +298,6 @@ Worker::Worker( const char* addr, uint16_t port )
     m_data.ctxUsageReady = true;
     m_data.symbolSamplesReady = true;
 #endif
-
-    m_thread = std::thread( [this] { SetThreadName( "Tracy Worker" ); Exec(); } );
-    m_threadNet = std::thread( [this] { SetThreadName( "Tracy Network" ); Network(); } );
 }
 
 Worker::Worker( const char* name, const char* program, const std::vector<ImportEventTimeline>& timeline, const std::vector<ImportEventMessages>& messages, const std::vector<ImportEventPlots>& plots, const std::unordered_map<uint64_t, std::string>& threadNames )
@@ -285,6 +310,7 @@ Worker::Worker( const char* name, const char* program, const std::vector<ImportE
     , m_executableTime( 0 )
     , m_pid( 0 )
     , m_samplingPeriod( 0 )
+    , m_memSamplingInterval( 0 )
     , m_stream( nullptr )
     , m_buffer( nullptr )
     , m_traceVersion( CurrentVersion )
@@ -507,6 +533,14 @@ Worker::Worker( FileRead& f, EventType::Type eventMask, bool bgTasks )
     {
         m_samplingPeriod = 0;
     }
+    if( fileVer >= FileVersion( 0, 7, 8 ) )
+    {
+        f.Read( m_memSamplingInterval );
+    }
+    else
+    {
+        m_memSamplingInterval = 0;
+    }
     if( fileVer >= FileVersion( 0, 6, 7 ) )
     {
         f.Read( m_data.cpuArch );
@@ -869,6 +903,19 @@ Worker::Worker( FileRead& f, EventType::Type eventMask, bool bgTasks )
         m_data.zoneExtra.push_back( ZoneExtra {} );
     }
 
+    if( fileVer >= FileVersion( 0, 7, 7 ) )
+    {
+        f.Read( sz );
+        m_data.zoneCounters.reserve( sz );
+        for( uint64_t i=0; i<sz; i++ )
+        {
+            uint32_t extra;
+            ZoneCounters counters;
+            f.Read2( extra, counters );
+            m_data.zoneCounters.emplace( extra, counters );
+        }
+    }
+
     s_loadProgress.progress.store( LoadProgress::Zones, std::memory_order_relaxed );
     f.Read( sz );
     s_loadProgress.subTotal.store( sz, std::memory_order_relaxed );
@@ -1183,7 +1230,7 @@ Worker::Worker( FileRead& f, EventType::Type eventMask, bool bgTasks )
     s_loadProgress.subTotal.store( 0, std::memory_order_relaxed );
     s_loadProgress.progress.store( LoadProgress::CallStacks, std::memory_order_relaxed );
     f.Read( sz );
-    m_data.callstackPayload.reserve( sz );
+    m_data.callstackPayload.reserve( sz + 1 );
     if( fileVer >= FileVersion( 0, 6, 8 ) )
     {
         for( uint64_t i=0; i<sz; i++ )
@@ -2566,6 +2613,13 @@ std::vector<int16_t> Worker::GetMatchingSourceLocation( const char* query, bool
     return match;
 }
 
+const ZoneCounters* Worker::GetZoneCounters( const ZoneEvent& ev ) const
+{
+    if( !HasZoneExtra( ev ) ) return nullptr;
+    auto it = m_data.zoneCounters.find( ev.extra );
+    return it != m_data.zoneCounters.end() ? &it->second : nullptr;
+}
+
 #ifndef TRACY_NO_STATISTICS
 const Worker::SourceLocationZones& Worker::GetZonesForSourceLocation( int16_t srcloc ) const
 {
@@ -2619,20 +2673,64 @@ void Worker::Network()
         }
 
         auto buf = m_buffer + m_bufferOffset;
-        lz4sz_t lz4sz;
-        if( !m_sock.Read( &lz4sz, sizeof( lz4sz ), 10, ShouldExit ) ) goto close;
-        if( !m_sock.Read( lz4buf.get(), lz4sz, 10, ShouldExit ) ) goto close;
-        auto bb = m_bytes.load( std::memory_order_relaxed );
-        m_bytes.store( bb + sizeof( lz4sz ) + lz4sz, std::memory_order_relaxed );
+        int sz;
+        RawStreamBlockHeader block = {};
+        if( m_rawStream )
+        {
+            lz4sz_t lz4sz;
+            if( fread( &block, 1, sizeof( block ), m_rawStream ) != sizeof( block ) ) goto close;
+            if( fread( &lz4sz, 1, sizeof( lz4sz ), m_rawStream ) != sizeof( lz4sz ) || lz4sz > LZ4Size ) goto close;
+            if( fread( lz4buf.get(), 1, lz4sz, m_rawStream ) != lz4sz ) goto close;
+            auto bb = m_bytes.load( std::memory_order_relaxed );
+            m_bytes.store( bb + sizeof( block ) + sizeof( lz4sz ) + lz4sz, std::memory_order_relaxed );
+
+            sz = LZ4_decompress_safe_continue( (LZ4_streamDecode_t*)m_stream, lz4buf.get(), buf, lz4sz, TargetFrameSize );
+            if( sz < 0 ) goto close;
+            bb = m_decBytes.load( std::memory_order_relaxed );
+            m_decBytes.store( bb + sz, std::memory_order_relaxed );
+        }
+        else
+#ifdef TRACY_HAS_SHM_TRANSPORT
+        if( m_shm )
+        {
+            for(;;)
+            {
+                sz = m_shm->Read( buf, TargetFrameSize );
+                if( sz >= 0 ) break;
+                if( sz == -2 || ShouldExit() ) goto close;
+                // The client writes everything to the ring before it closes the
+                // socket, so the ring has to be checked once more after that.
+                if( m_sock.IsPeerClosed() )
+                {
+                    sz = m_shm->Read( buf, TargetFrameSize );
+                    if( sz >= 0 ) break;
+                    goto close;
+                }
+                std::this_thread::sleep_for( std::chrono::milliseconds( 1 ) );
+            }
+            auto bb = m_bytes.load( std::memory_order_relaxed );
+            m_bytes.store( bb + sz, std::memory_order_relaxed );
+            bb = m_decBytes.load( std::memory_order_relaxed );
+            m_decBytes.store( bb + sz, std::memory_order_relaxed );
+        }
+        else
+#endif
+        {
+            lz4sz_t lz4sz;
+            if( !m_sock.Read( &lz4sz, sizeof( lz4sz ), 10, ShouldExit ) ) goto close;
+            if( !m_sock.Read( lz4buf.get(), lz4sz, 10, ShouldExit ) ) goto close;
+            auto bb = m_bytes.load( std::memory_order_relaxed );
+            m_bytes.store( bb + sizeof( lz4sz ) + lz4sz, std::memory_order_relaxed );
 
-        auto sz = LZ4_decompress_safe_continue( (LZ4_streamDecode_t*)m_stream, lz4buf.get(), buf, lz4sz, TargetFrameSize );
-        assert( sz >= 0 );
-        bb = m_decBytes.load( std::memory_order_relaxed );
-        m_decBytes.store( bb + sz, std::memory_order_relaxed );
+            sz = LZ4_decompress_safe_continue( (LZ4_streamDecode_t*)m_stream, lz4buf.get(), buf, lz4sz, TargetFrameSize );
+            assert( sz >= 0 );
+            bb = m_decBytes.load( std::memory_order_relaxed );
+            m_decBytes.store( bb + sz, std::memory_order_relaxed );
+        }
 
         {
             std::lock_guard<std::mutex> lock( m_netReadLock );
-            m_netRead.push_back( NetBuffer { m_bufferOffset, sz } );
+            m_netRead.push_back( NetBuffer { m_bufferOffset, sz, block } );
             m_netReadCv.notify_one();
         }
 
@@ -2646,27 +2744,24 @@ close:
     m_netReadCv.notify_one();
 }
 
-void Worker::Exec()
+bool Worker::Handshake()
 {
     auto ShouldExit = [this] { return m_shutdown.load( std::memory_order_relaxed ); };
 
-    for(;;)
-    {
-        if( m_shutdown.load( std::memory_order_relaxed ) ) { m_netWriteCv.notify_one(); return; };
-        if( m_sock.Connect( m_addr.c_str(), m_port ) ) break;
-        std::this_thread::sleep_for( std::chrono::milliseconds( 10 ) );
-    }
-
-    std::chrono::time_point<std::chrono::high_resolution_clock> t0;
-
     m_sock.Send( HandshakeShibboleth, HandshakeShibbolethSize );
     uint32_t protocolVersion = ProtocolVersion;
     m_sock.Send( &protocolVersion, sizeof( protocolVersion ) );
+#ifdef TRACY_HAS_SHM_TRANSPORT
+    const TransportType transport = TransportShm;
+#else
+    const TransportType transport = TransportSocket;
+#endif
+    m_sock.Send( &transport, sizeof( transport ) );
     HandshakeStatus handshake;
     if( !m_sock.Read( &handshake, sizeof( handshake ), 10, ShouldExit ) )
     {
         m_handshake.store( HandshakeDropped, std::memory_order_relaxed );
-        goto close;
+        return false;
     }
     m_handshake.store( handshake, std::memory_order_relaxed );
     switch( handshake )
@@ -2676,8 +2771,81 @@ void Worker::Exec()
     case HandshakeProtocolMismatch:
     case HandshakeNotAvailable:
     default:
-        goto close;
+        return false;
+    }
+
+    if( transport == TransportShm )
+    {
+        ShmOfferMessage offer;
+        if( !m_sock.Read( &offer, sizeof( offer ), 10, ShouldExit ) )
+        {
+            m_handshake.store( HandshakeDropped, std::memory_order_relaxed );
+            return false;
+        }
+#ifdef TRACY_HAS_SHM_TRANSPORT
+        if( offer.available )
+        {
+            // Connecting only succeeds if the client runs on this machine.
+            offer.socketName[ShmSocketNameSize-1] = '\0';
+            ShmConnect conn;
+            const uint8_t accepted = conn.Connect( offer.socketName );
+            m_sock.Send( &accepted, sizeof( accepted ) );
+            if( accepted )
+            {
+                const auto fd = conn.ReceiveFd( offer.token, 2000 );
+                if( fd != -1 )
+                {
+                    auto ring = std::make_unique<ShmRing>();
+                    if( ring->Map( fd ) ) m_shm = std::move( ring );
+                }
+                if( !m_shm )
+                {
+                    m_handshake.store( HandshakeDropped, std::memory_order_relaxed );
+                    return false;
+                }
+            }
+        }
+#endif
     }
+    return true;
+}
+
+bool Worker::ReadRawStreamHeader()
+{
+    char magic[RawStreamMagicSize];
+    if( fread( magic, 1, RawStreamMagicSize, m_rawStream ) != RawStreamMagicSize || memcmp( magic, RawStreamMagic, RawStreamMagicSize ) != 0 )
+    {
+        m_handshake.store( HandshakeDropped, std::memory_order_relaxed );
+        return false;
+    }
+    uint32_t protocolVersion;
+    if( fread( &protocolVersion, 1, sizeof( protocolVersion ), m_rawStream ) != sizeof( protocolVersion ) || protocolVersion != ProtocolVersion )
+    {
+        m_handshake.store( HandshakeProtocolMismatch, std::memory_order_relaxed );
+        return false;
+    }
+    m_handshake.store( HandshakeWelcome, std::memory_order_relaxed );
+    return true;
+}
+
+void Worker::Exec()
+{
+    auto ShouldExit = [this] { return m_shutdown.load( std::memory_order_relaxed ); };
+    auto ReadInit = [this, &ShouldExit] ( void* buf, int len ) { return m_rawStream ? fread( buf, 1, len, m_rawStream ) == size_t( len ) : m_sock.Read( buf, len, 10, ShouldExit ); };
+
+    if( !m_rawStream )
+    {
+        for(;;)
+        {
+            if( m_shutdown.load( std::memory_order_relaxed ) ) { m_netWriteCv.notify_one(); return; };
+            if( m_sock.Connect( m_addr.c_str(), m_port ) ) break;
+            std::this_thread::sleep_for( std::chrono::milliseconds( 10 ) );
+        }
+    }
+
+    std::chrono::time_point<std::chrono::high_resolution_clock> t0;
+
+    if( m_rawStream ? !ReadRawStreamHeader() : !Handshake() ) goto close;
 
     m_data.framesBase = m_data.frames.Retrieve( 0, [this] ( uint64_t name ) {
         auto fd = m_slab.AllocInit<FrameData>();
@@ -2692,7 +2860,7 @@ void Worker::Exec()
 
     {
         WelcomeMessage welcome;
-        if( !m_sock.Read( &welcome, sizeof( welcome ), 10, ShouldExit ) )
+        if( !ReadInit( &welcome, sizeof( welcome ) ) )
         {
             m_handshake.store( HandshakeDropped, std::memory_order_relaxed );
             goto close;
@@ -2707,13 +2875,15 @@ void Worker::Exec()
         m_resolution = TscTime( welcome.resolution );
         m_pid = welcome.pid;
         m_samplingPeriod = welcome.samplingPeriod;
+        m_memSamplingInterval = welcome.memSamplingInterval;
         m_onDemand = welcome.onDemand;
         m_captureProgram = welcome.programName;
         m_captureTime = welcome.epoch;
         m_executableTime = welcome.exectime;
         m_ignoreMemFreeFaults = welcome.onDemand || welcome.isApple;
         m_data.cpuArch = (CpuArchitecture)welcome.cpuArch;
-        m_codeTransfer = welcome.codeTransfer;
+        // Symbol code can only be retrieved from a running client.
+        m_codeTransfer = welcome.codeTransfer && !m_rawStream;
         m_data.cpuId = welcome.cpuId;
         memcpy( m_data.cpuManufacturer, welcome.cpuManufacturer, 12 );
         m_data.cpuManufacturer[12] = '\0';
@@ -2731,7 +2901,7 @@ void Worker::Exec()
         if( welcome.onDemand != 0 )
         {
             OnDemandPayloadMessage onDemand;
-            if( !m_sock.Read( &onDemand, sizeof( onDemand ), 10, ShouldExit ) )
+            if( !ReadInit( &onDemand, sizeof( onDemand ) ) )
             {
                 m_handshake.store( HandshakeDropped, std::memory_order_relaxed );
                 goto close;
@@ -2741,7 +2911,14 @@ void Worker::Exec()
         }
     }
 
-    m_serverQuerySpaceBase = m_serverQuerySpaceLeft = ( m_sock.GetSendBufSize() / ServerQueryPacketSize ) - ServerQueryPacketSize;   // leave space for terminate request
+    if( !m_rawStream )
+    {
+        m_serverQuerySpaceBase = m_serverQuerySpaceLeft = ( m_sock.GetSendBufSize() / ServerQueryPacketSize ) - ServerQueryPacketSize;   // leave space for terminate request
+    }
+    else
+    {
+        m_serverQuerySpaceBase = m_serverQuerySpaceLeft = 0;
+    }
     m_hasData.store( true, std::memory_order_release );
 
     LZ4_setStreamDecode( (LZ4_streamDecode_t*)m_stream, nullptr, 0 );
@@ -2769,13 +2946,47 @@ void Worker::Exec()
             netbuf = m_netRead.front();
             m_netRead.erase( m_netRead.begin() );
         }
-        if( netbuf.bufferOffset < 0 ) goto close;
+        if( netbuf.bufferOffset < 0 )
+        {
+            if( m_rawStream )
+            {
+                std::lock_guard<std::mutex> lock( m_data.lock );
+                ServeRawStreamQueries();
+            }
+            goto close;
+        }
 
         const char* ptr = m_buffer + netbuf.bufferOffset;
         const char* end = ptr + netbuf.size;
 
+        if( netbuf.block.type == RawStreamAnswer )
+        {
+            // Kept until the query is made. Large answers span several blocks.
+            auto& answer = m_rawStreamAnswers[netbuf.block.ptr ^ ( uint64_t( netbuf.block.query ) << 56 )];
+            answer.insert( answer.end(), ptr, end );
+
+            std::lock_guard<std::mutex> lock( m_netWriteLock );
+            m_netWriteCnt++;
+            m_netWriteCv.notify_one();
+            continue;
+        }
+
         {
             std::lock_guard<std::mutex> lock( m_data.lock );
+            // All answers written before this block are complete now.
+            if( m_rawStream && !ServeRawStreamQueries() )
+            {
+                if( m_failure != Failure::None ) HandleFailure( ptr, end );
+                goto close;
+            }
+            if( netbuf.block.type == RawStreamChunk )
+            {
+                // Flight recorder chunk, the client restarted its time references.
+                m_refTimeThread = 0;
+                m_refTimeSerial = 0;
+                m_refTimeCtx = 0;
+                m_refTimeGpu = 0;
+            }
             while( ptr < end )
             {
                 auto ev = (const QueueItem*)ptr;
@@ -2851,10 +3062,52 @@ void Worker::Exec()
 close:
     Shutdown();
     m_netWriteCv.notify_one();
-    m_sock.Close();
+    if( !m_rawStream ) m_sock.Close();
     m_connected.store( false, std::memory_order_relaxed );
 }
 
+bool Worker::ServeRawStreamQueries()
+{
+    // Answers are processed as if the client had just sent them. They could
+    // take a string the event data left pending for the next block.
+    if( m_pendingSingleString.ptr != nullptr || m_pendingSecondString.ptr != nullptr ) return true;
+
+    std::vector<ServerQueryPacket> queries, waiting;
+    bool served;
+    do
+    {
+        served = false;
+        // Source location answers are matched to queries in order.
+        bool srclocWaiting = false;
+        std::swap( queries, m_rawStreamQueries );
+        for( auto& query : queries )
+        {
+            auto it = m_rawStreamAnswers.find( query.ptr ^ ( uint64_t( query.type ) << 56 ) );
+            if( it == m_rawStreamAnswers.end() || ( srclocWaiting && query.type == ServerQuerySourceLocation ) )
+            {
+                if( query.type == ServerQuerySourceLocation ) srclocWaiting = true;
+                waiting.push_back( query );
+                continue;
+            }
+            served = true;
+            // Answers are kept, a callstack frame may be queried again before it is known.
+            const char* ptr = it->second.data();
+            const char* end = ptr + it->second.size();
+            while( ptr < end )
+            {
+                auto ev = (const QueueItem*)ptr;
+                if( !DispatchProcess( *ev, ptr ) ) return false;
+            }
+        }
+        queries.clear();
+        waiting.insert( waiting.end(), m_rawStreamQueries.begin(), m_rawStreamQueries.end() );
+        std::swap( waiting, m_rawStreamQueries );
+        waiting.clear();
+    }
+    while( served );
+    return true;
+}
+
 void Worker::UpdateMbps( int64_t td )
 {
     const auto bytes = m_bytes.exchange( 0, std::memory_order_relaxed );
@@ -2905,7 +3158,7 @@ bool Worker::HasAllFailureData()
 
 void Worker::HandleFailure( const char* ptr, const char* end )
 {
-    if( HasAllFailureData() ) return;
+    if( HasAllFailureData() || m_rawStream ) return;
     for(;;)
     {
         while( ptr < end )
@@ -3045,7 +3298,11 @@ void Worker::DispatchFailure( const QueueItem& ev, const char*& ptr )
 void Worker::Query( ServerQuery type, uint64_t data, uint32_t extra )
 {
     ServerQueryPacket query { type, data, extra };
-    if( m_serverQueryQueue.empty() && m_serverQuerySpaceLeft > 0 )
+    if( m_rawStream )
+    {
+        m_rawStreamQueries.push_back( query );
+    }
+    else if( m_serverQueryQueue.empty() && m_serverQuerySpaceLeft > 0 )
     {
         m_serverQuerySpaceLeft--;
         m_sock.Send( &query, ServerQueryPacketSize );
@@ -3058,6 +3315,7 @@ void Worker::Query( ServerQuery type, uint64_t data, uint32_t extra )
 
 void Worker::QueryTerminate()
 {
+    if( m_rawStream ) return;
     ServerQueryPacket query { ServerQueryTerminate, 0, 0 };
     m_sock.Send( &query, ServerQueryPacketSize );
 }
@@ -3448,12 +3706,19 @@ void Worker::InsertLockEvent( LockMap& lockmap, LockEvent* lev, uint64_t thread,
         timeline.push_back( { lev } );
         UpdateLockCount( lockmap, timeline.size() - 1 );
     }
-    else
+    else if( timeline.back().ptr->Time() <= time )
     {
-        assert( timeline.back().ptr->Time() <= time );
         timeline.push_back_non_empty( { lev } );
         UpdateLockCount( lockmap, timeline.size() - 1 );
     }
+    else
+    {
+        // Lock events are recorded per thread, so a batch from one thread may
+        // arrive after later events from another. Insert in time order.
+        auto it = std::upper_bound( timeline.begin(), timeline.end(), time, [] ( const auto& l, const auto& r ) { return l < r.ptr->Time(); } );
+        it = timeline.insert( it, { lev } );
+        UpdateLockCount( lockmap, std::distance( timeline.begin(), it ) );
+    }
 
     auto& range = lockmap.range[it->second];
     if( range.start > time ) range.start = time;
@@ -3479,7 +3744,7 @@ void Worker::CheckThreadString( uint64_t id )
     m_data.threadNames.emplace( id, "???" );
     m_pendingThreads++;
 
-    if( m_sock.IsValid() ) Query( ServerQueryThreadString, id );
+    if( m_sock.IsValid() || m_rawStream ) Query( ServerQueryThreadString, id );
 }
 
 void Worker::CheckExternalName( uint64_t id )
@@ -4200,6 +4465,9 @@ bool Worker::Process( const QueueItem& ev )
     case QueueType::ZoneValue:
         ProcessZoneValue( ev.zoneValue );
         break;
+    case QueueType::ZoneCounters:
+        ProcessZoneCounters( ev.zoneCounters );
+        break;
     case QueueType::LockAnnounce:
         ProcessLockAnnounce( ev.lockAnnounce );
         break;
@@ -4902,6 +5170,35 @@ void Worker::ProcessZoneValue( const QueueZoneValue& ev )
     }
 }
 
+void Worker::ProcessZoneCounters( const QueueZoneCounters& ev )
+{
+    auto td = RetrieveThread( m_threadCtx );
+    if( !td || td->stack.empty() || td->nextZoneId != td->zoneIdStack.back() )
+    {
+        ZoneTextFailure( m_threadCtx );
+        return;
+    }
+
+    td->nextZoneId = 0;
+    auto& stack = td->stack;
+    auto zone = stack.back();
+    RequestZoneExtra( *zone );
+    auto& counters = m_data.zoneCounters[zone->extra];
+    counters.cycles = ev.cycles;
+    counters.instructions = ev.instructions;
+    counters.cacheMisses = ev.cacheMisses;
+    counters.branchMisses = ev.branchMisses;
+
+#ifndef TRACY_NO_STATISTICS
+    auto slz = GetSourceLocationZones( zone->SrcLoc() );
+    slz->counters.cycles += ev.cycles;
+    slz->counters.instructions += ev.instructions;
+    slz->counters.cacheMisses += ev.cacheMisses;
+    slz->counters.branchMisses += ev.branchMisses;
+    slz->countersCnt++;
+#endif
+}
+
 void Worker::ProcessLockAnnounce( const QueueLockAnnounce& ev )
 {
     auto it = m_data.lockMap.find( ev.id );
@@ -5396,15 +5693,6 @@ void Worker::ProcessGpuZoneEnd( const QueueGpuZoneEnd& ev, bool serial )
     auto ctx = m_gpuCtxMap[ev.context];
     assert( ctx );
 
-    auto td = ctx->threadData.find( ev.thread );
-    assert( td != ctx->threadData.end() );
-
-    assert( !td->second.stack.empty() );
-    auto zone = td->second.stack.back_and_pop();
-
-    assert( !ctx->query[ev.queryId] );
-    ctx->query[ev.queryId] = zone;
-
     int64_t cpuTime;
     if( serial )
     {
@@ -5416,6 +5704,19 @@ void Worker::ProcessGpuZoneEnd( const QueueGpuZoneEnd& ev, bool serial )
         cpuTime = m_refTimeThread + ev.cpuTime;
         m_refTimeThread = cpuTime;
     }
+
+    // A flight recorder dump may start in the middle of a GPU zone.
+    auto td = ctx->threadData.find( ev.thread );
+    if( td == ctx->threadData.end() || td->second.stack.empty() )
+    {
+        assert( m_onDemand );
+        return;
+    }
+    auto zone = td->second.stack.back_and_pop();
+
+    assert( !ctx->query[ev.queryId] );
+    ctx->query[ev.queryId] = zone;
+
     const auto time = TscTime( cpuTime - m_data.baseTime );
     zone->SetCpuEnd( time );
     if( m_data.lastTime < time ) m_data.lastTime = time;
@@ -5455,7 +5756,11 @@ void Worker::ProcessGpuTime( const QueueGpuTime& ev )
     }
 
     auto zone = ctx->query[ev.queryId];
-    assert( zone );
+    if( !zone )
+    {
+        assert( m_onDemand );
+        return;
+    }
     ctx->query[ev.queryId] = nullptr;
 
     if( zone->GpuStart() < 0 )
@@ -5542,7 +5847,7 @@ MemEvent* Worker::ProcessMemAllocImpl( uint64_t memname, MemData& memdata, const
 
     memdata.low = std::min( low, ptr );
     memdata.high = std::max( high, ptrend );
-    memdata.usage += size;
+    memdata.usage += ScaleMemSize( size );
 
     MemAllocChanged( memname, memdata, time );
     return &mem;
@@ -5573,7 +5878,7 @@ MemEvent* Worker::ProcessMemFreeImpl( uint64_t memname, MemData& memdata, const
     memdata.frees.push_back( it->second );
     auto& mem = memdata.data[it->second];
     mem.SetTimeThreadFree( time, CompressThread( ev.thread ) );
-    memdata.usage -= mem.Size();
+    memdata.usage -= ScaleMemSize( mem.Size() );
     memdata.active.erase( it );
 
     MemAllocChanged( memname, memdata, time );
@@ -6216,6 +6521,15 @@ void Worker::CreateMemAllocPlot( MemData& memdata )
     m_data.plots.Data().push_back( memdata.plot );
 }
 
+uint64_t Worker::ScaleMemSize( uint64_t size ) const
+{
+    if( m_memSamplingInterval == 0 || size == 0 ) return size;
+    // A sampled allocation stands for 1/p allocations of its size, where p is
+    // the probability of sampling it.
+    const auto p = -expm1( -double( size ) / double( m_memSamplingInterval ) );
+    return uint64_t( double( size ) / p + 0.5 );
+}
+
 void Worker::ReconstructMemAllocPlot( MemData& mem )
 {
 #ifdef NO_PARALLEL_SORT
@@ -6259,7 +6573,7 @@ void Worker::ReconstructMemAllocPlot( MemData& mem )
         {
             if( atime < ftime )
             {
-                usage += int64_t( aptr->Size() );
+                usage += int64_t( ScaleMemSize( aptr->Size() ) );
                 assert( usage >= 0 );
                 if( max < usage ) max = usage;
                 ptr->time = atime;
@@ -6271,7 +6585,7 @@ void Worker::ReconstructMemAllocPlot( MemData& mem )
             }
             else
             {
-                usage -= int64_t( mem.data[*fptr].Size() );
+                usage -= int64_t( ScaleMemSize( mem.data[*fptr].Size() ) );
                 assert( usage >= 0 );
                 if( max < usage ) max = usage;
                 ptr->time = ftime;
@@ -6288,7 +6602,7 @@ void Worker::ReconstructMemAllocPlot( MemData& mem )
     {
         assert( aptr->TimeFree() < 0 );
         int64_t time = aptr->TimeAlloc();
-        usage += int64_t( aptr->Size() );
+        usage += int64_t( ScaleMemSize( aptr->Size() ) );
         assert( usage >= 0 );
         if( max < usage ) max = usage;
         ptr->time = time;
@@ -6300,7 +6614,7 @@ void Worker::ReconstructMemAllocPlot( MemData& mem )
     {
         const auto& memData = mem.data[*fptr];
         int64_t time = memData.TimeFree();
-        usage -= int64_t( memData.Size() );
+        usage -= int64_t( ScaleMemSize( memData.Size() ) );
         assert( usage >= 0 );
         assert( max >= usage );
         ptr->time = time;
@@ -6687,6 +7001,21 @@ void Worker::ReconstructZoneStatistics( ZoneEvent& zone, uint16_t thread )
         if( slz.selfMax < timeSpan ) slz.selfMax = timeSpan;
         slz.selfTotal += timeSpan;
     }
+    if( zone.extra != 0 )
+    {
+        auto cit = m_data.zoneCounters.find( zone.extra );
+        if( cit != m_data.zoneCounters.end() )
+        {
+            auto it = m_data.sourceLocationZones.find( zone.SrcLoc() );
+            assert( it != m_data.sourceLocationZones.end() );
+            auto& slz = it->second;
+            slz.counters.cycles += cit->second.cycles;
+            slz.counters.instructions += cit->second.instructions;
+            slz.counters.cacheMisses += cit->second.cacheMisses;
+            slz.counters.branchMisses += cit->second.branchMisses;
+            slz.countersCnt++;
+        }
+    }
 }
 #else
 void Worker::CountZoneStatistics( ZoneEvent* zone )
@@ -6834,6 +7163,7 @@ void Worker::Write( FileWrite& f )
     f.Write( &m_data.frameOffset, sizeof( m_data.frameOffset ) );
     f.Write( &m_pid, sizeof( m_pid ) );
     f.Write( &m_samplingPeriod, sizeof( m_samplingPeriod ) );
+    f.Write( &m_memSamplingInterval, sizeof( m_memSamplingInterval ) );
     f.Write( &m_data.cpuArch, sizeof( m_data.cpuArch ) );
     f.Write( &m_data.cpuId, sizeof( m_data.cpuId ) );
     f.Write( m_data.cpuManufacturer, 12 );
@@ -7038,6 +7368,14 @@ void Worker::Write( FileWrite& f )
     f.Write( &sz, sizeof( sz ) );
     f.Write( m_data.zoneExtra.data(), sz * sizeof( ZoneExtra ) );
 
+    sz = m_data.zoneCounters.size();
+    f.Write( &sz, sizeof( sz ) );
+    for( auto& v : m_data.zoneCounters )
+    {
+        f.Write( &v.first, sizeof( v.first ) );
+        f.Write( &v.second, sizeof( v.second ) );
+    }
+
     sz = 0;
     for( auto& v : m_data.threads ) sz += v->count;
     f.Write( &sz, sizeof( sz ) );
@@ -7,6 +7,7 @@
 #include <mutex>
 #include <shared_mutex>
 #include <stdexcept>
+#include <stdio.h>
 #include <string>
 #include <string.h>
 #include <thread>
@@ -16,6 +17,7 @@
 #include "../common/TracyForceInline.hpp"
 #include "../common/TracyQueue.hpp"
 #include "../common/TracyProtocol.hpp"
+#include "../common/TracyShm.hpp"
 #include "../common/TracySocket.hpp"
 #include "tracy_robin_hood.h"
 #include "TracyEvent.hpp"
@@ -182,6 +184,8 @@ private:
         int64_t selfMin = std::numeric_limits<int64_t>::max();
         int64_t selfMax = std::numeric_limits<int64_t>::min();
         int64_t selfTotal = 0;
+        ZoneCounters counters = {};
+        uint64_t countersCnt = 0;
     };
 
     struct CallstackFrameIdHash
@@ -243,6 +247,7 @@ private:
         StringDiscovery<PlotData*> plots;
         Vector<ThreadData*> threads;
         Vector<ZoneExtra> zoneExtra;
+        unordered_flat_map<uint32_t, ZoneCounters> zoneCounters;    // by zone extra index
         MemData* memory;
         unordered_flat_map<uint64_t, MemData*> memNameMap;
         uint64_t zonesCnt = 0;
@@ -397,6 +402,9 @@ public:
     };
 
     Worker( const char* addr, uint16_t port );
+    // Replays a raw stream written by a client capturing to file. Returns
+    // once the stream was processed. The stream is not closed.
+    explicit Worker( FILE* rawStream );
     Worker( const char* name, const char* program, const std::vector<ImportEventTimeline>& timeline, const std::vector<ImportEventMessages>& messages, const std::vector<ImportEventPlots>& plots, const std::unordered_map<uint64_t, std::string>& threadNames );
     Worker( FileRead& f, EventType::Type eventMask = EventType::All, bool bgTasks = true );
     ~Worker();
@@ -533,6 +541,8 @@ public:
 
     tracy_force_inline const bool HasZoneExtra( const ZoneEvent& ev ) const { return ev.extra != 0; }
     tracy_force_inline const ZoneExtra& GetZoneExtra( const ZoneEvent& ev ) const { return m_data.zoneExtra[ev.extra]; }
+    const ZoneCounters* GetZoneCounters( const ZoneEvent& ev ) const;
+    bool HasZoneCounters() const { return !m_data.zoneCounters.empty(); }
 
     std::vector<int16_t> GetMatchingSourceLocation( const char* query, bool ignoreCase ) const;
 
@@ -573,6 +583,8 @@ public:
     int GetTraceVersion() const { return m_traceVersion; }
     uint8_t GetHandshakeStatus() const { return m_handshake.load( std::memory_order_relaxed ); }
     int64_t GetSamplingPeriod() const { return m_samplingPeriod; }
+    uint64_t GetMemSamplingInterval() const { return m_memSamplingInterval; }
+    uint64_t ScaleMemSize( uint64_t size ) const;
 
     static const LoadProgress& GetLoadProgress() { return s_loadProgress; }
     int64_t GetLoadTime() const { return m_loadTime; }
@@ -595,8 +607,12 @@ public:
     void DoPostponedWork();
 
 private:
+    void InitLive();
     void Network();
     void Exec();
+    bool Handshake();
+    bool ReadRawStreamHeader();
+    bool ServeRawStreamQueries();
     void Query( ServerQuery type, uint64_t data, uint32_t extra = 0 );
     void QueryTerminate();
     void QuerySourceFile( const char* fn );
@@ -619,6 +635,7 @@ private:
     tracy_force_inline void ProcessZoneName();
     tracy_force_inline void ProcessZoneColor( const QueueZoneColor& ev );
     tracy_force_inline void ProcessZoneValue( const QueueZoneValue& ev );
+    tracy_force_inline void ProcessZoneCounters( const QueueZoneCounters& ev );
     tracy_force_inline void ProcessLockAnnounce( const QueueLockAnnounce& ev );
     tracy_force_inline void ProcessLockTerminate( const QueueLockTerminate& ev );
     tracy_force_inline void ProcessLockWait( const QueueLockWait& ev );
@@ -831,8 +848,12 @@ private:
     int64_t TscTime( uint64_t tsc ) { return int64_t( tsc * m_timerMul ); }
 
     Socket m_sock;
+#ifdef TRACY_HAS_SHM_TRANSPORT
+    std::unique_ptr<ShmRing> m_shm;
+#endif
     std::string m_addr;
     uint16_t m_port;
+    FILE* m_rawStream = nullptr;
 
     std::thread m_thread;
     std::thread m_threadNet;
@@ -853,6 +874,7 @@ private:
     std::string m_hostInfo;
     uint64_t m_pid;
     int64_t m_samplingPeriod;
+    uint64_t m_memSamplingInterval;
     bool m_terminate = false;
     bool m_crashed = false;
     bool m_disconnect = false;
@@ -910,6 +932,8 @@ private:
     PlotData* m_sysTimePlot = nullptr;
 
     Vector<ServerQueryPacket> m_serverQueryQueue;
+    std::vector<ServerQueryPacket> m_rawStreamQueries;
+    unordered_flat_map<uint64_t, std::vector<char>> m_rawStreamAnswers;
     size_t m_serverQuerySpaceLeft, m_serverQuerySpaceBase;
 
     unordered_flat_map<uint64_t, int32_t> m_frameImageStaging;
@@ -931,6 +955,7 @@ private:
     {
         int bufferOffset;
         int size;
+        RawStreamBlockHeader block;
     };
 
     std::vector<NetBuffer> m_netRead;
@@ -0,0 +1,78 @@
+// Call stack capture microbenchmark. Captures are taken at the bottom of a
+// deep enough chain of calls, and timed per capture for several depths.
+// backtrace() is timed too, as a reference for the frame pointer walker.
+//
+// Usage: callstackbench [captures]
+//
+// Build with TRACYFLAGS=-DTRACY_FRAME_POINTER_UNWIND and -fno-omit-frame-pointer
+// in OPTFLAGS to measure the frame pointer walker.
+
+#include <chrono>
+#include <execinfo.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../Tracy.hpp"
+#include "../client/TracyCallstack.hpp"
+
+enum { ChainDepth = 48 };
+
+static int s_captures;
+
+static double Measure( bool reference, int depth )
+{
+    const auto t0 = std::chrono::steady_clock::now();
+    for( int i=0; i<s_captures; i++ )
+    {
+        if( reference )
+        {
+            void* trace[64];
+            backtrace( trace, depth );
+        }
+        else
+        {
+            tracy::tracy_free( tracy::Callstack( depth ) );
+        }
+    }
+    const auto t1 = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::nano>( t1 - t0 ).count() / s_captures;
+}
+
+static __attribute__((noinline)) double Chain( int n, bool reference, int depth )
+{
+    if( n == 0 ) return Measure( reference, depth );
+    const auto ret = Chain( n-1, reference, depth );
+    asm volatile( "" ::: "memory" );
+    return ret;
+}
+
+static __attribute__((noinline)) int Frames( int n, int depth )
+{
+    if( n == 0 )
+    {
+        auto trace = (uintptr_t*)tracy::Callstack( depth );
+        const auto num = int( trace[0] );
+        tracy::tracy_free( trace );
+        return num;
+    }
+    const auto ret = Frames( n-1, depth );
+    asm volatile( "" ::: "memory" );
+    return ret;
+}
+
+int main( int argc, char** argv )
+{
+    s_captures = argc > 1 ? atoi( argv[1] ) : 200000;
+
+#ifdef TRACY_HAS_FRAME_POINTER_UNWIND
+    const char* method = "frame pointers";
+#else
+    const char* method = "backtrace";
+#endif
+    for( int depth : { 8, 16, 32 } )
+    {
+        const auto ref = Chain( ChainDepth, true, depth );
+        const auto ns = Chain( ChainDepth, false, depth );
+        printf( "depth %2d: %s %.0f ns (%d frames), backtrace %.0f ns\n", depth, method, ns, Frames( ChainDepth, depth ), ref );
+    }
+}
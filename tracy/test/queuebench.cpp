@@ -0,0 +1,54 @@
+// Client queue microbenchmark. Zones are emitted from several threads while
+// no server is connected, so every event stays in the queue. Reports the
+// producer throughput and the queue memory used per event.
+//
+// Usage: queuebench [threads] [zones per thread]
+
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "../Tracy.hpp"
+
+static size_t Resident()
+{
+    size_t pages = 0, resident = 0;
+    FILE* f = fopen( "/proc/self/statm", "r" );
+    if( !f ) return 0;
+    if( fscanf( f, "%zu %zu", &pages, &resident ) != 2 ) resident = 0;
+    fclose( f );
+    return resident * sysconf( _SC_PAGESIZE );
+}
+
+int main( int argc, char** argv )
+{
+    const int threads = argc > 1 ? atoi( argv[1] ) : 4;
+    const int zones = argc > 2 ? atoi( argv[2] ) : 500000;
+
+    // Let the profiler finish its startup before measuring.
+    std::this_thread::sleep_for( std::chrono::milliseconds( 200 ) );
+
+    const auto rss0 = Resident();
+    const auto t0 = std::chrono::steady_clock::now();
+
+    std::vector<std::thread> v;
+    for( int i=0; i<threads; i++ )
+    {
+        v.emplace_back( [zones] {
+            for( int j=0; j<zones; j++ )
+            {
+                ZoneScopedN( "bench" );
+            }
+        } );
+    }
+    for( auto& t : v ) t.join();
+
+    const auto t1 = std::chrono::steady_clock::now();
+    const auto rss1 = Resident();
+
+    const double events = 2.0 * threads * zones;
+    const double sec = std::chrono::duration<double>( t1 - t0 ).count();
+    printf( "%d threads, %.0f events: %.1f Mevents/s, %.1f bytes/event\n", threads, events, events / sec / 1e6, double( rss1 - rss0 ) / events );
+}
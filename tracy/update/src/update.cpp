@@ -3,9 +3,11 @@
 #endif
 
 #include <chrono>
+#include <memory>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "../../server/TracyFileRead.hpp"
 #include "../../server/TracyFileWrite.hpp"
@@ -25,7 +27,8 @@
 
 void Usage()
 {
-    printf( "Usage: update [options] input.tracy output.tracy\n\n" );
+    printf( "Usage: update [options] input.tracy output.tracy\n" );
+    printf( "Input can also be a raw stream written by a client with TRACY_CAPTURE_FILE set.\n\n" );
     printf( "  -h: enable LZ4HC compression\n" );
     printf( "  -e: enable extreme LZ4HC compression (very slow)\n" );
     printf( "  -z level: use Zstd compression with given compression level\n" );
@@ -122,11 +125,32 @@ int main( int argc, char** argv )
 
     printf( "Loading...\r" );
     fflush( stdout );
-    auto f = std::unique_ptr<tracy::FileRead>( tracy::FileRead::Open( input ) );
-    if( !f )
+
+    // Raw streams are replayed like a live connection, so the data can't be stripped.
+    FILE* rawStream = fopen( input, "rb" );
+    if( rawStream )
     {
-        fprintf( stderr, "Cannot open input file!\n" );
-        exit( 1 );
+        char magic[tracy::RawStreamMagicSize];
+        if( fread( magic, 1, tracy::RawStreamMagicSize, rawStream ) == tracy::RawStreamMagicSize && memcmp( magic, tracy::RawStreamMagic, tracy::RawStreamMagicSize ) == 0 )
+        {
+            rewind( rawStream );
+        }
+        else
+        {
+            fclose( rawStream );
+            rawStream = nullptr;
+        }
+    }
+
+    std::unique_ptr<tracy::FileRead> f;
+    if( !rawStream )
+    {
+        f.reset( tracy::FileRead::Open( input ) );
+        if( !f )
+        {
+            fprintf( stderr, "Cannot open input file!\n" );
+            exit( 1 );
+        }
     }
 
     try
@@ -136,10 +160,24 @@ int main( int argc, char** argv )
         int inVer;
         {
             const auto t0 = std::chrono::high_resolution_clock::now();
-            tracy::Worker worker( *f, (tracy::EventType::Type)events, false );
+            std::unique_ptr<tracy::Worker> worker;
+            if( rawStream )
+            {
+                worker = std::make_unique<tracy::Worker>( rawStream );
+                fclose( rawStream );
+                if( worker->GetHandshakeStatus() != tracy::HandshakeWelcome )
+                {
+                    fprintf( stderr, "The raw stream was written by an incompatible client.\n" );
+                    exit( 1 );
+                }
+            }
+            else
+            {
+                worker = std::make_unique<tracy::Worker>( *f, (tracy::EventType::Type)events, false );
+            }
 
 #ifndef TRACY_NO_STATISTICS
-            while( !worker.AreSourceLocationZonesReady() ) std::this_thread::sleep_for( std::chrono::milliseconds( 10 ) );
+            while( !worker->AreSourceLocationZonesReady() ) std::this_thread::sleep_for( std::chrono::milliseconds( 10 ) );
 #endif
 
             auto w = std::unique_ptr<tracy::FileWrite>( tracy::FileWrite::Open( output, clev, zstdLevel ) );
@@ -150,12 +188,12 @@ int main( int argc, char** argv )
             }
             printf( "Saving... \r" );
             fflush( stdout );
-            worker.Write( *w );
+            worker->Write( *w );
             w->Finish();
             const auto t1 = std::chrono::high_resolution_clock::now();
             const auto stats = w->GetCompressionStatistics();
             ratio = 100.f * stats.second / stats.first;
-            inVer = worker.GetTraceVersion();
+            inVer = worker->GetTraceVersion();
             t = std::chrono::duration_cast<std::chrono::nanoseconds>( t1 - t0 ).count();
         }
 
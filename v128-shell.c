@@ -19,10 +19,31 @@
 #include "tinywl.h"
 
 #include "log.h"
+#include "placement.h"
 #include "subprogram.h"
 #include "background.h"
-
-static struct wlr_output* g_next_output = NULL;
+#include "bench.h"
+#include "configure.h"
+#include "capture.h"
+#include "cpu_render.h"
+#include "fence.h"
+#include "framedump.h"
+#include "freeze.h"
+#include "keymap.h"
+#include "realtime.h"
+#include "scanout.h"
+#include "startup.h"
+
+
+static void server_damage_whole(struct tinywl_server *server) {
+    /* We don't track damage per surface, so anything that changes what a view
+     * shows redraws every output. Pointer motion deliberately doesn't end up
+     * here: the cursor plane, or the software cursor's own damage, covers it. */
+    struct tinywl_output *output;
+    wl_list_for_each(output, &server->outputs, link) {
+        wlr_output_damage_add_whole(output->damage);
+    }
+}
 
 static void focus_view(struct tinywl_view *view, struct wlr_surface *surface) {
     /* Note: this function only deals with keyboard focus. */
@@ -50,18 +71,26 @@ static void focus_view(struct tinywl_view *view, struct wlr_surface *surface) {
         printf("focus_view: Deactivating previous surface.\n");
         struct wlr_xdg_surface *previous = wlr_xdg_surface_from_wlr_surface(
             seat->keyboard_state.focused_surface);
-        wlr_xdg_toplevel_set_activated(previous, false);
+        if (previous->data != NULL) {
+            configure_set_activated(previous->data, false);
+        } else {
+            wlr_xdg_toplevel_set_activated(previous, false);
+        }
     }
 
     struct wlr_keyboard *keyboard = wlr_seat_get_keyboard(seat);
 
+    /* A frozen app has to be running again before it gets focus. */
+    freeze_view_thaw(view);
+
     /* Move the view to the front */
     wl_list_remove(&view->link);
     wl_list_insert(&server->views, &view->link);
+    server_damage_whole(server);
 
     /* Activate the new surface */
     printf("focus_view: Setting surface activated.\n");
-    wlr_xdg_toplevel_set_activated(view->xdg_surface, true);
+    configure_set_activated(view, true);
 
     /*
      * Tell the seat to have the keyboard enter this surface. wlroots will keep
@@ -71,6 +100,13 @@ static void focus_view(struct tinywl_view *view, struct wlr_surface *surface) {
     printf("focus_view: wlr_seat_keyboard_notify_enter.\n");
     wlr_seat_keyboard_notify_enter(seat, view->xdg_surface->surface,
                                    keyboard->keycodes, keyboard->num_keycodes, &keyboard->modifiers);
+
+    /* Give the focused app the CPU, and push everything else back. */
+    pid_t pid = 0;
+    struct wl_client *client =
+        wl_resource_get_client(view->xdg_surface->surface->resource);
+    wl_client_get_credentials(client, &pid, NULL, NULL);
+    subprogram_focus(pid);
 }
 
 static void keyboard_handle_modifiers(struct wl_listener *listener, void *data) {
@@ -180,15 +216,14 @@ static void server_new_keyboard(struct tinywl_server *server, struct wlr_input_d
     keyboard->device = device;
 
     /* We need to prepare an XKB keymap and assign it to the keyboard. This
-     * assumes the defaults (e.g. layout = "us"). */
+     * assumes the defaults (e.g. layout = "us"). Keymaps are cached by rule
+     * names, so every keyboard shares the one compiled on startup. */
     struct xkb_rule_names rules = { 0 };
-    struct xkb_context *context = xkb_context_new(XKB_CONTEXT_NO_FLAGS);
-    struct xkb_keymap *keymap = xkb_map_new_from_names(context, &rules,
-                                                       XKB_KEYMAP_COMPILE_NO_FLAGS);
-
-    wlr_keyboard_set_keymap(device->keyboard, keymap);
-    xkb_keymap_unref(keymap);
-    xkb_context_unref(context);
+    struct xkb_keymap *keymap = keymap_get(&rules);
+    if (keymap != NULL) {
+        wlr_keyboard_set_keymap(device->keyboard, keymap);
+        xkb_keymap_unref(keymap);
+    }
     wlr_keyboard_set_repeat_info(device->keyboard, 25, 600);
 
     /* Here we set up listeners for keyboard events. */
@@ -203,6 +238,14 @@ static void server_new_keyboard(struct tinywl_server *server, struct wlr_input_d
     wl_list_insert(&server->keyboards, &keyboard->link);
 }
 
+static void server_new_pointer(struct tinywl_server *server, struct wlr_input_device *device) {
+    /* We don't do anything special with pointers. All of our pointer handling
+     * is proxied through wlr_cursor. On another compositor, you might take this
+     * opportunity to do libinput configuration on the device to set
+     * acceleration, etc. */
+    wlr_cursor_attach_input_device(server->cursor, device);
+}
+
 static void server_new_input(struct wl_listener *listener, void *data) {
     /* This event is raised by the backend when a new input device becomes
      * available. */
@@ -214,6 +257,9 @@ static void server_new_input(struct wl_listener *listener, void *data) {
         case WLR_INPUT_DEVICE_KEYBOARD:
             server_new_keyboard(server, device);
             break;
+        case WLR_INPUT_DEVICE_POINTER:
+            server_new_pointer(server, device);
+            break;
         default:
             break;
     }
@@ -230,6 +276,25 @@ static void server_new_input(struct wl_listener *listener, void *data) {
     wlr_seat_set_capabilities(server->seat, caps);
 }
 
+static void seat_request_cursor(struct wl_listener *listener, void *data) {
+    struct tinywl_server *server = wl_container_of(
+        listener, server, request_cursor);
+    /* This event is raised by the seat when a client provides a cursor image */
+    struct wlr_seat_pointer_request_set_cursor_event *event = data;
+    struct wlr_seat_client *focused_client =
+        server->seat->pointer_state.focused_client;
+
+    /* This can be sent by any client, so we check to make sure this one is
+     * actually has pointer focus first. */
+    if (focused_client == event->seat_client) {
+        /* Once we've provided a surface, wlroots tries to put it on the
+         * output's hardware cursor plane and keeps it there as it moves. */
+        wlr_cursor_set_surface(server->cursor, event->surface,
+                               event->hotspot_x, event->hotspot_y);
+        server->cursor_image = NULL;
+    }
+}
+
 static void seat_request_set_selection(struct wl_listener *listener, void *data) {
     /* This event is raised by the seat when a client wants to set the selection,
      * usually when the user copies something. wlroots allows compositors to
@@ -242,15 +307,240 @@ static void seat_request_set_selection(struct wl_listener *listener, void *data)
     wlr_seat_set_selection(server->seat, event->source, event->serial);
 }
 
+static struct tinywl_view *desktop_view_at(struct tinywl_server *server, double lx, double ly,
+                                           struct wlr_surface **surface, double *sx, double *sy) {
+    /* This iterates over all of our surfaces and attempts to find one under the
+     * cursor. This relies on server->views being ordered from top-to-bottom. */
+    struct tinywl_view *view;
+    wl_list_for_each(view, &server->views, link) {
+        if (!view->mapped) {
+            continue;
+        }
+
+        double view_sx = lx - view->x;
+        double view_sy = ly - view->y;
+        double _sx, _sy;
+        struct wlr_surface *_surface = wlr_xdg_surface_surface_at(
+            view->xdg_surface, view_sx, view_sy, &_sx, &_sy);
+
+        if (_surface != NULL) {
+            *sx = _sx;
+            *sy = _sy;
+            *surface = _surface;
+            return view;
+        }
+    }
+
+    return NULL;
+}
+
+static void process_cursor_motion(struct tinywl_server *server, uint32_t time) {
+    TracyCZoneN(cursor_motion_ctx, "process_cursor_motion", true);
+
+    struct wlr_seat *seat = server->seat;
+    struct wlr_surface *surface = NULL;
+    double sx, sy;
+    struct tinywl_view *view = desktop_view_at(server,
+        server->cursor->x, server->cursor->y, &surface, &sx, &sy);
+
+    if (!view && server->cursor_image == NULL) {
+        /* If there's no view under the cursor, set the cursor image to a
+         * default. This is what makes the cursor image appear when you move it
+         * around the screen, not over any views. Setting the image uploads it
+         * to the cursor plane, so only do it when it actually changes. */
+        server->cursor_image = "left_ptr";
+        wlr_xcursor_manager_set_cursor_image(
+            server->cursor_mgr, server->cursor_image, server->cursor);
+    }
+
+    if (surface) {
+        /*
+         * "Enter" the surface if necessary. This lets the client know that the
+         * cursor has entered one of its surfaces.
+         *
+         * Note that this gives the surface "pointer focus", which is distinct
+         * from keyboard focus. You get pointer focus by moving the pointer over
+         * a window.
+         */
+        wlr_seat_pointer_notify_enter(seat, surface, sx, sy);
+        wlr_seat_pointer_notify_motion(seat, time, sx, sy);
+    } else {
+        /* Clear pointer focus so future button events and such are not sent to
+         * the last client to have the cursor over it. */
+        wlr_seat_pointer_clear_focus(seat);
+    }
+
+    TracyCZoneEnd(cursor_motion_ctx);
+}
+
+static void server_cursor_motion(struct wl_listener *listener, void *data) {
+    /* This event is forwarded by the cursor when a pointer emits a _relative_
+     * pointer motion event (i.e. a delta) */
+    struct tinywl_server *server =
+        wl_container_of(listener, server, cursor_motion);
+    struct wlr_event_pointer_motion *event = data;
+
+    /* The cursor doesn't move unless we tell it to. The cursor automatically
+     * handles constraining the motion to the output layout, as well as any
+     * special configuration applied for the specific input device which
+     * generated the event. With a hardware cursor this only moves the cursor
+     * plane, and nothing on the primary plane is damaged. */
+    wlr_cursor_move(server->cursor, event->device,
+                    event->delta_x, event->delta_y);
+    process_cursor_motion(server, event->time_msec);
+}
+
+static void server_cursor_motion_absolute(struct wl_listener *listener, void *data) {
+    /* This event is forwarded by the cursor when a pointer emits an _absolute_
+     * motion event, from 0..1 on each axis. This happens, for example, when
+     * wlroots is running under a Wayland window rather than KMS+DRM, and you
+     * move the mouse over the window. */
+    struct tinywl_server *server =
+        wl_container_of(listener, server, cursor_motion_absolute);
+    struct wlr_event_pointer_motion_absolute *event = data;
+
+    wlr_cursor_warp_absolute(server->cursor, event->device, event->x, event->y);
+    process_cursor_motion(server, event->time_msec);
+}
+
+static void server_cursor_button(struct wl_listener *listener, void *data) {
+    /* This event is forwarded by the cursor when a pointer emits a button
+     * event. */
+    struct tinywl_server *server =
+        wl_container_of(listener, server, cursor_button);
+    struct wlr_event_pointer_button *event = data;
+
+    /* Notify the client with pointer focus that a button press has occurred */
+    wlr_seat_pointer_notify_button(server->seat,
+                                   event->time_msec, event->button, event->state);
+
+    if (event->state == WL_POINTER_BUTTON_STATE_PRESSED) {
+        /* Focus that client if the button was _pressed_ */
+        double sx, sy;
+        struct wlr_surface *surface = NULL;
+        struct tinywl_view *view = desktop_view_at(server,
+            server->cursor->x, server->cursor->y, &surface, &sx, &sy);
+
+        if (view != NULL) {
+            focus_view(view, view->xdg_surface->surface);
+        }
+    }
+}
+
+static void server_cursor_axis(struct wl_listener *listener, void *data) {
+    /* This event is forwarded by the cursor when a pointer emits an axis event,
+     * for example when you move the scroll wheel. */
+    struct tinywl_server *server =
+        wl_container_of(listener, server, cursor_axis);
+    struct wlr_event_pointer_axis *event = data;
+
+    /* Notify the client with pointer focus of the axis event. */
+    wlr_seat_pointer_notify_axis(server->seat,
+                                 event->time_msec, event->orientation, event->delta,
+                                 event->delta_discrete, event->source);
+}
+
+static void server_cursor_frame(struct wl_listener *listener, void *data) {
+    /* This event is forwarded by the cursor when a pointer emits an frame
+     * event. Frame events are sent after regular pointer events to group
+     * multiple events together. For instance, two axis events may happen at the
+     * same time, in which case a frame event won't be sent in between. */
+    struct tinywl_server *server =
+        wl_container_of(listener, server, cursor_frame);
+
+    /* Notify the client with pointer focus of the frame event. */
+    wlr_seat_pointer_notify_frame(server->seat);
+}
+
+static void surface_commit(struct wl_listener *listener, void *data) {
+    struct tinywl_surface *surface = wl_container_of(listener, surface, commit);
+
+    /* Cursor surfaces are left to wlr_cursor, which damages only the cursor
+     * rectangles when it falls back to a software cursor. Everything else
+     * that can end up in a view redraws the outputs. */
+    if (wlr_surface_is_xdg_surface(surface->wlr_surface) ||
+        wlr_surface_is_subsurface(surface->wlr_surface)) {
+        surface->commit_ns = startup_now_ns();
+        cpu_render_surface_commit(surface);
+        fence_surface_commit(surface);
+        freeze_surface_commit(surface->server, surface->wlr_surface);
+        scanout_surface_commit(surface);
+        server_damage_whole(surface->server);
+    }
+}
+
+static void surface_destroy(struct wl_listener *listener, void *data) {
+    struct tinywl_surface *surface = wl_container_of(listener, surface, destroy);
+
+    wl_list_remove(&surface->commit.link);
+    wl_list_remove(&surface->destroy.link);
+    surface->wlr_surface->data = NULL;
+    cpu_render_surface_destroy(surface);
+    fence_surface_destroy(surface);
+    free(surface);
+}
+
+static void server_new_surface(struct wl_listener *listener, void *data) {
+    /* This event is raised by the compositor for every wl_surface a client
+     * creates, whatever role it ends up with. */
+    struct tinywl_server *server = wl_container_of(listener, server, new_surface);
+    struct wlr_surface *wlr_surface = data;
+
+    struct tinywl_surface *surface = calloc(1, sizeof(struct tinywl_surface));
+    surface->server = server;
+    surface->wlr_surface = wlr_surface;
+    wlr_surface->data = surface;
+
+    surface->commit.notify = surface_commit;
+    wl_signal_add(&wlr_surface->events.commit, &surface->commit);
+    surface->destroy.notify = surface_destroy;
+    wl_signal_add(&wlr_surface->events.destroy, &surface->destroy);
+}
+
 /* Used to move all of the data necessary to render a surface from the top-level
  * frame handler to the per-surface render function. */
 struct render_data {
     struct wlr_output *output;
     struct wlr_renderer *renderer;
     struct tinywl_view *view;
-    struct timespec *when;
+    pixman_region32_t *damage;
 };
 
+static void scissor_output(struct wlr_output *output, struct wlr_renderer *renderer,
+                           pixman_box32_t *rect) {
+    /* Damage is in buffer coordinates, which the renderer scissor expects
+     * untransformed. */
+    struct wlr_box box = {
+        .x = rect->x1,
+        .y = rect->y1,
+        .width = rect->x2 - rect->x1,
+        .height = rect->y2 - rect->y1,
+    };
+
+    int ow, oh;
+    wlr_output_transformed_resolution(output, &ow, &oh);
+
+    enum wl_output_transform transform =
+        wlr_output_transform_invert(output->transform);
+    wlr_box_transform(&box, &box, transform, ow, oh);
+
+    wlr_renderer_scissor(renderer, &box);
+}
+
+static struct wlr_texture *surface_texture(struct wlr_surface *surface,
+                                          int *width, int *height) {
+    /* A surface whose buffer the GPU is still rendering into is drawn from
+     * the last buffer that was ready. Sampling the busy one would stall the
+     * whole frame on the client. */
+    if (fence_surface_pending(surface->data)) {
+        return fence_surface_ready_texture(surface->data, width, height);
+    }
+
+    *width = surface->current.width;
+    *height = surface->current.height;
+    return wlr_surface_get_texture(surface);
+}
+
 static void render_surface(struct wlr_surface *surface, int sx, int sy, void *data) {
     TracyCZoneNS(render_surface_ctx, "render_surface", 10, true);
 
@@ -269,7 +559,8 @@ static void render_surface(struct wlr_surface *surface, int sx, int sy, void *da
      * could have sent a pixel buffer which we copied to the GPU, or a few other
      * means. You don't have to worry about this, wlroots takes care of it. */
     TracyCMessageL("wlr_surface_get_texture");
-    struct wlr_texture *texture = wlr_surface_get_texture(surface);
+    int width, height;
+    struct wlr_texture *texture = surface_texture(surface, &width, &height);
     if (texture == NULL) {
         TracyCMessageLS("Surface texture was NULL", 10);
         TracyCFrameMarkEnd(frame_name);
@@ -291,8 +582,8 @@ static void render_surface(struct wlr_surface *surface, int sx, int sy, void *da
     struct wlr_box box = {
         .x = ox * output->scale,
         .y = oy * output->scale,
-        .width = surface->current.width * output->scale,
-        .height = surface->current.height * output->scale,
+        .width = width * output->scale,
+        .height = height * output->scale,
     };
 
     /*
@@ -312,20 +603,125 @@ static void render_surface(struct wlr_surface *surface, int sx, int sy, void *da
     wlr_matrix_project_box(matrix, &box, transform, 0,
                            output->transform_matrix);
 
+    /* Only the parts of the surface that are damaged need to be redrawn, e.g.
+     * around a software cursor that moved. */
+    pixman_region32_t damage;
+    pixman_region32_init_rect(&damage, box.x, box.y, box.width, box.height);
+    pixman_region32_intersect(&damage, &damage, rdata->damage);
+
     /* This takes our matrix, the texture, and an alpha, and performs the actual
      * rendering on the GPU. */
     TracyCMessageL("wlr_render_texture_with_matrix");
-    wlr_render_texture_with_matrix(rdata->renderer, texture, matrix, 1);
+    int nrects;
+    pixman_box32_t *rects = pixman_region32_rectangles(&damage, &nrects);
+    for (int i = 0; i < nrects; i++) {
+        scissor_output(output, rdata->renderer, &rects[i]);
+        wlr_render_texture_with_matrix(rdata->renderer, texture, matrix, 1);
+    }
 
-    /* This lets the client know that we've displayed that frame and it can
-     * prepare another one now if it likes. */
-    TracyCMessageL("wlr_surface_send_frame_done");
-    wlr_surface_send_frame_done(surface, rdata->when);
+    pixman_region32_fini(&damage);
 
     TracyCFrameMarkEnd(frame_name);
     TracyCZoneEnd(render_surface_ctx);
 }
 
+struct opaque_data {
+    struct wlr_output *output;
+    struct tinywl_view *view;
+    pixman_region32_t *region;
+};
+
+static void add_opaque_surface(struct wlr_surface *surface, int sx, int sy, void *data) {
+    struct opaque_data *odata = data;
+    struct wlr_output *output = odata->output;
+    struct tinywl_view *view = odata->view;
+
+    int width, height;
+    struct wlr_texture *texture = surface_texture(surface, &width, &height);
+    if (texture == NULL) {
+        return;
+    }
+
+    double ox = 0, oy = 0;
+    wlr_output_layout_output_coords(
+        view->server->output_layout, output, &ox, &oy);
+    ox += view->x + sx, oy += view->y + sy;
+
+    if (wlr_texture_is_opaque(texture)) {
+        pixman_region32_union_rect(odata->region, odata->region,
+                                   ox * output->scale, oy * output->scale,
+                                   width * output->scale,
+                                   height * output->scale);
+        return;
+    }
+
+    /* Otherwise only what the client declared opaque counts. */
+    pixman_region32_t opaque;
+    pixman_region32_init(&opaque);
+    wlr_region_scale(&opaque, &surface->opaque_region, output->scale);
+    pixman_region32_translate(&opaque, ox * output->scale, oy * output->scale);
+    pixman_region32_union(odata->region, odata->region, &opaque);
+    pixman_region32_fini(&opaque);
+}
+
+static void output_opaque_region(struct tinywl_output *output, pixman_region32_t *region) {
+    /* Collects the parts of the output that views are guaranteed to paint
+     * over, so the background doesn't have to be drawn underneath them. */
+    struct wlr_output *wlr_output = output->wlr_output;
+    struct tinywl_view *view;
+
+    wl_list_for_each(view, &output->server->views, link) {
+        if (!view->mapped) {
+            continue;
+        }
+
+        /* An opaque fullscreen view covering the whole output hides the
+         * background, and every view behind it, entirely. */
+        struct wlr_surface *surface = view->xdg_surface->surface;
+        int width = 0, height = 0;
+        struct wlr_texture *texture = surface_texture(surface, &width, &height);
+        pixman_box32_t surface_box = { 0, 0, width, height };
+        if (view->xdg_surface->toplevel->current.fullscreen && texture != NULL &&
+            (wlr_texture_is_opaque(texture) ||
+             pixman_region32_contains_rectangle(&surface->opaque_region, &surface_box) ==
+                 PIXMAN_REGION_IN)) {
+            double ox = 0, oy = 0;
+            wlr_output_layout_output_coords(
+                output->server->output_layout, wlr_output, &ox, &oy);
+            ox += view->x, oy += view->y;
+
+            if (ox <= 0 && oy <= 0 &&
+                (ox + width) * wlr_output->scale >= wlr_output->width &&
+                (oy + height) * wlr_output->scale >= wlr_output->height) {
+                pixman_region32_union_rect(region, region, 0, 0,
+                                           wlr_output->width, wlr_output->height);
+                return;
+            }
+        }
+
+        struct opaque_data odata = {
+            .output = wlr_output,
+            .view = view,
+            .region = region,
+        };
+        wlr_xdg_surface_for_each_surface(view->xdg_surface,
+                                         add_opaque_surface, &odata);
+    }
+}
+
+static void send_frame_done(struct wlr_surface *surface, int sx, int sy, void *data) {
+    /* A client whose last buffer hasn't even been drawn yet doesn't need
+     * to start on another one. */
+    if (fence_surface_pending(surface->data)) {
+        return;
+    }
+
+    /* This lets the client know that we've displayed that frame and it can
+     * prepare another one now if it likes. */
+    struct timespec *when = data;
+    wlr_surface_send_frame_done(surface, when);
+}
+
 static void output_frame(struct wl_listener *listener, void *data) {
     TracyCZoneNS(output_frame_ctx, "output_frame", 10, true);
 
@@ -333,58 +729,161 @@ static void output_frame(struct wl_listener *listener, void *data) {
      * generally at the output's refresh rate (e.g. 60Hz). */
     struct tinywl_output *output =
         wl_container_of(listener, output, frame);
+    struct wlr_output *wlr_output = output->wlr_output;
     struct wlr_renderer *renderer = output->server->renderer;
 
     struct timespec now;
     clock_gettime(CLOCK_MONOTONIC, &now);
+    uint64_t compose_start = startup_now_ns();
+    enum bench_renderer bench_renderer = BENCH_RENDERER_GL;
+
+    /* The benchmark measures full redraws, and has to keep going even when
+     * nothing on screen changes. */
+    if (bench_running()) {
+        wlr_output_damage_add_whole(output->damage);
+    }
 
-    /* wlr_output_attach_render makes the OpenGL context current. */
-    TracyCMessageL("wlr_output_attach_render");
-    if (!wlr_output_attach_render(output->wlr_output, NULL)) {
-        TracyCMessageLS("wlr_output_attach_render failed", 10);
+    /* A low-latency app covering the whole output is shown directly. */
+    if (scanout_output_frame(output)) {
+        placement_output_frame(output, 0);
+        TracyCZoneEnd(output_frame_ctx);
+        TracyCFrameMark;
+        return;
+    }
+
+    bool needs_frame;
+    pixman_region32_t buffer_damage;
+    pixman_region32_init(&buffer_damage);
+
+    /* wlr_output_damage_attach_render makes the OpenGL context current, and
+     * tells us which parts of the buffer we got back are out of date. */
+    TracyCMessageL("wlr_output_damage_attach_render");
+    if (!wlr_output_damage_attach_render(output->damage, &needs_frame, &buffer_damage)) {
+        TracyCMessageLS("wlr_output_damage_attach_render failed", 10);
+        pixman_region32_fini(&buffer_damage);
         TracyCFrameMark;
         TracyCZoneEnd(output_frame_ctx);
         return;
     }
 
+    if (!needs_frame) {
+        /* Nothing changed since the last frame, e.g. only the hardware cursor
+         * moved. Skip the recomposition entirely. */
+        TracyCMessageL("no damage, skipping frame");
+        wlr_output_rollback(wlr_output);
+        pixman_region32_fini(&buffer_damage);
+        placement_output_frame(output, 0);
+        TracyCZoneEnd(output_frame_ctx);
+        TracyCFrameMark;
+        return;
+    }
+
     /* The "effective" resolution can change if you rotate your outputs. */
     int width, height;
-    wlr_output_effective_resolution(output->wlr_output, &width, &height);
+    wlr_output_effective_resolution(wlr_output, &width, &height);
 
     /* Begin the renderer (calls glViewport and some other GL sanity checks) */
     TracyCMessageL("wlr_renderer_begin");
     wlr_renderer_begin(renderer, width, height);
 
-    TracyCMessageL("background_render");
-    background_render(output->server, output->wlr_output, renderer);
-
-    /* Each subsequent window we render is rendered on top of the last. Because
-     * our view list is ordered front-to-back, we iterate over it backwards. */
+    int nrects;
+    pixman_box32_t *rects = pixman_region32_rectangles(&buffer_damage, &nrects);
     struct tinywl_view *view;
-    wl_list_for_each_reverse(view, &output->server->views, link) {
-        if (!view->mapped) {
-            /* An unmapped view should not be rendered. */
-            continue;
+
+    /* The CPU renderer composes the whole scene into a single texture, or
+     * returns NULL if it can't handle something on screen. */
+    struct wlr_texture *composed = cpu_render_output(output, &buffer_damage);
+    if (composed != NULL) {
+        bench_renderer = BENCH_RENDERER_CPU;
+
+        TracyCMessageL("cpu_render_output");
+        for (int i = 0; i < nrects; i++) {
+            scissor_output(wlr_output, renderer, &rects[i]);
+            wlr_render_texture(renderer, composed, wlr_output->transform_matrix, 0, 0, 1.0f);
+        }
+    } else {
+        /* The background only needs to go where something changed and no
+         * opaque view is about to be drawn on top of it. */
+        pixman_region32_t background_damage;
+        pixman_region32_init(&background_damage);
+        output_opaque_region(output, &background_damage);
+        pixman_region32_subtract(&background_damage, &buffer_damage, &background_damage);
+
+        TracyCMessageL("background_render");
+        int nbackground;
+        pixman_box32_t *background_rects =
+            pixman_region32_rectangles(&background_damage, &nbackground);
+        for (int i = 0; i < nbackground; i++) {
+            scissor_output(wlr_output, renderer, &background_rects[i]);
+            background_render(output, renderer);
+        }
+        pixman_region32_fini(&background_damage);
+
+        /* Each subsequent window we render is rendered on top of the last. Because
+         * our view list is ordered front-to-back, we iterate over it backwards. */
+        wl_list_for_each_reverse(view, &output->server->views, link) {
+            if (!view->mapped) {
+                /* An unmapped view should not be rendered. */
+                continue;
+            }
+            struct render_data rdata = {
+                .output = wlr_output,
+                .view = view,
+                .renderer = renderer,
+                .damage = &buffer_damage,
+            };
+            TracyCMessageL("wlr_xdg_surface_for_each_surface");
+            /* This calls our render_surface function for each surface among the
+             * xdg_surface's toplevel and popups. */
+            wlr_xdg_surface_for_each_surface(view->xdg_surface,
+                                             render_surface, &rdata);
         }
-        struct render_data rdata = {
-            .output = output->wlr_output,
-            .view = view,
-            .renderer = renderer,
-            .when = &now,
-        };
-        TracyCMessageL("wlr_xdg_surface_for_each_surface");
-        /* This calls our render_surface function for each surface among the
-         * xdg_surface's toplevel and popups. */
-        wlr_xdg_surface_for_each_surface(view->xdg_surface,
-                                         render_surface, &rdata);
     }
 
+    /* If the cursor couldn't go on a hardware plane, wlroots draws it here.
+     * Its damage only covers the old and new cursor rectangles. */
+    TracyCMessageL("wlr_output_render_software_cursors");
+    wlr_output_render_software_cursors(wlr_output, &buffer_damage);
+
+    /* Hands the finished frame to the frame dump writer, if enabled. */
+    framedump_frame(wlr_output, renderer);
+
     /* Conclude rendering and swap the buffers, showing the final frame
      * on-screen. */
     TracyCMessageL("wlr_renderer_end");
+    wlr_renderer_scissor(renderer, NULL);
     wlr_renderer_end(renderer);
+
+    TracyCMessageL("wlr_surface_send_frame_done");
+    wl_list_for_each(view, &output->server->views, link) {
+        if (view->mapped) {
+            wlr_xdg_surface_for_each_surface(view->xdg_surface,
+                                             send_frame_done, &now);
+        }
+    }
+
+    /* Tell the backend (and any screencopy clients) what changed this frame. */
+    int tr_width, tr_height;
+    wlr_output_transformed_resolution(wlr_output, &tr_width, &tr_height);
+
+    pixman_region32_t frame_damage;
+    pixman_region32_init(&frame_damage);
+    enum wl_output_transform transform = wlr_output_transform_invert(wlr_output->transform);
+    wlr_region_transform(&frame_damage, &output->damage->current,
+                         transform, tr_width, tr_height);
+    wlr_output_set_damage(wlr_output, &frame_damage);
+    pixman_region32_fini(&frame_damage);
+    pixman_region32_fini(&buffer_damage);
+
     TracyCMessageL("wlr_output_commit");
-    wlr_output_commit(output->wlr_output);
+    if (wlr_output_commit(wlr_output)) {
+        startup_first_frame();
+        uint64_t compose_ns = startup_now_ns() - compose_start;
+        bench_frame(bench_renderer, compose_ns);
+        placement_output_frame(output, compose_ns);
+        scanout_output_composed(output);
+        realtime_frame();
+    }
 
     TracyCZoneEnd(output_frame_ctx);
     TracyCFrameMark;
@@ -399,6 +898,8 @@ static void server_new_output(struct wl_listener *listener, void *data) {
     struct wlr_output *wlr_output = data;
     int set_mode = 0;
 
+    STARTUP_PHASE_BEGIN(mode_ctx, "output mode probe");
+
     /* Some backends don't have modes. DRM+KMS does, and we need to set a mode
      * before we can use the output. The mode is a tuple of (width, height,
      * refresh rate), and each monitor supports only a specific set of modes. We
@@ -415,6 +916,7 @@ static void server_new_output(struct wl_listener *listener, void *data) {
                 wlr_output_enable(wlr_output, true);
 
                 if (!wlr_output_commit(wlr_output)) {
+                    STARTUP_PHASE_END(mode_ctx);
                     return;
                 }
 
@@ -427,6 +929,17 @@ static void server_new_output(struct wl_listener *listener, void *data) {
         }
     }
 
+    if (!set_mode && wl_list_empty(&wlr_output->modes)) {
+        /* Headless and nested outputs don't have modes, but take any size. */
+        LOG("Output has no modes, using a 1280x720 custom mode");
+
+        wlr_output_set_custom_mode(wlr_output, 1280, 720, 0);
+        wlr_output_enable(wlr_output, true);
+        set_mode = wlr_output_commit(wlr_output);
+    }
+
+    STARTUP_PHASE_END(mode_ctx);
+
     if (!set_mode) {
         LOG("Failed to set mode.")
             return;
@@ -437,11 +950,19 @@ static void server_new_output(struct wl_listener *listener, void *data) {
     output->wlr_output = wlr_output;
     output->server = server;
 
+    /* The damage helper accumulates what changed on the output and tells
+     * us on each frame whether anything needs to be redrawn at all. */
+    output->damage = wlr_output_damage_create(wlr_output);
+
     /* Sets up a listener for the frame notify event. */
     output->frame.notify = output_frame;
-    wl_signal_add(&wlr_output->events.frame, &output->frame);
+    wl_signal_add(&output->damage->events.frame, &output->frame);
+    scanout_output_init(output);
     wl_list_insert(&server->outputs, &output->link);
 
+    /* Make sure the cursor theme is available at this output's scale. */
+    wlr_xcursor_manager_load(server->cursor_mgr, wlr_output->scale);
+
     /* Adds this to the output layout. The add_auto function arranges outputs
      * from left-to-right in the order they appear. A more sophisticated
      * compositor would let the user configure the arrangement of outputs in the
@@ -453,9 +974,7 @@ static void server_new_output(struct wl_listener *listener, void *data) {
      */
     wlr_output_layout_add_auto(server->output_layout, wlr_output);
 
-    if (g_next_output == NULL) {
-        g_next_output = wlr_output;
-    }
+    placement_output_add(output);
 }
 
 static void xdg_surface_map(struct wl_listener *listener, void *data) {
@@ -463,6 +982,14 @@ static void xdg_surface_map(struct wl_listener *listener, void *data) {
 
     /* Called when the surface is mapped, or ready to display on-screen. */
     view->mapped = true;
+
+    /* The hooks below look the client's process up by its pid. */
+    struct wl_client *client =
+        wl_resource_get_client(view->xdg_surface->surface->resource);
+    wl_client_get_credentials(client, &view->pid, NULL, NULL);
+
+    freeze_view_map(view);
+    scanout_view_map(view);
     focus_view(view, view->xdg_surface->surface);
 }
 
@@ -470,6 +997,8 @@ static void xdg_surface_unmap(struct wl_listener *listener, void *data) {
     /* Called when the surface is unmapped, and should no longer be shown. */
     struct tinywl_view *view = wl_container_of(listener, view, unmap);
     view->mapped = false;
+    server_damage_whole(view->server);
+    freeze_update(view->server);
 }
 
 static void xdg_surface_destroy(struct wl_listener *listener, void *data) {
@@ -479,8 +1008,12 @@ static void xdg_surface_destroy(struct wl_listener *listener, void *data) {
     struct wlr_seat *seat = server->seat;
 
     seat->keyboard_state.focused_surface = NULL;
+    configure_view_destroy(view);
+    view->xdg_surface->data = NULL;
     wl_list_remove(&view->link);
     free(view);
+    server_damage_whole(server);
+    freeze_update(server);
 
     if (wl_list_length(&server->views) == 0) {
         return;
@@ -491,46 +1024,6 @@ static void xdg_surface_destroy(struct wl_listener *listener, void *data) {
     focus_view(view, view->xdg_surface->surface);
 }
 
-/** Update the last_output to the next one or first one in the list.
- */
-static struct wlr_output* find_next_output(const struct tinywl_server *server) {
-    struct tinywl_output* output = NULL;
-
-    LOGF("find_next_output: have %d outputs",
-         wl_list_length(&server->outputs));
-
-    /* 
-     * Since the list is circular, this will automatically wrap around to the head
-     * of the list when it reaches the end.
-     */
-    wl_list_for_each(output, &server->outputs, link) {
-        LOGF("output #<%s %p>", output->wlr_output->name, output);
-
-        if (output->wlr_output == g_next_output) {
-            struct tinywl_output* next_twl_output = NULL;
-            struct wlr_output* next_output = NULL;
-            next_twl_output = 
-                wl_container_of(output->link.next, next_twl_output, link);
-
-            if (&next_twl_output->link == (&server->outputs)) {
-                LOG("find_next_output end of list -- going back to head");
-                next_twl_output =
-                    wl_container_of((&server->outputs)->next, next_twl_output, link);
-            }
-
-            next_output = next_twl_output->wlr_output;
-
-            LOGF("find_next_output found current #<%s %p>", output->wlr_output->name, output);
-            LOGF("find_next_output found new #<%s %p>", next_output->name, next_output);
-
-            return next_output;
-        }
-    }
-
-    LOG("find_next_output failed to find next output!");
-    return NULL;
-}
-
 static void server_new_xdg_surface(struct wl_listener *listener, void *data) {
     /* This event is raised when wlr_xdg_shell receives a new xdg surface from a
      * client, either a toplevel (application window) or popup. */
@@ -553,21 +1046,28 @@ static void server_new_xdg_surface(struct wl_listener *listener, void *data) {
     wl_signal_add(&xdg_surface->events.unmap, &view->unmap);
     view->destroy.notify = xdg_surface_destroy;
     wl_signal_add(&xdg_surface->events.destroy, &view->destroy);
+    configure_view_init(view);
+    xdg_surface->data = view;
+
+    /* Pick an output for it, before it counts towards any output's load */
+    struct tinywl_output *output = placement_choose(view);
+
+    /* Add it to the list of views. */
+    wl_list_insert(&server->views, &view->link);
+
+    if (output == NULL) {
+        return;
+    }
 
     /* Set x and y position based on output geometry */
     double ox, oy;
-    wlr_output_layout_closest_point(server->output_layout, g_next_output, 0, 0, &ox, &oy);
+    wlr_output_layout_closest_point(server->output_layout, output->wlr_output, 0, 0, &ox, &oy);
     view->x = ox;
     view->y = oy;
 
     /* Set fullscreen size */
-    wlr_xdg_toplevel_set_size(view->xdg_surface, g_next_output->width, g_next_output->height);
-    wlr_xdg_toplevel_set_fullscreen(view->xdg_surface, true);
-
-    /* Add it to the list of views. */
-    wl_list_insert(&server->views, &view->link);
-
-    g_next_output = find_next_output(server);
+    configure_set_size(view, output->wlr_output->width, output->wlr_output->height);
+    configure_set_fullscreen(view, true);
 }
 
 void maybe_drop_privileges() {
@@ -597,23 +1097,64 @@ void maybe_drop_privileges() {
     LOGF("Now running as UID/GID: [%d/%d]", getuid(), getgid());
 }
 
+/* The socket is created before privileges are dropped, so hand it (and its
+ * lock file) over to the user its clients run as. */
+void share_socket(const char *socket) {
+    if (getuid() == 1000) {
+        return;
+    }
+
+    const char *dir = getenv("XDG_RUNTIME_DIR");
+    const char *suffixes[] = { "", ".lock" };
+    for (size_t i = 0; i < sizeof(suffixes) / sizeof(suffixes[0]); i++) {
+        char path[256];
+        snprintf(path, sizeof(path), "%s/%s%s", dir, socket, suffixes[i]);
+        if (chown(path, 1000, 1000) != 0) {
+            LOGF("chown: Unable to hand [%s] to the user: %s", path, strerror(errno));
+        }
+    }
+}
+
 int main(int argc, char *argv[]) {
     struct tinywl_server server;
 
+    startup_init();
+
+    STARTUP_PHASE_BEGIN(log_ctx, "log init");
     log_init();
     wlr_log_init(WLR_DEBUG, NULL);
+    STARTUP_PHASE_END(log_ctx);
 
+    realtime_init();
     subprogram_init();
+    placement_init();
+    scanout_init();
+    cpu_render_init();
+    framedump_init();
+
+    /* Nothing below depends on the keymap until the first keyboard shows up
+     * during wlr_backend_start, so compile it in the background meanwhile. */
+    keymap_init();
 
     LOG("v128-shell starting...");
+    STARTUP_PHASE_BEGIN(autocreate_ctx, "backend autocreate");
     server.wl_display = wl_display_create();
+    bench_init(server.wl_display);
+    subprogram_watch(wl_display_get_event_loop(server.wl_display));
     server.backend = wlr_backend_autocreate(server.wl_display, NULL);
     server.renderer = wlr_backend_get_renderer(server.backend);
-    background_init(server.renderer);
+    STARTUP_PHASE_END(autocreate_ctx);
     wlr_renderer_init_wl_display(server.renderer, server.wl_display);
-    wlr_compositor_create(server.wl_display, server.renderer);
+    server.compositor = wlr_compositor_create(server.wl_display, server.renderer);
+    server.new_surface.notify = server_new_surface;
+    wl_signal_add(&server.compositor->events.new_surface, &server.new_surface);
     wlr_data_device_manager_create(server.wl_display);
+    capture_init(&server);
     server.output_layout = wlr_output_layout_create();
+
+    /* The background is composed per output on its first frame and cached
+     * until the layout changes. */
+    background_init(&server);
     wl_list_init(&server.outputs);
     server.new_output.notify = server_new_output;
     wl_signal_add(&server.backend->events.new_output, &server.new_output);
@@ -629,6 +1170,43 @@ int main(int argc, char *argv[]) {
     server.new_xdg_surface.notify = server_new_xdg_surface;
     wl_signal_add(&server.xdg_shell->events.new_surface,
                   &server.new_xdg_surface);
+    freeze_init(&server);
+
+    /*
+     * Creates a cursor, which is a wlroots utility for tracking the cursor
+     * image shown on screen.
+     */
+    server.cursor = wlr_cursor_create();
+    wlr_cursor_attach_output_layout(server.cursor, server.output_layout);
+
+    /* Creates an xcursor manager, another wlroots utility which loads up
+     * Xcursor themes to source cursor images from and makes sure that cursor
+     * images are available at all scale factors on the screen (necessary for
+     * HiDPI support). Images set through it go on the hardware cursor plane
+     * when the output has one, and are composited in software otherwise. */
+    server.cursor_mgr = wlr_xcursor_manager_create(NULL, 24);
+    wlr_xcursor_manager_load(server.cursor_mgr, 1);
+    server.cursor_image = NULL;
+
+    /*
+     * wlr_cursor *only* displays an image on screen. It does not move around
+     * when the pointer moves. However, we can attach input devices to it, and
+     * it will generate aggregate events for all of them. In these events, we
+     * can choose how we want to process them, forwarding them to clients and
+     * moving the cursor around.
+     */
+    server.cursor_mode = TINYWL_CURSOR_PASSTHROUGH;
+    server.cursor_motion.notify = server_cursor_motion;
+    wl_signal_add(&server.cursor->events.motion, &server.cursor_motion);
+    server.cursor_motion_absolute.notify = server_cursor_motion_absolute;
+    wl_signal_add(&server.cursor->events.motion_absolute,
+                  &server.cursor_motion_absolute);
+    server.cursor_button.notify = server_cursor_button;
+    wl_signal_add(&server.cursor->events.button, &server.cursor_button);
+    server.cursor_axis.notify = server_cursor_axis;
+    wl_signal_add(&server.cursor->events.axis, &server.cursor_axis);
+    server.cursor_frame.notify = server_cursor_frame;
+    wl_signal_add(&server.cursor->events.frame, &server.cursor_frame);
 
     /*
      * Configures a seat, which is a single "seat" at which a user sits and
@@ -641,42 +1219,60 @@ int main(int argc, char *argv[]) {
     server.new_input.notify = server_new_input;
     wl_signal_add(&server.backend->events.new_input, &server.new_input);
     server.seat = wlr_seat_create(server.wl_display, "seat0");
+    server.request_cursor.notify = seat_request_cursor;
+    wl_signal_add(&server.seat->events.request_set_cursor,
+                  &server.request_cursor);
     server.request_set_selection.notify = seat_request_set_selection;
     wl_signal_add(&server.seat->events.request_set_selection,
                   &server.request_set_selection);
 
+    /* Add a Unix socket to the Wayland display before the backend comes up, so
+     * clients can connect while it does. Connections queue up on the socket
+     * until the event loop below starts dispatching them. */
+    STARTUP_PHASE_BEGIN(socket_ctx, "socket");
+    setenv("XDG_RUNTIME_DIR", "/run/user/1000", true);
+    const char *socket = wl_display_add_socket_auto(server.wl_display);
+    if (!socket) {
+        STARTUP_PHASE_END(socket_ctx);
+        wlr_backend_destroy(server.backend);
+        return 1;
+    }
+    share_socket(socket);
+
+    setenv("WAYLAND_DISPLAY", socket, true);
+    setenv("_WAYLAND_DISPLAY", socket, true);
+    STARTUP_PHASE_END(socket_ctx);
+
     /* Start the backend. This will enumerate outputs and inputs, become the DRM
      * master, etc */
     LOG("Starting backend...");
+    STARTUP_PHASE_BEGIN(backend_ctx, "backend start");
     if (!wlr_backend_start(server.backend)) {
         LOG("Starting backend failed!");
         wlr_backend_destroy(server.backend);
         wl_display_destroy(server.wl_display);
         exit(1);
     }
+    STARTUP_PHASE_END(backend_ctx);
 
+    STARTUP_PHASE_BEGIN(privileges_ctx, "drop privileges");
+    realtime_lock();
     maybe_drop_privileges();
+    STARTUP_PHASE_END(privileges_ctx);
 
-    /* Set the WAYLAND_DISPLAY environment variable to our socket and run the
-     * startup command if requested. */
     setenv("SDL_VIDEODRIVER", "wayland", true);
     setenv("XDG_SESSION_TYPE", "wayland", true);
     setenv("QT_QPA_PLATFORM", "wayland", true);
     setenv("HOME", "/home/user", true);
     setenv("USER", "user", true);
-    setenv("XDG_RUNTIME_DIR", "/run/user/1000", true);
     setenv("DISPLAY", "", true);
-    subprogram_start("x128");
-
-    /* Add a Unix socket to the Wayland display. */
-    const char *socket = wl_display_add_socket_auto(server.wl_display);
-    if (!socket) {
-        wlr_backend_destroy(server.backend);
-        return 1;
-    }
 
-    setenv("WAYLAND_DISPLAY", socket, true);
-    setenv("_WAYLAND_DISPLAY", socket, true);
+    /* Children inherit our credentials, so x128 can only be started once
+     * privileges are dropped. The socket already exists, so its own startup
+     * still overlaps with the rest of ours. */
+    STARTUP_PHASE_BEGIN(x128_ctx, "x128 spawn");
+    subprogram_start("x128");
+    STARTUP_PHASE_END(x128_ctx);
 
     /* Run the Wayland event loop. This does not return until you exit the
      * compositor. Starting the backend rigged up all of the necessary event
@@ -689,8 +1285,13 @@ int main(int argc, char *argv[]) {
     /* Once wl_display_run returns, we shut down the server. */
     LOG("Shutting down...");
     background_deinit();
+    keymap_deinit();
+    cpu_render_deinit();
+    framedump_deinit();
 
     wl_display_destroy_clients(server.wl_display);
+    wlr_xcursor_manager_destroy(server.cursor_mgr);
+    wlr_cursor_destroy(server.cursor);
     wl_display_destroy(server.wl_display);
 
     return 0;